@@ -141,6 +141,12 @@ p_mode_start:
 
    call rd_disk_m_32
 
+   ; 扇区数寄存器只有 8 位,内核超过 100KB 后分两次读入,共 290 个扇区,
+   ; 用户程序从第 300 个扇区开始存放(见 command/compile.sh)
+   mov eax, KERNEL_START_SECTOR + 200
+   mov ecx, 90                         ; ebx 已指向上一次读入的末尾
+   call rd_disk_m_32
+
   ;创建页目录及页表并初始化页内存位图
   call setup_page
   ;要将描述符表地址及偏移量写入内存 gdt_ptr,一会儿用新地址重新加载
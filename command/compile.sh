@@ -11,15 +11,17 @@ if [[ ! -d "../lib" ]]; then
     exit
 fi
 
+# command 下的每个程序都这样编译:把 BIN 改为程序名(不带 .c)后执行
 BIN="cat"
 CFLAGS="-Wall -c -m32 -fno-builtin -W -Wstrict-prototypes \
-      -Wmissing-prototypes -Wsystem-headers -fno-stack-protector -mno-sse -g "
+      -Wmissing-prototypes -Wsystem-headers -fno-stack-protector -msse2 -mstackrealign -g "
 LIBS="-I ../lib/ -I ../lib/kernel/ -I ../lib/user/ -I \
  ../kernel/ -I ../device/ -I ../thread/ -I \
  ../userprog/ -I ../fs/ -I ../shell/"
  
 OBJS="../lib/string.o ../lib/user/syscall.o \
-      ../lib/stdio.o ../lib/user/assert.o"
+      ../lib/stdio.o ../lib/user/assert.o ../lib/user/pthread.o \
+      ../lib/user/tsc.o"
 DD_IN=$BIN
 DD_OUT="/home/gty/vscode/os/boot/boot.img"
 
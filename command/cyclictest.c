@@ -0,0 +1,84 @@
+/* 仿 cyclictest 的唤醒延迟测试:反复睡眠固定时间,
+ * 统计每次定时器到期唤醒后等多久才真正运行,并画出直方图。
+ * 用法: cyclictest      以普通任务测量
+ *       cyclictest rt   把自己设为实时任务后测量
+ * 测量期间有几个 CPU 密集任务做背景负载。 */
+#include <stdint.h>
+
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+#include "tsc.h"
+
+#define NR_LOAD 2       // 背景负载任务数
+#define NR_LOOPS 100    // 测量次数
+#define INTERVAL_MS 10  // 每次睡眠的毫秒数
+#define RT_PRIO 10      // 实时模式下的实时优先级
+
+/* 直方图各桶的上界(微秒),最后一桶收集更大的值 */
+static const uint32_t bucket_limit[] = {50, 100, 200, 500, 1000, 2000, 5000,
+                                        10000};
+#define NR_BUCKETS (sizeof(bucket_limit) / sizeof(bucket_limit[0]) + 1)
+
+/*背景负载:忙等 ms 毫秒后退出*/
+static void load(uint32_t cycles_per_ms, uint32_t ms) {
+  while (ms-- > 0) {
+    uint32_t start = rdtsc_low();
+    while (rdtsc_low() - start < cycles_per_ms) {
+    }
+  }
+  exit(0);
+}
+
+int main(int argc, char** argv) {
+  bool rt = argc > 1 && strcmp(argv[1], "rt") == 0;
+
+  /* 用一次睡眠粗略估计每毫秒的 TSC 周期数,供负载任务计时 */
+  uint32_t start = rdtsc_low();
+  sleep(100);
+  uint32_t cycles_per_ms = (rdtsc_low() - start) / 100;
+
+  uint32_t i;
+  for (i = 0; i < NR_LOAD; i++) {
+    if (fork() == 0) {
+      load(cycles_per_ms, NR_LOOPS * INTERVAL_MS + 500);
+    }
+  }
+  if (rt && sched_setscheduler(0, SCHED_FIFO, RT_PRIO) != 0) {
+    printf("cyclictest: sched_setscheduler failed\n");
+  }
+
+  uint32_t hist[NR_BUCKETS] = {0};
+  uint32_t min = 0xffffffff, max = 0, sum = 0;
+  for (i = 0; i < NR_LOOPS; i++) {
+    uint32_t latency = sleep(INTERVAL_MS);
+    if (latency < min) {
+      min = latency;
+    }
+    if (latency > max) {
+      max = latency;
+    }
+    sum += latency;
+    uint32_t b = 0;
+    while (b < NR_BUCKETS - 1 && latency >= bucket_limit[b]) {
+      b++;
+    }
+    hist[b]++;
+  }
+
+  printf("%s: min %d us, avg %d us, max %d us\n", rt ? "rt" : "normal", min,
+         sum / NR_LOOPS, max);
+  for (i = 0; i < NR_BUCKETS; i++) {
+    if (i < NR_BUCKETS - 1) {
+      printf("  < %d us: %d\n", bucket_limit[i], hist[i]);
+    } else {
+      printf(" >= %d us: %d\n", bucket_limit[i - 1], hist[i]);
+    }
+  }
+
+  int32_t status;
+  for (i = 0; i < NR_LOAD; i++) {
+    wait(&status);
+  }
+  return 0;
+}
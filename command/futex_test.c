@@ -0,0 +1,114 @@
+/* 用户态互斥锁与条件变量测试:
+ * 1 无竞争时加解锁的开销(不进内核)
+ * 2 几个线程在同一把锁下累加计数器,检查结果是否正确
+ * 3 用条件变量实现的生产者消费者 */
+#include <stdint.h>
+
+#include "pthread.h"
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+#include "tsc.h"
+
+#define NR_WORKERS 4
+#define INCS_PER_WORKER 20000  // 每个线程加锁累加的次数
+#define UNCONTENDED_ROUNDS 100000
+#define NR_ITEMS 1000  // 生产者放入的数据个数
+#define QUEUE_LEN 8
+
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t counter;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+static uint32_t queue[QUEUE_LEN];
+static uint32_t head, tail, count;
+
+static void* incrementer(void* arg UNUSED) {
+  uint32_t i;
+  for (i = 0; i < INCS_PER_WORKER; i++) {
+    pthread_mutex_lock(&counter_lock);
+    counter++;
+    pthread_mutex_unlock(&counter_lock);
+  }
+  return NULL;
+}
+
+/*依次放入 1..NR_ITEMS*/
+static void* producer(void* arg UNUSED) {
+  uint32_t i;
+  for (i = 1; i <= NR_ITEMS; i++) {
+    pthread_mutex_lock(&queue_lock);
+    while (count == QUEUE_LEN) {
+      pthread_cond_wait(&not_full, &queue_lock);
+    }
+    queue[tail] = i;
+    tail = (tail + 1) % QUEUE_LEN;
+    count++;
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&queue_lock);
+  }
+  return NULL;
+}
+
+/*取出全部数据,返回它们的和*/
+static void* consumer(void* arg UNUSED) {
+  uint32_t i, sum = 0;
+  for (i = 0; i < NR_ITEMS; i++) {
+    pthread_mutex_lock(&queue_lock);
+    while (count == 0) {
+      pthread_cond_wait(&not_empty, &queue_lock);
+    }
+    sum += queue[head];
+    head = (head + 1) % QUEUE_LEN;
+    count--;
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&queue_lock);
+  }
+  return (void*)sum;
+}
+
+int main(void) {
+  int32_t ret = 0;
+  uint32_t i;
+
+  uint32_t start = rdtsc_low();
+  for (i = 0; i < UNCONTENDED_ROUNDS; i++) {
+    pthread_mutex_lock(&counter_lock);
+    pthread_mutex_unlock(&counter_lock);
+  }
+  printf("uncontended lock/unlock: %d cycles\n",
+         (rdtsc_low() - start) / UNCONTENDED_ROUNDS);
+
+  pthread_t workers[NR_WORKERS];
+  start = rdtsc_low();
+  for (i = 0; i < NR_WORKERS; i++) {
+    pthread_create(&workers[i], incrementer, NULL);
+  }
+  for (i = 0; i < NR_WORKERS; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  printf("contended: %d threads x %d incs in %d kcycles\n", NR_WORKERS,
+         INCS_PER_WORKER, (rdtsc_low() - start) / 1000);
+  if (counter != NR_WORKERS * INCS_PER_WORKER) {
+    printf("counter mismatch: %d\n", counter);
+    ret = -1;
+  }
+
+  pthread_t prod, cons;
+  pthread_create(&cons, consumer, NULL);
+  pthread_create(&prod, producer, NULL);
+  void* sum;
+  pthread_join(prod, NULL);
+  pthread_join(cons, &sum);
+  if ((uint32_t)sum != NR_ITEMS * (NR_ITEMS + 1) / 2) {
+    printf("producer/consumer sum mismatch: %d\n", (uint32_t)sum);
+    ret = -1;
+  }
+
+  if (ret == 0) {
+    printf("futex_test: ok\n");
+  }
+  return ret;
+}
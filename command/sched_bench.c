@@ -0,0 +1,79 @@
+/* 调度器对比测试:几个 CPU 密集任务与一个交互任务同时运行。
+ * 看各 CPU 密集任务分到的循环次数是否接近(公平性),
+ * 以及交互任务从被唤醒到真正运行的延迟。
+ * 分别用 make 与 make SCHED=rr 构建内核运行,对比 CFS 与时间片轮转。 */
+#include <stdint.h>
+
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+#include "tsc.h"
+
+#define NR_HOGS 3             // CPU 密集任务数
+#define HOG_CYCLES 0x40000000  // 每个 CPU 密集任务运行的 TSC 周期数
+#define NR_SAMPLES 32          // 交互任务被唤醒的次数
+#define GAP_CYCLES 0x1000000   // 父进程两次唤醒交互任务之间忙等的周期数
+
+/*一直占用 cpu,统计在固定的时间内完成的循环次数*/
+static void hog(uint32_t id) {
+  uint32_t start = rdtsc_low();
+  uint32_t loops = 0;
+  while (rdtsc_low() - start < HOG_CYCLES) {
+    loops++;
+  }
+  printf("hog %d: %d loops\n", id, loops);
+  exit(0);
+}
+
+/* 交互任务:阻塞在管道上,读出父进程写入时的时间戳,
+ * 与当前时间的差就是唤醒延迟 */
+static void interactive(int32_t fd) {
+  uint32_t max = 0, sum = 0, i;
+  for (i = 0; i < NR_SAMPLES; i++) {
+    uint32_t stamp;
+    read(fd, &stamp, sizeof(stamp));
+    uint32_t latency = rdtsc_low() - stamp;
+    sum += latency / NR_SAMPLES;
+    if (latency > max) {
+      max = latency;
+    }
+  }
+  printf("wakeup latency: avg %d kcycles, max %d kcycles\n", sum / 1000,
+         max / 1000);
+  exit(0);
+}
+
+int main(void) {
+  int32_t fd[2] = {-1};
+  pipe(fd);
+
+  if (fork() == 0) {
+    close(fd[1]);
+    interactive(fd[0]);
+  }
+  close(fd[0]);
+
+  uint32_t id;
+  for (id = 0; id < NR_HOGS; id++) {
+    if (fork() == 0) {
+      hog(id);
+    }
+  }
+
+  /* 父进程也是 CPU 密集的,每隔一段时间唤醒一次交互任务 */
+  uint32_t i;
+  for (i = 0; i < NR_SAMPLES; i++) {
+    uint32_t stamp = rdtsc_low();
+    write(fd[1], &stamp, sizeof(stamp));
+    uint32_t start = rdtsc_low();
+    while (rdtsc_low() - start < GAP_CYCLES) {
+    }
+  }
+  close(fd[1]);
+
+  int32_t status;
+  for (i = 0; i < NR_HOGS + 1; i++) {
+    wait(&status);
+  }
+  return 0;
+}
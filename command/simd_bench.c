@@ -0,0 +1,124 @@
+/* SSE 与标量浮点运算的对比测试,同时检查浮点状态在任务切换后是否保持。 */
+#include <stdint.h>
+
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+#include "tsc.h"
+
+#define VEC_LEN 1024  // 向量长度,须为 4 的倍数
+#define ROUNDS 200    // 每种实现重复的次数
+
+typedef float v4sf __attribute__((vector_size(16)));
+
+static float a[VEC_LEN] __attribute__((aligned(16)));
+static float b[VEC_LEN] __attribute__((aligned(16)));
+static float y[VEC_LEN] __attribute__((aligned(16)));
+
+static void vec_fill(void) {
+  uint32_t i;
+  for (i = 0; i < VEC_LEN; i++) {
+    a[i] = (float)(i % 17);
+    b[i] = (float)(i % 13);
+  }
+}
+
+static float dot_scalar(void) {
+  float sum = 0;
+  uint32_t i;
+  for (i = 0; i < VEC_LEN; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static float dot_simd(void) {
+  v4sf sum = {0, 0, 0, 0};
+  const v4sf* va = (const v4sf*)a;
+  const v4sf* vb = (const v4sf*)b;
+  uint32_t i;
+  for (i = 0; i < VEC_LEN / 4; i++) {
+    sum += va[i] * vb[i];
+  }
+  return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+/* y = k * a + b */
+static void saxpy_scalar(float k) {
+  uint32_t i;
+  for (i = 0; i < VEC_LEN; i++) {
+    y[i] = k * a[i] + b[i];
+  }
+}
+
+static void saxpy_simd(float k) {
+  v4sf vk = {k, k, k, k};
+  const v4sf* va = (const v4sf*)a;
+  const v4sf* vb = (const v4sf*)b;
+  v4sf* vy = (v4sf*)y;
+  uint32_t i;
+  for (i = 0; i < VEC_LEN / 4; i++) {
+    vy[i] = vk * va[i] + vb[i];
+  }
+}
+
+/* 跑一遍所有实现,结果不一致返回 -1 */
+static int32_t bench(bool verbose) {
+  uint32_t r, start, scalar_cycles, simd_cycles;
+  float ds = 0, dv = 0;
+
+  start = rdtsc_low();
+  for (r = 0; r < ROUNDS; r++) {
+    ds = dot_scalar();
+  }
+  scalar_cycles = rdtsc_low() - start;
+  start = rdtsc_low();
+  for (r = 0; r < ROUNDS; r++) {
+    dv = dot_simd();
+  }
+  simd_cycles = rdtsc_low() - start;
+  if (verbose) {
+    printf("dot    scalar: %d cycles/round  sse: %d cycles/round\n",
+           scalar_cycles / ROUNDS, simd_cycles / ROUNDS);
+  }
+  if ((int32_t)ds != (int32_t)dv) {
+    printf("dot mismatch: scalar %d sse %d\n", (int32_t)ds, (int32_t)dv);
+    return -1;
+  }
+
+  start = rdtsc_low();
+  for (r = 0; r < ROUNDS; r++) {
+    saxpy_scalar(3);
+  }
+  scalar_cycles = rdtsc_low() - start;
+  int32_t check = (int32_t)y[VEC_LEN - 1];
+  start = rdtsc_low();
+  for (r = 0; r < ROUNDS; r++) {
+    saxpy_simd(3);
+  }
+  simd_cycles = rdtsc_low() - start;
+  if (verbose) {
+    printf("saxpy  scalar: %d cycles/round  sse: %d cycles/round\n",
+           scalar_cycles / ROUNDS, simd_cycles / ROUNDS);
+  }
+  if (check != (int32_t)y[VEC_LEN - 1]) {
+    printf("saxpy mismatch: scalar %d sse %d\n", check, (int32_t)y[VEC_LEN - 1]);
+    return -1;
+  }
+  return 0;
+}
+
+int main(void) {
+  vec_fill();
+  /* 父子进程同时用 SSE 计算,两边的结果都对才说明切换时浮点状态没有串 */
+  int16_t pid = fork();
+  int32_t ret = bench(pid != 0);
+  if (pid != 0) {
+    int32_t child_status;
+    wait(&child_status);
+    if (ret == 0 && child_status == 0) {
+      printf("simd_bench: ok\n");
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,84 @@
+/* 用户线程测试:几个线程共用一个地址空间,各自计算一段和写到全局数组,
+ * 另有一个线程阻塞在管道上读,主线程写入后它才返回,
+ * 检查线程间共享内存和文件描述符表,以及 join 拿到的返回值。 */
+#include <stdint.h>
+
+#include "pthread.h"
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+
+#define NR_WORKERS 4
+#define RANGE 100000  // 每个线程累加的数的个数
+
+static uint32_t partial[NR_WORKERS];
+static int32_t fd[2];
+
+/*累加 [id*RANGE, (id+1)*RANGE) 写到 partial[id]*/
+static void* worker(void* arg) {
+  uint32_t id = (uint32_t)arg;
+  uint32_t i, sum = 0;
+  for (i = id * RANGE; i < (id + 1) * RANGE; i++) {
+    sum += i;
+  }
+  partial[id] = sum;
+  return (void*)(id + 1);
+}
+
+/*在主线程创建的管道上阻塞读,返回读到的值*/
+static void* reader(void* arg UNUSED) {
+  uint32_t val = 0;
+  read(fd[0], &val, sizeof(val));
+  return (void*)val;
+}
+
+int main(void) {
+  pthread_t workers[NR_WORKERS], rd;
+  uint32_t i;
+  pipe(fd);
+  if (pthread_create(&rd, reader, NULL) == -1) {
+    printf("thread_test: pthread_create failed\n");
+    return -1;
+  }
+  for (i = 0; i < NR_WORKERS; i++) {
+    if (pthread_create(&workers[i], worker, (void*)i) == -1) {
+      printf("thread_test: pthread_create failed\n");
+      return -1;
+    }
+  }
+
+  int32_t ret = 0;
+  uint32_t total = 0;
+  for (i = 0; i < NR_WORKERS; i++) {
+    void* val;
+    pthread_join(workers[i], &val);
+    if ((uint32_t)val != i + 1) {
+      printf("worker %d returned %d\n", i, (uint32_t)val);
+      ret = -1;
+    }
+    total += partial[i];
+  }
+  uint32_t n = NR_WORKERS * RANGE, expect = 0;
+  for (i = 0; i < n; i++) {
+    expect += i;
+  }
+  if (total != expect) {
+    printf("sum mismatch: %d != %d\n", total, expect);
+    ret = -1;
+  }
+
+  uint32_t magic = 0x1234;
+  write(fd[1], &magic, sizeof(magic));
+  void* val;
+  pthread_join(rd, &val);
+  if ((uint32_t)val != magic) {
+    printf("reader got %x\n", (uint32_t)val);
+    ret = -1;
+  }
+  close(fd[0]);
+  close(fd[1]);
+  if (ret == 0) {
+    printf("thread_test: ok\n");
+  }
+  return ret;
+}
@@ -0,0 +1,44 @@
+/* 运行一条命令,结束后打印它用了多久以及运行统计。
+ * 用法: time 命令 [参数...]   命令不以 / 开头时在根目录下找
+ * 统计来自 getrusage(RUSAGE_CHILDREN),包括命令的线程和它回收的子进程。 */
+#include <stdint.h>
+
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("usage: time command [args...]\n");
+    return -1;
+  }
+  char path[MAX_PATH_LEN] = "/";
+  if (argv[1][0] == '/') {
+    path[0] = 0;
+  }
+  if (strlen(path) + strlen(argv[1]) >= MAX_PATH_LEN) {
+    printf("time: path too long\n");
+    return -1;
+  }
+  strcat(path, argv[1]);
+
+  uint32_t start = uptime();
+  pid_t pid = spawn(path, &argv[1]);
+  if (pid == -1) {
+    printf("time: can not run %s\n", path);
+    return -1;
+  }
+  int32_t status;
+  wait(&status);
+  uint32_t real = uptime() - start;
+
+  struct rusage ru;
+  getrusage(RUSAGE_CHILDREN, &ru);
+  printf("exit status %d\n", status);
+  printf("real    %d ms\n", real);
+  printf("cpu     %d ms\n", ru.cpu_ms);
+  printf("delay   %d ms (waiting on the run queue)\n", ru.run_delay_ms);
+  printf("iowait  %d ms\n", ru.iowait_ms);
+  printf("csw     %d voluntary, %d involuntary\n", ru.nvcsw, ru.nivcsw);
+  return 0;
+}
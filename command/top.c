@@ -0,0 +1,77 @@
+/* 类似 top 的任务统计:隔一秒取两次所有任务的运行统计,
+ * 算出这一秒内各任务的 CPU 占用,再列出累计的等待时间和切换次数,
+ * 最后打印最近一分钟每秒的平均可运行任务数。
+ * 用法: top */
+#include <stdint.h>
+
+#include "stdio.h"
+#include "string.h"
+#include "syscall.h"
+
+#define MAX_TASKS 64
+#define INTERVAL_MS 1000
+
+static struct task_stat before[MAX_TASKS];
+static struct task_stat after[MAX_TASKS];
+static uint32_t history[RQ_HISTORY_LEN];
+
+static const char* status_name[] = {"RUN",  "READY", "BLOCK",
+                                    "WAIT", "HANG",  "DIED"};
+
+/*在 stats 中按 pid 查找,找不到返回 NULL*/
+static struct task_stat* find_task(struct task_stat* stats, uint32_t cnt,
+                                   int16_t pid) {
+  uint32_t i;
+  for (i = 0; i < cnt; i++) {
+    if (stats[i].pid == pid) {
+      return &stats[i];
+    }
+  }
+  return NULL;
+}
+
+/*以两位小数打印 value/100*/
+static void print_centi(uint32_t value) {
+  printf("%d.%d%d ", value / 100, value / 10 % 10, value % 10);
+}
+
+int main(void) {
+  uint32_t start = uptime();
+  uint32_t nr_before = task_stats(before, MAX_TASKS);
+  sleep(INTERVAL_MS);
+  uint32_t nr_after = task_stats(after, MAX_TASKS);
+  uint32_t elapsed = uptime() - start;
+  if (elapsed == 0) {
+    elapsed = 1;
+  }
+
+  printf("PID\tPPID\tSTAT\tRT\t%s\tCPU_MS\tDELAY\tIOWAIT\tNVCSW\tNIVCSW\t"
+         "COMMAND\n",
+         "%CPU");  // printf 不支持 %%
+  uint32_t i;
+  for (i = 0; i < nr_after; i++) {
+    struct task_stat* st = &after[i];
+    struct task_stat* old = find_task(before, nr_before, st->pid);
+    uint32_t cpu_ms = st->cpu_ms;
+    if (old != NULL && strcmp(old->name, st->name) == 0) {
+      cpu_ms -= old->cpu_ms;  // pid 没有被复用时只算这一秒的
+    }
+    printf("%d\t%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n", st->pid, st->ppid,
+           st->status < 6 ? status_name[st->status] : "?", st->rt_priority,
+           cpu_ms * 100 / elapsed, st->cpu_ms, st->run_delay_ms, st->iowait_ms,
+           st->nvcsw, st->nivcsw, st->name);
+  }
+
+  uint32_t nr_secs = rq_history(history, RQ_HISTORY_LEN);
+  printf("runnable tasks per second, last %d s:\n", nr_secs);
+  for (i = 0; i < nr_secs; i++) {
+    print_centi(history[i]);
+    if (i % 10 == 9) {
+      printf("\n");
+    }
+  }
+  if (nr_secs % 10 != 0) {
+    printf("\n");
+  }
+  return 0;
+}
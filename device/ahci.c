@@ -0,0 +1,552 @@
+#include "ahci.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "pci.h"
+#include "stdio.h"
+#include "stdio_kernel.h"
+#include "string.h"
+#include "thread.h"
+#include "timer.h"
+
+/* 全局寄存器的位 */
+#define HBA_CAP_SNCQ 0x40000000  // 支持 NCQ
+#define HBA_GHC_IE 0x2           // 允许控制器发中断
+#define HBA_GHC_AE 0x80000000    // 工作在 AHCI 模式
+
+/* 端口寄存器 PxCMD 的位 */
+#define PxCMD_ST 0x1     // 开始处理命令列表
+#define PxCMD_FRE 0x10   // 允许接收 FIS
+#define PxCMD_FR 0x4000  // 接收 FIS 的引擎在运行
+#define PxCMD_CR 0x8000  // 命令列表的引擎在运行
+
+/* PxIS/PxIE 的位 */
+#define PxIS_DHRS 0x1        // 收到 D2H 寄存器 FIS,非排队命令完成
+#define PxIS_PSS 0x2         // 收到 PIO Setup FIS
+#define PxIS_DSS 0x4         // 收到 DMA Setup FIS
+#define PxIS_SDBS 0x8        // 收到 Set Device Bits FIS,排队命令完成
+#define PxIS_DPS 0x20        // 一个 PRD 项传完
+#define PxIS_ERR 0x78000000  // 接口、总线或任务文件出错(IFS|HBDS|HBFS|TFES)
+#define PxIE_ALL \
+  (PxIS_DHRS | PxIS_PSS | PxIS_DSS | PxIS_SDBS | PxIS_DPS | PxIS_ERR)
+
+#define PxSCTL_DET_INIT 0x1  // 发 COMRESET
+#define SSTS_DET_PRESENT 0x3  // 检测到设备并已建立通信
+#define SIG_ATA 0x00000101    // SATA 硬盘的签名
+
+/* PxTFD 的低字节是硬盘的状态寄存器 */
+#define ATA_STAT_BSY 0x80
+#define ATA_STAT_DRQ 0x08
+#define ATA_STAT_ERR 0x01
+
+#define FIS_TYPE_REG_H2D 0x27
+#define FIS_H2D_CMD 0x80  // 这个 FIS 是命令而不是设备控制
+#define ATA_DEV_LBA 0x40
+
+#define ATA_CMD_IDENTIFY 0xec
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_READ_FPDMA 0x60   // READ FPDMA QUEUED
+#define ATA_CMD_WRITE_FPDMA 0x61  // WRITE FPDMA QUEUED
+
+#define IDENTIFY_CAP_LBA48 0x400  // 第 83 字的第 10 位:支持 48 位地址
+#define IDENTIFY_SATA_NCQ 0x100   // 第 76 字的第 8 位:支持 NCQ
+
+#define CMD_HDR_WRITE 0x40  // 命令头 flags 的第 6 位:数据从内存写到硬盘
+#define AHCI_TIMEOUT_MS 5000
+
+/* 一个端口的寄存器,占 0x80 字节 */
+struct hba_port {
+  uint32_t clb;   // 命令列表的物理地址,1KB 对齐
+  uint32_t clbu;
+  uint32_t fb;    // 接收 FIS 区域的物理地址,256 字节对齐
+  uint32_t fbu;
+  uint32_t is;    // 中断状态,写 1 清除
+  uint32_t ie;    // 中断允许
+  uint32_t cmd;
+  uint32_t rsv0;
+  uint32_t tfd;   // 任务文件:硬盘的状态和错误寄存器
+  uint32_t sig;
+  uint32_t ssts;  // SATA 状态
+  uint32_t sctl;  // SATA 控制
+  uint32_t serr;  // SATA 错误,写 1 清除
+  uint32_t sact;  // 已发出未完成的排队命令
+  uint32_t ci;    // 已发出的命令槽
+  uint32_t sntf;
+  uint32_t fbs;
+  uint32_t rsv1[11];
+  uint32_t vendor[4];
+};
+
+/* 控制器的寄存器,由 BAR5 映射 */
+struct hba_mem {
+  uint32_t cap;  // 能力:端口数、命令槽数、是否支持 NCQ 等
+  uint32_t ghc;  // 全局控制
+  uint32_t is;   // 各端口的中断是否待处理,写 1 清除
+  uint32_t pi;   // 实现了哪些端口
+  uint32_t vs;
+  uint32_t ccc_ctl;
+  uint32_t ccc_pts;
+  uint32_t em_loc;
+  uint32_t em_ctl;
+  uint32_t cap2;
+  uint32_t bohc;
+  uint8_t rsv[0x100 - 0x2c];
+  struct hba_port ports[AHCI_MAX_PORTS];
+};
+
+/* 命令列表中的一项,对应一个命令槽 */
+struct ahci_cmd_header {
+  uint16_t flags;           // 低 5 位是命令 FIS 的双字数,第 6 位为写
+  uint16_t prdtl;           // 物理区域描述符的项数
+  volatile uint32_t prdbc;  // 已传送的字节数
+  uint32_t ctba;            // 命令表的物理地址,128 字节对齐
+  uint32_t ctbau;
+  uint32_t rsv[4];
+};
+
+/* 物理区域描述符,一项最多 4MB */
+struct ahci_prd {
+  uint32_t dba;  // 数据的物理地址,按字对齐
+  uint32_t dbau;
+  uint32_t rsv;
+  uint32_t dbc;  // 字节数减 1
+};
+
+/* 主机发给硬盘的寄存器 FIS,即一条 ATA 命令 */
+struct fis_reg_h2d {
+  uint8_t fis_type;
+  uint8_t pm_flags;  // 最高位为 1 表示命令
+  uint8_t command;
+  uint8_t featurel;  // 排队命令的扇区数放在 feature 中
+  uint8_t lba0;
+  uint8_t lba1;
+  uint8_t lba2;
+  uint8_t device;
+  uint8_t lba3;
+  uint8_t lba4;
+  uint8_t lba5;
+  uint8_t featureh;
+  uint8_t countl;  // 排队命令的第 3~7 位是标签,即命令槽号
+  uint8_t counth;
+  uint8_t icc;
+  uint8_t control;
+  uint8_t rsv[4];
+};
+
+/* 命令表,后面接着物理区域描述符表,每个槽占一页 */
+struct ahci_cmd_table {
+  uint8_t cfis[64];  // 命令 FIS
+  uint8_t acmd[16];
+  uint8_t rsv[48];
+  struct ahci_prd prdt[];
+};
+
+#define AHCI_PRDT_MAX \
+  ((PG_SIZE - sizeof(struct ahci_cmd_table)) / sizeof(struct ahci_prd))
+#define AHCI_MAX_SECS (AHCI_PRDT_MAX / 2)  // 每个扇区最多跨两页,占两项
+
+uint8_t ahci_port_cnt;                         // 接了硬盘的端口数
+struct ahci_port* ahci_ports[AHCI_MAX_PORTS];  // 接了硬盘的端口
+static volatile struct hba_mem* hba;
+
+/* 等寄存器 reg 中的 bits 全部清零,超过 m_seconds 毫秒返回 false */
+static bool wait_clear(volatile uint32_t* reg, uint32_t bits,
+                       uint32_t m_seconds) {
+  uint32_t waited_us = 0;
+  while (*reg & bits) {
+    if (waited_us >= m_seconds * 1000) {
+      return false;
+    }
+    udelay(10);
+    waited_us += 10;
+  }
+  return true;
+}
+
+/* 停止端口处理命令列表和接收 FIS,之后 PxCI 和 PxSACT 被清零 */
+static void port_stop(volatile struct hba_port* regs) {
+  regs->cmd &= ~PxCMD_ST;
+  wait_clear(&regs->cmd, PxCMD_CR, 500);
+  regs->cmd &= ~PxCMD_FRE;
+  wait_clear(&regs->cmd, PxCMD_FR, 500);
+}
+
+/* 硬盘空闲后打开接收 FIS 和命令处理 */
+static void port_start(volatile struct hba_port* regs) {
+  wait_clear(&regs->tfd, ATA_STAT_BSY | ATA_STAT_DRQ, AHCI_TIMEOUT_MS);
+  regs->cmd |= PxCMD_FRE;
+  regs->cmd |= PxCMD_ST;
+}
+
+/* 把 buf 开始的 len 字节接在描述符表的前 prd_cnt 项之后,返回新的项数.
+ * 每项不超过一页,物理上相连的合并为一项 */
+static uint32_t prd_fill(struct ahci_prd* prdt, uint32_t prd_cnt, void* buf,
+                         uint32_t len) {
+  uint32_t vaddr = (uint32_t)buf;
+  while (len > 0) {
+    uint32_t size = PG_SIZE - (vaddr & 0xfff);  // 本页剩下的部分
+    if (size > len) {
+      size = len;
+    }
+    uint32_t phy_addr = addr_v2p(vaddr);
+    struct ahci_prd* last = prd_cnt > 0 ? &prdt[prd_cnt - 1] : NULL;
+    if (last != NULL && last->dba + last->dbc + 1 == phy_addr) {
+      last->dbc += size;
+    } else {
+      ASSERT(prd_cnt < AHCI_PRDT_MAX);
+      prdt[prd_cnt].dba = phy_addr;
+      prdt[prd_cnt].dbau = 0;
+      prdt[prd_cnt].rsv = 0;
+      prdt[prd_cnt].dbc = size - 1;
+      prd_cnt++;
+    }
+    vaddr += size;
+    len -= size;
+  }
+  return prd_cnt;
+}
+
+/* 在命令表 table 中填好命令 FIS.ncq 为 true 时是排队命令,
+ * 扇区数放在 feature 中,标签 tag 放在 count 中 */
+static void fis_setup(struct ahci_cmd_table* table, uint8_t cmd, uint32_t lba,
+                      uint32_t sec_cnt, bool ncq, uint32_t tag) {
+  struct fis_reg_h2d* fis = (struct fis_reg_h2d*)table->cfis;
+  memset(fis, 0, sizeof(struct fis_reg_h2d));
+  fis->fis_type = FIS_TYPE_REG_H2D;
+  fis->pm_flags = FIS_H2D_CMD;
+  fis->command = cmd;
+  fis->device = ATA_DEV_LBA;
+  fis->lba0 = lba;
+  fis->lba1 = lba >> 8;
+  fis->lba2 = lba >> 16;
+  fis->lba3 = lba >> 24;
+  if (ncq) {
+    fis->featurel = sec_cnt;
+    fis->featureh = sec_cnt >> 8;
+    fis->countl = tag << 3;
+  } else {
+    fis->countl = sec_cnt;
+    fis->counth = sec_cnt >> 8;
+  }
+}
+
+/* 填好槽 slot 的命令头并发出命令 */
+static void slot_issue(struct ahci_port* port, uint32_t slot,
+                       uint32_t prd_cnt, bool write) {
+  struct ahci_cmd_header* header = &port->cmd_list[slot];
+  header->flags = sizeof(struct fis_reg_h2d) / 4 | (write ? CMD_HDR_WRITE : 0);
+  header->prdtl = prd_cnt;
+  header->prdbc = 0;
+  port->slots_busy |= 1u << slot;
+  asm volatile("" : : : "memory");  // 命令表和命令头写好后才能发出
+  if (port->ncq) {
+    port->regs->sact = 1u << slot;  // 排队命令要先在 PxSACT 中置位
+  }
+  port->regs->ci = 1u << slot;
+}
+
+/* 用槽 0 发 IDENTIFY 并轮询等待,得到扇区数和 NCQ 队列深度.
+ * 在打开端口的中断之前调用,失败返回 false */
+static bool ahci_identify(struct ahci_port* port, uint32_t* ncq_depth) {
+  uint16_t* id = get_kernel_pages(1);
+  if (id == NULL) {
+    return false;
+  }
+  struct ahci_cmd_table* table = port->cmd_tables[0];
+  uint32_t prd_cnt = prd_fill(table->prdt, 0, id, 512);
+  fis_setup(table, ATA_CMD_IDENTIFY, 0, 0, false, 0);
+  ((struct fis_reg_h2d*)table->cfis)->device = 0;
+  slot_issue(port, 0, prd_cnt, false);  // 此时 port->ncq 还是 false
+
+  volatile struct hba_port* regs = port->regs;
+  bool ok = wait_clear(&regs->ci, 1, AHCI_TIMEOUT_MS) &&
+            !(regs->is & PxIS_ERR) && !(regs->tfd & ATA_STAT_ERR);
+  port->slots_busy = 0;
+  regs->is = regs->is;
+  if (ok) {
+    struct block_device* hd = &port->bdev;
+    hd->sectors = *(uint32_t*)&id[60];
+    if (id[83] & IDENTIFY_CAP_LBA48) {
+      hd->sectors = *(uint32_t*)&id[100];
+      if (*(uint32_t*)&id[102] != 0) {
+        hd->sectors = 0xffffffff;
+      }
+    }
+    *ncq_depth = id[76] & IDENTIFY_SATA_NCQ ? (id[75] & 0x1f) + 1 : 0;
+  }
+  mfree_page(PF_KERNEL, id, 1);
+  return ok;
+}
+
+/* 用槽 slot 发出请求 rq,有缓冲区不是按字对齐时返回 false */
+static bool ahci_issue_rq(struct ahci_port* port, uint32_t slot,
+                          struct request* rq) {
+  struct ahci_cmd_table* table = port->cmd_tables[slot];
+  uint32_t prd_cnt = 0;
+  struct list_elem* elem = rq->bios.head.next;
+  while (elem != &rq->bios.tail) {
+    struct bio* bio = elem2entry(struct bio, tag, elem);
+    if ((uint32_t)bio->buf & 1) {
+      return false;
+    }
+    bio_access_begin(bio);  // 用户缓冲区要在提交者的页表下求物理地址
+    prd_cnt = prd_fill(table->prdt, prd_cnt, bio->buf, bio->sec_cnt * 512);
+    bio_access_end(bio);
+    elem = elem->next;
+  }
+  uint8_t cmd;
+  if (port->ncq) {
+    cmd = rq->write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+  } else {
+    cmd = rq->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+  }
+  fis_setup(table, cmd, rq->lba, rq->sec_cnt, port->ncq, slot);
+  port->slot_rq[slot] = rq;
+  slot_issue(port, slot, prd_cnt, rq->write);
+  return true;
+}
+
+/* 从队列中取请求,直到命令槽用满或没有可派发的请求 */
+static void ahci_issue(struct ahci_port* port) {
+  while (1) {
+    uint32_t slot = 0;
+    while (slot < port->depth && (port->slots_busy & (1u << slot))) {
+      slot++;
+    }
+    if (slot == port->depth) {
+      return;
+    }
+    struct request* rq = blk_fetch_request(&port->bdev.queue);
+    if (rq == NULL) {
+      return;
+    }
+    if (!ahci_issue_rq(port, slot, rq)) {
+      printk("%s: buffer at lba %d not word aligned\n", port->bdev.name,
+             rq->lba);
+      blk_end_request(rq, -1);
+      continue;
+    }
+    uint32_t inflight = 0;
+    for (slot = 0; slot < port->depth; slot++) {
+      inflight += (port->slots_busy >> slot) & 1;
+    }
+    if (inflight > port->max_inflight) {
+      port->max_inflight = inflight;
+    }
+  }
+}
+
+/* 结束 slots 中各槽上的请求 */
+static void slots_end(struct ahci_port* port, uint32_t slots, int32_t error) {
+  uint32_t slot;
+  for (slot = 0; slot < port->depth; slot++) {
+    if (slots & (1u << slot)) {
+      struct request* rq = port->slot_rq[slot];
+      port->slot_rq[slot] = NULL;
+      port->slots_busy &= ~(1u << slot);
+      blk_end_request(rq, error);
+    }
+  }
+}
+
+/* 出错或超时后停下端口,清除错误,必要时复位链路,未完成的命令全部失败 */
+static void ahci_port_recover(struct ahci_port* port, const char* why) {
+  volatile struct hba_port* regs = port->regs;
+  printk("%s: %s, tfd 0x%x serr 0x%x is 0x%x\n", port->bdev.name, why,
+         regs->tfd, regs->serr, regs->is);
+  port_stop(regs);
+  if (regs->tfd & (ATA_STAT_BSY | ATA_STAT_DRQ)) {
+    regs->sctl = (regs->sctl & ~0xf) | PxSCTL_DET_INIT;
+    udelay(1000);
+    regs->sctl &= ~0xf;
+    wait_clear(&regs->tfd, ATA_STAT_BSY, AHCI_TIMEOUT_MS);
+  }
+  regs->serr = 0xffffffff;
+  regs->is = 0xffffffff;
+  port_start(regs);
+  slots_end(port, port->slots_busy, -1);
+}
+
+/* 收割已完成的命令:非排队命令做完时 PxCI 清零,排队命令做完时 PxSACT 清零 */
+static void ahci_complete(struct ahci_port* port) {
+  enum intr_status old_status = intr_disable();
+  uint32_t irq_status = port->irq_status | (port->regs->is & PxIS_ERR);
+  port->irq_status = 0;
+  intr_set_status(old_status);
+
+  uint32_t active = port->regs->ci | port->regs->sact;
+  slots_end(port, port->slots_busy & ~active, 0);
+  if ((irq_status & PxIS_ERR) ||
+      (port->slots_busy != 0 && (port->regs->tfd & ATA_STAT_ERR))) {
+    ahci_port_recover(port, "command failed");
+  }
+}
+
+/* 端口的完成线程:收割完成的命令,再用空出的槽发新的请求,没事可做时睡眠.
+ * 有命令在做时最多睡 AHCI_TIMEOUT_MS,期间一个命令都没完成就算超时 */
+static void ahci_port_thread(void* arg) {
+  struct ahci_port* port = arg;
+  while (1) {
+    bool woken = true;
+    enum intr_status old_status = wait_queue_lock(&port->wq);
+    while (!port->event && woken) {
+      uint32_t timeout =
+          port->slots_busy != 0 ? msecs_to_ticks(AHCI_TIMEOUT_MS) : 0;
+      woken = wait_queue_sleep(&port->wq, false, timeout);
+    }
+    port->event = false;
+    wait_queue_unlock(&port->wq, old_status);
+
+    uint32_t busy = port->slots_busy;
+    ahci_complete(port);
+    if (!woken && port->slots_busy != 0 && port->slots_busy == busy) {
+      ahci_port_recover(port, "command timeout");
+    }
+    ahci_issue(port);
+  }
+}
+
+/*有新请求或中断时唤醒端口的完成线程*/
+static void ahci_wake(struct ahci_port* port) {
+  enum intr_status old_status = wait_queue_lock(&port->wq);
+  port->event = true;
+  wake_up_locked(&port->wq, 1);
+  wait_queue_unlock(&port->wq, old_status);
+}
+
+static void ahci_kick(struct blk_queue* q) { ahci_wake(q->driver_data); }
+
+static void ahci_tasklet_func(uint32_t data) {
+  ahci_wake((struct ahci_port*)data);
+}
+
+/* AHCI 中断处理程序:清除各端口的中断状态,留给完成线程处理 */
+static void intr_ahci_handler(uint8_t irq_no UNUSED) {
+  uint32_t pending = hba->is;
+  uint8_t idx;
+  for (idx = 0; idx < ahci_port_cnt; idx++) {
+    struct ahci_port* port = ahci_ports[idx];
+    if (pending & (1u << port->port_no)) {
+      uint32_t is = port->regs->is;
+      port->regs->is = is;
+      port->irq_status |= is;
+      tasklet_schedule(&port->intr_tasklet);
+    }
+  }
+  hba->is = pending;
+}
+
+/* 初始化第 port_no 个端口,接了 SATA 硬盘时加入 ahci_ports */
+static void ahci_port_init(uint8_t port_no) {
+  volatile struct hba_port* regs = &hba->ports[port_no];
+  if ((regs->ssts & 0xf) != SSTS_DET_PRESENT || regs->sig != SIG_ATA) {
+    return;
+  }
+  struct ahci_port* port = get_kernel_pages(1);
+  void* cmd_page = get_kernel_pages(1);
+  void* table = get_kernel_pages(1);
+  if (port == NULL || cmd_page == NULL || table == NULL) {
+    printk("ahci: no memory for port %d\n", port_no);
+    return;  // 启动时内存不会不够,这里不再回收
+  }
+  port->port_no = port_no;
+  port->regs = regs;
+  port_stop(regs);
+
+  /* 一页中前 1KB 是 32 项的命令列表,接着 256 字节接收 FIS */
+  port->cmd_list = cmd_page;
+  regs->clb = addr_v2p((uint32_t)cmd_page);
+  regs->clbu = 0;
+  regs->fb = regs->clb + 1024;
+  regs->fbu = 0;
+  port->cmd_tables[0] = table;
+  port->cmd_list[0].ctba = addr_v2p((uint32_t)table);
+  regs->serr = 0xffffffff;
+  regs->is = 0xffffffff;
+  port_start(regs);
+
+  struct block_device* hd = &port->bdev;
+  sprintf(hd->name, "sd%c", 'e' + ahci_port_cnt);  // 排在 IDE 的四块硬盘之后
+  uint32_t ncq_depth = 0;
+  if (!ahci_identify(port, &ncq_depth)) {
+    printk("%s: identify failed on port %d\n", hd->name, port_no);
+    port_stop(regs);
+    mfree_page(PF_KERNEL, table, 1);
+    mfree_page(PF_KERNEL, cmd_page, 1);
+    mfree_page(PF_KERNEL, port, 1);
+    return;
+  }
+
+  /* 控制器和硬盘都支持 NCQ 时用排队命令,否则一次一条 */
+  uint32_t slot_cnt = ((hba->cap >> 8) & 0x1f) + 1;
+  port->ncq = (hba->cap & HBA_CAP_SNCQ) && ncq_depth > 0;
+  port->depth = 1;
+  if (port->ncq) {
+    port->depth = ncq_depth < slot_cnt ? ncq_depth : slot_cnt;
+  }
+  uint32_t slot;
+  for (slot = 1; slot < port->depth; slot++) {
+    port->cmd_tables[slot] = get_kernel_pages(1);
+    if (port->cmd_tables[slot] == NULL) {
+      break;
+    }
+    port->cmd_list[slot].ctba = addr_v2p((uint32_t)port->cmd_tables[slot]);
+  }
+  port->depth = slot;
+  printk("%s: port %d, %dMB, ncq %s, depth %d\n", hd->name, port_no,
+         hd->sectors / 2048, port->ncq ? "yes" : "no", port->depth);
+
+  hd->ops = &blk_queue_ops;
+  blk_queue_init(&hd->queue, AHCI_MAX_SECS, ahci_kick, port);
+  wait_queue_init(&port->wq);
+  tasklet_init(&port->intr_tasklet, ahci_tasklet_func, (uint32_t)port);
+  regs->ie = PxIE_ALL;
+  port->thread = thread_start(hd->name, 31, ahci_port_thread, port);
+  ahci_ports[ahci_port_cnt++] = port;
+  bdev_register(hd);
+}
+
+/* 找到 AHCI 模式的 SATA 控制器后初始化各端口上的硬盘,扫描其中的分区 */
+void ahci_init(void) {
+  struct pci_dev pci;
+  if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, &pci) ||
+      pci.prog_if != PCI_PROGIF_AHCI) {
+    return;
+  }
+  printk("ahci_init start\n");
+  if (pci.irq_line >= 16) {
+    printk("ahci: no irq assigned, disabled\n");
+    return;
+  }
+  pci_enable(&pci, PCI_CMD_MEM | PCI_CMD_MASTER);
+  hba = ioremap(pci_bar(&pci, 5), sizeof(struct hba_mem));
+  if (hba == NULL) {
+    printk("ahci: cannot map registers\n");
+    return;
+  }
+  hba->ghc |= HBA_GHC_AE;
+  printk("ahci: %x:%x, irq %d, %d slots, ncq %s\n", pci.vendor_id,
+         pci.device_id, pci.irq_line, ((hba->cap >> 8) & 0x1f) + 1,
+         hba->cap & HBA_CAP_SNCQ ? "yes" : "no");
+
+  uint32_t implemented = hba->pi;
+  uint8_t port_no;
+  for (port_no = 0; port_no < AHCI_MAX_PORTS; port_no++) {
+    if (implemented & (1u << port_no)) {
+      ahci_port_init(port_no);
+    }
+  }
+
+  register_handler(0x20 + pci.irq_line, intr_ahci_handler);
+  pic_unmask(pci.irq_line);
+  hba->is = 0xffffffff;
+  hba->ghc |= HBA_GHC_IE;
+
+  uint8_t idx;
+  for (idx = 0; idx < ahci_port_cnt; idx++) {
+    bdev_scan_partitions(&ahci_ports[idx]->bdev);
+  }
+  printk("ahci_init done\n");
+}
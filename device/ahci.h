@@ -0,0 +1,38 @@
+#ifndef DEVICE_AHCI
+#define DEVICE_AHCI
+#include "blk.h"
+#include "softirq.h"
+#include "stdint.h"
+#include "sync.h"
+
+#define AHCI_MAX_PORTS 32
+#define AHCI_MAX_SLOTS 32  // 每个端口最多的命令槽
+
+struct hba_port;
+struct ahci_cmd_header;
+struct ahci_cmd_table;
+
+/* AHCI 控制器上接了硬盘的一个端口 */
+struct ahci_port {
+  struct block_device bdev;  // 对上层是一个块设备,经 bdev.queue 读写
+  uint8_t port_no;
+  volatile struct hba_port* regs;
+  struct ahci_cmd_header* cmd_list;  // 命令列表,后面接着接收 FIS 的区域
+  struct ahci_cmd_table* cmd_tables[AHCI_MAX_SLOTS];  // 每个槽一页
+  struct request* slot_rq[AHCI_MAX_SLOTS];  // 各槽上正在做的请求
+  uint32_t slots_busy;    // 已发出尚未完成的槽
+  uint32_t depth;         // 同时发出的命令数上限
+  bool ncq;               // 用 FPDMA QUEUED 命令排队
+  uint32_t max_inflight;  // 统计:同时在做的命令数的最大值
+  uint32_t irq_status;    // 中断处理程序收集的 PxIS,由完成线程处理
+  bool event;             // 有新请求或中断,由 wq 的锁保护
+  struct wait_queue wq;   // 完成线程在此等待
+  struct tasklet intr_tasklet;  // 在中断返回前唤醒完成线程
+  struct task_struct* thread;   // 发命令并收割完成的命令的线程
+};
+
+extern uint8_t ahci_port_cnt;
+extern struct ahci_port* ahci_ports[];
+
+void ahci_init(void);
+#endif /* DEVICE_AHCI */
@@ -0,0 +1,467 @@
+#include "blk.h"
+
+#include "debug.h"
+#include "memory.h"
+#include "process.h"
+#include "stdio.h"
+#include "stdio_kernel.h"
+#include "thread.h"
+#include "timer.h"
+
+#define BIO_BATCH (PG_SIZE / sizeof(struct bio))  // blk_read_sectors 一批的 bio 数
+
+struct list bdev_list;  // 注册了的块设备
+struct list partition_list;  // 分区队列
+struct rwlock partition_list_lock;  // 分区队列只在扫描分区表时修改,平时只读
+
+/* 用于记录总扩展分区的起始lba,初始为 0,partition_scan 时以此为标记 */
+static int32_t ext_lba_base = 0;
+
+static uint8_t p_no = 0, l_no = 0;  // 用来记录硬盘主分区和逻辑分区的下标
+
+/*初始化块设备和分区的队列,在各硬盘驱动之前调用*/
+void blk_init(void) {
+  list_init(&bdev_list);
+  list_init(&partition_list);
+  rwlock_init(&partition_list_lock);
+}
+
+/*初始化请求队列 q,一个请求最多 max_secs 个扇区*/
+void blk_queue_init(struct blk_queue* q, uint32_t max_secs,
+                    void (*kick)(struct blk_queue* q), void* driver_data) {
+  spin_lock_init(&q->lock);
+  list_init(&q->requests);
+  list_init(&q->inflight);
+  q->head_lba = 0;
+  q->seq = 0;
+  q->max_secs = max_secs;
+  q->contig_only = false;
+  q->nr_requests = 0;
+  q->nr_merges = 0;
+  q->kick = kick;
+  q->driver_data = driver_data;
+}
+
+/*初始化 bio,提交者为当前任务*/
+void bio_init(struct bio* bio, struct block_device* bdev, uint32_t lba,
+              void* buf, uint32_t sec_cnt, bool write, bio_end_io* end_io,
+              void* private) {
+  bio->bdev = bdev;
+  bio->queue = &bdev->queue;
+  bio->lba = lba;
+  bio->sec_cnt = sec_cnt;
+  bio->buf = buf;
+  bio->write = write;
+  bio->error = 0;
+  bio->owner = running_thread();
+  bio->end_io = end_io;
+  bio->private = private;
+  list_elem_init(&bio->tag);
+}
+
+/* 扇区范围 [lba, lba + cnt) 是否与请求 rq 重叠 */
+static bool rq_overlap(struct request* rq, uint32_t lba, uint32_t cnt) {
+  return lba < rq->lba + rq->sec_cnt && rq->lba < lba + cnt;
+}
+
+/* 缓冲区 a 之后紧接着是否就是提交者相同的缓冲区 b */
+static bool bio_buf_adjacent(struct bio* a, struct bio* b) {
+  return a->owner == b->owner && (uint32_t)a->buf + a->sec_cnt * 512 ==
+                                     (uint32_t)b->buf;
+}
+
+/* bio 能否接在 rq 之后(front 为 false)或之前 */
+static bool bio_mergeable(struct blk_queue* q, struct request* rq,
+                          struct bio* bio, bool front) {
+  if (!q->contig_only) {
+    return true;
+  }
+  if (front) {
+    struct bio* first = elem2entry(struct bio, tag, rq->bios.head.next);
+    return bio_buf_adjacent(bio, first);
+  }
+  struct bio* last = elem2entry(struct bio, tag, rq->bios.tail.prev);
+  return bio_buf_adjacent(last, bio);
+}
+
+/* 把 bio 并入 q 中与它首尾相接、方向相同的请求,成功返回 true.
+ * 与排队中的请求有重叠时不合并,由 blk_fetch_request 保证先后 */
+static bool blk_try_merge(struct blk_queue* q, struct bio* bio) {
+  struct request* target = NULL;
+  bool front = false;
+  struct list_elem* elem = q->requests.head.next;
+  while (elem != &q->requests.tail) {
+    struct request* rq = elem2entry(struct request, queue_tag, elem);
+    if (rq_overlap(rq, bio->lba, bio->sec_cnt)) {
+      return false;
+    }
+    if (target == NULL && rq->write == bio->write &&
+        rq->sec_cnt + bio->sec_cnt <= q->max_secs) {
+      if (rq->lba + rq->sec_cnt == bio->lba &&
+          bio_mergeable(q, rq, bio, false)) {
+        target = rq;
+      } else if (bio->lba + bio->sec_cnt == rq->lba &&
+                 bio_mergeable(q, rq, bio, true)) {
+        target = rq;
+        front = true;
+      }
+    }
+    elem = elem->next;
+  }
+  if (target == NULL) {
+    return false;
+  }
+  /* 没有重叠,合并后请求仍按 lba 有序 */
+  if (front) {
+    list_push(&target->bios, &bio->tag);
+    target->lba = bio->lba;
+  } else {
+    list_append(&target->bios, &bio->tag);
+  }
+  target->sec_cnt += bio->sec_cnt;
+  q->nr_merges++;
+  return true;
+}
+
+/* 异步提交 bio,完成时调用 bio->end_io.
+ * 能并入已有请求就合并,否则用 bio 内嵌的请求按 lba 插入队列 */
+void submit_bio(struct bio* bio) {
+  struct blk_queue* q = bio->queue;
+  ASSERT(bio->sec_cnt > 0 && bio->sec_cnt <= q->max_secs);
+  enum intr_status old_status = spin_lock_irqsave(&q->lock);
+  if (!blk_try_merge(q, bio)) {
+    struct request* rq = &bio->rq;
+    rq->queue = q;
+    rq->lba = bio->lba;
+    rq->sec_cnt = bio->sec_cnt;
+    rq->write = bio->write;
+    rq->seq = q->seq++;
+    list_init(&rq->bios);
+    list_append(&rq->bios, &bio->tag);
+
+    /* 插在第一个 lba 更大的请求之前,lba 相同时先来的在前 */
+    struct list_elem* elem = q->requests.head.next;
+    while (elem != &q->requests.tail) {
+      struct request* next = elem2entry(struct request, queue_tag, elem);
+      if (next->lba > rq->lba) {
+        break;
+      }
+      elem = elem->next;
+    }
+    list_insert_before(elem, &rq->queue_tag);
+  }
+  spin_unlock_irqrestore(&q->lock, old_status);
+  q->kick(q);
+}
+
+/* 请求 rq 能否现在派发:与更早入队的请求或正在做的请求重叠时要等它们先完成 */
+static bool rq_ready(struct blk_queue* q, struct request* rq) {
+  struct list_elem* elem = q->inflight.head.next;
+  while (elem != &q->inflight.tail) {
+    struct request* other = elem2entry(struct request, queue_tag, elem);
+    if (rq_overlap(other, rq->lba, rq->sec_cnt)) {
+      return false;
+    }
+    elem = elem->next;
+  }
+  elem = q->requests.head.next;
+  while (elem != &q->requests.tail) {
+    struct request* other = elem2entry(struct request, queue_tag, elem);
+    if (other != rq && other->seq < rq->seq &&
+        rq_overlap(other, rq->lba, rq->sec_cnt)) {
+      return false;
+    }
+    elem = elem->next;
+  }
+  return true;
+}
+
+/* 按 C-LOOK 取出下一个要派发的请求,没有可以派发的时返回 NULL:
+ * 磁头只向 lba 增大的方向扫,从上一个请求的结束处往后找,
+ * 后面没有了再回到 lba 最小的请求 */
+struct request* blk_fetch_request(struct blk_queue* q) {
+  struct request* first = NULL;
+  struct request* found = NULL;
+  enum intr_status old_status = spin_lock_irqsave(&q->lock);
+  struct list_elem* elem = q->requests.head.next;
+  while (elem != &q->requests.tail) {
+    struct request* rq = elem2entry(struct request, queue_tag, elem);
+    if (rq_ready(q, rq)) {
+      if (first == NULL) {
+        first = rq;
+      }
+      if (rq->lba >= q->head_lba) {
+        found = rq;
+        break;
+      }
+    }
+    elem = elem->next;
+  }
+  if (found == NULL) {
+    found = first;
+  }
+  if (found != NULL) {
+    list_remove(&found->queue_tag);
+    list_append(&q->inflight, &found->queue_tag);
+    q->head_lba = found->lba + found->sec_cnt;
+    q->nr_requests++;
+  }
+  spin_unlock_irqrestore(&q->lock, old_status);
+  return found;
+}
+
+/* 驱动做完请求 rq 后调用,error 为 0 表示成功.
+ * rq 放在它第一个 bio 中,这个 bio 的 end_io 之后 rq 可能已不存在,所以最后调用 */
+void blk_end_request(struct request* rq, int32_t error) {
+  struct blk_queue* q = rq->queue;
+  enum intr_status old_status = spin_lock_irqsave(&q->lock);
+  list_remove(&rq->queue_tag);
+  spin_unlock_irqrestore(&q->lock, old_status);
+
+  struct bio* rq_bio = elem2entry(struct bio, rq, rq);
+  while (!list_empty(&rq->bios)) {
+    struct list_elem* elem = list_pop(&rq->bios);
+    struct bio* bio = elem2entry(struct bio, tag, elem);
+    if (bio != rq_bio) {
+      bio->error = error;
+      bio->end_io(bio);
+    }
+  }
+  rq_bio->error = error;
+  rq_bio->end_io(rq_bio);
+}
+
+/* 驱动访问 bio->buf 之前调用。buf 在用户空间时换上提交者的页表,
+ * 期间不能被抢占,也不能睡眠,直到 bio_access_end */
+void bio_access_begin(struct bio* bio) {
+  if ((uint32_t)bio->buf < 0xc0000000) {
+    preempt_disable();
+    page_dir_activate(bio->owner);
+  }
+}
+
+/*访问完 bio->buf,恢复当前任务的页表*/
+void bio_access_end(struct bio* bio) {
+  if ((uint32_t)bio->buf < 0xc0000000) {
+    page_dir_activate(running_thread());
+    preempt_enable();
+  }
+}
+
+/*同步读写的完成回调,唤醒等待者*/
+static void bio_end_sync(struct bio* bio) {
+  sema_up((struct semaphore*)bio->private);
+}
+
+/* 经请求队列同步读写 lba 开始的 sec_cnt 个扇区,
+ * 等待的时间计入当前任务的 I/O 等待.成功返回 0,出错返回 -1 */
+static int32_t blk_rw(struct block_device* bdev, uint32_t lba, void* buf,
+                      uint32_t sec_cnt, bool write) {
+  struct blk_queue* q = &bdev->queue;
+  struct semaphore done;
+  struct bio bio;
+  int32_t ret = 0;
+  uint64_t start = rdtsc();
+  sema_init(&done, 0);
+  while (sec_cnt > 0) {
+    uint32_t secs = sec_cnt < q->max_secs ? sec_cnt : q->max_secs;
+    bio_init(&bio, bdev, lba, buf, secs, write, bio_end_sync, &done);
+    submit_bio(&bio);
+    sema_down(&done);
+    if (bio.error != 0) {
+      ret = -1;
+    }
+    lba += secs;
+    buf = (void*)((uint32_t)buf + secs * 512);
+    sec_cnt -= secs;
+  }
+  running_thread()->iowait_us += tsc_elapsed_us(&start);
+  return ret;
+}
+
+static int32_t blk_queue_read(struct block_device* bdev, uint32_t lba,
+                              void* buf, uint32_t sec_cnt) {
+  return blk_rw(bdev, lba, buf, sec_cnt, false);
+}
+
+static int32_t blk_queue_write(struct block_device* bdev, uint32_t lba,
+                               void* buf, uint32_t sec_cnt) {
+  return blk_rw(bdev, lba, buf, sec_cnt, true);
+}
+
+/* 驱动在设备报告写完后才结束请求,写都是同步等完成的,这里没有要等的.
+ * 硬盘自带的写缓存不在此刷新 */
+static int32_t blk_queue_flush(struct block_device* bdev UNUSED) { return 0; }
+
+static void blk_queue_submit(struct block_device* bdev UNUSED,
+                             struct bio* bio) {
+  submit_bio(bio);
+}
+
+/* 走请求队列的驱动共用的操作 */
+const struct block_device_ops blk_queue_ops = {
+    .read = blk_queue_read,
+    .write = blk_queue_write,
+    .flush = blk_queue_flush,
+    .submit = blk_queue_submit,
+};
+
+/* 登记块设备,filesys_init 在登记了的设备上找文件系统 */
+void bdev_register(struct block_device* bdev) {
+  ASSERT(bdev->ops != NULL);
+  list_append(&bdev_list, &bdev->bdev_tag);
+}
+
+/*从 bdev 读 sec_cnt 个扇区到 buf,出错时 PANIC*/
+void bdev_read(struct block_device* bdev, uint32_t lba, void* buf,
+               uint32_t sec_cnt) {
+  ASSERT(sec_cnt > 0 && lba < bdev->sectors &&
+         sec_cnt <= bdev->sectors - lba);
+  if (bdev->ops->read(bdev, lba, buf, sec_cnt) != 0) {
+    char error[64];
+    sprintf(error, "%s read sector %d failed!!!!\n", bdev->name, lba);
+    PANIC(error);
+  }
+}
+
+/*将buf中sec_cnt扇区数据写入 bdev,出错时 PANIC*/
+void bdev_write(struct block_device* bdev, uint32_t lba, void* buf,
+                uint32_t sec_cnt) {
+  ASSERT(sec_cnt > 0 && lba < bdev->sectors &&
+         sec_cnt <= bdev->sectors - lba);
+  if (bdev->ops->write(bdev, lba, buf, sec_cnt) != 0) {
+    char error[64];
+    sprintf(error, "%s write sector %d failed!!!!\n", bdev->name, lba);
+    PANIC(error);
+  }
+}
+
+int32_t bdev_flush(struct block_device* bdev) { return bdev->ops->flush(bdev); }
+
+/*异步提交 bio,完成时调用 bio->end_io*/
+void bdev_submit(struct bio* bio) { bio->bdev->ops->submit(bio->bdev, bio); }
+
+/* 扫描块设备 bdev 中地址为 ext_lba 的扇区中的所有分区 */
+static void partition_scan(struct block_device* bdev, uint32_t ext_lab) {
+  struct boot_sector* bs =
+      (struct boot_sector*)sys_malloc(sizeof(struct boot_sector));
+
+  bdev_read(bdev, ext_lab, bs, 1);
+  uint8_t part_idx = 0;
+  struct partition_table_entry* p = bs->partition_table;
+
+  /*遍历分区表四个分区表项*/
+  while (part_idx++ < 4) {
+    if (p->fs_type == 0x5) {  // 若为拓展分区
+      /* 子扩展分区的 start_lba 是相对于主引导扇区中的总扩展分区地址*/
+      if (ext_lba_base != 0) {
+        partition_scan(bdev, p->start_lba + ext_lba_base);
+      } else {
+        ext_lba_base = p->start_lba;
+        partition_scan(bdev, p->start_lba);
+      }
+    } else if (p->fs_type != 0) {  // 若是有效的分区类型
+      if (ext_lab == 0) {
+        bdev->prim_parts[p_no].start_lba = ext_lab + p->start_lba;
+        bdev->prim_parts[p_no].sec_cnt = p->sec_cnt;
+        bdev->prim_parts[p_no].my_disk = bdev;
+        write_lock(&partition_list_lock);
+        list_append(&partition_list, &bdev->prim_parts[p_no].part_tag);
+        write_unlock(&partition_list_lock);
+        sprintf(bdev->prim_parts[p_no].name, "%s%d", bdev->name, p_no + 1);
+        p_no++;
+        ASSERT(p_no < 4);
+      } else {
+        bdev->logic_parts[l_no].start_lba = ext_lab + p->start_lba;
+        bdev->logic_parts[l_no].sec_cnt = p->sec_cnt;
+        bdev->logic_parts[l_no].my_disk = bdev;
+        write_lock(&partition_list_lock);
+        list_append(&partition_list, &bdev->logic_parts[l_no].part_tag);
+        write_unlock(&partition_list_lock);
+        sprintf(bdev->logic_parts[l_no].name, "%s%d", bdev->name,
+                l_no + 5);  // 逻辑分区是从5开始的
+        l_no++;
+        if (l_no >= 8) {  // 只支持 8 个逻辑分区,避免数组越界
+          return;
+        }
+      }
+    }
+    p++;
+  }
+  sys_free(bs);
+}
+
+/* 扫描块设备 bdev 上的全部分区,加入 partition_list */
+void bdev_scan_partitions(struct block_device* bdev) {
+  ext_lba_base = 0;
+  p_no = 0;
+  l_no = 0;
+  partition_scan(bdev, 0);
+}
+
+/* 打印分区信息 */
+static bool partition_info(struct list_elem* pelem, int arg UNUSED) {
+  struct partition* part = elem2entry(struct partition, part_tag, pelem);
+
+  printk(" %s start_lba:0x%x, sec_cnt:0x%x\n", part->name, part->start_lba,
+         part->sec_cnt);
+
+  /* 在此处 return false 与函数本身功能无关,
+   * 只是为了让主调函数 list_traversal 继续向下遍历元素 */
+  return false;
+}
+
+/*打印所有块设备上的分区*/
+void bdev_print_partitions(void) {
+  printk("\nall partition info\n");
+  read_lock(&partition_list_lock);
+  list_traversal(&partition_list, partition_info, (int)NULL);
+  read_unlock(&partition_list_lock);
+}
+
+/* 把 cnt 个扇区 lbas[0..cnt) 依次读到 buf 中相连的位置.
+ * 一批 bio 同时提交,走请求队列的设备把相邻的扇区合并成一次请求,
+ * 其余的由电梯排序.成功返回 0,出错返回 -1 */
+int32_t blk_read_sectors(struct block_device* bdev, uint32_t* lbas,
+                         uint32_t cnt, void* buf) {
+  struct bio* bios = get_kernel_pages(1);
+  if (bios == NULL) {
+    /* 没有内存放 bio 时退回一个一个读 */
+    uint32_t idx;
+    for (idx = 0; idx < cnt; idx++) {
+      if (bdev->ops->read(bdev, lbas[idx], (uint8_t*)buf + idx * 512, 1) !=
+          0) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  struct semaphore done;
+  int32_t ret = 0;
+  uint64_t start = rdtsc();
+  sema_init(&done, 0);
+  uint32_t base = 0;
+  while (base < cnt) {
+    uint32_t batch = cnt - base < BIO_BATCH ? cnt - base : BIO_BATCH;
+    uint32_t idx;
+    for (idx = 0; idx < batch; idx++) {
+      bio_init(&bios[idx], bdev, lbas[base + idx],
+               (uint8_t*)buf + (base + idx) * 512, 1, false, bio_end_sync,
+               &done);
+      bdev_submit(&bios[idx]);
+    }
+    for (idx = 0; idx < batch; idx++) {
+      sema_down(&done);
+    }
+    for (idx = 0; idx < batch; idx++) {
+      if (bios[idx].error != 0) {
+        ret = -1;
+      }
+    }
+    base += batch;
+  }
+  running_thread()->iowait_us += tsc_elapsed_us(&start);
+  mfree_page(PF_KERNEL, bios, 1);
+  return ret;
+}
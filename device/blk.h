@@ -0,0 +1,142 @@
+#ifndef DEVICE_BLK
+#define DEVICE_BLK
+#include "bitmap.h"
+#include "global.h"
+#include "list.h"
+#include "stdint.h"
+#include "sync.h"
+
+struct bio;
+struct blk_queue;
+struct block_device;
+typedef void bio_end_io(struct bio* bio);
+
+/*分区结构体*/
+struct partition {
+  uint32_t start_lba;             // 起始扇区
+  uint32_t sec_cnt;               // 扇区数
+  struct block_device* my_disk;   // 分区所属的块设备
+  struct list_elem part_tag;      // 用于队列中的标记
+  char name[8];                   // 分区名称
+  struct super_block* sb;         // 超级快
+  struct bitmap block_bitmap;     // 块位图
+  struct bitmap inode_bitmap;     // inode节点位图
+  struct list open_inodes;        // 本分区打开的inode节点队列
+};
+
+/*构建一个16字节大小的结构体，用来存分区表项*/
+struct partition_table_entry {
+  uint8_t bootable;    // 是否可引导
+  uint8_t start_head;  // 起始磁头号
+  uint8_t start_sec;   // 起始扇区号
+  uint8_t start_chs;   // 起始柱面号
+  uint8_t fs_type;     // 分区类型
+  uint8_t end_head;    // 结束磁头号
+  uint8_t end_sec;     // 结束扇区号
+  uint8_t end_chs;     // 结束柱面号
+  /*重点关注的是下面两项*/
+  uint32_t start_lba;       // 本分区起始扇区的lba地址
+  uint32_t sec_cnt;         // 本分区的扇区数目
+} __attribute__((packed));  // gcc拓展语法，保证这个结构体占16字节
+
+/*引导扇区mbr或ebr*/
+struct boot_sector {
+  uint8_t other[446];  // 引导代码
+  struct partition_table_entry partition_table[4];
+  uint16_t signature;  // 启动扇区的结束标志0x55,0xaa
+} __attribute__((packed));
+
+/* 派发给驱动的请求,由扇区相连、方向相同的若干 bio 合并而成 */
+struct request {
+  struct blk_queue* queue;
+  uint32_t lba;      // 起始扇区
+  uint32_t sec_cnt;  // 扇区数,不超过 queue->max_secs
+  bool write;
+  uint32_t seq;                // 入队的先后,范围重叠的请求按此顺序执行
+  struct list bios;            // 组成请求的 bio,按 lba 排列
+  struct list_elem queue_tag;  // 在 queue->requests 或 queue->inflight 中的结点
+};
+
+/* 一次块读写。bio 本身必须在内核内存中,buf 可以在提交者的用户空间,
+ * 这时提交者在完成前不能退出。完成时在派发线程中调用 end_io,不能长时间阻塞 */
+struct bio {
+  struct block_device* bdev;
+  struct blk_queue* queue;     // bdev->queue,走请求队列的驱动用
+  uint32_t lba;
+  uint32_t sec_cnt;
+  void* buf;
+  bool write;
+  int32_t error;               // 完成后为 0 表示成功,-1 表示失败
+  struct task_struct* owner;   // 提交者,buf 在用户空间时用它的页表访问
+  bio_end_io* end_io;
+  void* private;               // 给 end_io 用
+  struct list_elem tag;        // 在所属请求的 bios 中的结点
+  struct request rq;           // 作为请求的第一个 bio 时用,免得另外分配
+};
+
+/* 一块硬盘的请求队列 */
+struct blk_queue {
+  struct spinlock lock;     // 保护以下各项
+  struct list requests;     // 等待派发的请求,按 lba 升序
+  struct list inflight;     // 已派发未完成的请求,驱动可以同时做多个
+  uint32_t head_lba;        // 上一个派发的请求结束处,C-LOOK 从这里向后找
+  uint32_t seq;             // 下一个请求的顺序号
+  uint32_t max_secs;        // 一个请求最多的扇区数
+  bool contig_only;         // 只合并缓冲区也首尾相接的 bio,请求的数据在一段连续内存中
+  uint32_t nr_requests;     // 统计:派发的请求数
+  uint32_t nr_merges;       // 统计:合并进已有请求的 bio 数
+  void (*kick)(struct blk_queue* q);  // 有新请求时通知驱动,不能睡眠
+  void* driver_data;
+};
+
+/* 块设备的操作。read/write 同步读写,成功返回 0,出错返回 -1;
+ * flush 返回时之前完成的写都已落到设备上;submit 异步提交 bio */
+struct block_device_ops {
+  int32_t (*read)(struct block_device* bdev, uint32_t lba, void* buf,
+                  uint32_t sec_cnt);
+  int32_t (*write)(struct block_device* bdev, uint32_t lba, void* buf,
+                   uint32_t sec_cnt);
+  int32_t (*flush)(struct block_device* bdev);
+  void (*submit)(struct block_device* bdev, struct bio* bio);
+};
+
+/* 一个块设备,硬盘驱动把它嵌在自己的结构中.扇区固定 512 字节 */
+struct block_device {
+  char name[8];
+  uint32_t sectors;  // 可读写的扇区数
+  const struct block_device_ops* ops;
+  struct blk_queue queue;  // 走请求队列的设备用,ops 为 blk_queue_ops
+  struct partition prim_parts[4];   // 主分区(最多四个)
+  struct partition logic_parts[8];  // 逻辑分区可以支持无数个(此处支持8个)
+  struct list_elem bdev_tag;        // 在 bdev_list 中的结点
+};
+
+extern const struct block_device_ops blk_queue_ops;
+extern struct list bdev_list;
+extern struct list partition_list;
+extern struct rwlock partition_list_lock;
+
+void blk_init(void);
+void bdev_register(struct block_device* bdev);
+void bdev_scan_partitions(struct block_device* bdev);
+void bdev_print_partitions(void);
+void bdev_read(struct block_device* bdev, uint32_t lba, void* buf,
+               uint32_t sec_cnt);
+void bdev_write(struct block_device* bdev, uint32_t lba, void* buf,
+                uint32_t sec_cnt);
+int32_t bdev_flush(struct block_device* bdev);
+void bdev_submit(struct bio* bio);
+
+void blk_queue_init(struct blk_queue* q, uint32_t max_secs,
+                    void (*kick)(struct blk_queue* q), void* driver_data);
+void bio_init(struct bio* bio, struct block_device* bdev, uint32_t lba,
+              void* buf, uint32_t sec_cnt, bool write, bio_end_io* end_io,
+              void* private);
+void submit_bio(struct bio* bio);
+struct request* blk_fetch_request(struct blk_queue* q);
+void blk_end_request(struct request* rq, int32_t error);
+void bio_access_begin(struct bio* bio);
+void bio_access_end(struct bio* bio);
+int32_t blk_read_sectors(struct block_device* bdev, uint32_t* lbas,
+                         uint32_t cnt, void* buf);
+#endif /* DEVICE_BLK */
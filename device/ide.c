@@ -6,8 +6,10 @@
 #include "interrupt.h"
 #include "io.h"
 #include "memory.h"
+#include "pci.h"
 #include "stdio_kernel.h"
 #include "string.h"
+#include "thread.h"
 #include "timer.h"
 /*Command Block
  * registers(用于向硬盘驱动器写入命令字或者从硬盘控制器获得硬盘状态)*/
@@ -23,11 +25,30 @@
 /*Control Block registers(控制硬盘工作状态)*/
 #define reg_alt_status(channel) (channel->port_base + 0x206)
 #define reg_ctl(channel) reg_alt_status(channel)
+/*总线主控 DMA 寄存器,两个通道各占 8 个端口*/
+#define bm_cmd(channel) (channel->bmide_base + 0)
+#define bm_status(channel) (channel->bmide_base + 2)
+#define bm_prdt(channel) (channel->bmide_base + 4)  // 描述符表的物理地址
 
 /* reg_alt_status 寄存器的一些关键位 */
 #define BIT_ALT_STAT_BSY 0x80   // 硬盘忙
 #define BIT_ALT_STAT_DRDY 0x40  // 驱动器准备好
 #define BIT_ALT_STAT_DRQ 0x8    // 数据传输准备好了
+#define BIT_STAT_DF 0x20        // 驱动器故障
+#define BIT_STAT_ERR 0x1        // 上一条命令出错
+
+/* reg_ctl 寄存器的位 */
+#define BIT_CTL_SRST 0x4  // 软复位通道上的硬盘
+
+/* 总线主控寄存器的位 */
+#define BM_CMD_START 0x1    // 开始传输,清零则停止
+#define BM_CMD_READ 0x8     // 方向:从硬盘读到内存
+#define BM_STAT_ACTIVE 0x1  // 传输尚未结束
+#define BM_STAT_ERR 0x2     // 传输出错,写 1 清除
+#define BM_STAT_INTR 0x4    // 硬盘发出了中断,写 1 清除
+#define BM_STAT_SIMPLEX 0x80  // 两个通道不能同时 DMA
+#define PRD_EOT 0x8000      // 描述符表的最后一项
+#define PRD_MAX_CNT (PG_SIZE / sizeof(struct prd))
 
 /* device 寄存器的一些关键位 */
 #define BIT_DEV_MBS 0xa0  // 第 7 位和第 5 位固定为 1
@@ -38,42 +59,43 @@
 #define CMD_IDENTIFY 0xec      // identufy指令
 #define CMD_READ_SECTOR 0x20   // 读扇区指令
 #define CMD_WRITE_SECTOR 0x30  // 写扇区指令
-
-/* 定义可读写的最大扇区数,调试用的 */
-#define max_lba ((80 * 1024 * 1024 / 512) - 1)  // 只支持 80MB 硬盘
+#define CMD_READ_MULTIPLE 0xc4   // 多扇区模式读,每个 DRQ 块一次中断
+#define CMD_WRITE_MULTIPLE 0xc5  // 多扇区模式写
+#define CMD_SET_MULTIPLE 0xc6    // 设置一个 DRQ 块的扇区数
+#define CMD_READ_DMA 0xc8      // DMA 读扇区指令
+#define CMD_WRITE_DMA 0xca     // DMA 写扇区指令
+#define CMD_READ_SECTOR_EXT 0x24     // 以下是 48 位地址的版本
+#define CMD_READ_DMA_EXT 0x25
+#define CMD_READ_MULTIPLE_EXT 0x29
+#define CMD_WRITE_SECTOR_EXT 0x34
+#define CMD_WRITE_DMA_EXT 0x35
+#define CMD_WRITE_MULTIPLE_EXT 0x39
+
+#define LBA28_MAX 0x0fffffff     // 28 位地址能访问的最后一个扇区
+#define IDENTIFY_CAP_DMA 0x100   // IDENTIFY 第 49 字的第 8 位:支持 DMA
+#define IDENTIFY_CAP_LBA48 0x400  // IDENTIFY 第 83 字的第 10 位:支持 48 位地址
+
+/* 传送方式,用来在 rw_cmds 中选命令 */
+enum xfer_mode {
+  XFER_PIO,       // 一次中断一个扇区
+  XFER_MULTIPLE,  // 一次中断一个多扇区块
+  XFER_DMA
+};
+
+/* 读写命令,按 [传送方式][是否 48 位地址][是否写] 排列 */
+static const uint8_t rw_cmds[3][2][2] = {
+    {{CMD_READ_SECTOR, CMD_WRITE_SECTOR},
+     {CMD_READ_SECTOR_EXT, CMD_WRITE_SECTOR_EXT}},
+    {{CMD_READ_MULTIPLE, CMD_WRITE_MULTIPLE},
+     {CMD_READ_MULTIPLE_EXT, CMD_WRITE_MULTIPLE_EXT}},
+    {{CMD_READ_DMA, CMD_WRITE_DMA}, {CMD_READ_DMA_EXT, CMD_WRITE_DMA_EXT}}};
+
+#define DISK_TIMEOUT_MS 5000  // 等待硬盘中断的最长时间
+#define BSY_SPIN_US 100        // 查看状态时先自旋等待 BSY 清除的时间
 
 uint8_t channel_cnt;             // 按硬盘数计算的通道数
 struct ide_channel channels[2];  // 有两个ide通道
 
-/* 用于记录总扩展分区的起始lba,初始为 0,partition_scan 时以此为标记 */
-int32_t ext_lba_base = 0;
-
-uint8_t p_no = 0, l_no = 0;  // 用来记录硬盘主分区和逻辑分区的下标
-
-struct list partition_list;  // 分区队列
-
-/*构建一个16字节大小的结构体，用来存分区表项*/
-struct partition_table_entry {
-  uint8_t bootable;    // 是否可引导
-  uint8_t start_head;  // 起始磁头号
-  uint8_t start_sec;   // 起始扇区号
-  uint8_t start_chs;   // 起始柱面号
-  uint8_t fs_type;     // 分区类型
-  uint8_t end_head;    // 结束磁头号
-  uint8_t end_sec;     // 结束扇区号
-  uint8_t end_chs;     // 结束柱面号
-  /*重点关注的是下面两项*/
-  uint32_t start_lba;       // 本分区起始扇区的lba地址
-  uint32_t sec_cnt;         // 本分区的扇区数目
-} __attribute__((packed));  // gcc拓展语法，保证这个结构体占16字节
-
-/*引导扇区mbr或ebr*/
-struct boot_sector {
-  uint8_t other[446];  // 引导代码
-  struct partition_table_entry partition_table[4];
-  uint16_t signature;  // 启动扇区的结束标志0x55,0xaa
-} __attribute__((packed));
-
 /*选择的读写的硬盘*/
 static void select_disk(struct disk* hd) {
   uint8_t reg_device = BIT_DEV_MBS | BIT_DEV_LBA;  // 固定位和LBA
@@ -83,10 +105,34 @@ static void select_disk(struct disk* hd) {
   outb(reg_dev(hd->my_channel), reg_device);
 }
 
-/* 向硬盘控制器写入起始扇区地址及要读写的扇区数 */
-static void select_sector(struct disk* hd, uint32_t lba, uint8_t sec_cnt) {
-  ASSERT(lba <= max_lba);
+/* 读写 lba 开始的 sec_cnt 个扇区是否要用 48 位地址,
+ * 28 位够用时仍用 28 位,少写几次端口 */
+static bool need_lba48(struct disk* hd, uint32_t lba, uint32_t sec_cnt) {
+  return hd->lba48 && lba + sec_cnt - 1 > LBA28_MAX;
+}
+
+/* 向硬盘控制器写入起始扇区地址及要读写的扇区数(1~256),
+ * lba48 为 true 时按 48 位地址写 */
+static void select_sector(struct disk* hd, uint32_t lba, uint32_t sec_cnt,
+                          bool lba48) {
+  ASSERT(sec_cnt > 0 && sec_cnt <= 256);
   struct ide_channel* channel = hd->my_channel;
+  uint8_t dev_bit = hd->dev_no == 1 ? BIT_DEV_DEV : 0;
+  if (lba48) {
+    /* 每个寄存器先写高字节再写低字节,扇区数 256 就是 0x100;
+     * lba 只有 32 位,第 5、6 字节为 0 */
+    outb(reg_sect_cnt(channel), sec_cnt >> 8);
+    outb(reg_lba_l(channel), lba >> 24);
+    outb(reg_lba_m(channel), 0);
+    outb(reg_lba_h(channel), 0);
+    outb(reg_sect_cnt(channel), sec_cnt);
+    outb(reg_lba_l(channel), lba);
+    outb(reg_lba_m(channel), lba >> 8);
+    outb(reg_lba_h(channel), lba >> 16);
+    outb(reg_dev(channel), BIT_DEV_MBS | BIT_DEV_LBA | dev_bit);
+    return;
+  }
+
   /*写入要读入的扇区数(0,表示256)*/
   outb(reg_sect_cnt(channel), sec_cnt);
 
@@ -95,12 +141,14 @@ static void select_sector(struct disk* hd, uint32_t lba, uint8_t sec_cnt) {
   outb(reg_lba_m(channel), lba >> 8);
   outb(reg_lba_h(channel), lba >> 16);
 
-  outb(reg_dev(channel), BIT_DEV_MBS | BIT_DEV_LBA |
-                             (hd->dev_no == 1 ? BIT_DEV_DEV : 0) | lba >> 24);
+  outb(reg_dev(channel), BIT_DEV_MBS | BIT_DEV_LBA | dev_bit | lba >> 24);
 }
 
 /* 向通道 channel 发命令 cmd */
 static void cmd_out(struct ide_channel* channel, uint8_t cmd) {
+  /* 清掉上次等待超时后才到的中断留下的计数,免得这次的等待立即返回 */
+  while (sema_try_down(&channel->disk_done)) {
+  }
   channel->expecting_intr = true;  // 置为true,告诉中断处理程序，正在等待cmd结果
   outb(reg_cmd(channel), cmd);
 }
@@ -129,96 +177,301 @@ static void write_to_sector(struct disk* hd, void* buf, uint8_t sec_cnt) {
   outsw(reg_data(hd->my_channel), buf, size_in_byte / 2);
 }
 
-/*等待30s(每10ms检查一次)*/
-static bool busy_wait(struct disk* hd) {
-  struct ide_channel* channel = hd->my_channel;
-  uint16_t time_limit = 30 * 1000;
-  while (time_limit -= 10 >= 0) {
-    if (!(inb(reg_status(channel)) & BIT_ALT_STAT_BSY)) {
-      return (inb(reg_status(channel)) & BIT_ALT_STAT_DRQ);
-    } else {
-      mtime_sleep(10);
-    }
+/* 等待通道上命令完成的中断,最多等 m_seconds 毫秒,超时返回 false.
+ * 超时后不再期待这次中断,由随后的 wait_ready 查看状态寄存器 */
+static bool wait_disk_done(struct ide_channel* channel, uint32_t m_seconds) {
+  if (sema_down_timeout(&channel->disk_done, m_seconds)) {
+    return true;
   }
+  enum intr_status old_status = intr_disable();
+  channel->expecting_intr = false;
+  intr_set_status(old_status);
   return false;
 }
 
-/*从硬盘读取sec_cnt个扇区到buf*/
-void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt) {
-  ASSERT(lba <= max_lba);
-  ASSERT(sec_cnt > 0);
-  lock_acquire(&hd->my_channel->lock);  // 一个通道同时只允许操作一个磁盘
+/* 等硬盘清除 BSY,返回此时的状态寄存器,超过 m_seconds 毫秒仍忙时返回的状态带 BSY.
+ * 中断到来后状态几乎总是已就绪,先在备用状态寄存器上自旋 BSY_SPIN_US 微秒,
+ * 读它不会清除硬盘的中断;仍忙时让出处理器,由时钟判断是否超时 */
+static uint8_t wait_not_busy(struct ide_channel* channel, uint32_t m_seconds) {
+  uint64_t stamp = rdtsc();
+  uint32_t spin_us = 0;
+  uint8_t status;
+  while ((status = inb(reg_alt_status(channel))) & BIT_ALT_STAT_BSY) {
+    if (spin_us >= BSY_SPIN_US) {
+      break;
+    }
+    asm volatile("pause");
+    spin_us += tsc_elapsed_us(&stamp);
+  }
+  uint32_t deadline = ticks + msecs_to_ticks(m_seconds);
+  while ((status & BIT_ALT_STAT_BSY) &&
+         (int32_t)(*(volatile uint32_t*)&ticks - deadline) < 0) {
+    thread_yield();
+    status = inb(reg_alt_status(channel));
+  }
+  return status;
+}
 
-  /*1.选择操作磁盘*/
-  select_disk(hd);
-  uint32_t secs_op;        // 每次操作的扇区数
-  uint32_t secs_done = 0;  // 已完成的扇区数
-  while (secs_done < sec_cnt) {
-    if ((secs_done + 256) <= sec_cnt) {
-      secs_op = 256;
+/* 检查硬盘在 lba 处的操作 op 是否成功,need_drq 为 true 时还要求硬盘准备好传数据.
+ * 超时、出错或没有数据请求时打印状态和错误寄存器,返回 false */
+static bool wait_ready(struct disk* hd, bool need_drq, const char* op,
+                       uint32_t lba) {
+  struct ide_channel* channel = hd->my_channel;
+  uint8_t status = wait_not_busy(channel, DISK_TIMEOUT_MS);
+  if (status & BIT_ALT_STAT_BSY) {
+    printk("%s: %s at lba %d timed out, status 0x%x\n", hd->bdev.name, op,
+           lba, status);
+    return false;
+  }
+  if ((status & (BIT_STAT_ERR | BIT_STAT_DF)) ||
+      (need_drq && !(status & BIT_ALT_STAT_DRQ))) {
+    printk("%s: %s at lba %d failed, status 0x%x error 0x%x\n",
+           hd->bdev.name, op, lba, status, inb(reg_error(channel)));
+    return false;
+  }
+  return true;
+}
+
+/* 把 buf 开始的 len 字节接在 channel 描述符表的前 *prd_cnt 项之后,
+ * 每项不超过一页,物理上相连且在同一个 64KB 内的合并为一项 */
+static void prd_add(struct ide_channel* channel, uint32_t* prd_cnt, void* buf,
+                    uint32_t len) {
+  struct prd* prd = channel->prd_table;
+  uint32_t vaddr = (uint32_t)buf;
+  while (len > 0) {
+    uint32_t size = PG_SIZE - (vaddr & 0xfff);  // 本页剩下的部分
+    if (size > len) {
+      size = len;
+    }
+    uint32_t phy_addr = addr_v2p(vaddr);
+    struct prd* last = *prd_cnt > 0 ? &prd[*prd_cnt - 1] : NULL;
+    if (last != NULL && last->phy_addr + last->byte_cnt == phy_addr &&
+        last->byte_cnt + size < 0x10000 &&
+        (last->phy_addr >> 16) == ((phy_addr + size - 1) >> 16)) {
+      last->byte_cnt += size;
     } else {
-      secs_op = sec_cnt - secs_done;
+      ASSERT(*prd_cnt < PRD_MAX_CNT);
+      prd[*prd_cnt].phy_addr = phy_addr;
+      prd[*prd_cnt].byte_cnt = size;
+      prd[*prd_cnt].flags = 0;
+      (*prd_cnt)++;
     }
+    vaddr += size;
+    len -= size;
+  }
+}
 
-    /*2.写入待读入的扇区数和起始扇区号*/
-    select_sector(hd, lba + secs_done, secs_op);
-
-    /*3.执行的命令写入reg_cmd寄存器*/
-    cmd_out(hd->my_channel, CMD_READ_SECTOR);
+/* 按请求 rq 中各个 bio 的缓冲区建立 channel 的描述符表.
+ * 请求不超过 256 扇区,每扇区最多跨两页,表项不会超过一页.
+ * 有缓冲区不是按字对齐时不能 DMA,返回 false */
+static bool prd_build(struct ide_channel* channel, struct request* rq) {
+  uint32_t prd_cnt = 0;
+  struct list_elem* elem = rq->bios.head.next;
+  while (elem != &rq->bios.tail) {
+    struct bio* bio = elem2entry(struct bio, tag, elem);
+    if ((uint32_t)bio->buf & 1) {
+      return false;
+    }
+    bio_access_begin(bio);  // 用户缓冲区要在提交者的页表下求物理地址
+    prd_add(channel, &prd_cnt, bio->buf, bio->sec_cnt * 512);
+    bio_access_end(bio);
+    elem = elem->next;
+  }
+  channel->prd_table[prd_cnt - 1].flags = PRD_EOT;
+  return true;
+}
 
-    sema_down(&hd->my_channel->disk_done);
+/* 让 hd 进入多扇区模式,一个 DRQ 块 multiple 个扇区,硬盘不接受时返回 false */
+static bool set_multiple_mode(struct disk* hd, uint8_t multiple) {
+  struct ide_channel* channel = hd->my_channel;
+  select_disk(hd);
+  outb(reg_sect_cnt(channel), multiple);
+  cmd_out(channel, CMD_SET_MULTIPLE);
+  wait_disk_done(channel, DISK_TIMEOUT_MS);  // 无数据的命令完成时发一次中断
+  uint8_t status = wait_not_busy(channel, DISK_TIMEOUT_MS);
+  return !(status & (BIT_ALT_STAT_BSY | BIT_STAT_ERR));
+}
 
-    /*4.检测硬盘状态是否可读*/
-    /*醒来后开始执行下面代码*/
-    if (!busy_wait(hd)) {  // 若失败
-      char error[64];
-      sprintf(error, "%s read sector %d failed!!!!\n", hd->name, lba);
-      PANIC(error);
+/* 软复位通道上的硬盘,DMA 出错或超时后让硬盘回到空闲状态,
+ * 复位可能清掉多扇区模式,再重新设置一遍 */
+static void channel_reset(struct ide_channel* channel) {
+  outb(reg_ctl(channel), BIT_CTL_SRST);
+  udelay(5);
+  outb(reg_ctl(channel), 0);
+  uint32_t wait_ms = 0;
+  while ((inb(reg_alt_status(channel)) & BIT_ALT_STAT_BSY) &&
+         wait_ms++ < DISK_TIMEOUT_MS) {
+    udelay(1000);
+  }
+  uint8_t dev_no;
+  for (dev_no = 0; dev_no < 2; dev_no++) {
+    struct disk* hd = &channel->devices[dev_no];
+    if (hd->multiple != 0 && !set_multiple_mode(hd, hd->multiple)) {
+      hd->multiple = 0;
     }
-
-    /*5.把数据从硬盘缓存区读出*/
-    read_from_sector(hd, (void*)((uint32_t)buf + secs_done * 512), secs_op);
-    secs_done += secs_op;
   }
-  lock_release(&hd->my_channel->lock);
 }
 
-/*从硬盘读取sec_cnt个扇区到buf*/
-void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt) {
-  ASSERT(lba <= max_lba);
-  ASSERT(sec_cnt > 0);
-  lock_acquire(&hd->my_channel->lock);  // 一个通道同时只允许操作一个磁盘
+/* 按已建好的描述符表,用 DMA 做请求 rq.
+ * 硬盘在整个传输结束后才发一次中断,等待期间处理器可以运行别的任务.
+ * 出错或超时返回 false,此后这块硬盘改用 PIO */
+static bool dma_transfer(struct disk* hd, struct request* rq) {
+  struct ide_channel* channel = hd->my_channel;
+  uint8_t direction = rq->write ? 0 : BM_CMD_READ;
+  outl(bm_prdt(channel), addr_v2p((uint32_t)channel->prd_table));
+  outb(bm_cmd(channel), direction);
+  outb(bm_status(channel), BM_STAT_ERR | BM_STAT_INTR);  // 清除上次的状态
+
+  bool lba48 = need_lba48(hd, rq->lba, rq->sec_cnt);
+  select_sector(hd, rq->lba, rq->sec_cnt, lba48);
+  cmd_out(channel, rw_cmds[XFER_DMA][lba48][rq->write]);
+  outb(bm_cmd(channel), direction | BM_CMD_START);
+
+  bool intr = wait_disk_done(channel, DISK_TIMEOUT_MS);
+
+  uint8_t bm_stat = inb(bm_status(channel));
+  outb(bm_cmd(channel), direction);  // 停止传输
+  outb(bm_status(channel), BM_STAT_ERR | BM_STAT_INTR);
+  const char* op = rq->write ? "dma write" : "dma read";
+  if (!wait_ready(hd, false, op, rq->lba)) {
+    /* wait_ready 已报告硬盘的状态 */
+  } else if (!intr || (bm_stat & (BM_STAT_ERR | BM_STAT_ACTIVE)) ||
+             !(bm_stat & BM_STAT_INTR)) {
+    printk("%s: %s at lba %d failed, bus master status 0x%x\n",
+           hd->bdev.name, op, rq->lba, bm_stat);
+  } else {
+    return true;
+  }
+  printk("%s: falling back to pio\n", hd->bdev.name);
+  hd->dma = false;
+  channel_reset(channel);
+  return false;
+}
 
-  /*1.选择操作磁盘*/
-  select_disk(hd);
-  uint32_t secs_op;        // 每次操作的扇区数
-  uint32_t secs_done = 0;  // 已完成的扇区数
-  while (secs_done < sec_cnt) {
-    if ((secs_done + 256) <= sec_cnt) {
-      secs_op = 256;
+/* PIO 时在请求的各个 bio 之间移动的位置 */
+struct rq_cursor {
+  struct list_elem* elem;  // 当前的 bio
+  uint32_t secs_done;      // 当前 bio 中已传送的扇区数
+};
+
+/* 从 cursor 处起在数据端口和 bio 的缓冲区之间传送 sec_cnt 个扇区,
+ * 跨过 bio 的边界时分段进行 */
+static void pio_move(struct disk* hd, struct rq_cursor* cursor,
+                     uint32_t sec_cnt, bool write) {
+  while (sec_cnt > 0) {
+    struct bio* bio = elem2entry(struct bio, tag, cursor->elem);
+    uint32_t secs = bio->sec_cnt - cursor->secs_done;
+    if (secs > sec_cnt) {
+      secs = sec_cnt;
+    }
+    void* buf = (void*)((uint32_t)bio->buf + cursor->secs_done * 512);
+    bio_access_begin(bio);
+    if (write) {
+      write_to_sector(hd, buf, secs);
     } else {
-      secs_op = sec_cnt - secs_done;
+      read_from_sector(hd, buf, secs);
+    }
+    bio_access_end(bio);
+    cursor->secs_done += secs;
+    sec_cnt -= secs;
+    if (cursor->secs_done == bio->sec_cnt) {
+      cursor->elem = cursor->elem->next;
+      cursor->secs_done = 0;
     }
+  }
+}
 
-    /*2.写入待读入的扇区数和起始扇区号*/
-    select_sector(hd, lba + secs_done, secs_op);
+/* 用 PIO 做请求 rq,超时或出错时复位通道并返回 false.
+ * 数据按 DRQ 块传送,多扇区模式下一块是 hd->multiple 个扇区,否则一个扇区.
+ * 读时硬盘每准备好一块发一次中断;写时第一块直接送,之后每写完一块发一次中断 */
+static bool pio_transfer(struct disk* hd, struct request* rq) {
+  struct ide_channel* channel = hd->my_channel;
+  const char* op = rq->write ? "write" : "read";
+  struct rq_cursor cursor = {rq->bios.head.next, 0};
+  uint32_t secs_left = rq->sec_cnt;
+  uint32_t block = hd->multiple == 0 ? 1 : hd->multiple;
+  enum xfer_mode mode = hd->multiple == 0 ? XFER_PIO : XFER_MULTIPLE;
+  bool lba48 = need_lba48(hd, rq->lba, rq->sec_cnt);
+
+  /*写入扇区数和起始扇区号,再发命令*/
+  select_sector(hd, rq->lba, rq->sec_cnt, lba48);
+  cmd_out(channel, rw_cmds[mode][lba48][rq->write]);
+
+  while (secs_left > 0) {
+    uint32_t secs = secs_left < block ? secs_left : block;
+    if (!rq->write) {
+      wait_disk_done(channel, DISK_TIMEOUT_MS);
+    }
+    /*检测硬盘是否准备好传送这一块*/
+    if (!wait_ready(hd, true, op, rq->lba)) {
+      channel_reset(channel);
+      return false;
+    }
+    secs_left -= secs;
+    /* 传完这一块后的中断可能在 insw/outsw 返回前就到来,要先置上标记.
+     * 读完最后一块后没有中断 */
+    if (rq->write || secs_left > 0) {
+      channel->expecting_intr = true;
+    }
+    pio_move(hd, &cursor, secs, rq->write);
+    if (rq->write) {
+      wait_disk_done(channel, DISK_TIMEOUT_MS);
+    }
+  }
+  /* 最后一块之后查看命令是否成功 */
+  if (!wait_ready(hd, false, op, rq->lba)) {
+    channel_reset(channel);
+    return false;
+  }
+  return true;
+}
 
-    /*3.执行的命令写入reg_cmd寄存器*/
-    cmd_out(hd->my_channel, CMD_WRITE_SECTOR);
+/* 在硬盘 hd 上做请求 rq,能 DMA 时由控制器直接读写各个 bio 的缓冲区,
+ * 否则或失败时用 PIO */
+static void ide_do_request(struct disk* hd, struct request* rq) {
+  select_disk(hd);
+  bool ok = hd->dma && prd_build(hd->my_channel, rq) && dma_transfer(hd, rq);
+  if (!ok) {
+    ok = pio_transfer(hd, rq);
+  }
+  blk_end_request(rq, ok ? 0 : -1);
+}
 
-    /*4.检测硬盘状态是否可读*/
-    if (!busy_wait(hd)) {  // 若失败
-      char error[64];
-      sprintf(error, "%s write sector %d failed!!!!\n", hd->name, lba);
-      PANIC(error);
+/* 取通道上下一个要做的请求,两块硬盘轮流,都没有时返回 NULL */
+static struct request* channel_fetch(struct ide_channel* channel,
+                                     struct disk** hd) {
+  uint8_t idx;
+  for (idx = 0; idx < 2; idx++) {
+    *hd = &channel->devices[(channel->next_dev + idx) % 2];
+    struct request* rq = blk_fetch_request(&(*hd)->bdev.queue);
+    if (rq != NULL) {
+      channel->next_dev = ((*hd)->dev_no + 1) % 2;
+      return rq;
     }
+  }
+  return NULL;
+}
 
-    /*5.把数据写入硬盘缓存*/
-    write_to_sector(hd, (void*)((uint32_t)buf + secs_done * 512), secs_op);
-    sema_down(&hd->my_channel->disk_done);
-    secs_done += secs_op;
+/* 通道的派发线程:逐个做两块硬盘队列中的请求,都空时睡眠.
+ * 提交者持队列锁入队后才唤醒,检查和睡眠之间不会漏掉 */
+static void ide_dispatch(void* arg) {
+  struct ide_channel* channel = arg;
+  while (1) {
+    struct disk* hd;
+    struct request* rq;
+    enum intr_status old_status = wait_queue_lock(&channel->dispatch_wq);
+    while ((rq = channel_fetch(channel, &hd)) == NULL) {
+      wait_queue_sleep(&channel->dispatch_wq, false, 0);
+    }
+    wait_queue_unlock(&channel->dispatch_wq, old_status);
+    ide_do_request(hd, rq);
   }
-  lock_release(&hd->my_channel->lock);
+}
+
+/*请求队列有新请求时唤醒所在通道的派发线程*/
+static void ide_kick(struct blk_queue* q) {
+  struct disk* hd = q->driver_data;
+  wake_up(&hd->my_channel->dispatch_wq, 1);
 }
 
 /*硬盘中断处理程序*/
@@ -229,12 +482,19 @@ void intr_hd_handler(uint8_t irq_no) {
   ASSERT(channel->irq_no == irq_no);
   if (channel->expecting_intr) {
     channel->expecting_intr = false;
-    sema_up(&channel->disk_done);
+    channel->intr_cnt++;
     // 读取状态寄存器使硬盘控制器认为此次的中断已被处理,从而硬盘可以继续执行新的读写
     inb(reg_status(channel));
+    tasklet_schedule(&channel->intr_tasklet);  // 唤醒驱动程序放到中断返回前做
   }
 }
 
+/*硬盘中断的 tasklet,唤醒等待本通道的驱动程序*/
+static void hd_tasklet_func(uint32_t data) {
+  struct ide_channel* channel = (struct ide_channel*)data;
+  sema_up(&channel->disk_done);
+}
+
 /* 将 dst 中 len 个相邻字节交换位置后存入 buf */
 static void swap_pairs_bytes(const char* dst, char* buf, uint32_t len) {
   uint8_t idx;
@@ -245,16 +505,24 @@ static void swap_pairs_bytes(const char* dst, char* buf, uint32_t len) {
   buf[idx] = '\0';
 }
 
-static void identify_disk(struct disk* hd) {
+/* 获取硬盘 hd 的参数,通道上没有这块硬盘时返回 false */
+static bool identify_disk(struct disk* hd) {
   char id_info[512];
   select_disk(hd);
+  udelay(1);  // 选择硬盘后状态寄存器要过 400ns 才有效
+  /* 没有接硬盘时总线悬空或由另一块硬盘代答,状态读出来是全 1 或全 0 */
+  uint8_t status = inb(reg_alt_status(hd->my_channel));
+  if (status == 0xff || status == 0) {
+    printk("disk %s not present\n", hd->bdev.name);
+    return false;
+  }
   cmd_out(hd->my_channel, CMD_IDENTIFY);
 
-  sema_down(&hd->my_channel->disk_done);
+  wait_disk_done(hd->my_channel, DISK_TIMEOUT_MS);
 
-  if (!busy_wait(hd)) {  // 若失败
+  if (!wait_ready(hd, true, "identify", 0)) {  // 若失败
     char error[64];
-    sprintf(error, "%s identify failed!!!!!!\n", hd->name);
+    sprintf(error, "%s identify failed!!!!!!\n", hd->bdev.name);
     PANIC(error);
   }
 
@@ -262,71 +530,36 @@ static void identify_disk(struct disk* hd) {
   char buf[64];
   uint8_t sn_start = 10 * 2, sn_len = 20, md_start = 27 * 2, md_len = 40;
   swap_pairs_bytes(&id_info[sn_start], buf, sn_len);
-  printk("disk %s info:\nSN: %s\n", hd->name, buf);
+  printk("disk %s info:\nSN: %s\n", hd->bdev.name, buf);
   memset(buf, 0, sizeof(buf));
   swap_pairs_bytes(&id_info[md_start], buf, md_len);
   printk("MODULE: %s\n", buf);
-  uint32_t sectors = *(uint32_t*)&id_info[60 * 2];
-  printk("SECTORS: %d\n", sectors);
-  printk("CAPACITY: %dMB\n", sectors * 512 / 1024 / 1024);
-}
-
-/* 扫描硬盘 hd 中地址为 ext_lba 的扇区中的所有分区 */
-static void partition_scan(struct disk* hd, uint32_t ext_lab) {
-  struct boot_sector* bs =
-      (struct boot_sector*)sys_malloc(sizeof(struct boot_sector));
-
-  ide_read(hd, ext_lab, bs, 1);
-  uint8_t part_idx = 0;
-  struct partition_table_entry* p = bs->partition_table;
-
-  /*遍历分区表四个分区表项*/
-  while (part_idx++ < 4) {
-    if (p->fs_type == 0x5) {  // 若为拓展分区
-      /* 子扩展分区的 start_lba 是相对于主引导扇区中的总扩展分区地址*/
-      if (ext_lba_base != 0) {
-        partition_scan(hd, p->start_lba + ext_lba_base);
-      } else {
-        ext_lba_base = p->start_lba;
-        partition_scan(hd, p->start_lba);
-      }
-    } else if (p->fs_type != 0) {  // 若是有效的分区类型
-      if (ext_lab == 0) {
-        hd->prim_parts[p_no].start_lba = ext_lab + p->start_lba;
-        hd->prim_parts[p_no].sec_cnt = p->sec_cnt;
-        hd->prim_parts[p_no].my_disk = hd;
-        list_append(&partition_list, &hd->prim_parts[p_no].part_tag);
-        sprintf(hd->prim_parts[p_no].name, "%s%d", hd->name, p_no + 1);
-        p_no++;
-        ASSERT(p_no < 4);
-      } else {
-        hd->logic_parts[l_no].start_lba = ext_lab + p->start_lba;
-        hd->logic_parts[l_no].sec_cnt = p->sec_cnt;
-        hd->logic_parts[l_no].my_disk = hd;
-        list_append(&partition_list, &hd->logic_parts[l_no].part_tag);
-        sprintf(hd->logic_parts[l_no].name, "%s%d", hd->name,
-                l_no + 5);  // 逻辑分区是从5开始的
-        l_no++;
-        if (l_no >= 8) {  // 只支持 8 个逻辑分区,避免数组越界
-          return;
-        }
-      }
+  /* 第 60~61 字是 28 位地址下的扇区数,支持 48 位地址时以第 100~103 字为准,
+   * 读写接口的 lba 是 32 位的,超过 2TB 的部分用不到 */
+  uint16_t cmd_sets = *(uint16_t*)&id_info[83 * 2];
+  hd->lba48 = cmd_sets & IDENTIFY_CAP_LBA48;
+  hd->bdev.sectors = *(uint32_t*)&id_info[60 * 2];
+  if (hd->lba48) {
+    hd->bdev.sectors = *(uint32_t*)&id_info[100 * 2];
+    if (*(uint32_t*)&id_info[102 * 2] != 0) {
+      hd->bdev.sectors = 0xffffffff;
     }
-    p++;
   }
-  sys_free(bs);
-}
-
-/* 打印分区信息 */
-static bool partition_info(struct list_elem* pelem, int arg UNUSED) {
-  struct partition* part = elem2entry(struct partition, part_tag, pelem);
-
-  printk(" %s start_lba:0x%x, sec_cnt:0x%x\n", part->name, part->start_lba,
-         part->sec_cnt);
-
-  /* 在此处 return false 与函数本身功能无关,
-   * 只是为了让主调函数 list_traversal 继续向下遍历元素 */
-  return false;
+  printk("SECTORS: %d%s\n", hd->bdev.sectors, hd->lba48 ? " (lba48)" : "");
+  printk("CAPACITY: %dMB\n", hd->bdev.sectors / 2048);
+  uint16_t capabilities = *(uint16_t*)&id_info[49 * 2];
+  hd->dma = hd->my_channel->bmide_base != 0 &&
+            (capabilities & IDENTIFY_CAP_DMA);
+  printk("DMA: %s\n", hd->dma ? "yes" : "no");
+
+  /* 第 47 字低 8 位是一个 DRQ 块最多的扇区数,为 0 表示不支持多扇区模式 */
+  uint8_t max_multiple = id_info[47 * 2];
+  hd->multiple = 0;
+  if (max_multiple > 0 && set_multiple_mode(hd, max_multiple)) {
+    hd->multiple = max_multiple;
+  }
+  printk("MULTIPLE: %d sectors per block\n", hd->multiple);
+  return true;
 }
 
 /*硬盘初始化*/
@@ -334,11 +567,23 @@ void ide_init() {
   printk("ide_init start\n");
   uint8_t hd_cnt = *((uint8_t*)(0x475));  // 获取硬盘的数量
   ASSERT(hd_cnt > 0);
-  list_init(&partition_list);
   channel_cnt = DIV_ROUND_UP(hd_cnt, 2);  // 计算需要的通道数量
   struct ide_channel* channel;
   uint8_t channel_no = 0, dev_no = 0;
 
+  /* PCI 上的 IDE 控制器支持总线主控时,BAR4 是两个通道的 DMA 寄存器 */
+  uint16_t bmide_base = 0;
+  struct pci_dev ide_pci;
+  if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide_pci) &&
+      (ide_pci.prog_if & 0x80)) {
+    bmide_base = pci_bar(&ide_pci, 4);
+    pci_enable(&ide_pci, PCI_CMD_IO | PCI_CMD_MASTER);
+    printk("bus master ide: %x:%x at port 0x%x\n", ide_pci.vendor_id,
+           ide_pci.device_id, bmide_base);
+  }
+  /* 只能单通道 DMA 的控制器上,只让主通道 DMA,两个通道才能同时工作 */
+  bool simplex = bmide_base != 0 && (inb(bmide_base + 2) & BM_STAT_SIMPLEX);
+
   /*处理每个通道上的硬盘*/
   while (channel_no < channel_cnt) {
     channel = &channels[channel_no];
@@ -355,29 +600,45 @@ void ide_init() {
         break;
     }
     channel->expecting_intr = false;  // 未向硬盘写入指令时不期待硬盘的中断
-    lock_init(&channel->lock);
+    channel->intr_cnt = 0;
     sema_init(&channel->disk_done, 0);
+    wait_queue_init(&channel->dispatch_wq);
+    channel->next_dev = 0;
+    tasklet_init(&channel->intr_tasklet, hd_tasklet_func, (uint32_t)channel);
+    channel->bmide_base = 0;
+    channel->prd_table = NULL;
+    if (bmide_base != 0 && !(simplex && channel_no != 0)) {
+      channel->prd_table = get_kernel_pages(1);
+      if (channel->prd_table != NULL) {
+        channel->bmide_base = bmide_base + channel_no * 8;
+      }
+    }
     register_handler(channel->irq_no, intr_hd_handler);
+    pic_unmask(channel->irq_no - 0x20);  // pic_init 只打开了主通道的 IRQ14
 
     while (dev_no < 2) {
       struct disk* hd = &channel->devices[dev_no];
       hd->my_channel = channel;
       hd->dev_no = dev_no;
-      sprintf(hd->name, "sd%c", 'a' + channel_no * 2 + dev_no);
-      identify_disk(hd);  // 获取硬盘参数
-      if (dev_no != 0) {  // 主盘是裸盘，不处理
-        partition_scan(hd, 0);
+      sprintf(hd->bdev.name, "sd%c", 'a' + channel_no * 2 + dev_no);
+      hd->bdev.ops = &blk_queue_ops;
+      hd->present = identify_disk(hd);  // 获取硬盘参数
+      /* 一条命令最多 256 扇区 */
+      blk_queue_init(&hd->bdev.queue, 256, ide_kick, hd);
+      if (hd->present) {
+        bdev_register(&hd->bdev);
       }
-      p_no = 0;
-      l_no = 0;
       dev_no++;
     }
     dev_no = 0;  // 置零，为下一个循环使用(下一个channel)
 
+    /* 此后的读写都经请求队列由派发线程完成,两个通道各有一个,可以同时读写 */
+    channel->dispatcher = thread_start(channel->name, 31, ide_dispatch, channel);
+    if (channel->devices[1].present) {
+      bdev_scan_partitions(&channel->devices[1].bdev);  // 主盘是裸盘，不处理
+    }
+
     channel_no++;
   }
-  printk("\nall partition info\n");
-  list_traversal(&partition_list, partition_info, (int)NULL);
-
   printk("ide_init done\n");
 }
\ No newline at end of file
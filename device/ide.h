@@ -1,48 +1,49 @@
 #ifndef DEVICE_IDE
 #define DEVICE_IDE
-/*分区结构体*/
-#include "bitmap.h"
+#include "blk.h"
 #include "list.h"
+#include "softirq.h"
 #include "stdint.h"
 #include "sync.h"
-struct partition {
-  uint32_t start_lba;          // 起始扇区
-  uint32_t sec_cnt;            // 扇区数
-  struct disk* my_disk;        // 分区所属硬盘
-  struct list_elem part_tag;   // 用于队列中的标记
-  char name[8];                // 分区名称
-  struct super_block* sb;      // 超级快
-  struct bitmap block_bitmap;  // 块位图
-  struct bitmap inode_bitmap;  // inode节点位图
-  struct list open_inodes;     // 本分区打开的inode节点队列
-};
 
 /*硬盘结构*/
 struct disk {
-  char name[8];                    // 本硬盘的名称
+  struct block_device bdev;        // 名称、扇区数、请求队列和分区
   struct ide_channel* my_channel;  // 此块硬盘归属的ide通道
   uint8_t dev_no;                  // 本硬盘是主还是从
-  struct partition prim_parts[4];  // 主分区(最多四个)
-  struct partition logic_parts[8];  // 逻辑分区可以支持无数个(此处支持8个)
+  bool present;                    // 通道上是否接了这块硬盘
+  bool lba48;                      // 是否支持 48 位地址
+  bool dma;                        // 是否用总线主控 DMA 读写,出错后退回 PIO
+  uint8_t multiple;                // 多扇区模式下一个 DRQ 块的扇区数,0 表示未启用
 };
 
+/* 物理区域描述符,描述 DMA 的一段物理内存,不能跨 64KB 边界 */
+struct prd {
+  uint32_t phy_addr;  // 起始物理地址,必须按字对齐
+  uint16_t byte_cnt;  // 字节数,0 表示 64KB
+  uint16_t flags;     // 最高位为 1 表示最后一项
+} __attribute__((packed));
+
 /*ata通道*/
 struct ide_channel {
   char name[8];                // 本ata通道名称
   uint16_t port_base;          // 本通道其实端口号
   uint8_t irq_no;              // 本通道所用的中断号
-  struct lock lock;            // 通道锁
   bool expecting_intr;         // 表示等待硬盘的中断
+  uint32_t intr_cnt;           // 收到的硬盘中断数,统计用
   struct semaphore disk_done;  // 用于阻塞，唤醒驱动程序
+  struct tasklet intr_tasklet;  // 在中断返回前唤醒驱动程序
+  uint16_t bmide_base;          // 总线主控寄存器的端口基址,为 0 表示不能 DMA
+  struct prd* prd_table;        // DMA 用的物理区域描述符表,占一页
+  struct wait_queue dispatch_wq;  // 两块硬盘的队列都空时派发线程在此等待
+  struct task_struct* dispatcher;  // 派发线程,通道上同时只做一个请求
+  uint8_t next_dev;                // 下一次先看哪块硬盘的队列,两块轮流
   struct disk devices[2];  // 一个通道上连接两个磁盘，一主一从
 };
 
 extern uint8_t channel_cnt;
 extern struct ide_channel channels[];
-extern struct list partition_list;
 
 void ide_init();
-void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
-void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
 
 #endif /* DEVICE_IDE */
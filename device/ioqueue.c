@@ -7,8 +7,8 @@
 
 /*初始化io队列ioq*/
 void ioqueue_init(struct ioqueue* ioq) {
-  lock_init(&ioq->lock);  // 初始化iod队列的锁
-  ioq->producer = ioq->consumer = NULL;
+  wait_queue_init(&ioq->readers);
+  wait_queue_init(&ioq->writers);
   ioq->head = ioq->tail = 0;
 }
 
@@ -27,55 +27,33 @@ bool ioq_empty(struct ioqueue* ioq) {
   return ioq->head == ioq->tail;
 }
 
-/*使当前生产者或消费者在此缓冲区上等待*/
-static void ioq_wait(struct task_struct** waiter) {
-  ASSERT(waiter != NULL && *waiter == NULL);
-  *waiter = running_thread();
-  thread_block(TASK_BLOCKED);
-}
-
-/*唤醒waiter*/
-static void wakeup(struct task_struct** waiter) {
-  ASSERT(waiter != NULL && *waiter != NULL);
-  thread_unblock(*waiter);
-  *waiter = NULL;
-}
-
-/*获取字符*/
+/* 获取字符。消费者互斥等待,每放入一个字符只唤醒一个,避免惊群 */
 char ioq_getchar(struct ioqueue* ioq) {
   ASSERT(intr_get_status() == INTR_OFF);
+  wait_queue_lock(&ioq->readers);
   while (ioq_empty(ioq)) {
-    // 如果该线程wait后，其他线程会那不到锁，也会进入block，这样做可以防止惊群效应
-    lock_acquire(&ioq->lock);
-    ioq_wait(&ioq->consumer);
-    lock_release(&ioq->lock);
+    wait_queue_sleep(&ioq->readers, true, 0);
   }
   char byte = ioq->buf[ioq->tail];
   ioq->tail = next_pos(ioq->tail);
+  wait_queue_unlock(&ioq->readers, INTR_OFF);
 
-  if (ioq->producer != NULL) {
-    wakeup(&ioq->producer);  // 唤醒生产者
-  }
-
+  wake_up(&ioq->writers, 1);  // 唤醒一个生产者
   return byte;
 }
 
 void ioq_putchar(struct ioqueue* ioq, char byte) {
   ASSERT(intr_get_status() == INTR_OFF);
+  wait_queue_lock(&ioq->writers);
   while (ioq_full(ioq)) {
-    // 如果该线程wait后，其他线程会那不到锁，也会进入block
-    lock_acquire(&ioq->lock);
-    ioq_wait(&ioq->producer);
-    lock_release(&ioq->lock);
+    wait_queue_sleep(&ioq->writers, true, 0);
   }
   ioq->buf[ioq->head] = byte;
   ioq->head = next_pos(ioq->head);
+  wait_queue_unlock(&ioq->writers, INTR_OFF);
 
-  if (ioq->consumer != NULL) {
-    wakeup(&ioq->consumer);  // 唤醒消费者
-  }
+  wake_up(&ioq->readers, 1);  // 唤醒一个消费者
 }
-
 /* 返回环形缓冲区中的数据长度 */
 uint32_t ioq_length(struct ioqueue* ioq) {
   uint32_t len = 0;
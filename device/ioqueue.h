@@ -6,11 +6,12 @@
 
 #define bufsize 2048
 
-/*环形队列*/
+/* 环形队列,可以有多个生产者和消费者。
+ * 消费者在 readers 上等待,其队列锁保护 tail;
+ * 生产者在 writers 上等待,其队列锁保护 head */
 struct ioqueue {
-  struct lock lock;
-  struct task_struct* producer;
-  struct task_struct* consumer;
+  struct wait_queue readers;
+  struct wait_queue writers;
 
   char buf[bufsize];  // 缓冲区
   int32_t head;       // 队头
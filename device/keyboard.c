@@ -5,6 +5,7 @@
 #include "io.h"
 #include "ioqueue.h"
 #include "print.h"
+#include "softirq.h"
 
 #define KBD_BUF_PORT 0x60  // 键盘 buffer 寄存器端口号为 0x60
 #define esc '\033'
@@ -41,6 +42,13 @@ static bool ctrl_status, shift_status, alt_status, caps_lock_status,
 
 struct ioqueue kbd_buf;  // 定义键盘缓冲区
 
+/* 中断处理程序只把扫描码放进这里,由 tasklet 译成字符。
+ * 只有 BSP 接收键盘中断,tasklet 也在 BSP 上执行,一读一写无需加锁 */
+#define SCANCODE_BUF_SIZE 64
+static uint8_t scancode_buf[SCANCODE_BUF_SIZE];
+static volatile uint32_t scancode_head, scancode_tail;
+static struct tasklet kbd_tasklet;
+
 /* 以通码make_code为索引的二维数组 */
 static char keymap[][2] = {
     /* 扫描码   未与shift组合  与shift组合*/
@@ -107,15 +115,14 @@ static char keymap[][2] = {
     /*其它按键暂不处理*/
 };
 
-/*键盘中断处理程序*/
-static void intr_keyboard_handler(void) {
+/*处理一个扫描码*/
+static void scancode_handle(uint16_t scancode) {
   // 判断上次中断，是否有按下下面三个键
   bool ctrl_down_last = ctrl_status; /*后面会用到*/
   bool shift_down_last = shift_status;
   bool caps_down_last = caps_lock_status;
 
   bool break_code;
-  uint16_t scancode = inb(KBD_BUF_PORT);  // 读取扫描码
   if (scancode == 0xe0) {
     ext_scancode = true;  // 打开e0标记
     return;
@@ -171,9 +178,11 @@ static void intr_keyboard_handler(void) {
           (ctrl_down_last && cur_char == 'u')) {
         cur_char -= 'a';
       }
+      enum intr_status old_status = intr_disable();  // ioqueue 要求关中断
       if (!ioq_full(&kbd_buf)) {
         ioq_putchar(&kbd_buf, cur_char);
       }
+      intr_set_status(old_status);
       return;
     }
     /* 记录本次是否按下了下面几类控制键之一,供下次键入时判断组合键 */
@@ -192,10 +201,30 @@ static void intr_keyboard_handler(void) {
   }
 }
 
+/*键盘的 tasklet,开中断处理积攒的扫描码*/
+static void kbd_tasklet_func(uint32_t data UNUSED) {
+  while (scancode_tail != scancode_head) {
+    uint8_t scancode = scancode_buf[scancode_tail % SCANCODE_BUF_SIZE];
+    scancode_tail++;
+    scancode_handle(scancode);
+  }
+}
+
+/*键盘中断处理程序,读出扫描码后尽快返回*/
+static void intr_keyboard_handler(void) {
+  uint8_t scancode = inb(KBD_BUF_PORT);  // 读取扫描码,不读键盘不会再发中断
+  if (scancode_head - scancode_tail < SCANCODE_BUF_SIZE) {  // 满了就丢掉
+    scancode_buf[scancode_head % SCANCODE_BUF_SIZE] = scancode;
+    scancode_head++;
+  }
+  tasklet_schedule(&kbd_tasklet);
+}
+
 /*键盘初始化*/
 void keyboard_init() {
   put_str("keyboard init start\n");
   ioqueue_init(&kbd_buf);
+  tasklet_init(&kbd_tasklet, kbd_tasklet_func, 0);
   register_handler(0x21, intr_keyboard_handler);
   put_str("keyboard init done\n");
   return;
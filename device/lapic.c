@@ -0,0 +1,120 @@
+#include "lapic.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "timer.h"
+
+/* local APIC 寄存器偏移 */
+#define LAPIC_ID 0x020         // APIC ID
+#define LAPIC_TPR 0x080        // 任务优先级
+#define LAPIC_EOI 0x0b0        // 中断结束
+#define LAPIC_SVR 0x0f0        // 伪中断向量
+#define LAPIC_ESR 0x280        // 错误状态
+#define LAPIC_ICR_LOW 0x300    // 中断命令,低 32 位
+#define LAPIC_ICR_HIGH 0x310   // 中断命令,高 32 位
+#define LAPIC_LVT_TIMER 0x320  // 定时器
+#define LAPIC_LVT_LINT0 0x350  // LINT0
+#define LAPIC_LVT_LINT1 0x360  // LINT1
+#define LAPIC_LVT_ERR 0x370    // 错误中断
+#define LAPIC_TIMER_ICR 0x380  // 定时器初始计数
+#define LAPIC_TIMER_CCR 0x390  // 定时器当前计数
+#define LAPIC_TIMER_DCR 0x3e0  // 定时器分频
+
+#define LAPIC_SVR_ENABLE 0x100     // 软件使能位
+#define LAPIC_LVT_MASKED 0x10000   // 屏蔽位
+#define LAPIC_TIMER_PERIODIC 0x20000  // 周期模式
+#define LAPIC_TIMER_DIV16 0x3      // 16 分频
+#define ICR_DELIVERY_PENDING 0x1000  // 投递中
+
+#define CALIBRATE_US 50000  // 校准定时器时等待的微秒数
+
+static volatile uint32_t* lapic;  // 映射后的寄存器基址
+static uint32_t lapic_ticks_per_intr;  // 一个时钟嘀嗒对应的定时器计数
+
+static uint32_t lapic_read(uint32_t reg) { return lapic[reg / 4]; }
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+  lapic[reg / 4] = value;
+  (void)lapic[LAPIC_ID / 4];  // 读一次保证写入已完成
+}
+
+/*local APIC 定时器中断,AP 靠它进行时间片调度*/
+static void intr_lapic_timer_handler(void) {
+  lapic_eoi();
+  timer_tick();
+}
+
+/*重新调度的 IPI:need_resched 已由发送方设置,由 irq_exit 调度*/
+static void intr_resched_handler(void) { lapic_eoi(); }
+
+/*刷新本核 TLB 的 IPI*/
+static void intr_tlb_handler(void) {
+  uint32_t cr3;
+  asm volatile("movl %%cr3, %0" : "=r"(cr3));
+  asm volatile("movl %0, %%cr3" ::"r"(cr3) : "memory");
+  lapic_eoi();
+}
+
+/*伪中断不需要 EOI*/
+static void intr_spurious_handler(void) {}
+
+/*映射 local APIC 的寄存器页,各核的 local APIC 都在同一物理地址*/
+void lapic_map(uint32_t phy_addr) {
+  lapic = ioremap(phy_addr, PG_SIZE);
+  ASSERT(lapic != NULL);
+  register_handler(LAPIC_TIMER_VEC, intr_lapic_timer_handler);
+  register_handler(LAPIC_RESCHED_VEC, intr_resched_handler);
+  register_handler(LAPIC_TLB_VEC, intr_tlb_handler);
+  register_handler(LAPIC_SPURIOUS_VEC, intr_spurious_handler);
+}
+
+/*初始化本核的 local APIC*/
+void lapic_init(bool is_bsp) {
+  lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+  lapic_write(LAPIC_TPR, 0);  // 接收所有优先级的中断
+  if (!is_bsp) {
+    // 8259A 只接到 BSP,AP 屏蔽 LINT0/LINT1
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+  }
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_LVT_ERR, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_ESR, 0);
+  lapic_write(LAPIC_ESR, 0);
+  lapic_write(LAPIC_EOI, 0);
+}
+
+/*本核的 APIC ID*/
+uint8_t lapic_id(void) { return lapic_read(LAPIC_ID) >> 24; }
+
+/*通知 local APIC 中断处理结束*/
+void lapic_eoi(void) { lapic_write(LAPIC_EOI, 0); }
+
+/*向 apic_id 发送处理器间中断,icr_low 指定投递模式和向量*/
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr_low) {
+  lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+  lapic_write(LAPIC_ICR_LOW, icr_low);
+  while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING) {
+    asm volatile("pause");
+  }
+}
+
+/*用 udelay 测出定时器在一个时钟嘀嗒内的计数,各核频率相同只需测一次*/
+void lapic_timer_calibrate(void) {
+  lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_TIMER_ICR, 0xffffffff);
+  udelay(CALIBRATE_US);
+  uint32_t elapsed = 0xffffffff - lapic_read(LAPIC_TIMER_CCR);
+  lapic_write(LAPIC_TIMER_ICR, 0);  // 停止计数
+  lapic_ticks_per_intr = elapsed / (CALIBRATE_US / (1000000 / IRQ0_FREQUENCY));
+  ASSERT(lapic_ticks_per_intr > 0);
+}
+
+/*以 IRQ0_FREQUENCY 的频率周期性产生定时器中断*/
+void lapic_timer_start(void) {
+  lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV16);
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VEC);
+  lapic_write(LAPIC_TIMER_ICR, lapic_ticks_per_intr);
+}
@@ -0,0 +1,25 @@
+#ifndef DEVICE_LAPIC
+#define DEVICE_LAPIC
+#include "global.h"
+#include "stdint.h"
+
+/* local APIC 产生的中断向量,放在 8259A 的 0x20~0x2f 之后 */
+#define LAPIC_TIMER_VEC 0x30     // local APIC 定时器
+#define LAPIC_RESCHED_VEC 0x31   // 通知目标核重新调度
+#define LAPIC_TLB_VEC 0x32       // 通知目标核刷新 TLB
+#define LAPIC_SPURIOUS_VEC 0x3f  // 伪中断,低 4 位必须为 1
+
+/* ICR 低 32 位中的投递模式 */
+#define ICR_INIT 0x00000500
+#define ICR_STARTUP 0x00000600
+#define ICR_LEVEL_ASSERT 0x00004000
+#define ICR_ALL_BUT_SELF 0x000c0000  // 目标简写:除自己外的所有核
+
+void lapic_map(uint32_t phy_addr);
+void lapic_init(bool is_bsp);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr_low);
+void lapic_timer_calibrate(void);
+void lapic_timer_start(void);
+#endif /* DEVICE_LAPIC */
@@ -0,0 +1,539 @@
+#include "nvme.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "pci.h"
+#include "stdio.h"
+#include "stdio_kernel.h"
+#include "string.h"
+#include "thread.h"
+#include "timer.h"
+
+/* 控制器寄存器,由 BAR0 映射 */
+#define NVME_REG_CAP 0x00    // 能力,64 位
+#define NVME_REG_INTMS 0x0c  // 写 1 屏蔽中断(INTx 时只用第 0 位)
+#define NVME_REG_INTMC 0x10  // 写 1 解除屏蔽
+#define NVME_REG_CC 0x14
+#define NVME_REG_CSTS 0x1c
+#define NVME_REG_AQA 0x24  // 管理队列的大小
+#define NVME_REG_ASQ 0x28  // 管理提交队列的物理地址,64 位
+#define NVME_REG_ACQ 0x30  // 管理完成队列的物理地址,64 位
+#define NVME_REG_DB 0x1000  // 门铃从这里开始,提交队列尾和完成队列头交替排列
+
+#define NVME_CC_EN 0x1
+#define NVME_CC_IOSQES (6 << 16)  // 提交项 64 字节
+#define NVME_CC_IOCQES (4 << 20)  // 完成项 16 字节
+#define NVME_CSTS_RDY 0x1
+#define NVME_CSTS_CFS 0x2  // 控制器出了致命错误
+
+#define NVME_ADMIN_QSIZE 8
+
+/* 管理命令 */
+#define NVME_ADMIN_CREATE_SQ 0x01
+#define NVME_ADMIN_CREATE_CQ 0x05
+#define NVME_ADMIN_IDENTIFY 0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+#define NVME_FEAT_NUM_QUEUES 0x07
+#define NVME_ID_CNS_NS 0x0
+#define NVME_ID_CNS_CTRL 0x1
+#define NVME_QUEUE_PHYS_CONTIG 0x1
+#define NVME_CQ_IRQ_ENABLED 0x2
+
+/* I/O 命令 */
+#define NVME_CMD_WRITE 0x01
+#define NVME_CMD_READ 0x02
+
+#define NVME_MAX_SECS 256  // 一条命令最多的扇区数
+#define NVME_PRP_PER_CMD (NVME_MAX_SECS * 512 / PG_SIZE)  // 第一页之外最多的页数
+
+/* 提交项 */
+struct nvme_sqe {
+  uint8_t opcode;
+  uint8_t flags;
+  uint16_t cid;  // 命令号,完成项中原样带回
+  uint32_t nsid;
+  uint32_t rsv[2];
+  uint32_t mptr[2];
+  uint32_t prp1;  // 数据第一页的物理地址,可以不从页首开始
+  uint32_t prp1_hi;
+  uint32_t prp2;  // 第二页,超过两页时是 PRP 表的物理地址
+  uint32_t prp2_hi;
+  uint32_t cdw10;
+  uint32_t cdw11;
+  uint32_t cdw12;
+  uint32_t cdw13;
+  uint32_t cdw14;
+  uint32_t cdw15;
+};
+
+/* 完成项 */
+struct nvme_cqe {
+  uint32_t result;
+  uint32_t rsv;
+  uint16_t sq_head;
+  uint16_t sq_id;
+  uint16_t cid;
+  uint16_t status;  // 第 0 位是相位,其余为 0 表示成功
+};
+
+uint8_t nvme_cnt;
+struct nvme_ctrl* nvme_ctrls[NVME_MAX_CTRLS];
+
+static inline volatile uint32_t* nvme_reg(struct nvme_ctrl* ctrl,
+                                          uint32_t offset) {
+  return (volatile uint32_t*)(ctrl->regs + offset);
+}
+
+/* 初始化第 qid 对队列,项数为 size,I/O 队列还要给每个命令号一段 PRP 表 */
+static bool nvme_queue_init(struct nvme_ctrl* ctrl, struct nvme_queue* q,
+                            uint16_t qid, uint16_t size) {
+  q->qid = qid;
+  q->size = size;
+  q->sq = get_kernel_pages(1);
+  q->cq = get_kernel_pages(1);
+  q->prp_lists = NULL;
+  if (qid != 0) {
+    q->prp_lists = get_kernel_pages(
+        DIV_ROUND_UP(size * NVME_PRP_PER_CMD * sizeof(uint64_t), PG_SIZE));
+  }
+  if (q->sq == NULL || q->cq == NULL || (qid != 0 && q->prp_lists == NULL)) {
+    return false;  // 启动时内存不会不够,这里不再回收
+  }
+  q->sq_db = nvme_reg(ctrl, NVME_REG_DB + 2 * qid * ctrl->db_stride);
+  q->cq_db = nvme_reg(ctrl, NVME_REG_DB + (2 * qid + 1) * ctrl->db_stride);
+  q->sq_tail = 0;
+  q->cq_head = 0;
+  q->phase = 1;
+  q->cids_busy = 0;
+  return true;
+}
+
+/* 把 sqe 放进提交队列并按门铃 */
+static void nvme_submit(struct nvme_queue* q, struct nvme_sqe* sqe) {
+  memcpy(&q->sq[q->sq_tail], sqe, sizeof(struct nvme_sqe));
+  q->sq_tail = (q->sq_tail + 1) % q->size;
+  asm volatile("" : : : "memory");  // 提交项写好后才能按门铃
+  *q->sq_db = q->sq_tail;
+}
+
+/* 取出完成队列中下一个新的完成项,没有时返回 false.
+ * 完成项的相位位与队列当前的相位相同时才是新的,每绕一圈相位翻转 */
+static bool nvme_cq_pop(struct nvme_queue* q, struct nvme_cqe* cqe) {
+  volatile struct nvme_cqe* entry = &q->cq[q->cq_head];
+  if ((entry->status & 1) != q->phase) {
+    return false;
+  }
+  asm volatile("" : : : "memory");  // 先看相位再读其余各项
+  cqe->result = entry->result;
+  cqe->sq_head = entry->sq_head;
+  cqe->cid = entry->cid;
+  cqe->status = entry->status;
+  q->cq_head++;
+  if (q->cq_head == q->size) {
+    q->cq_head = 0;
+    q->phase ^= 1;
+  }
+  return true;
+}
+
+/* 发一条管理命令并轮询等它完成,只在打开中断之前用.
+ * 成功返回 true,命令的结果放在 result 中 */
+static bool nvme_admin_cmd(struct nvme_ctrl* ctrl, struct nvme_sqe* sqe,
+                           uint32_t* result) {
+  struct nvme_queue* q = &ctrl->admin;
+  struct nvme_cqe cqe;
+  uint32_t waited_us = 0;
+  nvme_submit(q, sqe);
+  while (!nvme_cq_pop(q, &cqe)) {
+    if (waited_us >= ctrl->timeout_ms * 1000) {
+      printk("nvme: admin command 0x%x timeout\n", sqe->opcode);
+      return false;
+    }
+    udelay(10);
+    waited_us += 10;
+  }
+  *q->cq_db = q->cq_head;
+  if (cqe.status >> 1 != 0) {
+    printk("nvme: admin command 0x%x failed, status 0x%x\n", sqe->opcode,
+           cqe.status >> 1);
+    return false;
+  }
+  if (result != NULL) {
+    *result = cqe.result;
+  }
+  return true;
+}
+
+/* IDENTIFY,cns 指明要控制器还是命名空间 nsid 的信息,结果读到 buf 这一页中 */
+static bool nvme_identify(struct nvme_ctrl* ctrl, uint32_t cns, uint32_t nsid,
+                          void* buf) {
+  struct nvme_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = NVME_ADMIN_IDENTIFY;
+  sqe.nsid = nsid;
+  sqe.prp1 = addr_v2p((uint32_t)buf);
+  sqe.cdw10 = cns;
+  return nvme_admin_cmd(ctrl, &sqe, NULL);
+}
+
+/* 建 I/O 队列 q:先建完成队列,再建挂在它上面的提交队列 */
+static bool nvme_create_io_queue(struct nvme_ctrl* ctrl, struct nvme_queue* q) {
+  struct nvme_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = NVME_ADMIN_CREATE_CQ;
+  sqe.prp1 = addr_v2p((uint32_t)q->cq);
+  sqe.cdw10 = ((q->size - 1) << 16) | q->qid;
+  sqe.cdw11 = NVME_CQ_IRQ_ENABLED | NVME_QUEUE_PHYS_CONTIG;  // 都用 0 号中断
+  if (!nvme_admin_cmd(ctrl, &sqe, NULL)) {
+    return false;
+  }
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = NVME_ADMIN_CREATE_SQ;
+  sqe.prp1 = addr_v2p((uint32_t)q->sq);
+  sqe.cdw10 = ((q->size - 1) << 16) | q->qid;
+  sqe.cdw11 = (q->qid << 16) | NVME_QUEUE_PHYS_CONTIG;
+  return nvme_admin_cmd(ctrl, &sqe, NULL);
+}
+
+/* 用队列 q 的命令号 cid 发出请求 rq,缓冲区不是 4 字节对齐时返回 false.
+ * 队列要求合并的 bio 缓冲区相连,请求的数据是一段连续的虚拟内存,
+ * 第一页之后各页都从页首开始,正好能用 PRP 描述 */
+static bool nvme_issue_rq(struct nvme_ctrl* ctrl, struct nvme_queue* q,
+                          uint16_t cid, struct request* rq) {
+  struct bio* first = elem2entry(struct bio, tag, rq->bios.head.next);
+  uint32_t vaddr = (uint32_t)first->buf;
+  uint32_t len = rq->sec_cnt * 512;
+  if (vaddr & 3) {
+    return false;
+  }
+  struct nvme_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = rq->write ? NVME_CMD_WRITE : NVME_CMD_READ;
+  sqe.cid = cid;
+  sqe.nsid = 1;
+  sqe.cdw10 = rq->lba;
+  sqe.cdw12 = rq->sec_cnt - 1;
+
+  bio_access_begin(first);  // 用户缓冲区要在提交者的页表下求物理地址
+  sqe.prp1 = addr_v2p(vaddr);
+  uint32_t first_len = PG_SIZE - (vaddr & 0xfff);
+  if (len > first_len) {
+    vaddr += first_len;
+    len -= first_len;
+    if (len <= PG_SIZE) {
+      sqe.prp2 = addr_v2p(vaddr);
+    } else {
+      uint64_t* list = &q->prp_lists[cid * NVME_PRP_PER_CMD];
+      uint32_t idx = 0;
+      while (1) {
+        ASSERT(idx < NVME_PRP_PER_CMD);
+        list[idx++] = addr_v2p(vaddr);
+        if (len <= PG_SIZE) {
+          break;
+        }
+        vaddr += PG_SIZE;
+        len -= PG_SIZE;
+      }
+      sqe.prp2 = addr_v2p((uint32_t)list);
+    }
+  }
+  bio_access_end(first);
+
+  q->cid_rq[cid] = rq;
+  q->cids_busy |= 1 << cid;
+  nvme_submit(q, &sqe);
+  return true;
+}
+
+/* 从请求队列中取请求,轮流发到各 I/O 队列,直到命令号用完或没有可派发的请求 */
+static void nvme_issue(struct nvme_ctrl* ctrl) {
+  while (1) {
+    struct nvme_queue* q = NULL;
+    uint16_t cid = 0;
+    uint8_t tried;
+    for (tried = 0; tried < ctrl->io_cnt && q == NULL; tried++) {
+      struct nvme_queue* cand =
+          &ctrl->io[(ctrl->next_io + tried) % ctrl->io_cnt];
+      for (cid = 0; cid < cand->size - 1; cid++) {  // 队列满时尾追上头,少用一项
+        if (!(cand->cids_busy & (1 << cid))) {
+          q = cand;
+          break;
+        }
+      }
+    }
+    if (q == NULL) {
+      return;
+    }
+    struct request* rq = blk_fetch_request(&ctrl->bdev.queue);
+    if (rq == NULL) {
+      return;
+    }
+    if (!nvme_issue_rq(ctrl, q, cid, rq)) {
+      printk("%s: buffer at lba %d not dword aligned\n", ctrl->bdev.name,
+             rq->lba);
+      blk_end_request(rq, -1);
+      continue;
+    }
+    ctrl->next_io = q->qid % ctrl->io_cnt;  // qid 从 1 开始,即下一个队列
+    ctrl->inflight++;
+    if (ctrl->inflight > ctrl->max_inflight) {
+      ctrl->max_inflight = ctrl->inflight;
+    }
+  }
+}
+
+/* 收割各 I/O 完成队列中的新完成项,再按门铃告诉控制器处理到哪里了 */
+static void nvme_complete(struct nvme_ctrl* ctrl) {
+  uint8_t qi;
+  for (qi = 0; qi < ctrl->io_cnt; qi++) {
+    struct nvme_queue* q = &ctrl->io[qi];
+    struct nvme_cqe cqe;
+    bool popped = false;
+    while (nvme_cq_pop(q, &cqe)) {
+      popped = true;
+      ASSERT(cqe.cid < q->size && (q->cids_busy & (1 << cqe.cid)));
+      struct request* rq = q->cid_rq[cqe.cid];
+      q->cid_rq[cqe.cid] = NULL;
+      q->cids_busy &= ~(1 << cqe.cid);
+      ctrl->inflight--;
+      int32_t error = 0;
+      if (cqe.status >> 1 != 0) {
+        printk("%s: lba %d failed, status 0x%x\n", ctrl->bdev.name, rq->lba,
+               cqe.status >> 1);
+        error = -1;
+      }
+      blk_end_request(rq, error);
+    }
+    if (popped) {
+      *q->cq_db = q->cq_head;
+    }
+  }
+}
+
+/* 控制器的完成线程:收割完成项,用空出的命令号发新的请求,
+ * 然后解除中断屏蔽(中断处理程序屏蔽了它),没事可做时睡眠 */
+static void nvme_thread(void* arg) {
+  struct nvme_ctrl* ctrl = arg;
+  while (1) {
+    enum intr_status old_status = wait_queue_lock(&ctrl->wq);
+    while (!ctrl->event) {
+      wait_queue_sleep(&ctrl->wq, false, 0);
+    }
+    ctrl->event = false;
+    wait_queue_unlock(&ctrl->wq, old_status);
+
+    nvme_complete(ctrl);
+    nvme_issue(ctrl);
+    *nvme_reg(ctrl, NVME_REG_INTMC) = 1;
+  }
+}
+
+/*有新请求或中断时唤醒控制器的完成线程*/
+static void nvme_wake(struct nvme_ctrl* ctrl) {
+  enum intr_status old_status = wait_queue_lock(&ctrl->wq);
+  ctrl->event = true;
+  wake_up_locked(&ctrl->wq, 1);
+  wait_queue_unlock(&ctrl->wq, old_status);
+}
+
+static void nvme_kick(struct blk_queue* q) { nvme_wake(q->driver_data); }
+
+static void nvme_tasklet_func(uint32_t data) {
+  nvme_wake((struct nvme_ctrl*)data);
+}
+
+/* NVMe 的中断处理程序.INTx 在完成项被收割前一直有效,
+ * 所以先屏蔽控制器的中断,由完成线程收割后再打开 */
+static void intr_nvme_handler(uint8_t irq_no UNUSED) {
+  uint8_t idx;
+  for (idx = 0; idx < nvme_cnt; idx++) {
+    struct nvme_ctrl* ctrl = nvme_ctrls[idx];
+    uint8_t qi;
+    for (qi = 0; qi < ctrl->io_cnt; qi++) {
+      struct nvme_queue* q = &ctrl->io[qi];
+      if ((q->cq[q->cq_head].status & 1) == q->phase) {
+        break;
+      }
+    }
+    if (qi < ctrl->io_cnt) {
+      *nvme_reg(ctrl, NVME_REG_INTMS) = 1;
+      ctrl->nr_irq++;
+      tasklet_schedule(&ctrl->intr_tasklet);
+    }
+  }
+}
+
+/* 等 CSTS.RDY 变成 ready,超时或控制器出错时返回 false */
+static bool nvme_wait_ready(struct nvme_ctrl* ctrl, uint32_t ready) {
+  uint32_t waited_us = 0;
+  while ((*nvme_reg(ctrl, NVME_REG_CSTS) & NVME_CSTS_RDY) != ready) {
+    if ((*nvme_reg(ctrl, NVME_REG_CSTS) & NVME_CSTS_CFS) ||
+        waited_us >= ctrl->timeout_ms * 1000) {
+      return false;
+    }
+    udelay(100);
+    waited_us += 100;
+  }
+  return true;
+}
+
+/* 复位控制器,建好管理队列后重新打开 */
+static bool nvme_enable(struct nvme_ctrl* ctrl) {
+  *nvme_reg(ctrl, NVME_REG_CC) = 0;
+  if (!nvme_wait_ready(ctrl, 0)) {
+    return false;
+  }
+  struct nvme_queue* admin = &ctrl->admin;
+  *nvme_reg(ctrl, NVME_REG_AQA) =
+      ((admin->size - 1) << 16) | (admin->size - 1);
+  *nvme_reg(ctrl, NVME_REG_ASQ) = addr_v2p((uint32_t)admin->sq);
+  *nvme_reg(ctrl, NVME_REG_ASQ + 4) = 0;
+  *nvme_reg(ctrl, NVME_REG_ACQ) = addr_v2p((uint32_t)admin->cq);
+  *nvme_reg(ctrl, NVME_REG_ACQ + 4) = 0;
+  *nvme_reg(ctrl, NVME_REG_CC) = NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES;
+  return nvme_wait_ready(ctrl, NVME_CSTS_RDY);
+}
+
+/* 从 IDENTIFY 得到命名空间 1 的扇区数和控制器一条命令最多的扇区数 */
+static bool nvme_identify_disk(struct nvme_ctrl* ctrl, uint32_t* max_secs) {
+  uint8_t* id = get_kernel_pages(1);
+  if (id == NULL) {
+    return false;
+  }
+  bool ok = false;
+  *max_secs = NVME_MAX_SECS;
+  if (nvme_identify(ctrl, NVME_ID_CNS_CTRL, 0, id)) {
+    uint8_t mdts = id[77];  // 2 的幂,以最小页 4KB 为单位,0 表示不限
+    if (mdts != 0 && mdts < 6 && (8u << mdts) < *max_secs) {
+      *max_secs = 8 << mdts;
+    }
+    if (nvme_identify(ctrl, NVME_ID_CNS_NS, 1, id)) {
+      uint32_t* nsze = (uint32_t*)id;  // 命名空间的块数,64 位
+      uint8_t flbas = id[26] & 0xf;   // 当前用的块格式
+      uint32_t lbaf = *(uint32_t*)&id[128 + flbas * 4];
+      if (((lbaf >> 16) & 0xff) != 9) {
+        printk("nvme: block size %d not supported\n",
+               1 << ((lbaf >> 16) & 0xff));
+      } else {
+        ctrl->bdev.sectors = nsze[1] != 0 ? 0xffffffff : nsze[0];
+        ok = true;
+      }
+    }
+  }
+  mfree_page(PF_KERNEL, id, 1);
+  return ok;
+}
+
+/* 初始化 PCI 功能 pci 上的 NVMe 控制器,成功时加入 nvme_ctrls */
+static bool nvme_probe(struct pci_dev* pci) {
+  if (pci_read(pci, PCI_BAR0 + 4) != 0) {
+    printk("nvme: registers above 4GB, skipped\n");  // BAR0 是 64 位的
+    return false;
+  }
+  pci_enable(pci, PCI_CMD_MEM | PCI_CMD_MASTER);
+  struct nvme_ctrl* ctrl = get_kernel_pages(1);
+  if (ctrl == NULL) {
+    return false;
+  }
+  /* 门铃只用到管理队列和 NVME_IO_QUEUES 个 I/O 队列的 */
+  ctrl->regs = ioremap(pci_bar(pci, 0), NVME_REG_DB + PG_SIZE);
+  if (ctrl->regs == NULL) {
+    return false;
+  }
+  uint32_t cap_lo = *nvme_reg(ctrl, NVME_REG_CAP);
+  uint32_t cap_hi = *nvme_reg(ctrl, NVME_REG_CAP + 4);
+  uint32_t mqes = (cap_lo & 0xffff) + 1;  // 一个队列最多的项数
+  ctrl->timeout_ms = ((cap_lo >> 24) & 0xff) * 500;
+  ctrl->db_stride = 4 << (cap_hi & 0xf);
+  if (((cap_hi >> 16) & 0xf) != 0 ||
+      (2 * NVME_IO_QUEUES + 2) * ctrl->db_stride > PG_SIZE) {
+    printk("nvme: unsupported page size or doorbell stride\n");
+    return false;
+  }
+
+  uint16_t admin_size = mqes < NVME_ADMIN_QSIZE ? mqes : NVME_ADMIN_QSIZE;
+  if (!nvme_queue_init(ctrl, &ctrl->admin, 0, admin_size)) {
+    return false;
+  }
+  *nvme_reg(ctrl, NVME_REG_INTMS) = 1;  // 建队列时轮询,不要中断
+  if (!nvme_enable(ctrl)) {
+    printk("nvme: controller not ready, csts 0x%x\n",
+           *nvme_reg(ctrl, NVME_REG_CSTS));
+    return false;
+  }
+  uint32_t max_secs;
+  if (!nvme_identify_disk(ctrl, &max_secs)) {
+    return false;
+  }
+
+  /* 申请 NVME_IO_QUEUES 对 I/O 队列,控制器可能给得更少 */
+  struct nvme_sqe sqe;
+  uint32_t granted;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = NVME_ADMIN_SET_FEATURES;
+  sqe.cdw10 = NVME_FEAT_NUM_QUEUES;
+  sqe.cdw11 = ((NVME_IO_QUEUES - 1) << 16) | (NVME_IO_QUEUES - 1);
+  if (!nvme_admin_cmd(ctrl, &sqe, &granted)) {
+    return false;
+  }
+  uint32_t io_cnt = NVME_IO_QUEUES;
+  if ((granted & 0xffff) + 1 < io_cnt) {
+    io_cnt = (granted & 0xffff) + 1;
+  }
+  if ((granted >> 16) + 1 < io_cnt) {
+    io_cnt = (granted >> 16) + 1;
+  }
+  uint16_t io_size = mqes < NVME_QSIZE ? mqes : NVME_QSIZE;
+  for (ctrl->io_cnt = 0; ctrl->io_cnt < io_cnt; ctrl->io_cnt++) {
+    struct nvme_queue* q = &ctrl->io[ctrl->io_cnt];
+    if (!nvme_queue_init(ctrl, q, ctrl->io_cnt + 1, io_size) ||
+        !nvme_create_io_queue(ctrl, q)) {
+      break;
+    }
+  }
+  if (ctrl->io_cnt == 0) {
+    return false;
+  }
+
+  struct block_device* hd = &ctrl->bdev;
+  sprintf(hd->name, "nv%c", 'a' + nvme_cnt);
+  printk("%s: %dMB, %d io queues of %d, %d sectors per command\n", hd->name,
+         hd->sectors / 2048, ctrl->io_cnt, io_size, max_secs);
+
+  hd->ops = &blk_queue_ops;
+  blk_queue_init(&hd->queue, max_secs, nvme_kick, ctrl);
+  hd->queue.contig_only = true;  // 一个请求要能用 PRP 描述
+  wait_queue_init(&ctrl->wq);
+  tasklet_init(&ctrl->intr_tasklet, nvme_tasklet_func, (uint32_t)ctrl);
+  ctrl->thread = thread_start(hd->name, 31, nvme_thread, ctrl);
+  nvme_ctrls[nvme_cnt++] = ctrl;
+  bdev_register(hd);
+  return true;
+}
+
+/* 找出 PCI 上所有的 NVMe 控制器,初始化后扫描其中的分区 */
+void nvme_init(void) {
+  uint32_t idx;
+  for (idx = 0; idx < pci_dev_cnt && nvme_cnt < NVME_MAX_CTRLS; idx++) {
+    struct pci_dev* pci = &pci_devs[idx];
+    if (pci->class_code != PCI_CLASS_STORAGE ||
+        pci->subclass != PCI_SUBCLASS_NVM || pci->prog_if != PCI_PROGIF_NVME) {
+      continue;
+    }
+    if (pci->irq_line >= 16) {
+      printk("nvme: no irq assigned, disabled\n");
+      continue;
+    }
+    if (!nvme_probe(pci)) {
+      printk("nvme: %x:%x init failed\n", pci->vendor_id, pci->device_id);
+      continue;
+    }
+    register_handler(0x20 + pci->irq_line, intr_nvme_handler);
+    pic_unmask(pci->irq_line);
+    *nvme_reg(nvme_ctrls[nvme_cnt - 1], NVME_REG_INTMC) = 1;
+  }
+  for (idx = 0; idx < nvme_cnt; idx++) {
+    bdev_scan_partitions(&nvme_ctrls[idx]->bdev);
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef DEVICE_NVME
+#define DEVICE_NVME
+#include "blk.h"
+#include "softirq.h"
+#include "stdint.h"
+#include "sync.h"
+
+#define NVME_MAX_CTRLS 2
+#define NVME_IO_QUEUES 2  // I/O 提交/完成队列的对数
+#define NVME_QSIZE 32     // 每个 I/O 队列的项数,同时最多 NVME_QSIZE-1 条命令
+
+struct nvme_sqe;
+struct nvme_cqe;
+
+/* 一对提交队列和完成队列,各占一页 */
+struct nvme_queue {
+  uint16_t qid;  // 0 是管理队列
+  uint16_t size;
+  struct nvme_sqe* sq;
+  volatile struct nvme_cqe* cq;
+  volatile uint32_t* sq_db;  // 提交队列尾的门铃
+  volatile uint32_t* cq_db;  // 完成队列头的门铃
+  uint16_t sq_tail;
+  uint16_t cq_head;
+  uint8_t phase;        // 完成项的相位位等于它时是新的
+  uint32_t cids_busy;   // 已发出尚未完成的命令号
+  struct request* cid_rq[NVME_QSIZE];  // 各命令号上正在做的请求
+  uint64_t* prp_lists;  // 每个命令号一段 PRP 表
+};
+
+/* 一个 NVMe 控制器,只用它的 1 号命名空间 */
+struct nvme_ctrl {
+  struct block_device bdev;  // 对上层是一个块设备,经 bdev.queue 读写
+  volatile uint8_t* regs;
+  uint32_t db_stride;  // 相邻门铃相隔的字节数
+  uint32_t timeout_ms;  // 控制器就绪的最长等待
+  struct nvme_queue admin;
+  struct nvme_queue io[NVME_IO_QUEUES];
+  uint8_t io_cnt;          // 实际建起来的 I/O 队列数
+  uint8_t next_io;         // 下一条命令先看哪个队列,轮流用
+  uint32_t inflight;       // 已发出的 I/O 命令数
+  uint32_t max_inflight;   // 统计:同时在做的命令数的最大值
+  uint32_t nr_irq;         // 统计:收到的中断数
+  bool event;              // 有新请求或中断,由 wq 的锁保护
+  struct wait_queue wq;    // 完成线程在此等待
+  struct tasklet intr_tasklet;  // 在中断返回前唤醒完成线程
+  struct task_struct* thread;   // 发命令并收割完成项的线程
+};
+
+extern uint8_t nvme_cnt;
+extern struct nvme_ctrl* nvme_ctrls[];
+
+void nvme_init(void);
+#endif /* DEVICE_NVME */
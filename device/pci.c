@@ -0,0 +1,106 @@
+#include "pci.h"
+
+#include "io.h"
+#include "print.h"
+#include "stdio_kernel.h"
+
+#define PCI_CONFIG_ADDR 0xcf8  // 配置空间地址端口
+#define PCI_CONFIG_DATA 0xcfc  // 配置空间数据端口
+#define PCI_ENABLE_BIT 0x80000000
+
+#define PCI_MAX_BUS 256
+#define PCI_MAX_SLOT 32
+#define PCI_MAX_FUNC 8
+
+struct pci_dev pci_devs[PCI_MAX_DEVS];  // pci_init 枚举到的功能
+uint32_t pci_dev_cnt;
+
+/*配置机制 1:写地址端口选中寄存器,再从数据端口读写,offset 按 4 字节对齐*/
+static void pci_select(uint8_t bus, uint8_t slot, uint8_t func,
+                       uint8_t offset) {
+  outl(PCI_CONFIG_ADDR, PCI_ENABLE_BIT | (bus << 16) | (slot << 11) |
+                            (func << 8) | (offset & 0xfc));
+}
+
+/*读 dev 配置空间中 offset 处的 4 字节*/
+uint32_t pci_read(struct pci_dev* dev, uint8_t offset) {
+  pci_select(dev->bus, dev->slot, dev->func, offset);
+  return inl(PCI_CONFIG_DATA);
+}
+
+/*写 dev 配置空间中 offset 处的 4 字节*/
+void pci_write(struct pci_dev* dev, uint8_t offset, uint32_t value) {
+  pci_select(dev->bus, dev->slot, dev->func, offset);
+  outl(PCI_CONFIG_DATA, value);
+}
+
+/* 枚举总线上所有的 PCI 功能,记入 pci_devs 并打印 */
+void pci_init(void) {
+  put_str("pci_init start\n");
+  uint32_t bus, slot, func;
+  struct pci_dev dev;
+  for (bus = 0; bus < PCI_MAX_BUS; bus++) {
+    for (slot = 0; slot < PCI_MAX_SLOT; slot++) {
+      for (func = 0; func < PCI_MAX_FUNC; func++) {
+        dev.bus = bus;
+        dev.slot = slot;
+        dev.func = func;
+        uint32_t id = pci_read(&dev, PCI_VENDOR_ID);
+        if ((id & 0xffff) == 0xffff) {  // 没有这个功能
+          if (func == 0) {
+            break;
+          }
+          continue;
+        }
+        uint32_t class_rev = pci_read(&dev, PCI_CLASS_REVISION);
+        dev.vendor_id = id & 0xffff;
+        dev.device_id = id >> 16;
+        dev.class_code = class_rev >> 24;
+        dev.subclass = (class_rev >> 16) & 0xff;
+        dev.prog_if = (class_rev >> 8) & 0xff;
+        dev.irq_line = pci_read(&dev, PCI_INTERRUPT_LINE) & 0xff;
+        printk("pci %x:%x.%x %x:%x class %x/%x/%x irq %d\n", bus, slot, func,
+               dev.vendor_id, dev.device_id, dev.class_code, dev.subclass,
+               dev.prog_if, dev.irq_line);
+        if (pci_dev_cnt < PCI_MAX_DEVS) {
+          pci_devs[pci_dev_cnt++] = dev;
+        }
+        /* 头类型最高位为 0 表示单功能设备,不用再看其他功能 */
+        if (func == 0 &&
+            !((pci_read(&dev, PCI_HEADER_TYPE) >> 16) & 0x80)) {
+          break;
+        }
+      }
+    }
+  }
+  put_str("pci_init done\n");
+}
+
+/* 在 pci_init 枚举到的功能中找第一个类别为 class_code/subclass 的,
+ * 找到后复制到 dev 返回 true */
+bool pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_dev* dev) {
+  uint32_t idx;
+  for (idx = 0; idx < pci_dev_cnt; idx++) {
+    if (pci_devs[idx].class_code == class_code &&
+        pci_devs[idx].subclass == subclass) {
+      *dev = pci_devs[idx];
+      return true;
+    }
+  }
+  return false;
+}
+
+/*第 bar_no 个 BAR 的基址,去掉了低位的类型标志*/
+uint32_t pci_bar(struct pci_dev* dev, uint8_t bar_no) {
+  uint32_t bar = pci_read(dev, PCI_BAR0 + bar_no * 4);
+  if (bar & PCI_BAR_IO) {
+    return bar & 0xfffffffc;
+  }
+  return bar & 0xfffffff0;
+}
+
+/*在 command 寄存器中打开 cmd_bits*/
+void pci_enable(struct pci_dev* dev, uint32_t cmd_bits) {
+  uint32_t cmd = pci_read(dev, PCI_COMMAND);
+  pci_write(dev, PCI_COMMAND, (cmd & 0xffff) | cmd_bits);
+}
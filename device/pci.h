@@ -0,0 +1,54 @@
+#ifndef DEVICE_PCI
+#define DEVICE_PCI
+#include "global.h"
+#include "stdint.h"
+
+/* 配置空间中的一些寄存器(偏移) */
+#define PCI_VENDOR_ID 0x00
+#define PCI_COMMAND 0x04
+#define PCI_CLASS_REVISION 0x08  // 类别|子类别|编程接口|版本
+#define PCI_HEADER_TYPE 0x0e
+#define PCI_BAR0 0x10            // BAR0~BAR5 依次相隔 4 字节
+#define PCI_INTERRUPT_LINE 0x3c  // 最低字节是 BIOS 分配的 8259A 中断号
+
+/* command 寄存器的位 */
+#define PCI_CMD_IO 0x1      // 响应 I/O 空间访问
+#define PCI_CMD_MEM 0x2     // 响应内存空间访问
+#define PCI_CMD_MASTER 0x4  // 允许设备做总线主控(DMA)
+
+#define PCI_BAR_IO 0x1  // BAR 最低位为 1 表示 I/O 端口
+
+/* 类别 */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+#define PCI_SUBCLASS_SATA 0x06
+#define PCI_PROGIF_AHCI 0x01  // SATA 控制器工作在 AHCI 模式
+#define PCI_SUBCLASS_NVM 0x08
+#define PCI_PROGIF_NVME 0x02  // 非易失存储控制器走 NVMe 协议
+
+#define PCI_MAX_DEVS 32  // 最多记录的功能数
+
+/* 一个 PCI 功能的位置及身份 */
+struct pci_dev {
+  uint8_t bus;
+  uint8_t slot;
+  uint8_t func;
+  uint16_t vendor_id;
+  uint16_t device_id;
+  uint8_t class_code;
+  uint8_t subclass;
+  uint8_t prog_if;
+  uint8_t irq_line;
+};
+
+extern struct pci_dev pci_devs[];
+extern uint32_t pci_dev_cnt;
+
+void pci_init(void);
+
+uint32_t pci_read(struct pci_dev* dev, uint8_t offset);
+void pci_write(struct pci_dev* dev, uint8_t offset, uint32_t value);
+bool pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_dev* dev);
+uint32_t pci_bar(struct pci_dev* dev, uint8_t bar_no);
+void pci_enable(struct pci_dev* dev, uint32_t cmd_bits);
+#endif /* DEVICE_PCI */
@@ -0,0 +1,89 @@
+#include "ramdisk.h"
+
+#include "debug.h"
+#include "memory.h"
+#include "stdio.h"
+#include "stdio_kernel.h"
+#include "string.h"
+
+#define RAMDISK_PART_START 8  // 分区的起始扇区,前面是分区表
+
+static struct ramdisk rd;
+
+/* lba 开始的 sec_cnt 个扇区在盘内时返回它们的起始地址,否则返回 NULL */
+static uint8_t* ramdisk_sector(struct block_device* bdev, uint32_t lba,
+                               uint32_t sec_cnt) {
+  if (sec_cnt == 0 || lba >= bdev->sectors ||
+      sec_cnt > bdev->sectors - lba) {
+    return NULL;
+  }
+  struct ramdisk* disk = elem2entry(struct ramdisk, bdev, bdev);
+  return disk->data + lba * 512;
+}
+
+static int32_t ramdisk_read(struct block_device* bdev, uint32_t lba,
+                            void* buf, uint32_t sec_cnt) {
+  uint8_t* src = ramdisk_sector(bdev, lba, sec_cnt);
+  if (src == NULL) {
+    return -1;
+  }
+  memcpy(buf, src, sec_cnt * 512);
+  return 0;
+}
+
+static int32_t ramdisk_write(struct block_device* bdev, uint32_t lba,
+                             void* buf, uint32_t sec_cnt) {
+  uint8_t* dst = ramdisk_sector(bdev, lba, sec_cnt);
+  if (dst == NULL) {
+    return -1;
+  }
+  memcpy(dst, buf, sec_cnt * 512);
+  return 0;
+}
+
+/* 写在返回前就已完成,没有要刷的 */
+static int32_t ramdisk_flush(struct block_device* bdev UNUSED) { return 0; }
+
+/* 在提交者的上下文中直接完成,buf 在用户空间时用的正是提交者的页表 */
+static void ramdisk_submit(struct block_device* bdev, struct bio* bio) {
+  if (bio->write) {
+    bio->error = ramdisk_write(bdev, bio->lba, bio->buf, bio->sec_cnt);
+  } else {
+    bio->error = ramdisk_read(bdev, bio->lba, bio->buf, bio->sec_cnt);
+  }
+  bio->end_io(bio);
+}
+
+static const struct block_device_ops ramdisk_ops = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .flush = ramdisk_flush,
+    .submit = ramdisk_submit,
+};
+
+/* 建一块 RAMDISK_MB 大小的内存盘,写好只有一个主分区的分区表后扫描分区 */
+void ramdisk_init(void) {
+  if (RAMDISK_MB == 0) {
+    return;
+  }
+  rd.data = get_kernel_pages(RAMDISK_MB * 256);  // 每 MB 256 页
+  if (rd.data == NULL) {
+    printk("ramdisk: cannot allocate %dMB\n", RAMDISK_MB);
+    return;
+  }
+  struct block_device* hd = &rd.bdev;
+  sprintf(hd->name, "rda");
+  hd->sectors = RAMDISK_MB * 2048;
+  hd->ops = &ramdisk_ops;
+
+  /* 页已清零,只需填分区表,filesys_init 会把没有文件系统的 rda1 格式化 */
+  struct boot_sector* mbr = (struct boot_sector*)rd.data;
+  mbr->partition_table[0].fs_type = 0x83;
+  mbr->partition_table[0].start_lba = RAMDISK_PART_START;
+  mbr->partition_table[0].sec_cnt = hd->sectors - RAMDISK_PART_START;
+  mbr->signature = 0xaa55;
+
+  printk("%s: %dMB in memory\n", hd->name, RAMDISK_MB);
+  bdev_register(hd);
+  bdev_scan_partitions(hd);
+}
@@ -0,0 +1,19 @@
+#ifndef DEVICE_RAMDISK
+#define DEVICE_RAMDISK
+#include "blk.h"
+#include "stdint.h"
+
+/* 内存盘的大小(MB),0 表示不建内存盘,用 make RAMDISK_MB=4 设置.
+ * 内存取自内核内存池,不要超过它的一半 */
+#ifndef RAMDISK_MB
+#define RAMDISK_MB 0
+#endif
+
+/* 一块内存盘,读写就是内存拷贝,没有寻道和中断,用来单独测文件系统 */
+struct ramdisk {
+  struct block_device bdev;  // 名为 rda,只有一个主分区 rda1
+  uint8_t* data;             // 盘上的全部扇区,虚拟地址连续
+};
+
+void ramdisk_init(void);
+#endif /* DEVICE_RAMDISK */
@@ -4,12 +4,24 @@
 #include "interrupt.h"
 #include "io.h"
 #include "print.h"
+#include "rcu.h"
+#include "sched.h"
+#include "softirq.h"
+#include "sync.h"
 #include "thread.h"
 
 #define IRQ0_FREQUENCY 100                            // 一秒一百次
 #define mil_seconds_per_intr (1000 / IRQ0_FREQUENCY)  // 一次时钟中断多少毫秒
 
 uint32_t ticks;  // ticks 是内核自中断开启以来总共的嘀嗒数
+static uint32_t tsc_per_us;  // 每微秒的 TSC 计数,由 udelay_calibrate 得出
+
+/* 按到期时间排序的定时器,只由 BSP 的 PIT 中断检查 */
+static struct list timer_list;
+static struct spinlock timer_lock;
+static struct timer* running_timer;  // 正在执行回调的定时器,timer_del 要等它执行完
+
+#define CALIBRATE_TICKS 10  // 校准 TSC 时等待的 PIT 周期数
 // 设置控制字寄存器，并且设置计数初始寄存器
 static void frequency_set(uint8_t counter_port, uint8_t counter_on, uint8_t rwl,
                           uint8_t counter_mode, uint16_t counter_value) {
@@ -19,21 +31,193 @@ static void frequency_set(uint8_t counter_port, uint8_t counter_on, uint8_t rwl,
 
   // 设置计数初始寄存器
   outb(counter_port, (uint8_t)counter_value);       // 低8位
-  outb(counter_port, (uint8_t)counter_value >> 8);  // 高8位
+  outb(counter_port, (uint8_t)(counter_value >> 8));  // 高8位
 }
 
-/*时钟中断处理函数*/
-static void intr_timer_handler(void) {
+/*读 TSC 的低 32 位*/
+static inline uint32_t rdtsc_low(void) {
+  uint32_t low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+/*读 64 位的 TSC*/
+uint64_t rdtsc(void) {
+  uint32_t low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+}
+
+/* 64 位数除以 32 位数,得 64 位的商.
+ * 内核不链接 libgcc,没有 64 位除法,分高低两段做 divl */
+static uint64_t div_u64(uint64_t dividend, uint32_t divisor) {
+  uint32_t high = (uint32_t)(dividend >> 32);
+  uint32_t quot_high = high / divisor;
+  uint32_t rem = high % divisor;  // 余数小于除数,低段的商不会溢出
+  uint32_t quot_low = (uint32_t)dividend;
+  asm("divl %2" : "+a"(quot_low), "+d"(rem) : "rm"(divisor));
+  return ((uint64_t)quot_high << 32) | quot_low;
+}
+
+/* 返回从 *stamp 到现在经过的微秒数,并把 *stamp 前移这么多,
+ * 不足一微秒的零头留到下次。按 64 位计算,间隔再长也不截断 */
+uint64_t tsc_elapsed_us(uint64_t* stamp) {
+  uint64_t us = div_u64(rdtsc() - *stamp, tsc_per_us);
+  *stamp += us * tsc_per_us;
+  return us;
+}
+
+/*微秒数换算成毫秒数,超过 32 位的部分截断*/
+uint32_t us_to_ms(uint64_t us) { return (uint32_t)div_u64(us, 1000); }
+
+/*开机以来的毫秒数*/
+uint32_t sys_uptime(void) { return ticks * mil_seconds_per_intr; }
+
+/*锁存并读出计数器 0 的当前值*/
+static uint16_t pit_counter0_read(void) {
+  outb(PIT_CONTROL_PORT, COUNTER0_NO << 6);  // rwl 为 0 表示锁存命令
+  uint8_t low = inb(COUNTER0_PORT);
+  uint8_t high = inb(COUNTER0_PORT);
+  return (high << 8) | low;
+}
+
+/*轮询计数器 0,等它重装 cnt 次(不依赖时钟中断)*/
+static void pit_wait_reload(uint32_t cnt) {
+  uint16_t last = pit_counter0_read();
+  while (cnt > 0) {
+    uint16_t now = pit_counter0_read();
+    if (now > last) {  // 计数值变大说明减到头后重装了
+      cnt--;
+    }
+    last = now;
+  }
+}
+
+/*用 PIT 校准 TSC,之后 udelay 可以在任何核上使用*/
+static void udelay_calibrate(void) {
+  pit_wait_reload(1);  // 先对齐到周期边界
+  uint32_t start = rdtsc_low();
+  pit_wait_reload(CALIBRATE_TICKS);
+  uint32_t elapsed = rdtsc_low() - start;
+  tsc_per_us = elapsed / (CALIBRATE_TICKS * mil_seconds_per_intr * 1000);
+  if (tsc_per_us == 0) {
+    tsc_per_us = 1;
+  }
+}
+
+/*忙等 us 微秒,关中断时也可用*/
+void udelay(uint32_t us) {
+  while (us > 0) {
+    // 分段等待,避免 us * tsc_per_us 溢出
+    uint32_t step = us > 1000 ? 1000 : us;
+    uint32_t start = rdtsc_low();
+    while (rdtsc_low() - start < step * tsc_per_us) {
+      asm volatile("pause");
+    }
+    us -= step;
+  }
+}
+
+/* 对当前任务记账,各核的时钟中断共用。
+ * 该换下时只做标记,由 irq_exit 在中断返回前调度 */
+void timer_tick(void) {
   struct task_struct* cur_thread = running_thread();
   ASSERT(cur_thread->stack_magic == STACK_MAGIC);  // 检查PCB栈是否溢出
 
   cur_thread->elapsed_ticks++;  // 记录次线程占用CPU的时间
+  sched_tick();
+  rcu_tick();
+}
+
+/*a 是否早于 b,用差值比较,不怕 ticks 回绕*/
+static bool ticks_before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+/*第一个定时器是否已到期,调用者需持有 timer_lock*/
+static bool timer_expired(void) {
+  if (list_empty(&timer_list)) {
+    return false;
+  }
+  struct timer* t = elem2entry(struct timer, tag, timer_list.head.next);
+  return !ticks_before(ticks, t->expires);
+}
+
+/*时钟中断处理函数,全局的 ticks 只由 PIT 推进*/
+static void intr_timer_handler(void) {
   ticks++;
-  if (cur_thread->ticks == 0) {  // 若进程时间片用完,就开始调度新的进程上 cpu
-    schedule();                  // 进行调度
-  } else {
-    cur_thread->ticks--;  // 将当前进程的时间片-1
+  timer_tick();
+  sched_sample_load();
+  spin_lock(&timer_lock);
+  if (timer_expired()) {
+    raise_softirq(TIMER_SOFTIRQ);  // 到期的定时器放到中断返回前处理
+  }
+  spin_unlock(&timer_lock);
+}
+
+/*TIMER_SOFTIRQ 的处理函数,依次执行所有到期的定时器*/
+static void run_timers(void) {
+  enum intr_status old_status = spin_lock_irqsave(&timer_lock);
+  while (timer_expired()) {
+    struct timer* t = elem2entry(struct timer, tag, list_pop(&timer_list));
+    running_timer = t;
+    spin_unlock_irqrestore(&timer_lock, old_status);
+    t->func(t->data);
+    old_status = spin_lock_irqsave(&timer_lock);
+    running_timer = NULL;
   }
+  spin_unlock_irqrestore(&timer_lock, old_status);
+}
+
+/*初始化定时器,到期时在软中断中执行 func(data)*/
+void timer_setup(struct timer* t, void (*func)(uint32_t), uint32_t data) {
+  list_elem_init(&t->tag);
+  t->func = func;
+  t->data = data;
+}
+
+/*按到期时间插入,调用者需持有 timer_lock*/
+static void timer_insert(struct timer* t, uint32_t expires) {
+  ASSERT(t->tag.owner == NULL);
+  t->expires = expires;
+  struct list_elem* elem = timer_list.head.next;
+  while (elem != &timer_list.tail) {
+    struct timer* next = elem2entry(struct timer, tag, elem);
+    if (ticks_before(expires, next->expires)) {
+      break;
+    }
+    elem = elem->next;
+  }
+  list_insert_before(elem, &t->tag);
+}
+
+/*在 ticks 达到 expires 时触发 t*/
+void timer_add(struct timer* t, uint32_t expires) {
+  enum intr_status old_status = spin_lock_irqsave(&timer_lock);
+  timer_insert(t, expires);
+  spin_unlock_irqrestore(&timer_lock, old_status);
+}
+
+/* 取消 t,t 还没触发时返回 true。
+ * 回调正在别的核上执行时等它结束,返回后 t 和 data 都可以安全释放,
+ * 因此不能在 t 自己的回调中调用 */
+bool timer_del(struct timer* t) {
+  bool pending = false;
+  enum intr_status old_status = spin_lock_irqsave(&timer_lock);
+  while (running_timer == t) {
+    spin_unlock(&timer_lock);
+    asm volatile("pause" ::: "memory");
+    spin_lock(&timer_lock);
+  }
+  if (t->tag.owner != NULL) {
+    list_remove(&t->tag);
+    pending = true;
+  }
+  spin_unlock_irqrestore(&timer_lock, old_status);
+  return pending;
+}
+
+/*毫秒数换算成 tick 数,向上取整*/
+uint32_t msecs_to_ticks(uint32_t m_seconds) {
+  return DIV_ROUND_UP(m_seconds, mil_seconds_per_intr);
 }
 
 // 初始化PIT8253
@@ -42,19 +226,29 @@ void timer_init() {
   /* 设置 8253 的定时周期,也就是发中断的周期 */
   frequency_set(COUNTER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, COUNTER_MODE,
                 COUNTER0_VALUE);
+  udelay_calibrate();
+  list_init(&timer_list);
+  spin_lock_init(&timer_lock);
+  open_softirq(TIMER_SOFTIRQ, run_timers);
 
   register_handler(0x20, intr_timer_handler);  // 注册中断处理函数
   put_str("timer_init done\n");
 }
 
-/* 以 tick 为单位的 sleep,任何时间形式的 sleep 会转换此 ticks 形式 */
-static void tisks_to_sleep(uint32_t sleep_ticks) {
-  uint32_t start_ticks = ticks;
+/*睡眠到期,唤醒睡眠的任务*/
+static void sleep_timeout(uint32_t data) {
+  thread_unblock((struct task_struct*)data);
+}
 
-  /* 若间隔的 ticks 数不够便让出 cpu */
-  while (ticks - start_ticks < sleep_ticks) {
-    thread_yield();
-  }
+/* 以 tick 为单位的 sleep,任何时间形式的 sleep 会转换此 ticks 形式。
+ * 在 timer_lock 内设置阻塞状态,定时器不会在阻塞之前触发 */
+static void tisks_to_sleep(uint32_t sleep_ticks) {
+  struct timer timer;
+  timer_setup(&timer, sleep_timeout, (uint32_t)running_thread());
+  enum intr_status old_status = spin_lock_irqsave(&timer_lock);
+  timer_insert(&timer, ticks + sleep_ticks);
+  thread_block_unlock(TASK_BLOCKED, &timer_lock);
+  intr_set_status(old_status);
 }
 
 /*以毫秒为单位的sleep*/
@@ -64,6 +258,16 @@ void mtime_sleep(uint32_t m_seconds) {
   tisks_to_sleep(sleep_ticks);
 }
 
+/* 睡眠 m_seconds 毫秒,返回被唤醒后等了多少微秒才重新运行,
+ * 即唤醒延迟,供 cyclictest 之类的测试使用 */
+uint32_t sys_sleep(uint32_t m_seconds) {
+  if (m_seconds == 0) {
+    return 0;
+  }
+  mtime_sleep(m_seconds);
+  return running_thread()->wakeup_latency_us;
+}
+
 /*以秒为单位的sleep*/
 void stime_sleep(uint32_t s_seconds) {
   uint32_t sleep_ticks = DIV_ROUND_UP(s_seconds * 1000, mil_seconds_per_intr);
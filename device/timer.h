@@ -1,5 +1,6 @@
 #ifndef DEVICE_TIMER
 #define DEVICE_TIMER
+#include "list.h"
 #include "stdint.h"
 #define IRQ0_FREQUENCY 100       // IRQ0的频率(时钟中断频率)
 #define INPUT_FREQUENCY 1193180  // 作脉冲信号频率
@@ -13,8 +14,29 @@
 #define READ_WRITE_LATCH 3  // 选择读写方式（先读写低，再读写高）
 #define PIT_CONTROL_PORT 0x43  // 控制字寄存器操作端口
 
+/* 内核定时器,到期时在软中断中执行 func(data),不能睡眠 */
+struct timer {
+  struct list_elem tag;  // 挂在按到期时间排序的定时器队列中
+  uint32_t expires;      // 到期时的 ticks
+  void (*func)(uint32_t data);
+  uint32_t data;
+};
+
+extern uint32_t ticks;
+
 // 初始化PIT8253
 void timer_init();
+void timer_setup(struct timer* t, void (*func)(uint32_t), uint32_t data);
+void timer_add(struct timer* t, uint32_t expires);
+bool timer_del(struct timer* t);
+uint32_t msecs_to_ticks(uint32_t m_seconds);
+uint32_t sys_sleep(uint32_t m_seconds);
+void timer_tick(void);
+void udelay(uint32_t us);
+uint64_t rdtsc(void);
+uint64_t tsc_elapsed_us(uint64_t* stamp);
+uint32_t us_to_ms(uint64_t us);
+uint32_t sys_uptime(void);
 void mtime_sleep(uint32_t m_seconds);
 void stime_sleep(uint32_t s_seconds);
 #endif /* DEVICE_TIMER */
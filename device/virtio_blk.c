@@ -0,0 +1,416 @@
+#include "virtio_blk.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "io.h"
+#include "memory.h"
+#include "pci.h"
+#include "stdio.h"
+#include "stdio_kernel.h"
+#include "thread.h"
+
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001  // 传统(兼容)接口的块设备
+
+/* 传统接口 BAR0 中的寄存器(没有打开 MSI-X 时的布局) */
+#define VIRTIO_PCI_HOST_FEATURES 0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN 0x08  // 队列的物理页号,写 0 表示不用
+#define VIRTIO_PCI_QUEUE_NUM 0x0c
+#define VIRTIO_PCI_QUEUE_SEL 0x0e
+#define VIRTIO_PCI_QUEUE_NOTIFY 0x10
+#define VIRTIO_PCI_STATUS 0x12
+#define VIRTIO_PCI_ISR 0x13     // 读出后清零,第 0 位表示队列有更新
+#define VIRTIO_PCI_CONFIG 0x14  // 设备的配置,块设备是容量等
+
+/* 设备状态 */
+#define VIRTIO_STATUS_ACK 0x1
+#define VIRTIO_STATUS_DRIVER 0x2
+#define VIRTIO_STATUS_DRIVER_OK 0x4
+#define VIRTIO_STATUS_FAILED 0x80
+
+/* 块设备的特性位及配置 */
+#define VIRTIO_BLK_F_SEG_MAX 0x4  // 配置中有一个请求最多的数据段数
+#define VIRTIO_BLK_F_RO 0x20      // 只读
+#define VIRTIO_BLK_CFG_CAPACITY 0x0
+#define VIRTIO_BLK_CFG_SEG_MAX 0xc
+
+#define VIRTIO_BLK_T_IN 0   // 读
+#define VIRTIO_BLK_T_OUT 1  // 写
+
+#define VRING_DESC_F_NEXT 0x1   // 后面还有描述符
+#define VRING_DESC_F_WRITE 0x2  // 设备往这块内存里写
+#define VRING_AVAIL_F_NO_INTERRUPT 0x1  // 驱动告诉设备:做完了先别发中断
+#define VRING_USED_F_NO_NOTIFY 0x1      // 设备告诉驱动:有新请求先别通知
+#define VRING_ALIGN PG_SIZE
+#define VIRTIO_QSIZE_MAX 1024
+
+#define VIRTIO_BLK_MAX_SECS 64  // 一个请求最多的扇区数
+
+struct vring_desc {
+  uint32_t addr;  // 64 位物理地址的低 32 位
+  uint32_t addr_hi;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+};
+
+struct vring_avail {
+  uint16_t flags;
+  uint16_t idx;  // 下一个要填的位置,只增不减,用时对 qsize 取模
+  uint16_t ring[];
+};
+
+struct vring_used_elem {
+  uint32_t id;   // 描述符链的首个下标
+  uint32_t len;  // 设备写入的字节数
+};
+
+struct vring_used {
+  volatile uint16_t flags;
+  volatile uint16_t idx;
+  volatile struct vring_used_elem ring[];
+};
+
+/* 一个请求的头和状态字节,大小整除页,不会跨页 */
+struct virtio_blk_req {
+  uint32_t type;
+  uint32_t reserved;
+  uint32_t sector;  // 64 位扇区号的低 32 位
+  uint32_t sector_hi;
+  volatile uint8_t status;  // 设备写回,0 表示成功
+  uint8_t pad[11];
+  struct request* rq;
+};
+
+uint8_t virtio_blk_cnt;
+struct virtio_blk* virtio_blks[VIRTIO_BLK_MAX_DEVS];
+
+/* 编译器屏障之外还要让之前的写先于之后的读,x86 上只有这种情况会乱序 */
+static inline void virtio_mb(void) {
+  asm volatile("lock; addl $0, (%%esp)" : : : "memory");
+}
+
+/* 项数为 qsize 的队列中 used 环的偏移:描述符表和 avail 环在前,used 环另起一页 */
+static uint32_t vring_used_offset(uint16_t qsize) {
+  uint32_t avail_end = sizeof(struct vring_desc) * qsize +
+                       sizeof(struct vring_avail) + 2 * qsize + 2;
+  return DIV_ROUND_UP(avail_end, VRING_ALIGN) * VRING_ALIGN;
+}
+
+/*项数为 qsize 的队列占的页数*/
+static uint32_t vring_pages(uint16_t qsize) {
+  uint32_t used_size = sizeof(struct vring_used) +
+                       sizeof(struct vring_used_elem) * qsize + 2;
+  return (vring_used_offset(qsize) + DIV_ROUND_UP(used_size, VRING_ALIGN) *
+                                         VRING_ALIGN) / PG_SIZE;
+}
+
+/* 取一个空闲描述符填好,接在 prev 之后(prev 为 -1 表示链首),返回其下标.
+ * merge 为 true 时,与 prev 方向相同且物理上相连的并入 prev */
+static int32_t desc_add(struct virtio_blk* vb, int32_t prev, uint32_t phy_addr,
+                        uint32_t len, uint16_t flags, bool merge) {
+  if (merge && prev >= 0) {
+    struct vring_desc* last = &vb->desc[prev];
+    if ((last->flags & VRING_DESC_F_WRITE) == flags &&
+        last->addr + last->len == phy_addr) {
+      last->len += len;
+      return prev;
+    }
+  }
+  ASSERT(vb->num_free > 0);
+  uint16_t idx = vb->free_head;
+  struct vring_desc* desc = &vb->desc[idx];
+  vb->free_head = desc->next;
+  vb->num_free--;
+  desc->addr = phy_addr;
+  desc->addr_hi = 0;
+  desc->len = len;
+  desc->flags = flags;
+  if (prev >= 0) {
+    vb->desc[prev].flags |= VRING_DESC_F_NEXT;
+    vb->desc[prev].next = idx;
+  }
+  return idx;
+}
+
+/* 把 buf 开始的 len 字节按页拆开接在 prev 之后,返回最后一个描述符的下标.
+ * merge 为 false 时第一段不并入 prev */
+static int32_t desc_add_buf(struct virtio_blk* vb, int32_t prev, void* buf,
+                            uint32_t len, uint16_t flags, bool merge) {
+  uint32_t vaddr = (uint32_t)buf;
+  while (len > 0) {
+    uint32_t size = PG_SIZE - (vaddr & 0xfff);  // 本页剩下的部分
+    if (size > len) {
+      size = len;
+    }
+    prev = desc_add(vb, prev, addr_v2p(vaddr), size, flags, merge);
+    merge = true;
+    vaddr += size;
+    len -= size;
+  }
+  return prev;
+}
+
+/* 把请求 rq 放进 avail 环的第 slot 项,描述符不够时返回 false.
+ * 链的第一项是请求头,接着是数据,最后是设备写回的状态 */
+static bool virtio_add_rq(struct virtio_blk* vb, struct request* rq,
+                          uint16_t slot) {
+  /* 先按跨的页数估计要几个描述符 */
+  uint32_t need = 2;
+  struct list_elem* elem = rq->bios.head.next;
+  while (elem != &rq->bios.tail) {
+    struct bio* bio = elem2entry(struct bio, tag, elem);
+    need += DIV_ROUND_UP(((uint32_t)bio->buf & 0xfff) + bio->sec_cnt * 512,
+                         PG_SIZE);
+    elem = elem->next;
+  }
+  if (need > vb->num_free) {
+    return false;
+  }
+
+  uint16_t head = vb->free_head;
+  struct virtio_blk_req* req = &vb->reqs[head];
+  req->type = rq->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->reserved = 0;
+  req->sector = rq->lba;
+  req->sector_hi = 0;
+  req->status = 0xff;
+  req->rq = rq;
+  int32_t prev = desc_add(vb, -1, addr_v2p((uint32_t)req), 16, 0, false);
+
+  /* 请求头、数据、状态三部分各自成段,互不合并 */
+  uint16_t data_flags = rq->write ? 0 : VRING_DESC_F_WRITE;
+  bool merge = false;
+  elem = rq->bios.head.next;
+  while (elem != &rq->bios.tail) {
+    struct bio* bio = elem2entry(struct bio, tag, elem);
+    bio_access_begin(bio);  // 用户缓冲区要在提交者的页表下求物理地址
+    prev = desc_add_buf(vb, prev, bio->buf, bio->sec_cnt * 512, data_flags,
+                        merge);
+    bio_access_end(bio);
+    merge = true;
+    elem = elem->next;
+  }
+  desc_add(vb, prev, addr_v2p((uint32_t)&req->status), 1, VRING_DESC_F_WRITE,
+           false);
+
+  vb->avail->ring[slot % vb->qsize] = head;
+  return true;
+}
+
+/* 从队列中取请求放进 avail 环,一批放完后只通知设备一次,
+ * 设备正在处理队列(置了 NO_NOTIFY)时连这一次也省掉 */
+static void virtio_issue(struct virtio_blk* vb) {
+  uint16_t avail_idx = vb->avail->idx;
+  uint16_t added = 0;
+  while (1) {
+    struct request* rq = vb->pending;
+    if (rq == NULL) {
+      rq = blk_fetch_request(&vb->bdev.queue);
+      if (rq == NULL) {
+        break;
+      }
+    }
+    if (!virtio_add_rq(vb, rq, avail_idx + added)) {
+      vb->pending = rq;  // 等有请求做完、还回描述符后再发
+      break;
+    }
+    vb->pending = NULL;
+    added++;
+  }
+  if (added == 0) {
+    return;
+  }
+  asm volatile("" : : : "memory");  // 描述符和 ring 写好后才能更新 idx
+  vb->avail->idx = avail_idx + added;
+  vb->inflight += added;
+  if (vb->inflight > vb->max_inflight) {
+    vb->max_inflight = vb->inflight;
+  }
+  virtio_mb();  // 先让设备看到新的 idx,再看它要不要通知
+  if (!(vb->used->flags & VRING_USED_F_NO_NOTIFY)) {
+    outw(vb->io_base + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+    vb->nr_notify++;
+  }
+}
+
+/* 收割 used 环中做完的请求,把描述符链还回空闲链表 */
+static void virtio_complete(struct virtio_blk* vb) {
+  while (vb->last_used != vb->used->idx) {
+    asm volatile("" : : : "memory");  // 先读 idx 再读 ring
+    uint16_t head = vb->used->ring[vb->last_used % vb->qsize].id;
+    struct virtio_blk_req* req = &vb->reqs[head];
+    struct request* rq = req->rq;
+    int32_t error = req->status == 0 ? 0 : -1;
+
+    uint16_t idx = head;
+    while (vb->desc[idx].flags & VRING_DESC_F_NEXT) {
+      idx = vb->desc[idx].next;
+      vb->num_free++;
+    }
+    vb->desc[idx].next = vb->free_head;
+    vb->free_head = head;
+    vb->num_free++;
+    vb->last_used++;
+    vb->inflight--;
+    if (error != 0) {
+      printk("%s: request at lba %d failed, status %d\n", vb->bdev.name,
+             rq->lba, req->status);
+    }
+    blk_end_request(rq, error);
+  }
+}
+
+/* 硬盘的完成线程:收割做完的请求,再把新的请求放进队列,没事可做时睡眠.
+ * 醒着的时候让设备不发中断,睡前打开并再看一眼 used 环,免得漏掉 */
+static void virtio_blk_thread(void* arg) {
+  struct virtio_blk* vb = arg;
+  while (1) {
+    enum intr_status old_status = wait_queue_lock(&vb->wq);
+    while (!vb->event) {
+      wait_queue_sleep(&vb->wq, false, 0);
+    }
+    vb->event = false;
+    wait_queue_unlock(&vb->wq, old_status);
+
+    vb->avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    while (1) {
+      virtio_complete(vb);
+      virtio_issue(vb);
+      vb->avail->flags = 0;
+      virtio_mb();
+      if (vb->used->idx == vb->last_used) {
+        break;
+      }
+      vb->avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    }
+  }
+}
+
+/*有新请求或中断时唤醒硬盘的完成线程*/
+static void virtio_blk_wake(struct virtio_blk* vb) {
+  enum intr_status old_status = wait_queue_lock(&vb->wq);
+  vb->event = true;
+  wake_up_locked(&vb->wq, 1);
+  wait_queue_unlock(&vb->wq, old_status);
+}
+
+static void virtio_blk_kick(struct blk_queue* q) {
+  virtio_blk_wake(q->driver_data);
+}
+
+static void virtio_blk_tasklet_func(uint32_t data) {
+  virtio_blk_wake((struct virtio_blk*)data);
+}
+
+/* virtio 硬盘的中断处理程序,几块硬盘可能共用一个中断号,逐个读 ISR 看是谁 */
+static void intr_virtio_blk_handler(uint8_t irq_no UNUSED) {
+  uint8_t idx;
+  for (idx = 0; idx < virtio_blk_cnt; idx++) {
+    struct virtio_blk* vb = virtio_blks[idx];
+    if (inb(vb->io_base + VIRTIO_PCI_ISR) & 0x1) {  // 读 ISR 同时撤销中断
+      vb->nr_irq++;
+      tasklet_schedule(&vb->intr_tasklet);
+    }
+  }
+}
+
+/* 初始化 PCI 功能 pci 上的 virtio 硬盘,成功时加入 virtio_blks */
+static bool virtio_blk_probe(struct pci_dev* pci) {
+  pci_enable(pci, PCI_CMD_IO | PCI_CMD_MASTER);
+  uint16_t io_base = pci_bar(pci, 0);
+  outb(io_base + VIRTIO_PCI_STATUS, 0);  // 复位
+  outb(io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK);
+  outb(io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+  uint32_t features = inl(io_base + VIRTIO_PCI_HOST_FEATURES);
+  outl(io_base + VIRTIO_PCI_GUEST_FEATURES, features & VIRTIO_BLK_F_SEG_MAX);
+
+  outw(io_base + VIRTIO_PCI_QUEUE_SEL, 0);
+  uint16_t qsize = inw(io_base + VIRTIO_PCI_QUEUE_NUM);
+  struct virtio_blk* vb = get_kernel_pages(1);
+  void* ring = NULL;
+  if (qsize != 0 && qsize <= VIRTIO_QSIZE_MAX) {
+    ring = get_kernel_pages_contig(vring_pages(qsize));
+  }
+  uint32_t req_pages =
+      DIV_ROUND_UP(qsize * sizeof(struct virtio_blk_req), PG_SIZE);
+  void* reqs = ring == NULL ? NULL : get_kernel_pages(req_pages);
+  if (vb == NULL || reqs == NULL) {
+    printk("virtio_blk: queue size %d not usable\n", qsize);
+    outb(io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+    return false;  // 启动时内存不会不够,这里不再回收
+  }
+
+  vb->io_base = io_base;
+  vb->qsize = qsize;
+  vb->desc = ring;
+  vb->avail = (struct vring_avail*)((uint32_t)ring +
+                                    sizeof(struct vring_desc) * qsize);
+  vb->used = (struct vring_used*)((uint32_t)ring + vring_used_offset(qsize));
+  vb->reqs = reqs;
+  uint16_t idx;
+  for (idx = 0; idx < qsize - 1; idx++) {
+    vb->desc[idx].next = idx + 1;
+  }
+  vb->free_head = 0;
+  vb->num_free = qsize;
+  outl(io_base + VIRTIO_PCI_QUEUE_PFN, addr_v2p((uint32_t)ring) >> 12);
+
+  /* 一个扇区最多跨两页,请求的数据段数不能超过设备的限制和队列的项数 */
+  uint32_t seg_max = qsize - 2;
+  if (features & VIRTIO_BLK_F_SEG_MAX) {
+    uint32_t dev_seg_max =
+        inl(io_base + VIRTIO_PCI_CONFIG + VIRTIO_BLK_CFG_SEG_MAX);
+    if (dev_seg_max != 0 && dev_seg_max < seg_max) {
+      seg_max = dev_seg_max;
+    }
+  }
+  uint32_t max_secs = seg_max / 2 < VIRTIO_BLK_MAX_SECS ? seg_max / 2
+                                                        : VIRTIO_BLK_MAX_SECS;
+
+  struct block_device* hd = &vb->bdev;
+  sprintf(hd->name, "vd%c", 'a' + virtio_blk_cnt);
+  hd->sectors = inl(io_base + VIRTIO_PCI_CONFIG + VIRTIO_BLK_CFG_CAPACITY);
+  if (inl(io_base + VIRTIO_PCI_CONFIG + VIRTIO_BLK_CFG_CAPACITY + 4) != 0) {
+    hd->sectors = 0xffffffff;  // 只用得到 32 位扇区号
+  }
+  printk("%s: %dMB, queue size %d, %d sectors per request%s\n", hd->name,
+         hd->sectors / 2048, qsize, max_secs,
+         features & VIRTIO_BLK_F_RO ? ", read only" : "");
+
+  hd->ops = &blk_queue_ops;
+  blk_queue_init(&hd->queue, max_secs, virtio_blk_kick, vb);
+  wait_queue_init(&vb->wq);
+  tasklet_init(&vb->intr_tasklet, virtio_blk_tasklet_func, (uint32_t)vb);
+  vb->thread = thread_start(hd->name, 31, virtio_blk_thread, vb);
+  outb(io_base + VIRTIO_PCI_STATUS,
+       VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+  virtio_blks[virtio_blk_cnt++] = vb;
+  bdev_register(hd);
+  return true;
+}
+
+/* 找出 PCI 上所有的 virtio 硬盘,初始化后扫描其中的分区 */
+void virtio_blk_init(void) {
+  uint32_t idx;
+  for (idx = 0; idx < pci_dev_cnt && virtio_blk_cnt < VIRTIO_BLK_MAX_DEVS;
+       idx++) {
+    struct pci_dev* pci = &pci_devs[idx];
+    if (pci->vendor_id != VIRTIO_VENDOR_ID ||
+        pci->device_id != VIRTIO_BLK_DEVICE_ID) {
+      continue;
+    }
+    if (pci->irq_line >= 16) {
+      printk("virtio_blk: no irq assigned, disabled\n");
+      continue;
+    }
+    if (virtio_blk_probe(pci)) {
+      register_handler(0x20 + pci->irq_line, intr_virtio_blk_handler);
+      pic_unmask(pci->irq_line);
+    }
+  }
+  for (idx = 0; idx < virtio_blk_cnt; idx++) {
+    bdev_scan_partitions(&virtio_blks[idx]->bdev);
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef DEVICE_VIRTIO_BLK
+#define DEVICE_VIRTIO_BLK
+#include "blk.h"
+#include "softirq.h"
+#include "stdint.h"
+#include "sync.h"
+
+#define VIRTIO_BLK_MAX_DEVS 4
+
+struct vring_desc;
+struct vring_avail;
+struct vring_used;
+struct virtio_blk_req;
+
+/* 一块 virtio 硬盘(传统 PCI 接口),只用一个虚拟队列 */
+struct virtio_blk {
+  struct block_device bdev;  // 对上层是一个块设备,经 bdev.queue 读写
+  uint16_t io_base;  // BAR0,传统接口的寄存器都在 I/O 空间
+  uint16_t qsize;    // 队列的项数,由设备决定
+  struct vring_desc* desc;    // 描述符表
+  struct vring_avail* avail;  // 驱动交给设备的描述符链
+  struct vring_used* used;    // 设备做完还回来的描述符链
+  uint16_t free_head;         // 空闲描述符用 next 串成链表
+  uint16_t num_free;
+  uint16_t last_used;         // 已收割到 used 环的哪里
+  struct virtio_blk_req* reqs;     // 各请求的头和状态,按首个描述符的下标
+  struct request* pending;         // 已取出但描述符不够,等有空闲再发
+  uint32_t inflight;               // 已交给设备的请求数
+  uint32_t max_inflight;           // 统计:同时在做的请求数的最大值
+  uint32_t nr_notify;              // 统计:通知设备的次数
+  uint32_t nr_irq;                 // 统计:收到的中断数
+  bool event;                      // 有新请求或中断,由 wq 的锁保护
+  struct wait_queue wq;            // 完成线程在此等待
+  struct tasklet intr_tasklet;     // 在中断返回前唤醒完成线程
+  struct task_struct* thread;      // 发请求并收割完成的请求的线程
+};
+
+extern uint8_t virtio_blk_cnt;
+extern struct virtio_blk* virtio_blks[];
+
+void virtio_blk_init(void);
+#endif /* DEVICE_VIRTIO_BLK */
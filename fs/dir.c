@@ -3,7 +3,7 @@
 #include "debug.h"
 #include "file.h"
 #include "fs.h"
-#include "ide.h"
+#include "blk.h"
 #include "inode.h"
 #include "memory.h"
 #include "process.h"
@@ -35,7 +35,7 @@ bool search_dir_entry(struct partition* part, struct dir* pdir,
   }
   block_idx = 0;
   if (pdir->inode->i_sectors[12] != 0) {  // 若含有一级间接块
-    ide_read(part->my_disk, pdir->inode->i_sectors[12], all_blocks + 12, 1);
+    bdev_read(part->my_disk, pdir->inode->i_sectors[12], all_blocks + 12, 1);
   }
   uint8_t* buf = (uint8_t*)sys_malloc(SECTOR_SIZE);
 
@@ -50,7 +50,7 @@ bool search_dir_entry(struct partition* part, struct dir* pdir,
       block_idx++;
       continue;
     }
-    ide_read(part->my_disk, all_blocks[block_idx], buf, 1);
+    bdev_read(part->my_disk, all_blocks[block_idx], buf, 1);
     uint32_t dir_entry_idx = 0;
     // 遍历该块中所有的目录项
     while (dir_entry_idx < dir_entry_cnt) {
@@ -106,7 +106,7 @@ void create_dir_entry(char* filename, uint32_t inode_no, uint8_t file_types,
 bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de,
                     void* io_buf) {
   struct inode* dir_inode = parent_dir->inode;
-  uint32_t dir_size = dir_inode->i_size;
+  uint32_t dir_size UNUSED = dir_inode->i_size;
   uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
 
   ASSERT(dir_size % dir_entry_size == 0);  // 保证是整数个条目
@@ -162,22 +162,22 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de,
 
         all_blocks[12] = block_lba;
         /* 把新分配的第 0 个间接块地址写入一级间接块表 */
-        ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
-                  1);
+        bdev_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
+                   1);
       } else {  // 已经分配了12
         all_blocks[block_idx] = block_lba;
-        ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
-                  1);
+        bdev_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
+                   1);
       }
 
       /* 再将新目录项 p_de 写入新分配的间接块 */
       memset(io_buf, 0, 512);
       memcpy(io_buf, p_de, dir_entry_size);
-      ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+      bdev_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
       dir_inode->i_size += dir_entry_size;
       return true;
     }
-    ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+    bdev_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
     /*在扇区中查找空目录项*/
     uint8_t dir_entry_idx = 0;
     while (dir_entry_idx < dir_entrys_per_sec) {
@@ -185,7 +185,7 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de,
         // FT_UNKNOWN 为 0,无论是初始化,或是删除文件后,
         // 都会将 f_type 置为 FT_UNKNOWN
         memcpy(dir_e + dir_entry_idx, p_de, dir_entry_size);
-        ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+        bdev_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
         dir_inode->i_size += dir_entry_size;
         return true;
       }
@@ -194,7 +194,8 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de,
     block_idx++;
     // 读取二级块
     if (block_idx > 12) {
-      ide_read(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+      bdev_read(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
+                1);
     }
   }
   printk("directory is full!\n");
@@ -214,7 +215,7 @@ bool delete_dir_entry(struct partition* part, struct dir* pgdir,
   }
 
   if (dir_inode->i_sectors[12] != 0) {
-    ide_read(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+    bdev_read(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
   }
 
   /*目录项存储时保证不会跨扇区*/
@@ -237,7 +238,7 @@ bool delete_dir_entry(struct partition* part, struct dir* pgdir,
 
     dir_entry_idx = dir_entry_cnt = 0;
     /* 读取扇区,获得目录项 */
-    ide_read(part->my_disk, all_blocks[block_idx], io_buf, 1);
+    bdev_read(part->my_disk, all_blocks[block_idx], io_buf, 1);
 
     /* 遍历所有的目录项,统计该扇区的目录项数量及是否有待删除的目录项 */
     while (dir_entry_idx < dir_entry_per_sec) {
@@ -288,8 +289,8 @@ bool delete_dir_entry(struct partition* part, struct dir* pgdir,
         // 同步
         if (indirect_blocks > 1) {
           all_blocks[block_idx] = 0;
-          ide_write(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
-                    1);
+          bdev_write(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12,
+                     1);
         } else {  // indirect_blocks =1
           block_bitmap_idx =
               dir_inode->i_sectors[12] - part->sb->data_start_lba;
@@ -302,7 +303,7 @@ bool delete_dir_entry(struct partition* part, struct dir* pgdir,
     } else {
       // 仅将该目录项清空
       memset(dir_entry_found, 0, dir_entry_size);
-      ide_write(part->my_disk, all_blocks[block_idx], io_buf, 1);
+      bdev_write(part->my_disk, all_blocks[block_idx], io_buf, 1);
     }
     /* 更新 i 结点信息并同步到硬盘 */
     ASSERT(dir_inode->i_size >= dir_entry_size);
@@ -327,7 +328,7 @@ struct dir_entry* dir_read(struct dir* dir) {
   }
   if (dir_inode->i_sectors[12] != 0) {
     // 若含有一级间接块表
-    ide_read(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+    bdev_read(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
     block_cnt = 140;
   }
   block_idx = 0;
@@ -345,7 +346,7 @@ struct dir_entry* dir_read(struct dir* dir) {
       continue;
     }
     memset(dir_e, 0, SECTOR_SIZE);
-    ide_read(cur_part->my_disk, all_blocks[block_idx], dir_e, 1);
+    bdev_read(cur_part->my_disk, all_blocks[block_idx], dir_e, 1);
 
     dir_entry_idx = 0;
 
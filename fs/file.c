@@ -8,11 +8,18 @@
 #include "stdio_kernel.h"
 #include "string.h"
 #include "super_block.h"
+#include "sync.h"
 #include "thread.h"
 
 /*文件表*/
 struct file file_table[MAX_FILE_OPEN];
 
+/* 保护文件表各项的 fd_inode,分配和释放表项要写锁,按 inode 查找只需读锁 */
+static struct rwlock file_table_lock;
+
+/* 保护 inode 的 write_deny 标记 */
+static struct spinlock write_deny_lock;
+
 /*分配一个节点*/
 int32_t inode_bitmap_alloc(struct partition* part) {
   int32_t bit_idx = bitmap_scan(&part->inode_bitmap, 1);
@@ -33,15 +40,28 @@ int32_t block_bitmap_alloc(struct partition* part) {
   return (part->sb->data_start_lba + bit_idx);
 }
 
-/*从文件表file_table中获取一个空闲位，成功返回下标，失败返回-1*/
-int32_t get_free_slot_in_global(void) {
+/*初始化文件表*/
+void file_table_init(void) {
+  rwlock_init(&file_table_lock);
+  uint32_t fd_idx = 0;
+  while (fd_idx < MAX_FILE_OPEN) {
+    file_table[fd_idx++].fd_inode = NULL;
+  }
+}
+
+/* 从文件表file_table中获取一个空闲位并让它指向 inode,
+ * 查找和占用在同一把写锁内完成.成功返回下标，失败返回-1 */
+int32_t get_free_slot_in_global(struct inode* inode) {
+  write_lock(&file_table_lock);
   uint32_t fd_idx = 3;
   while (fd_idx < MAX_FILE_OPEN) {
     if (file_table[fd_idx].fd_inode == NULL) {
+      file_table[fd_idx].fd_inode = inode;
       break;
     }
     fd_idx++;
   }
+  write_unlock(&file_table_lock);
   if (fd_idx == MAX_FILE_OPEN) {
     printk("exceed max open files\n");
     return -1;
@@ -49,6 +69,30 @@ int32_t get_free_slot_in_global(void) {
   return fd_idx;
 }
 
+/*归还文件表中的 fd_idx 项*/
+void file_slot_release(uint32_t fd_idx) {
+  write_lock(&file_table_lock);
+  file_table[fd_idx].fd_inode = NULL;
+  write_unlock(&file_table_lock);
+}
+
+/*文件表中是否有打开 inode_no 的项*/
+bool file_inode_in_use(uint32_t inode_no) {
+  bool in_use = false;
+  read_lock(&file_table_lock);
+  uint32_t fd_idx = 0;
+  while (fd_idx < MAX_FILE_OPEN) {
+    struct inode* inode = file_table[fd_idx].fd_inode;
+    if (inode != NULL && inode->i_no == inode_no) {
+      in_use = true;
+      break;
+    }
+    fd_idx++;
+  }
+  read_unlock(&file_table_lock);
+  return in_use;
+}
+
 /*将内存中bitmap第bit_idx位所在的512字节同步到硬盘*/
 void bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp) {
   uint32_t off_sec = bit_idx / 4096;         // 该位扇区偏移量
@@ -67,7 +111,7 @@ void bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp) {
       bitmap_off = part->block_bitmap.bits + off_size;
       break;
   }
-  ide_write(part->my_disk, sec_lba, bitmap_off, 1);
+  bdev_write(part->my_disk, sec_lba, bitmap_off, 1);
 }
 
 int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag) {
@@ -104,14 +148,12 @@ int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag) {
 
   inode_init(inode_no, new_file_inode);  // 初始化inode节点
 
-  int fd_idx = get_free_slot_in_global();
+  int fd_idx = get_free_slot_in_global(new_file_inode);
   if (fd_idx == -1) {
-    printk("exceed max open files\n");
     rollback_step = 2;
     goto rollback;
   }
 
-  file_table[fd_idx].fd_inode = new_file_inode;
   file_table[fd_idx].fd_pos = 0;
   file_table[fd_idx].fd_flag = flag;
   file_table[fd_idx].fd_inode->write_deny = false;
@@ -139,15 +181,14 @@ int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag) {
 
   /*将创建的文件inode节点添加到open_inodes链表*/
 
-  list_push(&cur_part->open_inodes, &new_file_inode->inode_tag);
-  new_file_inode->i_open_cnts = 1;
+  inode_install(cur_part, new_file_inode);
   sys_free(io_buf);
 
   return pcb_fd_install(fd_idx);
 rollback:
   switch (rollback_step) {
     case 3:
-      memset(&file_table[fd_idx], 0, sizeof(struct file));
+      file_slot_release(fd_idx);
     case 2:
       sys_free(new_file_inode);
     case 1:
@@ -159,24 +200,24 @@ rollback:
 }
 
 int32_t file_open(uint32_t inode_no, uint8_t flag) {
-  int fd_idx = get_free_slot_in_global();
+  struct inode* inode = inode_open(cur_part, inode_no);
+  int fd_idx = get_free_slot_in_global(inode);
   if (fd_idx == -1) {
-    printk("exceed max open files\n");
+    inode_close(inode);
     return -1;
   }
-  file_table[fd_idx].fd_inode = inode_open(cur_part, inode_no);
   file_table[fd_idx].fd_pos = 0;
   file_table[fd_idx].fd_flag = flag;
   bool* write_deny = &file_table[fd_idx].fd_inode->write_deny;
 
   // 如果是具有写权限的打开方式，访问write_den要在临界区
   if (flag & O_RDWR || flag & O_WRONLY) {
-    enum intr_status old_status = intr_disable();
+    enum intr_status old_status = spin_lock_irqsave(&write_deny_lock);
     if (!(*write_deny)) {
       *write_deny = true;
-      intr_set_status(old_status);
+      spin_unlock_irqrestore(&write_deny_lock, old_status);
     } else {
-      intr_set_status(old_status);
+      spin_unlock_irqrestore(&write_deny_lock, old_status);
       printk("file can’t be open now, try again later\n");
       return -1;
     }
@@ -191,7 +232,7 @@ int32_t file_close(struct file* f) {
   f->fd_inode->write_deny = false;
 
   inode_close(f->fd_inode);
-  f->fd_inode = NULL;
+  file_slot_release(f - file_table);
   return 0;
 }
 
@@ -265,7 +306,7 @@ int32_t file_write(struct file* file, const void* buf, uint32_t count) {
       // 使用间接块
       ASSERT(file->fd_inode->i_sectors[12] != 0);
       indirect_block_table = file->fd_inode->i_sectors[12];
-      ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
     }
   } else {
     // 如果有增量，分三种情况
@@ -340,14 +381,14 @@ int32_t file_write(struct file* file, const void* buf, uint32_t count) {
         block_idx++;  // 下一个扇区
       }
       // 同步一级间接块表到硬盘
-      ide_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
     } else if (file_has_used_blocks > 12) {
       // 第三种，全部使用间接块
       ASSERT(file->fd_inode->i_sectors[12] != 0);
       // 已经具备一级间接块表
       // 将所有的间接块读入内存
       indirect_block_table = file->fd_inode->i_sectors[12];
-      ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
 
       block_idx = file_has_used_blocks;  // 第一个未使用的间接块
 
@@ -363,7 +404,7 @@ int32_t file_write(struct file* file, const void* buf, uint32_t count) {
         bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
       }
       // 同步一级间接块表到硬盘
-      ide_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
     }
   }
 
@@ -381,11 +422,11 @@ int32_t file_write(struct file* file, const void* buf, uint32_t count) {
     /* 判断此次写入硬盘的数据大小 */
     chunk_size = size_left < sec_left_bytes ? size_left : sec_left_bytes;
     if (first_write_block) {
-      ide_read(cur_part->my_disk, sec_lba, io_buf, 1);
+      bdev_read(cur_part->my_disk, sec_lba, io_buf, 1);
       first_write_block = false;
     }
     memcpy(io_buf + sec_off_bytes, src, chunk_size);
-    ide_write(cur_part->my_disk, sec_lba, io_buf, 1);
+    bdev_write(cur_part->my_disk, sec_lba, io_buf, 1);
     printk("file write at lba 0x%x\n", sec_lba);  // 调试,完成后去掉
 
     src += chunk_size;  // 将指针推移到下一个新数据
@@ -405,21 +446,14 @@ int32_t file_write(struct file* file, const void* buf, uint32_t count) {
 int32_t file_read(struct file* file, void* buf, uint32_t count) {
   uint8_t* buf_dst = (uint8_t*)buf;
   uint32_t size = count;
-  uint32_t size_left = size;
 
   /* 若要读取的字节数超过了文件可读的剩余量,就用剩余量作为待读取的字节数 */
   if ((file->fd_pos + count) > file->fd_inode->i_size) {
     size = file->fd_inode->i_size - file->fd_pos;
-    size_left = size;
     if (size == 0) {  // 读到文件尾巴,则返回-1
       return -1;
     }
   }
-  uint8_t* io_buf = sys_malloc(BLOCK_SIZE);
-  if (io_buf == NULL) {
-    printk("file_read: sys_malloc for io_buf failed\n");
-    return -1;
-  }
   uint32_t* all_blocks = (uint32_t*)sys_malloc(140 * 4);
   if (all_blocks == NULL) {
     printk("file_read: sys_malloc for all_blocks failed\n");
@@ -444,7 +478,7 @@ int32_t file_read(struct file* file, void* buf, uint32_t count) {
     } else {
       // 第二种情况，间接块
       indirect_block_table = file->fd_inode->i_sectors[12];
-      ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
     }
   } else {  // 要读多个块
     if (block_read_end_idx < 12) {
@@ -466,36 +500,34 @@ int32_t file_read(struct file* file, void* buf, uint32_t count) {
       ASSERT(file->fd_inode->i_sectors[12] != 0);
       // 再读入间接块
       indirect_block_table = file->fd_inode->i_sectors[12];
-      ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
 
     } else {
       //  第三种情况， 都是间接块
       ASSERT(file->fd_inode->i_sectors[12] != 0);
       indirect_block_table = file->fd_inode->i_sectors[12];
-      ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+      bdev_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
     }
   }
 
   // 需要用到的block地址已经收集完成
-  uint32_t sec_idx, sec_lba, sec_off_bytes, sec_left_bytes, chunk_size;
-  uint32_t bytes_read = 0;
-  while (bytes_read < size) {
-    sec_idx = file->fd_pos / BLOCK_SIZE;
-    sec_lba = all_blocks[sec_idx];
-    sec_off_bytes = file->fd_pos % BLOCK_SIZE;
-    sec_left_bytes = BLOCK_SIZE - sec_off_bytes;  // 这个扇区要读的数据数量
-    chunk_size = size_left < sec_left_bytes ? size_left : sec_left_bytes;
-
-    memset(io_buf, 0, BLOCK_SIZE);
-
-    ide_read(cur_part->my_disk, sec_lba, io_buf, 1);
-    memcpy(buf_dst, io_buf + sec_off_bytes, chunk_size);
-    buf_dst += chunk_size;
-    file->fd_pos += chunk_size;
-    bytes_read += chunk_size;
-    size_left -= chunk_size;
+  /* 把要用到的扇区一次提交,相邻的扇区在请求队列中合并,
+   * 读到连续的缓冲区后整段拷贝 */
+  uint32_t last_idx = (file->fd_pos + size - 1) / BLOCK_SIZE;
+  uint32_t sec_cnt = last_idx - block_read_start_idx + 1;
+  uint8_t* io_buf = sys_malloc(sec_cnt * BLOCK_SIZE);
+  if (io_buf == NULL) {
+    printk("file_read: sys_malloc for io_buf failed\n");
+    sys_free(all_blocks);
+    return -1;
+  }
+  if (blk_read_sectors(cur_part->my_disk, all_blocks + block_read_start_idx,
+                       sec_cnt, io_buf) != 0) {
+    PANIC("file_read: read sectors failed\n");
   }
+  memcpy(buf_dst, io_buf + file->fd_pos % BLOCK_SIZE, size);
+  file->fd_pos += size;
   sys_free(all_blocks);
   sys_free(io_buf);
-  return bytes_read;
+  return size;
 }
\ No newline at end of file
@@ -26,7 +26,10 @@ enum bitmap_type {
 
 extern struct file file_table[MAX_FILE_OPEN];
 
-int32_t get_free_slot_in_global(void);
+void file_table_init(void);
+int32_t get_free_slot_in_global(struct inode* inode);
+void file_slot_release(uint32_t fd_idx);
+bool file_inode_in_use(uint32_t inode_no);
 int32_t inode_bitmap_alloc(struct partition* part);
 int32_t block_bitmap_alloc(struct partition* part);
 int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag);
@@ -18,6 +18,11 @@
 #include "syscall_init.h"
 #include "thread.h"
 
+/* 默认挂载的分区,编译时可用 make ROOT_PART=rda1 换成内存盘 */
+#ifndef ROOT_PART
+#define ROOT_PART "sdb1"
+#endif
+
 struct partition* cur_part;  // 默认情况下操作的是哪一个分区
 
 /*在分区链表中找到名为part_name的分区，并将其指针赋给cur_part*/
@@ -26,7 +31,7 @@ static bool mount_partition(struct list_elem* pelem, int arg) {
   struct partition* part = elem2entry(struct partition, part_tag, pelem);
   if (!strcmp(part->name, part_name)) {
     cur_part = part;
-    struct disk* hd = cur_part->my_disk;
+    struct block_device* hd = cur_part->my_disk;
 
     /*sd_buf用来存储从硬盘上读入的超级块*/
     struct super_block* sb_buf = (struct super_block*)sys_malloc(SECTOR_SIZE);
@@ -38,7 +43,7 @@ static bool mount_partition(struct list_elem* pelem, int arg) {
     }
     /*读入超级块*/
     memset(sb_buf, 0, SECTOR_SIZE);
-    ide_read(hd, cur_part->start_lba + 1, sb_buf, 1);
+    bdev_read(hd, cur_part->start_lba + 1, sb_buf, 1);
     /* 把 sb_buf 中超级块的信息复制到分区的超级块 sb 中 */
     memcpy(cur_part->sb, sb_buf, sizeof(struct super_block));
 
@@ -51,8 +56,8 @@ static bool mount_partition(struct list_elem* pelem, int arg) {
     cur_part->block_bitmap.btmp_bytes_len =
         sb_buf->block_bitmap_sects * SECTOR_SIZE;
     // 从磁盘中读取块位图
-    ide_read(hd, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits,
-             sb_buf->block_bitmap_sects);
+    bdev_read(hd, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits,
+              sb_buf->block_bitmap_sects);
 
     /**********将硬盘上的 inode 位图读入到内存************/
     cur_part->inode_bitmap.bits =
@@ -62,8 +67,8 @@ static bool mount_partition(struct list_elem* pelem, int arg) {
     }
     cur_part->inode_bitmap.btmp_bytes_len =
         sb_buf->inode_bitmap_sects * SECTOR_SIZE;
-    ide_read(hd, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits,
-             sb_buf->inode_bitmap_sects);
+    bdev_read(hd, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits,
+              sb_buf->inode_bitmap_sects);
 
     list_init(&cur_part->open_inodes);
     printk("mount %s done!\n", part->name);
@@ -85,7 +90,8 @@ static void partition_format(struct partition* part) {
       DIV_ROUND_UP(MAX_FILES_PER_PART, BITS_PER_SECTOR);
 
   uint32_t inode_table_sects =
-      DIV_ROUND_UP((sizeof(struct inode) * MAX_FILES_PER_PART), SECTOR_SIZE);
+      DIV_ROUND_UP((sizeof(struct inode_disk) * MAX_FILES_PER_PART),
+                   SECTOR_SIZE);
 
   uint32_t used_sects = boot_sector_sects + super_block_sects +
                         inode_bitmap_sects + inode_table_sects;
@@ -102,7 +108,7 @@ static void partition_format(struct partition* part) {
 
   /*超级块初始化*/
   struct super_block sb;
-  sb.magic = 0x19590318;
+  sb.magic = SUPER_BLOCK_MAGIC;
   sb.sec_cnt = part->sec_cnt;
   sb.inode_cnt = MAX_FILES_PER_PART;
   sb.part_lba_base = part->start_lba;
@@ -134,10 +140,10 @@ static void partition_format(struct partition* part) {
   printk("inode_table_sectors : 0x%x\n", sb.inode_table_sects);
   printk("data_start_lba : 0x%x\n", sb.data_start_lba);
 
-  struct disk* hd = part->my_disk;
+  struct block_device* hd = part->my_disk;
 
   /*1. 将超级块写入本分区的1扇区*/
-  ide_write(hd, part->start_lba + 1, &sb, 1);
+  bdev_write(hd, part->start_lba + 1, &sb, 1);
   printk("super_block_lba:0x%x\n", part->start_lba + 1);
 
   /*找数据量最大的元信息，用其尺寸做存储缓冲区(存放位图)*/
@@ -164,24 +170,24 @@ static void partition_format(struct partition* part) {
     buf[block_bitmap_last_byte] &= ~(1 << bit_idx++);
   }
 
-  ide_write(hd, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);
+  bdev_write(hd, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);
 
   // 3 将 inode 位图初始化并写入 sb.inode_bitmap_lba
   // 先清空缓冲区
   memset(buf, 0, buf_size);
   buf[0] |= 0x1;
   // inode一个4096个刚好占用一个扇区
-  ide_write(hd, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
+  bdev_write(hd, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
 
   // 4 将 inode 数组初始化并写入 sb.inode_table_lba
   memset(buf, 0, buf_size);
   // 写入第0个inode(第0个指向根目录)
-  struct inode* i = (struct inode*)buf;
+  struct inode_disk* i = (struct inode_disk*)buf;
   i->i_size = sb.dir_entry_size * 2;  // .和..
   i->i_no = 0;  // 根目录占inode数组中的第0个inode
   i->i_sectors[0] = sb.data_start_lba;
 
-  ide_write(hd, sb.inode_table_lba, buf, sb.inode_table_sects);
+  bdev_write(hd, sb.inode_table_lba, buf, sb.inode_table_sects);
 
   // 5 将根目录写入 sb.data_start_lba
   // 初始化根目录的两个目录项 . 和 ..
@@ -197,7 +203,7 @@ static void partition_format(struct partition* part) {
   p_de->i_no = 0;  // 根目录的父目录依然是根目录自己
   p_de->f_type = FT_DIRECTORY;
   // 第一个块已经预留给根目录
-  ide_write(hd, sb.data_start_lba, buf, 1);
+  bdev_write(hd, sb.data_start_lba, buf, 1);
   printk("root_dir_lba:0x%x\n", sb.data_start_lba);
   printk("%s format done\n", part->name);
   sys_free(buf);
@@ -253,7 +259,7 @@ static int search_file(const char* pathname,
     return 0;
   }
 
-  uint32_t path_len = strlen(pathname);
+  uint32_t path_len UNUSED = strlen(pathname);
   /* 保证 pathname 至少是这样的路径/x,且小于最大长度 */
   ASSERT(pathname[0] == '/' && path_len > 1 && path_len < MAX_PATH_LEN);
 
@@ -402,9 +408,36 @@ int32_t sys_create(const char* pathname) {
   return 0;
 }
 
+/* 检查块设备 hd 上的各分区,没有文件系统的就格式化 */
+static bool disk_format(struct list_elem* bdev_elem, int arg) {
+  struct block_device* hd =
+      elem2entry(struct block_device, bdev_tag, bdev_elem);
+  struct super_block* sb_buf = (struct super_block*)arg;
+  uint8_t part_idx = 0;
+  struct partition* part = hd->prim_parts;
+  while (part_idx < 12) {  // 4(主)+8(逻辑)
+    if (part_idx == 4) {
+      part = hd->logic_parts;
+    }
+    if (part->sec_cnt != 0) {
+      memset(sb_buf, 0, SECTOR_SIZE);
+      // 读取超级块，根据魔术来判断是否存在文件系统
+      bdev_read(hd, part->start_lba + 1, sb_buf, 1);
+      if (sb_buf->magic == SUPER_BLOCK_MAGIC) {
+        printk("%s has filesystem\n", part->name);
+      } else {
+        printk("formatting %s`s partition %s......\n", hd->name, part->name);
+        partition_format(part);
+      }
+    }
+    part_idx++;
+    part++;
+  }
+  return false;  // 让 list_traversal 继续检查下一个块设备
+}
+
 /* 在磁盘上搜索文件系统,若没有则格式化分区创建文件系统 */
 void filesys_init() {
-  uint8_t channel_no = 0, dev_no = 0, part_idx = 0;
   /*sb_buf用来存储从硬盘上读入的超级块*/
   struct super_block* sb_buf =
       (struct super_block*)sys_malloc(sizeof(struct super_block));
@@ -412,58 +445,35 @@ void filesys_init() {
   if (sb_buf == NULL) {
     PANIC("filesys_init alloc memory failed!...\n");
   }
+  inode_lock_init();
+  bdev_print_partitions();
   printk("searching filesystem......\n");
-  while (channel_no < channel_cnt) {
-    dev_no = 0;
-    while (dev_no < 2) {
-      if (dev_no == 0) {  // 跨过主盘(裸盘)
-        dev_no++;
-        continue;
-      }
-      struct disk* hd = &channels[channel_no].devices[dev_no];
-      struct partition* part = hd->prim_parts;
-      while (part_idx < 12) {  // 4(主)+8(逻辑)
-        if (part_idx == 4) {
-          part = hd->logic_parts;
-        }
-        if (part->sec_cnt != 0) {
-          memset(sb_buf, 0, SECTOR_SIZE);
-          // 读取超级块，根据魔术来判断是否存在文件系统
-          ide_read(hd, part->start_lba + 1, sb_buf, 1);
-          if (sb_buf->magic == 0x19590318) {
-            printk("%s has filesystem\n", part->name);
-          } else {
-            printk("formatting %s`s partition %s......\n", hd->name,
-                   part->name);
-            partition_format(part);
-          }
-        }
-        part_idx++;
-        part++;
-      }
-      dev_no++;  // 下一个磁盘
-    }
-    channel_no++;  // 下一个通道
-  }
+  /* 各 IDE 通道的主盘是裸盘,没有扫描分区,这里自然跳过 */
+  list_traversal(&bdev_list, disk_format, (int)sb_buf);
   sys_free(sb_buf);
 
-  /*确认默认操作的分区*/
-  char default_part[8] = "sdb1";
+  /*确认默认操作的分区,没有 ROOT_PART 时用找到的第一个分区*/
+  char default_part[8] = ROOT_PART;
 
   /*挂载分区*/
-  list_traversal(&partition_list, mount_partition, (int)default_part);
+  read_lock(&partition_list_lock);
+  if (list_traversal(&partition_list, mount_partition, (int)default_part) ==
+          NULL &&
+      !list_empty(&partition_list)) {
+    struct partition* first =
+        elem2entry(struct partition, part_tag, partition_list.head.next);
+    strcpy(default_part, first->name);
+    list_traversal(&partition_list, mount_partition, (int)default_part);
+  }
+  read_unlock(&partition_list_lock);
   // 将当前分区跟目录打开
   open_root_dir(cur_part);
-  /* 初始化文件表 */
-  uint32_t fd_idx = 0;
-  while (fd_idx < MAX_FILE_OPEN) {
-    file_table[fd_idx++].fd_inode = NULL;
-  }
+  file_table_init();
 }
 
 // 将fd转换为文件表的下标
 uint32_t fd_local2global(uint32_t local_fd) {
-  struct task_struct* cur_thred = running_thread();
+  struct task_struct* cur_thred = running_thread()->group_leader;
   int32_t globa_idx = cur_thred->fd_table[local_fd];
   ASSERT(globa_idx >= 0 && globa_idx < MAX_FILES_OPEN_PER_PROC);
 
@@ -482,14 +492,14 @@ int32_t sys_close(int32_t fd) {
       /* 如果此管道上的描述符都被关闭,释放管道的环形缓冲区 */
       if (--file_table[_fd].fd_pos == 0) {
         mfree_page(PF_KERNEL, file_table[_fd].fd_inode, 1);
-        file_table[_fd].fd_inode = NULL;
+        file_slot_release(_fd);
       }
       ret = 0;
     } else {
       ret = file_close(&file_table[_fd]);
     }
 
-    running_thread()->fd_table[fd] = -1;  // 使该文件描述符位可用
+    running_thread()->group_leader->fd_table[fd] = -1;  // 使该文件描述符位可用
   }
 
   return ret;
@@ -620,20 +630,11 @@ int32_t sys_unlink(const char* pathname) {
   }
 
   /* 检查是否在已打开文件列表(文件表)中,删除文件时，要保证没有正在使用 */
-  uint32_t file_idx = 0;
-  while (file_idx < MAX_FILE_OPEN) {
-    if (file_table[file_idx].fd_inode != NULL &&
-        (uint32_t)inode_no == file_table[file_idx].fd_inode->i_no) {
-      break;
-    }
-    file_idx++;
-  }
-  if (file_idx < MAX_FILE_OPEN) {
+  if (file_inode_in_use(inode_no)) {
     dir_close(searched_record.parent_dir);
     printk("file %s is in use, not allow to delete!\n", pathname);
     return -1;
   }
-  ASSERT(file_idx == MAX_FILE_OPEN);
 
   /* 为 delete_dir_entry 申请缓冲区 */
   void* io_buf = sys_malloc(SECTOR_SIZE + SECTOR_SIZE);
@@ -730,7 +731,7 @@ int32_t sys_mkdir(const char* pathname) {
   p_de->f_type = FT_DIRECTORY;
 
   // 写入
-  ide_write(cur_part->my_disk, new_dir_inode.i_sectors[0], io_buf, 1);
+  bdev_write(cur_part->my_disk, new_dir_inode.i_sectors[0], io_buf, 1);
 
   new_dir_inode.i_size = 2 * cur_part->sb->dir_entry_size;
   // 在父目录中添加自己
@@ -862,7 +863,7 @@ static uint32_t get_parent_dir_inode_nr(uint32_t child_inode_nr, void* io_buf) {
   uint32_t block_lba = child_dir_inode->i_sectors[0];
   ASSERT(block_lba >= cur_part->sb->data_start_lba);
   inode_close(child_dir_inode);
-  ide_read(cur_part->my_disk, block_lba, io_buf, 1);
+  bdev_read(cur_part->my_disk, block_lba, io_buf, 1);
   struct dir_entry* dir_e = (struct dir_entry*)io_buf;
 
   /* 第 0 个目录项是".",第 1 个目录项是".." */
@@ -887,8 +888,8 @@ static int get_child_dir_name(uint32_t p_inode_nr, uint32_t c_inode_nr,
   }
   if (parent_dir_inode->i_sectors[12]) {
     // 若包含了一级间接块表,将其读入 all_blocks
-    ide_read(cur_part->my_disk, parent_dir_inode->i_sectors[12],
-             all_blocks + 12, 1);
+    bdev_read(cur_part->my_disk, parent_dir_inode->i_sectors[12],
+              all_blocks + 12, 1);
     block_cnt = 140;
   }
   inode_close(parent_dir_inode);
@@ -900,7 +901,7 @@ static int get_child_dir_name(uint32_t p_inode_nr, uint32_t c_inode_nr,
   /*遍历所有块*/
   while (block_idx < block_cnt) {
     if (all_blocks[block_idx]) {  // 如果相应块不为空,则读入相应块
-      ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+      bdev_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
       uint8_t dir_e_idx = 0;
 
       while (dir_e_idx < dir_entrys_per_sec) {
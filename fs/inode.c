@@ -2,14 +2,41 @@
 
 #include "debug.h"
 #include "file.h"
-#include "ide.h"
+#include "blk.h"
 #include "interrupt.h"
 #include "list.h"
 #include "memory.h"
 #include "stdio_kernel.h"
 #include "string.h"
 #include "super_block.h"
+#include "sync.h"
 #include "thread.h"
+
+/* 保护各分区的 open_inodes 链表。查找已打开的 inode 只需读锁,
+ * 此时打开计数用原子加;插入、删除以及减少计数需要写锁 */
+static struct rwlock open_inodes_lock;
+
+/*原子地给 inode 的打开计数加 1,持有读锁时用*/
+static void inode_open_cnt_inc(struct inode* inode) {
+  asm volatile("lock incl %0" : "+m"(inode->i_open_cnts) : : "memory");
+}
+
+/*在 part 已打开的 inode 中查找 inode_no,找到则打开数加 1,调用者需持有锁*/
+static struct inode* inode_find(struct partition* part, uint32_t inode_no) {
+  struct list_elem* elem = part->open_inodes.head.next;
+  while (elem != &part->open_inodes.tail) {
+    struct inode* inode = elem2entry(struct inode, inode_tag, elem);
+    if (inode->i_no == inode_no) {
+      inode_open_cnt_inc(inode);
+      return inode;
+    }
+    elem = elem->next;
+  }
+  return NULL;
+}
+
+/*初始化 open_inodes_lock,在挂载分区前调用*/
+void inode_lock_init(void) { rwlock_init(&open_inodes_lock); }
 /*用来存储inode位置*/
 struct inode_position {
   bool two_sec;       // inode是否跨扇区
@@ -24,7 +51,7 @@ static void inode_locate(struct partition* part, uint32_t inode_no,
 
   ASSERT(inode_no < 4096);
   uint32_t inode_table_lba = part->sb->inode_table_lba;
-  uint32_t inode_size = sizeof(struct inode);
+  uint32_t inode_size = sizeof(struct inode_disk);
   uint32_t off_size = inode_no * inode_size;  // 字节偏移量
 
   uint32_t off_sec = off_size / 512;          // 扇区偏移量
@@ -50,40 +77,38 @@ void inode_sync(struct partition* part, struct inode* inode, void* io_buf) {
   inode_locate(part, inode_no, &inode_pos);  // 获取位置信息
   ASSERT(inode_pos.sec_lba <= (part->start_lba + part->sec_cnt));
 
-  // inode中有三项不需要写入磁盘
-  struct inode pure_inode;
-  memcpy(&pure_inode, inode, sizeof(struct inode));
-  pure_inode.i_open_cnts = 0;
-  pure_inode.write_deny = false;
-  pure_inode.inode_tag.prev = pure_inode.inode_tag.next = NULL;
+  // 只把持久的字段写入磁盘,打开数、写标志和链表结点不写
+  struct inode_disk pure_inode;
+  memset(&pure_inode, 0, sizeof(struct inode_disk));
+  pure_inode.i_no = inode->i_no;
+  pure_inode.i_size = inode->i_size;
+  memcpy(pure_inode.i_sectors, inode->i_sectors, sizeof(inode->i_sectors));
 
   char* inode_buf = (char*)io_buf;
   if (inode_pos.two_sec) {
     /* 跨扇区了读出两个数据*/
-    ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+    bdev_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
     // 填入数据
-    memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
+    memcpy((inode_buf + inode_pos.off_size), &pure_inode,
+           sizeof(struct inode_disk));
     // 写回
-    ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+    bdev_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
   } else {
-    ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-    memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
-    ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+    bdev_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+    memcpy((inode_buf + inode_pos.off_size), &pure_inode,
+           sizeof(struct inode_disk));
+    bdev_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
   }
 }
 
 /*根据i节点号返回相应的我i节点*/
 struct inode* inode_open(struct partition* part, uint32_t inode_no) {
   // 先在已经打开的inode链表中找inode.此链表相当于缓冲哦
-  struct list_elem* elem = part->open_inodes.head.next;
-  struct inode* inode_found;
-  while (elem != &part->open_inodes.tail) {
-    inode_found = elem2entry(struct inode, inode_tag, elem);
-    if (inode_found->i_no == inode_no) {
-      inode_found->i_open_cnts++;
-      return inode_found;
-    }
-    elem = elem->next;
+  read_lock(&open_inodes_lock);
+  struct inode* inode_found = inode_find(part, inode_no);
+  read_unlock(&open_inodes_lock);
+  if (inode_found != NULL) {
+    return inode_found;
   }
 
   /*从缓冲中没有找到*/
@@ -101,26 +126,49 @@ struct inode* inode_open(struct partition* part, uint32_t inode_no) {
   char* inode_buf;
   if (inode_pos.two_sec) {  // 跨扇区
     inode_buf = (char*)sys_malloc(1024);
-    ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+    bdev_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
   } else {
     inode_buf = (char*)sys_malloc(512);
-    ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+    bdev_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
   }
-  memcpy(inode_found, inode_buf + inode_pos.off_size, sizeof(struct inode));
+  struct inode_disk* disk_inode =
+      (struct inode_disk*)(inode_buf + inode_pos.off_size);
+  memset(inode_found, 0, sizeof(struct inode));
+  inode_found->i_no = disk_inode->i_no;
+  inode_found->i_size = disk_inode->i_size;
+  memcpy(inode_found->i_sectors, disk_inode->i_sectors,
+         sizeof(inode_found->i_sectors));
 
-  // 插入队头，因为最可能被访问到
-  list_push(&part->open_inodes, &inode_found->inode_tag);
-  inode_found->i_open_cnts = 1;
   sys_free(inode_buf);
+
+  /* 读盘期间别的任务可能已打开了同一个 inode,以先插入的为准 */
+  write_lock(&open_inodes_lock);
+  struct inode* inode_raced = inode_find(part, inode_no);
+  if (inode_raced == NULL) {
+    // 插入队头，因为最可能被访问到
+    inode_found->i_open_cnts = 1;
+    list_push(&part->open_inodes, &inode_found->inode_tag);
+  }
+  write_unlock(&open_inodes_lock);
+  if (inode_raced != NULL) {
+    cur->pgdir = NULL;
+    sys_free(inode_found);
+    cur->pgdir = cur_pagedir_bak;
+    return inode_raced;
+  }
   return inode_found;
 }
 
 /* 关闭 inode 或减少 inode 的打开数 */
 void inode_close(struct inode* inode) {
   /* 若没有进程再打开此文件,将此 inode 去掉并释放空间 */
-  enum intr_status old_status = intr_disable();
-  if (--inode->i_open_cnts == 0) {
+  write_lock(&open_inodes_lock);
+  bool last_close = (--inode->i_open_cnts == 0);
+  if (last_close) {
     list_remove(&inode->inode_tag);
+  }
+  write_unlock(&open_inodes_lock);
+  if (last_close) {
     // 确保被释放的是内核内存池
     struct task_struct* cur = running_thread();
     uint32_t* cur_pagedir_bak = cur->pgdir;
@@ -129,7 +177,21 @@ void inode_close(struct inode* inode) {
     /*恢复pgdir*/
     cur->pgdir = cur_pagedir_bak;
   }
-  intr_set_status(old_status);
+}
+
+/*把新建的 inode 加入 part 已打开的 inode 中,打开数为 1*/
+void inode_install(struct partition* part, struct inode* inode) {
+  inode->i_open_cnts = 1;
+  write_lock(&open_inodes_lock);
+  list_push(&part->open_inodes, &inode->inode_tag);
+  write_unlock(&open_inodes_lock);
+}
+
+/*给已打开的 inode 再增加一次打开数,用于 fork 复制文件描述符*/
+void inode_dup(struct inode* inode) {
+  read_lock(&open_inodes_lock);
+  inode_open_cnt_inc(inode);
+  read_unlock(&open_inodes_lock);
 }
 
 /*初始化new_inode*/
@@ -158,13 +220,13 @@ void inode_delete(struct partition* part, uint32_t inode_no, void* io_buf) {
   ASSERT(inode_pos.sec_lba <= (part->start_lba + part->sec_cnt));
   char* inode_buf = (char*)io_buf;
   if (inode_pos.two_sec) {  // 跨扇区
-    ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-    memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode));
-    ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+    bdev_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+    memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode_disk));
+    bdev_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
   } else {  // 不跨扇区
-    ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-    memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode));
-    ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+    bdev_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+    memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode_disk));
+    bdev_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
   }
 }
 
@@ -185,7 +247,7 @@ void inode_release(struct partition* part, uint32_t inode_no) {
   }
 
   if (inode_to_del->i_sectors[12] != 0) {
-    ide_read(part->my_disk, inode_to_del->i_sectors[12], all_blocks + 12, 1);
+    bdev_read(part->my_disk, inode_to_del->i_sectors[12], all_blocks + 12, 1);
 
     block_cnt=140;
     /* 回收一级间接块表占用的扇区 */
@@ -1,7 +1,7 @@
 #ifndef FS_INODE
 #define FS_INODE
 #include "global.h"
-#include "ide.h"
+#include "blk.h"
 #include "list.h"
 #include "stdint.h"
 /*inode结构*/
@@ -14,11 +14,25 @@ struct inode {
   struct list_elem inode_tag;
 };
 
+/* 磁盘上的 inode,布局固定,只存持久的字段.
+ * 与最初直接写入 struct inode 时的布局相同,旧分区可以照常挂载 */
+struct inode_disk {
+  uint32_t i_no;
+  uint32_t i_size;
+  uint32_t i_open_cnts;    // 磁盘上总是 0
+  bool write_deny;         // 磁盘上总是 false
+  uint32_t i_sectors[13];
+  uint32_t reserved[2];    // 原先 inode_tag 的 prev 和 next,写为 0
+};
+
 void inode_sync(struct partition* part, struct inode* inode, void* io_buf);
 
 struct inode* inode_open(struct partition* part, uint32_t inode_no);
 
 void inode_close(struct inode* inode);
+void inode_lock_init(void);
+void inode_install(struct partition* part, struct inode* inode);
+void inode_dup(struct inode* inode);
 void inode_init(uint32_t inode_no, struct inode* new_inode);
 void inode_delete(struct partition* part, uint32_t inode_no, void* io_buf);
 void inode_release(struct partition*part,uint32_t inode_no);
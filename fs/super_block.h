@@ -1,6 +1,10 @@
 #ifndef FS_SUPER_BLOCK
 #define FS_SUPER_BLOCK
 #include "stdint.h"
+
+/* 文件系统魔数,磁盘上的 inode 是固定的 struct inode_disk,
+ * 内存中 struct inode 的变化不影响磁盘格式 */
+#define SUPER_BLOCK_MAGIC 0x19590318
 /*超级块*/
 struct super_block {
   uint32_t magic;          // 用来标识文件系统类型
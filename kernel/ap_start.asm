@@ -0,0 +1,58 @@
+;AP 的启动代码,由 BSP 拷贝到物理地址 AP_START_PHY 后用 SIPI 唤醒 AP 执行
+;代码被拷贝走后才运行,所以其中的地址都要按 AP_START_PHY + (标号 - ap_start) 计算
+AP_START_PHY equ 0x70000
+PAGE_DIR_TABLE_POS equ 0x100000
+SELECTOR_CODE equ (1 << 3)
+SELECTOR_DATA equ (2 << 3)
+
+%define AP_ADDR(label) (AP_START_PHY + ((label) - ap_start))
+
+extern ap_main
+global ap_start
+global ap_start_end
+global ap_gdt_ptr
+global ap_stack_top
+
+section .text
+[bits 16]
+ap_start:
+    cli
+    mov ax, cs
+    mov ds, ax
+    lgdt [ap_gdt_ptr - ap_start]    ;base 为 gdt 的物理地址,由 BSP 填写
+
+    mov eax, cr0
+    or eax, 0x00000001
+    mov cr0, eax
+    jmp dword SELECTOR_CODE:AP_ADDR(ap_protect_mode)
+
+[bits 32]
+ap_protect_mode:
+    mov ax, SELECTOR_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ;与 BSP 共用内核页目录
+    mov eax, PAGE_DIR_TABLE_POS
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    ;栈用 BSP 为本核分配的 idle 线程的 pcb 页
+    mov esp, [AP_ADDR(ap_stack_top)]
+    mov eax, ap_main
+    call eax
+    jmp $
+
+align 4
+ap_gdt_ptr:
+    dw 0        ;gdt 界限
+    dd 0        ;gdt 物理基址
+align 4
+ap_stack_top:
+    dd 0
+ap_start_end:
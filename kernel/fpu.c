@@ -0,0 +1,180 @@
+#include "fpu.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "print.h"
+#include "smp.h"
+#include "string.h"
+#include "thread.h"
+
+#define CR0_MP 0x2   // 配合 TS,让 wait/fwait 也产生 #NM
+#define CR0_EM 0x4   // 置 1 时所有浮点指令都产生 #NM
+#define CR0_TS 0x8   // 任务已切换,下一条浮点/SSE 指令产生 #NM
+#define CR0_NE 0x20  // 浮点错误以 #MF 异常报告
+#define CR4_OSFXSR 0x200      // 操作系统支持 fxsave/fxrstor,允许 SSE 指令
+#define CR4_OSXMMEXCPT 0x400  // 操作系统处理 #XM 异常
+
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE (1 << 25)
+#define CPUID_SSE2 (1 << 26)
+
+#define MXCSR_DEFAULT 0x1f80  // 屏蔽所有 SIMD 浮点异常
+#define NM_VEC 0x07           // #NM 设备不可用异常
+
+static bool fpu_supported;  // 处理器是否支持 fxsave 与 SSE2
+/* fninit 后的初始状态,任务第一次使用浮点时从这里复制 */
+static uint8_t fpu_init_state[FXSAVE_SIZE] __attribute__((aligned(16)));
+
+static uint32_t read_cr0(void) {
+  uint32_t cr0;
+  asm volatile("movl %%cr0, %0" : "=r"(cr0));
+  return cr0;
+}
+
+static void write_cr0(uint32_t cr0) {
+  asm volatile("movl %0, %%cr0" ::"r"(cr0) : "memory");
+}
+
+static void clts(void) { asm volatile("clts" ::: "memory"); }
+
+static void stts(void) { write_cr0(read_cr0() | CR0_TS); }
+
+static void fxsave(void* area) {
+  asm volatile("fxsave (%0)" ::"r"(area) : "memory");
+}
+
+static void fxrstor(void* area) {
+  asm volatile("fxrstor (%0)" ::"r"(area) : "memory");
+}
+
+/* 本核的浮点寄存器中是否是 task 的最新状态:
+ * 任务被别的核装入过状态,或本核又装入了别人的状态,都要重新装入 */
+static bool fpu_regs_valid(struct cpu* cpu, struct task_struct* task) {
+  return cpu->fpu_owner == task && task->fpu_last_cpu == cpu;
+}
+
+/* #NM 处理程序:用户进程在 TS 置位后第一次执行浮点/SSE 指令,
+ * 这时才为它装入浮点状态,从不用浮点的任务完全不必保存恢复 */
+static void intr_nm_handler(void) {
+  if (!fpu_supported) {
+    PANIC("fpu: FXSR/SSE2 not supported by this cpu\n");
+  }
+  struct task_struct* cur = running_thread();
+  ASSERT(cur->pgdir != NULL);  // 内核用 -mno-sse 编译,不会用到浮点
+
+  if (cur->fpu_state == NULL) {
+    // 可能在内存池的锁上睡眠,之后才关中断确定所在的核
+    void* state = get_kernel_pages(1);
+    if (state == NULL) {
+      PANIC("fpu: no memory for fpu state\n");
+    }
+    memcpy(state, fpu_init_state, FXSAVE_SIZE);
+    cur->fpu_state = state;
+  }
+
+  enum intr_status old_status = intr_disable();
+  struct cpu* cpu = this_cpu();
+  clts();
+  if (!fpu_regs_valid(cpu, cur)) {
+    fxrstor(cur->fpu_state);
+    cpu->fpu_owner = cur;
+    cur->fpu_last_cpu = cpu;
+  }
+  intr_set_status(old_status);
+}
+
+/* 由 schedule 在 switch_to 之前调用,此时中断是关闭的。
+ * 换下的任务若在本核用过浮点就立即保存,保证它被别的核偷走后仍能恢复;
+ * 换上的任务若本核寄存器中仍是它的状态就直接清 TS,否则置 TS 等 #NM */
+void fpu_switch(struct task_struct* prev, struct task_struct* next) {
+  if (!fpu_supported) {
+    return;
+  }
+  struct cpu* cpu = this_cpu();
+  if (fpu_regs_valid(cpu, prev)) {
+    fxsave(prev->fpu_state);
+  }
+  if (fpu_regs_valid(cpu, next)) {
+    clts();
+  } else {
+    stts();
+  }
+}
+
+/* 子进程继承父进程的浮点状态,失败返回 -1。
+ * 父进程正在执行 fork 系统调用,它的最新状态可能还在本核寄存器中 */
+int32_t fpu_fork(struct task_struct* child, struct task_struct* parent) {
+  child->fpu_state = NULL;
+  child->fpu_last_cpu = NULL;
+  if (parent->fpu_state == NULL) {
+    return 0;
+  }
+  void* state = get_kernel_pages(1);
+  if (state == NULL) {
+    return -1;
+  }
+
+  enum intr_status old_status = intr_disable();
+  if (fpu_regs_valid(this_cpu(), parent)) {
+    fxsave(parent->fpu_state);  // 寄存器有效说明 TS 已清,可以直接保存
+  }
+  memcpy(state, parent->fpu_state, FXSAVE_SIZE);
+  intr_set_status(old_status);
+
+  child->fpu_state = state;
+  return 0;
+}
+
+/* 回收 task 的浮点状态,用于任务退出和 exec。
+ * task 若是当前任务,要先让本核放弃它的状态,免得换下时保存到已回收的页中 */
+void fpu_release(struct task_struct* task) {
+  if (task->fpu_state == NULL) {
+    return;
+  }
+  enum intr_status old_status = intr_disable();
+  struct cpu* cpu = this_cpu();
+  if (cpu->fpu_owner == task) {
+    cpu->fpu_owner = NULL;
+    if (task == running_thread()) {
+      stts();
+    }
+  }
+  task->fpu_last_cpu = NULL;
+  intr_set_status(old_status);
+
+  mfree_page(PF_KERNEL, task->fpu_state, 1);
+  task->fpu_state = NULL;
+}
+
+/* 初始化本核的浮点单元,BSP 与各 AP 都要调用。
+ * 开启 SSE 并置 TS,第一次使用浮点时由 #NM 装入任务的状态 */
+void fpu_init(void) {
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile("cpuid"
+               : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+               : "a"(1));
+  uint32_t need = CPUID_FXSR | CPUID_SSE | CPUID_SSE2;
+  uint32_t cr0 = read_cr0();
+  if ((edx & need) != need) {
+    // 不支持时让所有浮点指令都陷入 #NM
+    write_cr0(cr0 | CR0_EM);
+    fpu_supported = false;
+    return;
+  }
+  write_cr0((cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  uint32_t cr4;
+  asm volatile("movl %%cr4, %0" : "=r"(cr4));
+  cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+  asm volatile("movl %0, %%cr4" ::"r"(cr4) : "memory");
+
+  uint32_t mxcsr = MXCSR_DEFAULT;
+  asm volatile("fninit; ldmxcsr %0" ::"m"(mxcsr));
+  if (this_cpu()->id == 0) {
+    fxsave(fpu_init_state);
+    fpu_supported = true;
+    register_handler(NM_VEC, intr_nm_handler);
+  }
+  this_cpu()->fpu_owner = NULL;
+  stts();
+}
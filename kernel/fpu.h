@@ -0,0 +1,14 @@
+#ifndef KERNEL_FPU
+#define KERNEL_FPU
+#include "global.h"
+#include "stdint.h"
+
+#define FXSAVE_SIZE 512  // fxsave 保存区的大小,要求 16 字节对齐
+
+struct task_struct;
+
+void fpu_init(void);
+void fpu_switch(struct task_struct* prev, struct task_struct* next);
+int32_t fpu_fork(struct task_struct* child, struct task_struct* parent);
+void fpu_release(struct task_struct* task);
+#endif /* KERNEL_FPU */
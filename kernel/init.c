@@ -1,28 +1,52 @@
 #include "init.h"
 
 #include "print.h"
+#include "ahci.h"
+#include "blk.h"
+#include "fpu.h"
 #include "fs.h"
+#include "futex.h"
 #include "ide.h"
 #include "init.h"
 #include "interrupt.h"
 #include "keyboard.h"
 #include "memory.h"
+#include "nvme.h"
+#include "pci.h"
+#include "ramdisk.h"
+#include "rcu.h"
 #include "console.h"
+#include "smp.h"
+#include "softirq.h"
 #include "syscall_init.h"
 #include "thread.h"
 #include "timer.h"
 #include "tss.h"
+#include "virtio_blk.h"
+#include "workqueue.h"
 /*负责初始化所有模块 */
 void init_all() {
   put_str("init_all\n");
   idt_init();       // 初始化中断
+  softirq_init();   // 初始化软中断
   timer_init();     // 初始化PIT
   mem_init();       // 内存池初始化
   keyboard_init();  // 键盘初始化
   tss_init();       // tss初始化
   thread_init();    // 初始化线程环境
+  futex_init();     // 用户态锁的等待队列
+  rcu_init();       // RCU 的回调队列
+  workqueue_init();  // 启动内核工作线程
+  fpu_init();        // 开启 SSE,浮点状态按需切换
   console_init();   //
   syscall_init();
-  ide_init();  // 硬盘初始化
+  blk_init();   // 块设备和分区的队列
+  pci_init();   // 枚举 PCI 设备
+  ide_init();   // 硬盘初始化
+  ahci_init();  // SATA 硬盘
+  virtio_blk_init();  // 虚拟机中的 virtio 硬盘
+  nvme_init();        // NVMe 硬盘
+  ramdisk_init();     // 内存盘,RAMDISK_MB 为 0 时不建
   filesys_init();
+  smp_init();  // 启动其他处理器
 }
\ No newline at end of file
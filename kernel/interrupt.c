@@ -127,19 +127,21 @@ static void exception_init(void) {
   intr_name[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/*加载idt到idtr寄存器,各处理器共用同一个idt*/
+void idt_load(void) {
+  uint64_t idt_operand =
+      ((sizeof(idt) - 1) | ((uint64_t)((uint32_t)idt) << 16));
+
+  asm volatile("lidt %0" : : "m"(idt_operand));
+}
+
 /*完成有关中断的所有初始化工作*/
 void idt_init() {
   put_str("idt_init start\n");
   idt_desc_init();
   exception_init();
   pic_init();  // 初始化 8259A
-  // 加载idt到idtr寄存器
-  uint64_t a = 0;
-  asm volatile("lidt %0" : : "m"(a));
-  uint64_t idt_operand =
-      ((sizeof(idt) - 1) | ((uint64_t)((uint32_t)idt) << 16));
-
-  asm volatile("lidt %0" : : "m"(idt_operand));
+  idt_load();
 
   put_str("idt_init done\n");
 }
@@ -175,6 +177,18 @@ void register_handler(uint8_t vector_no, intr_handler function) {
   idt_table[vector_no] = function;
 }
 
+/* 在 8259A 上打开第 irq 号中断,从片上的还要打开主片上级联的 IR2 */
+void pic_unmask(uint8_t irq) {
+  enum intr_status old_status = intr_disable();
+  if (irq < 8) {
+    outb(PIC_M_DATA, inb(PIC_M_DATA) & ~(1 << irq));
+  } else {
+    outb(PIC_S_DATA, inb(PIC_S_DATA) & ~(1 << (irq - 8)));
+    outb(PIC_M_DATA, inb(PIC_M_DATA) & ~(1 << 2));
+  }
+  intr_set_status(old_status);
+}
+
 /*设置中断状态*/
 enum intr_status intr_set_status(enum intr_status status) {
   return status & INTR_ON ? intr_enable() : intr_disable();
@@ -18,6 +18,7 @@ typedef void* intr_handler;  // 用于指向中断处理函数的地址
 #define GET_EFLAGS(EFLAG_VAR) asm volatile("pushfl;popl %0" : "=g"(EFLAG_VAR))
 /*中断初始化*/
 void idt_init();
+void idt_load(void);
 
 // 定义两种状态
 enum intr_status {
@@ -40,4 +41,7 @@ enum intr_status intr_set_status(enum intr_status status);
 /*中断处理程序的注册*/
 void register_handler(uint8_t vector_no, intr_handler function);
 
+/*在 8259A 上打开第 irq 号中断*/
+void pic_unmask(uint8_t irq);
+
 #endif /* KERNEL_INTERRUPT */
@@ -4,6 +4,7 @@
 %define ZERO push 0
 
 extern idt_table
+extern irq_exit
 section .data
 global intr_entry_table
 intr_entry_table:
@@ -18,13 +19,18 @@ intr%1entry:
     push gs 
     pushad  ;通用寄存器入栈
 
+%if %1 < 0x30
     ;如果是从片上进入的中断，除了往从片上发送EOI外，还要往主片上发送EOI
     mov al, 0x20    ;中断结束命令 EOI
     out 0xa0, al    ;向从片上发送
     out 0x20, al    ;向主片上发送
+%endif              ;0x30 之后是 local APIC 的中断,由处理函数自己写 EOI
 
     push %1         ;压入中断号，方便后期调试
     call [idt_table+%1*4] ; 调用 idt_table 中的 C 版本中断处理函数
+%if %1 >= 0x20
+    call irq_exit         ; 外部中断返回前执行软中断,需要时调度
+%endif
     jmp intr_exit       
 
 section .data  
@@ -93,11 +99,30 @@ intr_exit:
   VECTOR 0x2d, ZERO    ;fpu 浮点单元异常
   VECTOR 0x2e, ZERO    ;硬盘
   VECTOR 0x2f, ZERO    ;保留
+  VECTOR 0x30, ZERO    ;local APIC 定时器
+  VECTOR 0x31, ZERO    ;重新调度的 IPI
+  VECTOR 0x32, ZERO    ;刷新 TLB 的 IPI
+  VECTOR 0x33, ZERO
+  VECTOR 0x34, ZERO
+  VECTOR 0x35, ZERO
+  VECTOR 0x36, ZERO
+  VECTOR 0x37, ZERO
+  VECTOR 0x38, ZERO
+  VECTOR 0x39, ZERO
+  VECTOR 0x3a, ZERO
+  VECTOR 0x3b, ZERO
+  VECTOR 0x3c, ZERO
+  VECTOR 0x3d, ZERO
+  VECTOR 0x3e, ZERO
+  VECTOR 0x3f, ZERO    ;local APIC 伪中断
 
 
  ;---------------------0x80号中断----------------------
 [bits 32]
 extern syscall_table 
+extern kernel_lock_acquire
+extern kernel_lock_release
+extern check_resched
 section .text
 global syscall_handler
 syscall_handler:
@@ -109,6 +134,12 @@ syscall_handler:
     pushad  ;通用寄存器入栈
     push 0x80
 
+    ;系统调用期间持有大内核锁,调用 C 函数会破坏 eax/ecx/edx,之后从栈中恢复
+    call kernel_lock_acquire
+    mov eax, [esp+8*4]
+    mov ecx, [esp+7*4]
+    mov edx, [esp+6*4]
+
     ;将参数压入(内核栈)
     push edx ;3
     push ecx ;2
@@ -120,4 +151,6 @@ syscall_handler:
     ;将返回值存入内核栈eax处(切换为用户栈后会从内核栈恢复eax)
     mov [esp+8*4], eax
 
+    call kernel_lock_release
+    call check_resched    ;返回用户态前,被唤醒的任务可能要求抢占当前任务
     jmp intr_exit 
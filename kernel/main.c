@@ -2,11 +2,13 @@
 #include "debug.h"
 #include "dir.h"
 #include "fs.h"
+#include "ide.h"
 #include "init.h"
 #include "interrupt.h"
 #include "memory.h"
 #include "print.h"
 #include "process.h"
+#include "sched.h"
 #include "shell.h"
 #include "stdio.h"
 #include "stdio_kernel.h"
@@ -15,16 +17,38 @@
 #include "syscall.h"
 #include "syscall_init.h"
 #include "thread.h"
+#include "timer.h"
 void k_thread_a(void*);
 void k_thread_b(void*);
 void u_prog_a(void);
 void u_prog_b(void);
 void load_user_code(uint32_t size, char* name);
+#ifdef PI_TEST
+static void pi_test_start(void);
+#endif
+#ifdef IDE_BENCH
+static void ide_bench(void);
+#endif
+#ifdef STORAGE_BENCH
+#include "ahci.h"
+#include "nvme.h"
+#include "virtio_blk.h"
+static void storage_bench(void);
+#endif
 
 int main(void) {
   put_str("I am kernel\n");
   init_all();
   intr_enable();
+#ifdef PI_TEST
+  pi_test_start();
+#endif
+#ifdef IDE_BENCH
+  ide_bench();
+#endif
+#ifdef STORAGE_BENCH
+  storage_bench();
+#endif
   /*************    写入应用程序    *************/
   // load_user_code(18292, "prog_arg");
   // load_user_code(20576, "cat");
@@ -130,7 +154,7 @@ void load_user_code(uint32_t size, char* name) {
   namebuf[1] = 0;
   strcat(namebuf, name);
   void* prog_buf = sys_malloc(file_size);
-  ide_read(sda, 300, prog_buf, sec_cnt);
+  bdev_read(&sda->bdev, 300, prog_buf, sec_cnt);
   int32_t fd = sys_open(namebuf, O_CREAT | O_RDWR);
   if (fd != -1) {
     if (sys_write(fd, prog_buf, file_size) == -1) {
@@ -141,3 +165,314 @@ void load_user_code(uint32_t size, char* name) {
   }
   close(fd);
 }
+
+#ifdef PI_TEST
+/* 优先级反转测试,make PI_TEST=1 打开,单处理器上才能看出效果:
+ * 低优先级 L 持锁忙 PI_HOLD_MS,高优先级 H 随后等这把锁,
+ * 中优先级 M 不用锁,只忙 PI_BUSY_MS。没有优先级继承时 M 抢占 L,
+ * H 要等 M 跑完;有继承时 L 被提升到 H 的优先级,H 只等 L 用完锁 */
+#define PI_HOLD_MS 50
+#define PI_BUSY_MS 500
+
+static struct lock pi_test_lock;
+static volatile bool pi_low_locked;
+
+/*忙等 ms 毫秒,不让出处理器*/
+static void pi_busy(uint32_t ms) {
+  uint32_t end = ticks + msecs_to_ticks(ms);
+  while ((int32_t)(*(volatile uint32_t*)&ticks - end) < 0)
+    ;
+}
+
+/*测试线程不能返回,做完后永远阻塞*/
+static void pi_park(void) {
+  while (1) {
+    thread_block(TASK_BLOCKED);
+  }
+}
+
+static void pi_low(void* arg UNUSED) {
+  lock_acquire(&pi_test_lock);
+  pi_low_locked = true;
+  pi_busy(PI_HOLD_MS);
+  printk("pi_test: L releases the lock, rt_priority %d\n",
+         running_thread()->rt_priority);
+  lock_release(&pi_test_lock);
+  pi_park();
+}
+
+static void pi_medium(void* arg UNUSED) {
+  pi_busy(PI_BUSY_MS);
+  printk("pi_test: M done\n");
+  pi_park();
+}
+
+static void pi_high(void* arg UNUSED) {
+  uint32_t start = ticks;
+  lock_acquire(&pi_test_lock);
+  uint32_t waited = ticks - start;
+  lock_release(&pi_test_lock);
+  printk("pi_test: H waited %d ticks for the lock: %s\n", waited,
+         waited < msecs_to_ticks(PI_BUSY_MS) ? "ok" : "priority inversion!");
+  pi_park();
+}
+
+/*以 rt_priority 启动一个实时线程*/
+static void pi_spawn(char* name, uint8_t rt_priority, thread_func func) {
+  struct task_struct* t = thread_start(name, 31, func, NULL);
+  sys_sched_setscheduler(t->pid, SCHED_FIFO, rt_priority);
+}
+
+/*控制线程优先级最高,先让 L 拿到锁,再同时放出 M 和 H*/
+static void pi_control(void* arg UNUSED) {
+  lock_init(&pi_test_lock);
+  pi_spawn("pi_low", 1, pi_low);
+  while (!pi_low_locked) {
+    mtime_sleep(10);
+  }
+  pi_spawn("pi_medium", 10, pi_medium);
+  pi_spawn("pi_high", 20, pi_high);
+  pi_park();
+}
+
+static void pi_test_start(void) {
+  struct task_struct* t = thread_start("pi_control", 31, pi_control, NULL);
+  sys_sched_setscheduler(t->pid, SCHED_FIFO, 30);
+}
+#endif
+
+#if defined(IDE_BENCH) || defined(STORAGE_BENCH)
+#define BENCH_SECS 256  // 每次读的扇区数,也是乱序读的扇区数
+
+/* 乱序读散布的扇区:先逐个同步读,再一次全部提交 */
+static void bench_seek(char* tag, struct block_device* hd, void* buf) {
+  uint32_t* lbas = get_kernel_pages(1);
+  uint32_t stride = hd->sectors / (BENCH_SECS / 2);
+  uint32_t idx;
+  for (idx = 0; idx < BENCH_SECS; idx++) {
+    uint32_t slot = idx * 37 % BENCH_SECS;  // 37 与 256 互素,slot 不重复
+    lbas[idx] = slot / 2 * stride + slot % 2;
+  }
+
+  uint32_t rq_start = hd->queue.nr_requests;
+  uint64_t stamp = rdtsc();
+  for (idx = 0; idx < BENCH_SECS; idx++) {
+    bdev_read(hd, lbas[idx], (uint8_t*)buf + idx * 512, 1);
+  }
+  uint64_t sync_us = tsc_elapsed_us(&stamp);
+  /* 总耗时远在 32 位微秒数(约 71 分钟)以内,可以截断后用 32 位除法求平均 */
+  printk("%s: seek sync %d ms, %d requests, %d us per request\n", tag,
+         us_to_ms(sync_us), hd->queue.nr_requests - rq_start,
+         (uint32_t)sync_us / BENCH_SECS);
+
+  rq_start = hd->queue.nr_requests;
+  uint32_t merge_start = hd->queue.nr_merges;
+  stamp = rdtsc();
+  blk_read_sectors(hd, lbas, BENCH_SECS, buf);
+  uint32_t batch_ms = us_to_ms(tsc_elapsed_us(&stamp));
+  printk("%s: seek batch %d ms, %d requests, %d merges\n", tag, batch_ms,
+         hd->queue.nr_requests - rq_start, hd->queue.nr_merges - merge_start);
+  mfree_page(PF_KERNEL, lbas, 1);
+}
+
+#endif
+
+#ifdef IDE_BENCH
+/* 读盘方式的对比,make IDE_BENCH=1 打开:
+ * 分别用单扇区 PIO、多扇区 PIO 和 DMA 从 sdb 开头连续读 IDE_BENCH_MB 兆字节,
+ * 每次 BENCH_SECS 个扇区,报告吞吐量、每次请求的中断数,
+ * 以及处理器花在这次读盘上的比例(通道派发线程的运行时间).
+ * 再把 BENCH_SECS 个散布在全盘、两两相邻的扇区按乱序读一遍,
+ * 比较逐个同步读与一次全部提交(电梯排序并合并)的耗时.
+ * 从通道上接了 sdc 时(见 bochsrc.disk),比较先后读与同时读 sdb、sdc 的总带宽 */
+#define IDE_BENCH_MB 4
+
+static void ide_bench_run(struct disk* hd, void* buf, char* mode) {
+  struct task_struct* dispatcher = hd->my_channel->dispatcher;
+  uint64_t exec_start = dispatcher->sum_exec_us;
+  uint32_t intr_start = hd->my_channel->intr_cnt;
+  uint64_t stamp = rdtsc();
+  uint32_t total_secs = IDE_BENCH_MB * 1024 * 1024 / 512;
+  uint32_t lba;
+  for (lba = 0; lba < total_secs; lba += BENCH_SECS) {
+    bdev_read(&hd->bdev, lba, buf, BENCH_SECS);
+  }
+  /* 模拟器中 PIO 读几 MB 可能要好几秒,按 64 位的微秒数换算 */
+  uint32_t wall_ms = us_to_ms(tsc_elapsed_us(&stamp));
+  uint32_t busy_ms = us_to_ms(dispatcher->sum_exec_us - exec_start);
+  if (wall_ms == 0) {
+    wall_ms = 1;
+  }
+  uint32_t busy_pct = busy_ms * 100 / wall_ms;
+  uint32_t intrs = hd->my_channel->intr_cnt - intr_start;
+  printk("ide_bench: %s %d KB/s, %d irqs per request, cpu busy %d percent\n",
+         mode, total_secs / 2 * 1000 / wall_ms,
+         intrs / (total_secs / BENCH_SECS), busy_pct);
+}
+
+/* 同时读两块硬盘的测试线程,每次收到 go 就把 hd 开头读一遍 */
+struct bench_reader {
+  struct disk* hd;
+  void* buf;
+  struct semaphore go;
+  struct semaphore* done;
+};
+
+static void ide_bench_reader(void* arg) {
+  struct bench_reader* reader = arg;
+  uint32_t total_secs = IDE_BENCH_MB * 1024 * 1024 / 512;
+  while (1) {
+    sema_down(&reader->go);
+    uint32_t lba;
+    for (lba = 0; lba < total_secs; lba += BENCH_SECS) {
+      bdev_read(&reader->hd->bdev, lba, reader->buf, BENCH_SECS);
+    }
+    sema_up(reader->done);
+  }
+}
+
+/* 主通道的 sdb 和从通道的 sdc 先后各读一遍,再同时各读一遍,报告总带宽 */
+static void ide_bench_parallel(struct disk* sdb, void* buf) {
+  uint32_t total_secs = IDE_BENCH_MB * 1024 * 1024 / 512;
+  struct disk* sdc = &channels[1].devices[0];
+  if (channel_cnt < 2 || !sdc->present || sdc->bdev.sectors < total_secs) {
+    printk("ide_bench: no sdc on ide1, skipping parallel read\n");
+    return;
+  }
+  /* 测试线程做完后停在 go 上,用到的都不能放在栈上 */
+  static struct semaphore done;
+  static struct bench_reader readers[2];
+  sema_init(&done, 0);
+  readers[0].hd = sdb;
+  readers[0].buf = buf;
+  readers[1].hd = sdc;
+  readers[1].buf = get_kernel_pages(BENCH_SECS * 512 / PG_SIZE);
+  uint32_t idx;
+  for (idx = 0; idx < 2; idx++) {
+    sema_init(&readers[idx].go, 0);
+    readers[idx].done = &done;
+    thread_start(readers[idx].hd->bdev.name, 31, ide_bench_reader,
+                 &readers[idx]);
+  }
+
+  uint64_t stamp = rdtsc();
+  for (idx = 0; idx < 2; idx++) {
+    sema_up(&readers[idx].go);
+    sema_down(&done);
+  }
+  uint32_t serial_ms = us_to_ms(tsc_elapsed_us(&stamp)) + 1;
+
+  stamp = rdtsc();
+  sema_up(&readers[0].go);
+  sema_up(&readers[1].go);
+  sema_down(&done);
+  sema_down(&done);
+  uint32_t parallel_ms = us_to_ms(tsc_elapsed_us(&stamp)) + 1;
+
+  /* 两块盘共读了 total_secs * 2 个扇区,即 total_secs 千字节 */
+  printk("ide_bench: sdb+sdc serial %d KB/s, parallel %d KB/s\n",
+         total_secs * 1000 / serial_ms, total_secs * 1000 / parallel_ms);
+  mfree_page(PF_KERNEL, readers[1].buf, BENCH_SECS * 512 / PG_SIZE);
+}
+
+static void ide_bench(void) {
+  struct disk* sdb = &channels[0].devices[1];
+  void* buf = get_kernel_pages(BENCH_SECS * 512 / PG_SIZE);
+  bool dma = sdb->dma;
+  uint8_t multiple = sdb->multiple;
+
+  sdb->dma = false;
+  sdb->multiple = 0;
+  ide_bench_run(sdb, buf, "pio");
+  if (multiple != 0) {
+    sdb->multiple = multiple;
+    ide_bench_run(sdb, buf, "pio multiple");
+  }
+  if (dma) {
+    sdb->dma = true;
+    ide_bench_run(sdb, buf, "dma");
+  } else {
+    printk("ide_bench: %s does not support dma\n", sdb->bdev.name);
+  }
+  bench_seek("ide_bench", &sdb->bdev, buf);
+  ide_bench_parallel(sdb, buf);
+  mfree_page(PF_KERNEL, buf, BENCH_SECS * 512 / PG_SIZE);
+}
+#endif
+
+#ifdef STORAGE_BENCH
+/* IDE 以外的硬盘的测试,make STORAGE_BENCH=1 打开:
+ * 接了 AHCI 硬盘时(make run_qemu_ahci),做一遍与 IDE 相同的乱序读,
+ * 报告同时在做的命令数的最大值.virtio 硬盘(make run_qemu_virtio)同样测一遍,
+ * 另外报告通知设备的次数和中断数,看一批请求合并了多少次通知.
+ * NVMe 硬盘(make run_qemu_nvme)做队列深度测试:随机读 4KB 的块,
+ * 同时提交的读依次为 1、2、4 直到 32 个,报告每秒读的次数 */
+#define STORAGE_BENCH_QD_OPS 256  // 队列深度测试每种深度读的块数
+#define STORAGE_BENCH_QD_MAX (BENCH_SECS * 512 / PG_SIZE)
+
+static struct bio qd_bios[STORAGE_BENCH_QD_MAX];
+
+static void bio_end_bench(struct bio* bio) {
+  sema_up((struct semaphore*)bio->private);
+}
+
+/* 随机读 4KB 的块,每批同时提交 depth 个,全部读完再提交下一批 */
+static void storage_bench_qd(struct block_device* hd, void* buf) {
+  uint32_t stride = hd->sectors / STORAGE_BENCH_QD_OPS / 8 * 8;
+  struct semaphore done;
+  sema_init(&done, 0);
+  uint32_t depth;
+  for (depth = 1; depth <= STORAGE_BENCH_QD_MAX; depth *= 2) {
+    uint64_t stamp = rdtsc();
+    uint32_t op, idx;
+    for (op = 0; op < STORAGE_BENCH_QD_OPS; op += depth) {
+      for (idx = 0; idx < depth; idx++) {
+        uint32_t block = (op + idx) * 37 % STORAGE_BENCH_QD_OPS;
+        bio_init(&qd_bios[idx], hd, block * stride,
+                 (uint8_t*)buf + idx * PG_SIZE, 8, false, bio_end_bench,
+                 &done);
+        bdev_submit(&qd_bios[idx]);
+      }
+      for (idx = 0; idx < depth; idx++) {
+        sema_down(&done);
+      }
+    }
+    /* 按 64 位计时;一种深度的读远不到 32 位微秒数(约 71 分钟),
+     * 求比率时截到 32 位,用 32 位除法 */
+    uint64_t elapsed_us = tsc_elapsed_us(&stamp);
+    uint32_t us = elapsed_us > 0xffffffff ? 0xffffffff : (uint32_t)elapsed_us;
+    if (us == 0) {
+      us = 1;
+    }
+    printk("storage_bench: %s qd %d, %d reads/s, %d us per read\n", hd->name,
+           depth, STORAGE_BENCH_QD_OPS * 1000000 / us, us / STORAGE_BENCH_QD_OPS);
+  }
+}
+
+static void storage_bench(void) {
+  void* buf = get_kernel_pages(BENCH_SECS * 512 / PG_SIZE);
+  if (ahci_port_cnt > 0) {
+    struct ahci_port* port = ahci_ports[0];
+    bench_seek("storage_bench", &port->bdev, buf);
+    printk("storage_bench: %s ncq %s, depth %d, max %d commands in flight\n",
+           port->bdev.name, port->ncq ? "yes" : "no", port->depth,
+           port->max_inflight);
+  }
+  if (virtio_blk_cnt > 0) {
+    struct virtio_blk* vb = virtio_blks[0];
+    uint32_t notify_start = vb->nr_notify;
+    uint32_t irq_start = vb->nr_irq;
+    bench_seek("storage_bench", &vb->bdev, buf);
+    printk("storage_bench: %s %d notifies, %d irqs, max %d requests in flight\n",
+           vb->bdev.name, vb->nr_notify - notify_start, vb->nr_irq - irq_start,
+           vb->max_inflight);
+  }
+  if (nvme_cnt > 0) {
+    struct nvme_ctrl* ctrl = nvme_ctrls[0];
+    storage_bench_qd(&ctrl->bdev, buf);
+    printk("storage_bench: %s %d io queues, %d irqs, max %d commands in flight\n",
+           ctrl->bdev.name, ctrl->io_cnt, ctrl->nr_irq, ctrl->max_inflight);
+  }
+  mfree_page(PF_KERNEL, buf, BENCH_SECS * 512 / PG_SIZE);
+}
+#endif
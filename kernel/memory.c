@@ -6,6 +6,7 @@
 #include "interrupt.h"
 #include "list.h"
 #include "print.h"
+#include "smp.h"
 #include "string.h"
 #include "sync.h"
 #include "thread.h"
@@ -233,7 +234,11 @@ static void page_table_add(void* _vaddr, void* _page_phyaddr) {
 static void page_table_pte_remove(uint32_t vaddr) {
   uint32_t* pte = pte_ptr(vaddr);
   *pte &= ~PG_P_1;                                    // 将p位置0
-  asm volatile("invlpg %0" ::"m"(vaddr) : "memory");  // 更新 tlb(页表高速缓存)
+  asm volatile("invlpg (%0)" ::"r"(vaddr) : "memory");  // 更新 tlb(页表高速缓存)
+  if (vaddr >= 0xc0000000) {
+    // 内核空间各核共享,其他核上可能还缓存着这一项
+    smp_tlb_flush_others();
+  }
 }
 
 /* 分配 pg_cnt 个页空间,成功则返回起始虚拟地址,失败时返回 NULL */
@@ -308,13 +313,63 @@ void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt) {
 /* 从内核物理内存池中申请 cnt 页内存,
 成功则返回其虚拟地址,失败则返回 NULL */
 void* get_kernel_pages(uint32_t pg_cnt) {
+  lock_acquire(&kernel_pool.lock);
   void* vaddr = malloc_page(PF_KERNEL, pg_cnt);
   if (vaddr != NULL) {  // 若分配的地址不为空,将页框清 0(清除脏数据) 后返回
     memset(vaddr, 0, pg_cnt * PG_SIZE);
   }
+  lock_release(&kernel_pool.lock);
   return vaddr;
 }
 
+/* 从内核物理内存池中申请物理地址也连续的 pg_cnt 页,清 0 后返回虚拟地址,
+ * 失败返回 NULL。给只认一个物理基址的设备用,用 mfree_page 释放 */
+void* get_kernel_pages_contig(uint32_t pg_cnt) {
+  lock_acquire(&kernel_pool.lock);
+  int bit_idx = bitmap_scan(&kernel_pool.pool_bitmap, pg_cnt);
+  void* vaddr_start = bit_idx == -1 ? NULL : vaddr_get(PF_KERNEL, pg_cnt);
+  if (vaddr_start != NULL) {
+    uint32_t vaddr = voidptrTouint32(vaddr_start);
+    uint32_t cnt;
+    for (cnt = 0; cnt < pg_cnt; cnt++) {
+      bitmap_set(&kernel_pool.pool_bitmap, bit_idx + cnt, 1);
+      page_table_add(uint32ToVoidptr(vaddr),
+                     uint32ToVoidptr(kernel_pool.phy_addr_start +
+                                     (bit_idx + cnt) * PG_SIZE));
+      vaddr += PG_SIZE;
+    }
+    memset(vaddr_start, 0, pg_cnt * PG_SIZE);
+  }
+  lock_release(&kernel_pool.lock);
+  return vaddr_start;
+}
+
+/* 将从物理地址 phy_addr 开始的 size 字节设备寄存器映射到内核空间,
+ * 不占用物理内存池,映射为禁用缓存。成功返回对应的虚拟地址,失败返回 NULL */
+void* ioremap(uint32_t phy_addr, uint32_t size) {
+  uint32_t offset = phy_addr & 0x00000fff;
+  uint32_t pg_cnt = DIV_ROUND_UP(offset + size, PG_SIZE);
+  uint32_t page_phyaddr = phy_addr - offset;
+
+  lock_acquire(&kernel_pool.lock);
+  void* vaddr_start = vaddr_get(PF_KERNEL, pg_cnt);
+  if (vaddr_start == NULL) {
+    lock_release(&kernel_pool.lock);
+    return NULL;
+  }
+  uint32_t vaddr = voidptrTouint32(vaddr_start);
+  while (pg_cnt-- > 0) {
+    page_table_add(uint32ToVoidptr(vaddr), uint32ToVoidptr(page_phyaddr));
+    uint32_t* pte = pte_ptr(vaddr);
+    *pte = (*pte & ~PG_US_U) | PG_PCD_1 | PG_PWT_1;
+    asm volatile("invlpg (%0)" ::"r"(vaddr) : "memory");
+    vaddr += PG_SIZE;
+    page_phyaddr += PG_SIZE;
+  }
+  lock_release(&kernel_pool.lock);
+  return uint32ToVoidptr(voidptrTouint32(vaddr_start) + offset);
+}
+
 void* get_a_page(enum pool_flags pf, uint32_t vaddr) {
   pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
   lock_acquire(&mem_pool->lock);
@@ -410,7 +465,7 @@ void* sys_malloc(uint32_t size) {
     PF = PF_USER;
     mem_pool = &user_pool;
     pool_size = user_pool.pool_size;
-    descs = cur_thread->u_block_desc;
+    descs = cur_thread->group_leader->u_block_desc;  // 同一进程的线程共用
   }
 
   /* 若申请的内存不在内存池容量范围内,则直接返回 NULL */
@@ -462,15 +517,13 @@ void* sys_malloc(uint32_t size) {
       a->large = false;
       a->cnt = descs[desc_idx].block_per_arena;
       uint32_t block_idx;
-      enum intr_status old_status = intr_disable();
-
+      // free_list 由 mem_pool->lock 保护,这里不必再关中断
       for (block_idx = 0; block_idx < descs[desc_idx].block_per_arena;
            block_idx++) {
         b = arena2block(a, block_idx);
         ASSERT(!elem_find(&a->desc->free_list, &b->free_elem));
         list_append(&a->desc->free_list, &b->free_elem);
       }
-      intr_set_status(old_status);
     }
 
     /* 开始分配内存块 */
@@ -526,6 +579,34 @@ void sys_free(void* ptr) {
   }
 }
 
+/* 把 pg_phy_addrs 中的 cnt 个物理页一次归还,
+ * 每个内存池只加一次锁,回收大量页时用它代替 free_a_phy_page */
+void free_phy_pages(uint32_t* pg_phy_addrs, uint32_t cnt) {
+  struct pool* pools[2] = {&user_pool, &kernel_pool};
+  uint32_t pool_idx;
+  for (pool_idx = 0; pool_idx < 2; pool_idx++) {
+    struct pool* mem_pool = pools[pool_idx];
+    bool locked = false;
+    uint32_t idx;
+    for (idx = 0; idx < cnt; idx++) {
+      uint32_t pg_phy_addr = pg_phy_addrs[idx];
+      if ((pg_phy_addr >= user_pool.phy_addr_start) !=
+          (mem_pool == &user_pool)) {
+        continue;
+      }
+      if (!locked) {
+        lock_acquire(&mem_pool->lock);
+        locked = true;
+      }
+      bitmap_set(&mem_pool->pool_bitmap,
+                 (pg_phy_addr - mem_pool->phy_addr_start) / PG_SIZE, 0);
+    }
+    if (locked) {
+      lock_release(&mem_pool->lock);
+    }
+  }
+}
+
 /* 根据物理页框地址 pg_phy_addr 在相应的内存池的位图清 0,不改动页表*/
 void free_a_phy_page(uint32_t pg_phy_addr) {
   struct pool* mem_pool;
@@ -25,6 +25,8 @@ enum pool_flags {
 #define PG_RW_W 2  // R/W 属性位值,读/写/执行
 #define PG_US_S 0  // U/S 属性位值,系统级
 #define PG_US_U 4  // U/S 属性位值,用户级
+#define PG_PWT_1 8     // 写直通,映射设备寄存器时使用
+#define PG_PCD_1 0x10  // 禁用缓存,映射设备寄存器时使用
 
 /*内存块*/
 struct mem_block {
@@ -53,6 +55,9 @@ void sys_free(void* ptr);
 void* get_a_page_without_opvaddrbitmap(enum pool_flags pf, uint32_t vaddr);
 void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt);
 void free_a_phy_page(uint32_t pg_phy_addr);
+void free_phy_pages(uint32_t* pg_phy_addrs, uint32_t cnt);
 uint32_t* pte_ptr(uint32_t vaddr);
 uint32_t* pde_ptr(uint32_t vaddr);
+void* get_kernel_pages_contig(uint32_t pg_cnt);
+void* ioremap(uint32_t phy_addr, uint32_t size);
 #endif /* KERNEL_MEMORY */
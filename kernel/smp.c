@@ -0,0 +1,272 @@
+#include "smp.h"
+
+#include "debug.h"
+#include "fpu.h"
+#include "interrupt.h"
+#include "lapic.h"
+#include "memory.h"
+#include "print.h"
+#include "sched.h"
+#include "string.h"
+#include "thread.h"
+#include "timer.h"
+#include "tss.h"
+
+/* MP 浮点结构,BIOS 把它放在 EBDA、基本内存末尾或 BIOS ROM 中 */
+struct mp_float {
+  char signature[4];    // "_MP_"
+  uint32_t config_ptr;  // MP 配置表的物理地址
+  uint8_t length;       // 以 16 字节为单位
+  uint8_t spec_rev;
+  uint8_t checksum;
+  uint8_t type;  // 非 0 表示使用默认配置,没有配置表
+  uint8_t features[4];
+} __attribute__((packed));
+
+/* MP 配置表表头,表项紧跟其后 */
+struct mp_config {
+  char signature[4];  // "PCMP"
+  uint16_t length;    // 表头加表项的总长度
+  uint8_t version;
+  uint8_t checksum;
+  char oem_id[8];
+  char product_id[12];
+  uint32_t oem_table;
+  uint16_t oem_length;
+  uint16_t entry_cnt;
+  uint32_t lapic_addr;  // local APIC 的物理地址
+  uint16_t ext_length;
+  uint8_t ext_checksum;
+  uint8_t reserved;
+} __attribute__((packed));
+
+/* 处理器表项 */
+struct mp_proc {
+  uint8_t type;
+  uint8_t apic_id;
+  uint8_t apic_version;
+  uint8_t flags;
+  uint32_t signature;
+  uint32_t feature;
+  uint32_t reserved[2];
+} __attribute__((packed));
+
+#define MP_ENTRY_PROC 0       // 处理器表项类型
+#define MP_PROC_ENABLED 0x1   // 处理器可用
+#define MP_PROC_BSP 0x2       // 处理器是 BSP
+#define MP_OTHER_ENTRY_SIZE 8  // 除处理器外其他表项的大小
+
+#define LOW_MEM_END 0x100000                        // 低端 1M 的结束地址
+#define LOW_MEM_VADDR(phy) ((void*)(0xc0000000 + (phy)))  // 低端 1M 的内核映射
+
+struct cpu cpus[NR_CPUS];
+uint8_t cpu_cnt = 1;
+struct spinlock kernel_lock;  // 大内核锁,系统调用期间持有,保证内核数据结构仍像单核时一样互斥
+static bool smp_started = false;  // AP 是否已经启动完毕
+static uint32_t lapic_phy_addr;   // MP 配置表给出的 local APIC 地址
+
+extern char ap_start[], ap_start_end[], ap_gdt_ptr[], ap_stack_top[];
+
+/*当前任务所在的处理器*/
+struct cpu* this_cpu(void) { return running_thread()->cpu; }
+
+/*初始化 cpu 的私有数据和运行队列*/
+void cpu_init(struct cpu* cpu, uint8_t id) {
+  memset(cpu, 0, sizeof(*cpu));
+  cpu->id = id;
+  spin_lock_init(&cpu->rq_lock);
+  sched_cpu_init(cpu);
+  list_init(&cpu->tasklet_list);
+}
+
+/*求 len 个字节的累加和,MP 的各结构累加和都应为 0*/
+static uint8_t checksum(void* addr, uint32_t len) {
+  uint8_t sum = 0;
+  uint8_t* p = addr;
+  while (len-- > 0) {
+    sum += *p++;
+  }
+  return sum;
+}
+
+/*在物理地址 phy_addr 开始的 len 字节中以 16 字节为步长查找 MP 浮点结构*/
+static struct mp_float* mp_search(uint32_t phy_addr, uint32_t len) {
+  uint8_t* p = LOW_MEM_VADDR(phy_addr);
+  uint8_t* end = p + len;
+  while (p + sizeof(struct mp_float) <= end) {
+    if (memcmp(p, "_MP_", 4) == 0 &&
+        checksum(p, sizeof(struct mp_float)) == 0) {
+      return (struct mp_float*)p;
+    }
+    p += 16;
+  }
+  return NULL;
+}
+
+/*按规范依次在 EBDA 的首 1K、基本内存的最后 1K、BIOS ROM 中查找*/
+static struct mp_float* mp_find(void) {
+  struct mp_float* mpf;
+  uint32_t ebda = (uint32_t)(*(uint16_t*)LOW_MEM_VADDR(0x40e)) << 4;
+  if (ebda != 0 && (mpf = mp_search(ebda, 1024)) != NULL) {
+    return mpf;
+  }
+  uint32_t base_mem = (uint32_t)(*(uint16_t*)LOW_MEM_VADDR(0x413)) * 1024;
+  if (base_mem >= 1024 && (mpf = mp_search(base_mem - 1024, 1024)) != NULL) {
+    return mpf;
+  }
+  return mp_search(0xf0000, 0x10000);
+}
+
+/*解析 MP 配置表,得到各处理器的 APIC ID,失败返回 false*/
+static bool mp_config_parse(void) {
+  struct mp_float* mpf = mp_find();
+  if (mpf == NULL || mpf->config_ptr == 0 || mpf->type != 0) {
+    return false;
+  }
+  // 目前只映射了低端 1M,配置表一般也都在这里
+  if (mpf->config_ptr + sizeof(struct mp_config) > LOW_MEM_END) {
+    return false;
+  }
+  struct mp_config* conf = LOW_MEM_VADDR(mpf->config_ptr);
+  if (memcmp(conf->signature, "PCMP", 4) != 0 ||
+      mpf->config_ptr + conf->length > LOW_MEM_END ||
+      checksum(conf, conf->length) != 0) {
+    return false;
+  }
+  lapic_phy_addr = conf->lapic_addr;
+
+  uint8_t* p = (uint8_t*)(conf + 1);
+  uint8_t* end = (uint8_t*)conf + conf->length;
+  while (p < end) {
+    if (*p != MP_ENTRY_PROC) {
+      p += MP_OTHER_ENTRY_SIZE;
+      continue;
+    }
+    struct mp_proc* proc = (struct mp_proc*)p;
+    p += sizeof(struct mp_proc);
+    if (!(proc->flags & MP_PROC_ENABLED)) {
+      continue;
+    }
+    if (proc->flags & MP_PROC_BSP) {
+      cpus[0].apic_id = proc->apic_id;
+    } else if (cpu_cnt < NR_CPUS) {
+      cpu_init(&cpus[cpu_cnt], cpu_cnt);
+      cpus[cpu_cnt].apic_id = proc->apic_id;
+      cpu_cnt++;
+    }
+  }
+  return true;
+}
+
+/*AP 在启动代码开启分页后进入此处,运行在自己 idle 线程的 pcb 页上*/
+void ap_main(void) {
+  struct task_struct* idle = running_thread();
+  struct cpu* cpu = idle->cpu;
+
+  tss_init_ap(cpu->id);  // 换成内核的 gdt 并加载本核的 tss
+  idt_load();
+  lapic_init(false);
+  lapic_timer_start();
+  fpu_init();
+
+  idle->status = TASK_RUNNING;
+  idle->on_cpu = true;
+  cpu->cur_thread = idle;
+  cpu->started = true;
+  cpu_idle();
+}
+
+/*用 INIT-SIPI-SIPI 唤醒 cpu,成功返回 true*/
+static bool ap_boot(struct cpu* cpu) {
+  struct task_struct* idle = idle_thread_create(cpu);
+  *(uint32_t*)LOW_MEM_VADDR(AP_START_PHY + (ap_stack_top - ap_start)) =
+      (uint32_t)idle + PG_SIZE;
+
+  lapic_send_ipi(cpu->apic_id, ICR_INIT | ICR_LEVEL_ASSERT);
+  udelay(10000);
+  uint8_t sipi_cnt;
+  for (sipi_cnt = 0; sipi_cnt < 2 && !cpu->started; sipi_cnt++) {
+    // 向量号即启动代码所在的物理页号
+    lapic_send_ipi(cpu->apic_id, ICR_STARTUP | (AP_START_PHY >> 12));
+    udelay(200);
+  }
+
+  uint32_t wait_cnt = 0;  // 最多等 100ms
+  while (!cpu->started && wait_cnt++ < 1000) {
+    udelay(100);
+  }
+  return cpu->started;
+}
+
+/*找出所有处理器并启动 AP,没有 MP 配置表时按单核运行*/
+void smp_init(void) {
+  put_str("smp_init start\n");
+  if (!mp_config_parse()) {
+    put_str("   no MP table, running on one cpu\n");
+    return;
+  }
+  lapic_map(lapic_phy_addr);
+  lapic_init(true);
+  cpus[0].apic_id = lapic_id();  // 以 BSP 实际的 APIC ID 为准
+
+  if (cpu_cnt > 1) {
+    lapic_timer_calibrate();
+
+    /* 拷贝启动代码,gdt 用物理地址,这时只需要内核代码段和数据段 */
+    memcpy(LOW_MEM_VADDR(AP_START_PHY), ap_start, ap_start_end - ap_start);
+    uint8_t* gdt_ptr = LOW_MEM_VADDR(AP_START_PHY + (ap_gdt_ptr - ap_start));
+    *(uint16_t*)gdt_ptr = 3 * 8 - 1;
+    *(uint32_t*)(gdt_ptr + 2) = 0x900;
+
+    uint8_t idx;
+    for (idx = 1; idx < cpu_cnt; idx++) {
+      if (!ap_boot(&cpus[idx])) {
+        put_str("   cpu ");
+        put_int(cpus[idx].apic_id);
+        put_str(" failed to start\n");
+      }
+    }
+    smp_started = true;
+  }
+
+  put_str("   cpu count: ");
+  put_int(cpu_cnt);
+  put_str("\nsmp_init done\n");
+}
+
+/* 发 IPI 让 cpu 进入一次中断,返回前检查 need_resched,
+ * idle 时还能把它从 hlt 中叫醒 */
+void smp_send_reschedule(struct cpu* cpu) {
+  if (smp_started && cpu != this_cpu() && cpu->started) {
+    lapic_send_ipi(cpu->apic_id, LAPIC_RESCHED_VEC);
+  }
+}
+
+/* 让其他核刷新 TLB,不等待应答:
+ * 内核页没有设 G 位,各核切换任务时重载 cr3 也会清掉旧的映射 */
+void smp_tlb_flush_others(void) {
+  if (smp_started) {
+    lapic_send_ipi(0, ICR_ALL_BUT_SELF | LAPIC_TLB_VEC);
+  }
+}
+
+/*获取大内核锁,可重入,被调度走时由 schedule 暂时释放*/
+void kernel_lock_acquire(void) {
+  enum intr_status old_status = intr_disable();
+  struct task_struct* cur = running_thread();
+  if (cur->kernel_lock_depth++ == 0) {
+    spin_lock(&kernel_lock);
+  }
+  intr_set_status(old_status);
+}
+
+/*释放大内核锁*/
+void kernel_lock_release(void) {
+  enum intr_status old_status = intr_disable();
+  struct task_struct* cur = running_thread();
+  ASSERT(cur->kernel_lock_depth > 0);
+  if (--cur->kernel_lock_depth == 0) {
+    spin_unlock(&kernel_lock);
+  }
+  intr_set_status(old_status);
+}
@@ -0,0 +1,56 @@
+#ifndef KERNEL_SMP
+#define KERNEL_SMP
+#include "global.h"
+#include "list.h"
+#include "rbtree.h"
+#include "sched.h"
+#include "stdint.h"
+#include "sync.h"
+
+#define NR_CPUS 8  // 最多支持的处理器数
+
+#define AP_START_PHY 0x70000  // AP 启动代码的物理地址(loader 读内核用的缓冲区)
+
+/*每个处理器私有的数据*/
+struct cpu {
+  uint8_t id;                       // 逻辑编号,BSP 为 0
+  uint8_t apic_id;                  // local APIC ID
+  volatile bool started;            // 是否已完成初始化可以调度
+  struct task_struct* idle_thread;  // 本核的 idle 线程
+  struct task_struct* cur_thread;   // 本核正在运行的任务
+  struct task_struct* prev_thread;  // 刚被换下的任务,换下完成前不能被别的核运行
+
+  /* 运行队列,rq_lock 在 switch_to 期间一直持有,由新任务在 schedule_tail 释放 */
+  struct spinlock rq_lock;
+  uint32_t nr_ready;         // 各调度类就绪任务的总数
+  struct list rt_queue[RT_PRIO_CNT];  // 实时类每个优先级一个队列
+  uint32_t rt_bitmap;        // 第 n 位为 1 表示 rt_queue[n] 非空
+  struct list ready_list;    // 时间片轮转类的就绪队列
+  struct rb_root cfs_tree;   // CFS 类的就绪任务,按 vruntime 排序
+  uint64_t min_vruntime;     // CFS 类的 vruntime 基准,只增不减
+  uint32_t cfs_load;         // CFS 就绪任务的权重和
+  uint32_t nr_cfs;           // CFS 就绪任务数
+
+  /* 软中断 */
+  uint32_t softirq_pending;  // 挂起的软中断位图
+  bool in_softirq;           // 是否正在执行软中断
+  struct list tasklet_list;  // 本核待执行的 tasklet
+
+  struct task_struct* fpu_owner;  // 浮点寄存器中装的是哪个任务的状态
+
+  uint32_t rcu_qs_count;  // 经过的 RCU 静止状态数,只在本核上增加
+};
+
+extern struct cpu cpus[NR_CPUS];
+extern uint8_t cpu_cnt;
+extern struct spinlock kernel_lock;
+
+struct cpu* this_cpu(void);
+void cpu_init(struct cpu* cpu, uint8_t id);
+void smp_init(void);
+void ap_main(void);
+void smp_send_reschedule(struct cpu* cpu);
+void smp_tlb_flush_others(void);
+void kernel_lock_acquire(void);
+void kernel_lock_release(void);
+#endif /* KERNEL_SMP */
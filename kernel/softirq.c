@@ -0,0 +1,106 @@
+#include "softirq.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "print.h"
+#include "smp.h"
+#include "sync.h"
+#include "thread.h"
+
+#define MAX_SOFTIRQ_RESTART 10  // 一次中断返回最多重复处理的轮数
+
+static softirq_action* softirq_vec[NR_SOFTIRQS];
+static struct spinlock tasklet_lock;  // 保护各处理器的 tasklet 队列
+
+/*注册软中断处理函数*/
+void open_softirq(enum softirq_nr nr, softirq_action* action) {
+  ASSERT(nr < NR_SOFTIRQS);
+  softirq_vec[nr] = action;
+}
+
+/*在本处理器上挂起软中断 nr,在本核下一次中断返回时执行*/
+void raise_softirq(enum softirq_nr nr) {
+  enum intr_status old_status = intr_disable();
+  this_cpu()->softirq_pending |= (1 << nr);
+  intr_set_status(old_status);
+}
+
+/* 开中断执行本核挂起的软中断,调用时中断是关闭的。
+ * 执行期间到来的中断不会再进入这里,由外层循环接着处理它们挂起的软中断 */
+void do_softirq(void) {
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct cpu* cpu = this_cpu();
+  if (cpu->in_softirq) {
+    return;
+  }
+  cpu->in_softirq = true;
+
+  uint32_t restart = MAX_SOFTIRQ_RESTART;
+  uint32_t pending;
+  while ((pending = cpu->softirq_pending) != 0 && restart-- > 0) {
+    cpu->softirq_pending = 0;
+    intr_enable();
+    uint32_t nr;
+    for (nr = 0; nr < NR_SOFTIRQS; nr++) {
+      if ((pending & (1 << nr)) && softirq_vec[nr] != NULL) {
+        softirq_vec[nr]();
+      }
+    }
+    intr_disable();
+  }
+  // 还没处理完的留到下一次中断返回
+  cpu->in_softirq = false;
+}
+
+/* 每个中断处理函数返回后调用:先执行软中断,
+ * 再看当前任务是否被要求让出。软中断中嵌套的中断不做调度 */
+void irq_exit(void) {
+  do_softirq();
+  if (!this_cpu()->in_softirq) {
+    check_resched();
+  }
+}
+
+/*初始化 tasklet*/
+void tasklet_init(struct tasklet* t, void (*func)(uint32_t), uint32_t data) {
+  list_elem_init(&t->tag);
+  t->func = func;
+  t->data = data;
+  t->scheduled = false;
+}
+
+/*将 t 挂到本处理器的 tasklet 队列,已在队列中时不重复挂*/
+void tasklet_schedule(struct tasklet* t) {
+  struct cpu* cpu;
+  enum intr_status old_status = spin_lock_irqsave(&tasklet_lock);
+  if (!t->scheduled) {
+    t->scheduled = true;
+    cpu = this_cpu();
+    list_append(&cpu->tasklet_list, &t->tag);
+    cpu->softirq_pending |= (1 << TASKLET_SOFTIRQ);
+  }
+  spin_unlock_irqrestore(&tasklet_lock, old_status);
+}
+
+/*TASKLET_SOFTIRQ 的处理函数,逐个取出本核的 tasklet 执行*/
+static void tasklet_action(void) {
+  struct cpu* cpu = this_cpu();
+  enum intr_status old_status = spin_lock_irqsave(&tasklet_lock);
+  while (!list_empty(&cpu->tasklet_list)) {
+    struct tasklet* t =
+        elem2entry(struct tasklet, tag, list_pop(&cpu->tasklet_list));
+    t->scheduled = false;  // 执行期间可以被再次挂起
+    spin_unlock_irqrestore(&tasklet_lock, old_status);
+    t->func(t->data);
+    old_status = spin_lock_irqsave(&tasklet_lock);
+  }
+  spin_unlock_irqrestore(&tasklet_lock, old_status);
+}
+
+/*初始化软中断*/
+void softirq_init(void) {
+  put_str("softirq_init start\n");
+  spin_lock_init(&tasklet_lock);
+  open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+  put_str("softirq_init done\n");
+}
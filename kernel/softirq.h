@@ -0,0 +1,31 @@
+#ifndef KERNEL_SOFTIRQ
+#define KERNEL_SOFTIRQ
+#include "global.h"
+#include "list.h"
+#include "stdint.h"
+
+/* 软中断号,号越小越先执行 */
+enum softirq_nr {
+  TIMER_SOFTIRQ,    // 执行到期的定时器
+  TASKLET_SOFTIRQ,  // 执行各驱动挂上来的 tasklet
+  NR_SOFTIRQS
+};
+
+typedef void softirq_action(void);
+
+/* tasklet:由中断处理程序挂起,在中断返回前开中断执行的小段工作,不能睡眠 */
+struct tasklet {
+  struct list_elem tag;       // 挂在处理器的 tasklet 队列中
+  void (*func)(uint32_t data);
+  uint32_t data;              // 传给 func 的参数
+  bool scheduled;             // 已在队列中等待执行
+};
+
+void softirq_init(void);
+void open_softirq(enum softirq_nr nr, softirq_action* action);
+void raise_softirq(enum softirq_nr nr);
+void do_softirq(void);
+void irq_exit(void);
+void tasklet_init(struct tasklet* t, void (*func)(uint32_t), uint32_t data);
+void tasklet_schedule(struct tasklet* t);
+#endif /* KERNEL_SOFTIRQ */
@@ -12,6 +12,11 @@ inline uint8_t inb(uint16_t port) {
   return ret;
 }
 
+// 端口写两个字节
+inline void outw(uint16_t port, uint16_t value) {
+  asm volatile("outw %1, %0" : : "dN"(port), "a"(value));
+}
+
 // 端口读两个字节
 inline uint16_t inw(uint16_t port) {
   uint16_t ret;
@@ -19,6 +24,18 @@ inline uint16_t inw(uint16_t port) {
   return ret;
 }
 
+// 端口写四个字节
+inline void outl(uint16_t port, uint32_t value) {
+  asm volatile("outl %1, %0" : : "dN"(port), "a"(value));
+}
+
+// 端口读四个字节
+inline uint32_t inl(uint16_t port) {
+  uint32_t ret;
+  asm volatile("inl %1, %0" : "=a"(ret) : "dN"(port));
+  return ret;
+}
+
 /* 将addr处起始的word_cnt个字写入端口port */
 inline void outsw(uint16_t port, const void* addr, uint32_t word_cnt) {
   asm volatile("cld; rep outsw" : "+S"(addr), "+c"(word_cnt) : "d"(port));
@@ -9,9 +9,18 @@ void outb(uint16_t port, uint8_t value);
 // 端口读一个字节
 uint8_t inb(uint16_t port);
 
+// 端口写两个字节
+void outw(uint16_t port, uint16_t value);
+
 // 端口读两个字节
 uint16_t inw(uint16_t port);
 
+// 端口写四个字节
+void outl(uint16_t port, uint32_t value);
+
+// 端口读四个字节
+uint32_t inl(uint16_t port);
+
 /* 将addr处起始的word_cnt个字写入端口port */
 void outsw(uint16_t port, const void* addr, uint32_t word_cnt);
 
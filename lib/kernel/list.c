@@ -8,6 +8,13 @@ void list_init(struct list* list) {
   list->tail.prev = &list->head;
   list->head.prev = &list->tail;
   list->tail.next = &list->head;
+  list->head.owner = list->tail.owner = list;
+}
+
+/* 初始化结点,使其不属于任何链表 */
+void list_elem_init(struct list_elem* elem) {
+  elem->prev = elem->next = NULL;
+  elem->owner = NULL;
 }
 
 // 在before前插入elem
@@ -18,6 +25,20 @@ void list_insert_before(struct list_elem* before, struct list_elem* elem) {
   elem->next = before;
   elem->prev = before->prev;
   before->prev = elem;
+  elem->owner = before->owner;  // 与 before 同属一个链表
+  intr_set_status(old_status);
+}
+
+/* 在 before 前插入 elem,供不加锁遍历的 RCU 读者使用:
+ * 先把 elem 填好,再让它在 next 方向上可见,读者走到它时 next 已经有效 */
+void list_insert_before_rcu(struct list_elem* before, struct list_elem* elem) {
+  enum intr_status old_status = intr_disable();
+  elem->next = before;
+  elem->prev = before->prev;
+  elem->owner = before->owner;
+  asm volatile("" : : : "memory");  // x86 的写不会重排,只需挡住编译器
+  before->prev->next = elem;  // 发布
+  before->prev = elem;
   intr_set_status(old_status);
 }
 
@@ -31,11 +52,17 @@ void list_append(struct list* plist, struct list_elem* elem) {
   list_insert_before(&plist->tail, elem);
 }
 
+/* 追加元素到队尾,链表有 RCU 读者时使用 */
+void list_append_rcu(struct list* plist, struct list_elem* elem) {
+  list_insert_before_rcu(&plist->tail, elem);
+}
+
 /* 使元素 pelem 脱离链表 */
 void list_remove(struct list_elem* pelem) {
   enum intr_status old_status = intr_disable();
   pelem->next->prev = pelem->prev;
   pelem->prev->next = pelem->next;
+  pelem->owner = NULL;
   intr_set_status(old_status);
 }
 
@@ -46,17 +73,10 @@ struct list_elem* list_pop(struct list* plist) {
   return elem;
 }
 
-/* 从链表中查找元素 obj_elem,成功时返回 true,失败时返回 false */
+/* 判断 obj_elem 是否在链表 plist 中,成功时返回 true,失败时返回 false.
+ * 结点入队时记录了所属链表,因此无需遍历,是常数时间的操作 */
 bool elem_find(struct list* plist, struct list_elem* obj_elem) {
-  struct list_elem* elem = plist->head.next;
-  while (elem != &plist->tail) {
-    if (elem == obj_elem) {
-      return true;
-    } else {
-      elem = elem->next;
-    }
-  }
-  return false;
+  return obj_elem->owner == plist;
 }
 
 /*判断链表是否为空*/
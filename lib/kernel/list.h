@@ -8,9 +8,12 @@
 #define elem2entry(struct_type, struct_member_name, elem_ptr) \
   (struct_type*)((long int)elem_ptr - offset(struct_type, struct_member_name))
 
+struct list;
+
 struct list_elem {
   struct list_elem* prev;  // 前驱
   struct list_elem* next;  // 后继
+  struct list* owner;      // 所在的链表,不在任何链表中时为 NULL
 };
 
 /* 链表结构,用来实现队列*/
@@ -24,14 +27,17 @@ typedef bool(function)(struct list_elem*, int arg);
 
 void list_init(struct list*);
 void list_insert_before(struct list_elem* before, struct list_elem* elem);
+void list_insert_before_rcu(struct list_elem* before, struct list_elem* elem);
 void list_push(struct list* plist, struct list_elem* elem);
 void list_append(struct list* plist, struct list_elem* elem);
+void list_append_rcu(struct list* plist, struct list_elem* elem);
 void list_remove(struct list_elem* pelem);
 struct list_elem* list_pop(struct list* plist);
 bool list_empty(struct list* plist);
 uint32_t list_len(struct list* plist);
 struct list_elem* list_traversal(struct list* plist, function func, int arg);
 bool elem_find(struct list* plist, struct list_elem* obj_elem);
+void list_elem_init(struct list_elem* elem);
 
 void print_ele(struct list* plist);
 #endif /* LIB_KERNEL_LIST */
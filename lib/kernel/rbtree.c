@@ -0,0 +1,275 @@
+#include "rbtree.h"
+
+/*初始化空树*/
+void rb_root_init(struct rb_root* root) {
+  root->node = NULL;
+  root->leftmost = NULL;
+}
+
+bool rb_empty(struct rb_root* root) { return root->node == NULL; }
+
+/*用 new 替换 old 在其父结点(或树根)中的位置*/
+static void replace_child(struct rb_root* root, struct rb_node* old,
+                          struct rb_node* new) {
+  struct rb_node* parent = old->parent;
+  if (parent == NULL) {
+    root->node = new;
+  } else if (parent->left == old) {
+    parent->left = new;
+  } else {
+    parent->right = new;
+  }
+  if (new != NULL) {
+    new->parent = parent;
+  }
+}
+
+/* 左旋:
+ *     x                y
+ *    / \              / \
+ *   a   y     =>     x   c
+ *      / \          / \
+ *     b   c        a   b        */
+static void rotate_left(struct rb_root* root, struct rb_node* x) {
+  struct rb_node* y = x->right;
+  x->right = y->left;
+  if (y->left != NULL) {
+    y->left->parent = x;
+  }
+  replace_child(root, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/*右旋,与左旋对称*/
+static void rotate_right(struct rb_root* root, struct rb_node* x) {
+  struct rb_node* y = x->left;
+  x->left = y->right;
+  if (y->right != NULL) {
+    y->right->parent = x;
+  }
+  replace_child(root, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/*插入 node 后修复红黑性质*/
+static void insert_fixup(struct rb_root* root, struct rb_node* node) {
+  struct rb_node* parent;
+  while ((parent = node->parent) != NULL && parent->red) {
+    struct rb_node* gparent = parent->parent;  // 父结点为红,一定不是根
+    if (parent == gparent->left) {
+      struct rb_node* uncle = gparent->right;
+      if (uncle != NULL && uncle->red) {  // 叔叔为红:变色后上移两层
+        parent->red = uncle->red = false;
+        gparent->red = true;
+        node = gparent;
+        continue;
+      }
+      if (node == parent->right) {  // 转成外侧的情况
+        rotate_left(root, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->red = false;
+      gparent->red = true;
+      rotate_right(root, gparent);
+    } else {
+      struct rb_node* uncle = gparent->left;
+      if (uncle != NULL && uncle->red) {
+        parent->red = uncle->red = false;
+        gparent->red = true;
+        node = gparent;
+        continue;
+      }
+      if (node == parent->left) {
+        rotate_right(root, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->red = false;
+      gparent->red = true;
+      rotate_left(root, gparent);
+    }
+  }
+  root->node->red = false;
+}
+
+/*按 less 的顺序插入 node,相等的结点插在已有结点之后*/
+void rb_insert(struct rb_root* root, struct rb_node* node, rb_less* less) {
+  struct rb_node** link = &root->node;
+  struct rb_node* parent = NULL;
+  bool leftmost = true;
+  while (*link != NULL) {
+    parent = *link;
+    if (less(node, parent)) {
+      link = &parent->left;
+    } else {
+      link = &parent->right;
+      leftmost = false;
+    }
+  }
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->red = true;
+  *link = node;
+  if (leftmost) {
+    root->leftmost = node;
+  }
+  insert_fixup(root, node);
+}
+
+/*删除后修复:node 所在子树少了一个黑结点,node 可能为 NULL*/
+static void erase_fixup(struct rb_root* root, struct rb_node* node,
+                        struct rb_node* parent) {
+  while (node != root->node && (node == NULL || !node->red)) {
+    if (node == parent->left) {
+      struct rb_node* sibling = parent->right;
+      if (sibling->red) {  // 兄弟为红:转成兄弟为黑的情况
+        sibling->red = false;
+        parent->red = true;
+        rotate_left(root, parent);
+        sibling = parent->right;
+      }
+      if ((sibling->left == NULL || !sibling->left->red) &&
+          (sibling->right == NULL || !sibling->right->red)) {
+        sibling->red = true;  // 兄弟的子结点都黑:兄弟变红,问题上移
+        node = parent;
+        parent = node->parent;
+        continue;
+      }
+      if (sibling->right == NULL || !sibling->right->red) {
+        sibling->left->red = false;
+        sibling->red = true;
+        rotate_right(root, sibling);
+        sibling = parent->right;
+      }
+      sibling->red = parent->red;
+      parent->red = false;
+      sibling->right->red = false;
+      rotate_left(root, parent);
+      node = root->node;
+      break;
+    } else {
+      struct rb_node* sibling = parent->left;
+      if (sibling->red) {
+        sibling->red = false;
+        parent->red = true;
+        rotate_right(root, parent);
+        sibling = parent->left;
+      }
+      if ((sibling->left == NULL || !sibling->left->red) &&
+          (sibling->right == NULL || !sibling->right->red)) {
+        sibling->red = true;
+        node = parent;
+        parent = node->parent;
+        continue;
+      }
+      if (sibling->left == NULL || !sibling->left->red) {
+        sibling->right->red = false;
+        sibling->red = true;
+        rotate_left(root, sibling);
+        sibling = parent->left;
+      }
+      sibling->red = parent->red;
+      parent->red = false;
+      sibling->left->red = false;
+      rotate_right(root, parent);
+      node = root->node;
+      break;
+    }
+  }
+  if (node != NULL) {
+    node->red = false;
+  }
+}
+
+/*从树中删除 node*/
+void rb_erase(struct rb_root* root, struct rb_node* node) {
+  if (root->leftmost == node) {
+    root->leftmost = rb_next(node);
+  }
+
+  struct rb_node* child;
+  struct rb_node* parent;
+  bool removed_red;
+  if (node->left == NULL || node->right == NULL) {
+    // 最多一个孩子,直接用孩子顶替
+    child = node->left != NULL ? node->left : node->right;
+    parent = node->parent;
+    removed_red = node->red;
+    replace_child(root, node, child);
+  } else {
+    // 两个孩子:用后继 succ 顶替 node,实际被摘掉的是 succ 原来的位置
+    struct rb_node* succ = node->right;
+    while (succ->left != NULL) {
+      succ = succ->left;
+    }
+    child = succ->right;
+    removed_red = succ->red;
+    if (succ->parent == node) {
+      parent = succ;
+    } else {
+      parent = succ->parent;
+      parent->left = child;
+      if (child != NULL) {
+        child->parent = parent;
+      }
+      succ->right = node->right;
+      node->right->parent = succ;
+    }
+    replace_child(root, node, succ);
+    succ->left = node->left;
+    node->left->parent = succ;
+    succ->red = node->red;
+  }
+  if (!removed_red) {
+    erase_fixup(root, child, parent);
+  }
+  node->parent = node->left = node->right = NULL;
+}
+
+/*最小结点*/
+struct rb_node* rb_first(struct rb_root* root) { return root->leftmost; }
+
+/*最大结点*/
+struct rb_node* rb_last(struct rb_root* root) {
+  struct rb_node* node = root->node;
+  if (node == NULL) {
+    return NULL;
+  }
+  while (node->right != NULL) {
+    node = node->right;
+  }
+  return node;
+}
+
+/*中序后继*/
+struct rb_node* rb_next(struct rb_node* node) {
+  if (node->right != NULL) {
+    node = node->right;
+    while (node->left != NULL) {
+      node = node->left;
+    }
+    return node;
+  }
+  while (node->parent != NULL && node == node->parent->right) {
+    node = node->parent;
+  }
+  return node->parent;
+}
+
+/*中序前驱*/
+struct rb_node* rb_prev(struct rb_node* node) {
+  if (node->left != NULL) {
+    node = node->left;
+    while (node->right != NULL) {
+      node = node->right;
+    }
+    return node;
+  }
+  while (node->parent != NULL && node == node->parent->left) {
+    node = node->parent;
+  }
+  return node->parent;
+}
@@ -0,0 +1,32 @@
+#ifndef LIB_KERNEL_RBTREE
+#define LIB_KERNEL_RBTREE
+
+#include "global.h"
+#include "list.h"
+
+/* 侵入式红黑树,结点嵌在宿主结构中,用 elem2entry 取回宿主 */
+struct rb_node {
+  struct rb_node* parent;
+  struct rb_node* left;
+  struct rb_node* right;
+  bool red;
+};
+
+/* 树根,另外缓存最左(最小)结点,取最小值为 O(1) */
+struct rb_root {
+  struct rb_node* node;
+  struct rb_node* leftmost;
+};
+
+/* 比较函数,a 应排在 b 之前时返回 true */
+typedef bool(rb_less)(struct rb_node* a, struct rb_node* b);
+
+void rb_root_init(struct rb_root* root);
+void rb_insert(struct rb_root* root, struct rb_node* node, rb_less* less);
+void rb_erase(struct rb_root* root, struct rb_node* node);
+struct rb_node* rb_first(struct rb_root* root);
+struct rb_node* rb_last(struct rb_root* root);
+struct rb_node* rb_next(struct rb_node* node);
+struct rb_node* rb_prev(struct rb_node* node);
+bool rb_empty(struct rb_root* root);
+#endif /* LIB_KERNEL_RBTREE */
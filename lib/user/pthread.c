@@ -0,0 +1,129 @@
+#include "pthread.h"
+
+#include "syscall.h"
+
+/*新线程的入口,start_routine 返回后结束本线程*/
+static void pthread_entry(void* arg) {
+  struct pthread* t = arg;
+  t->retval = t->start_routine(t->arg);
+  exit(0);
+}
+
+/*创建线程执行 start_routine(arg),成功返回 0,失败返回 -1*/
+int32_t pthread_create(pthread_t* thread, void* (*start_routine)(void*),
+                       void* arg) {
+  struct pthread* t = malloc(sizeof(struct pthread));
+  if (t == NULL) {
+    return -1;
+  }
+  t->stack = malloc(PTHREAD_STACK_SIZE);
+  if (t->stack == NULL) {
+    free(t);
+    return -1;
+  }
+  t->start_routine = start_routine;
+  t->arg = arg;
+  t->retval = NULL;
+
+  /* 栈顶按 16 字节对齐 */
+  uint32_t stack_top = ((uint32_t)t->stack + PTHREAD_STACK_SIZE) & ~0xf;
+  t->tid = clone(pthread_entry, t, (void*)stack_top);
+  if (t->tid == -1) {
+    free(t->stack);
+    free(t);
+    return -1;
+  }
+  *thread = t;
+  return 0;
+}
+
+/*等待线程结束并回收它的栈,retval 不为 NULL 时存入其返回值*/
+int32_t pthread_join(pthread_t thread, void** retval) {
+  int32_t status;
+  if (thread_join(thread->tid, &status) == -1) {
+    return -1;
+  }
+  if (retval != NULL) {
+    *retval = thread->retval;
+  }
+  free(thread->stack);
+  free(thread);
+  return 0;
+}
+
+/*当前线程的 tid*/
+pid_t pthread_self(void) { return getpid(); }
+
+/*若 *addr 等于 old 则改为 new,返回 *addr 原来的值*/
+static uint32_t cmpxchg(volatile uint32_t* addr, uint32_t old, uint32_t new) {
+  uint32_t prev;
+  asm volatile("lock cmpxchgl %2, %1"
+               : "=a"(prev), "+m"(*addr)
+               : "r"(new), "0"(old)
+               : "memory");
+  return prev;
+}
+
+/*把 *addr 换成 val,返回原来的值,xchg 自带 lock 语义*/
+static uint32_t xchg(volatile uint32_t* addr, uint32_t val) {
+  asm volatile("xchgl %0, %1" : "+r"(val), "+m"(*addr) : : "memory");
+  return val;
+}
+
+/*原子地给 *addr 加 1*/
+static void atomic_inc(volatile uint32_t* addr) {
+  asm volatile("lock incl %0" : "+m"(*addr) : : "memory");
+}
+
+void pthread_mutex_init(pthread_mutex_t* mutex) { mutex->state = 0; }
+
+void pthread_mutex_lock(pthread_mutex_t* mutex) {
+  uint32_t c = cmpxchg(&mutex->state, 0, 1);
+  if (c == 0) {
+    return;  // 快速路径,没有竞争
+  }
+  /* 标记为有人等待后睡眠,醒来再抢,抢到时仍标为 2,
+   * 因为不知道是否还有别的等待者 */
+  if (c != 2) {
+    c = xchg(&mutex->state, 2);
+  }
+  while (c != 0) {
+    futex((uint32_t*)&mutex->state, FUTEX_WAIT, 2);
+    c = xchg(&mutex->state, 2);
+  }
+}
+
+bool pthread_mutex_trylock(pthread_mutex_t* mutex) {
+  return cmpxchg(&mutex->state, 0, 1) == 0;
+}
+
+void pthread_mutex_unlock(pthread_mutex_t* mutex) {
+  if (xchg(&mutex->state, 0) == 2) {
+    futex((uint32_t*)&mutex->state, FUTEX_WAKE, 1);
+  }
+}
+
+void pthread_cond_init(pthread_cond_t* cond) { cond->seq = 0; }
+
+/* 先记下 seq 再解锁,解锁后有人 signal 会改变 seq,
+ * futex_wait 发现值变了就直接返回,不会丢失唤醒。
+ * 可能被虚假唤醒,调用者要在循环中检查条件 */
+void pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+  uint32_t seq = cond->seq;
+  pthread_mutex_unlock(mutex);
+  futex((uint32_t*)&cond->seq, FUTEX_WAIT, seq);
+  /* 可能还有别的等待者被一起唤醒,重新加锁时按有竞争处理 */
+  while (xchg(&mutex->state, 2) != 0) {
+    futex((uint32_t*)&mutex->state, FUTEX_WAIT, 2);
+  }
+}
+
+void pthread_cond_signal(pthread_cond_t* cond) {
+  atomic_inc(&cond->seq);
+  futex((uint32_t*)&cond->seq, FUTEX_WAKE, 1);
+}
+
+void pthread_cond_broadcast(pthread_cond_t* cond) {
+  atomic_inc(&cond->seq);
+  futex((uint32_t*)&cond->seq, FUTEX_WAKE, 0xffffffff);
+}
@@ -0,0 +1,44 @@
+#ifndef LIB_USER_PTHREAD
+#define LIB_USER_PTHREAD
+#include "stdint.h"
+#include "syscall.h"
+
+#define PTHREAD_STACK_SIZE 8192  // 每个线程的用户栈大小
+
+/*用户态线程的描述,由 pthread_create 分配,pthread_join 后释放*/
+struct pthread {
+  pid_t tid;
+  void* (*start_routine)(void*);
+  void* arg;
+  void* retval;  // start_routine 的返回值
+  void* stack;   // 用户栈所在的堆内存
+};
+typedef struct pthread* pthread_t;
+
+/* 互斥锁,0 空闲,1 被持有,2 被持有且可能有人在等。
+ * 无竞争时加锁解锁都只是一条原子指令,不进内核 */
+typedef struct {
+  volatile uint32_t state;
+} pthread_mutex_t;
+
+/* 条件变量,seq 每次 signal/broadcast 加一,等待者在 seq 上 futex_wait */
+typedef struct {
+  volatile uint32_t seq;
+} pthread_cond_t;
+
+#define PTHREAD_MUTEX_INITIALIZER {0}
+#define PTHREAD_COND_INITIALIZER {0}
+
+int32_t pthread_create(pthread_t* thread, void* (*start_routine)(void*),
+                       void* arg);
+int32_t pthread_join(pthread_t thread, void** retval);
+pid_t pthread_self(void);
+void pthread_mutex_init(pthread_mutex_t* mutex);
+void pthread_mutex_lock(pthread_mutex_t* mutex);
+bool pthread_mutex_trylock(pthread_mutex_t* mutex);
+void pthread_mutex_unlock(pthread_mutex_t* mutex);
+void pthread_cond_init(pthread_cond_t* cond);
+void pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+void pthread_cond_signal(pthread_cond_t* cond);
+void pthread_cond_broadcast(pthread_cond_t* cond);
+#endif /* LIB_USER_PTHREAD */
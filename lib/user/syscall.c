@@ -144,4 +144,49 @@ void fd_redirect(uint32_t old_local_fd, uint32_t new_local_fd) {
   _syscall2(SYS_FD_REDIRECT, old_local_fd, new_local_fd);
 }
 
-void help(void) { _syscall0(SYS_HELP); }
\ No newline at end of file
+void help(void) { _syscall0(SYS_HELP); }
+/* 睡眠 m_seconds 毫秒,返回被唤醒后等待上 cpu 的微秒数 */
+uint32_t sleep(uint32_t m_seconds) { return _syscall1(SYS_SLEEP, m_seconds); }
+
+/* 修改 pid 的调度策略,pid 为 0 表示自己 */
+int32_t sched_setscheduler(int32_t pid, uint32_t policy, uint32_t rt_priority) {
+  return _syscall3(SYS_SCHED_SETSCHEDULER, pid, policy, rt_priority);
+}
+
+/*创建共用地址空间的线程,在 stack 上从 entry(arg) 开始执行*/
+pid_t clone(void (*entry)(void*), void* arg, void* stack) {
+  return _syscall3(SYS_CLONE, entry, arg, stack);
+}
+
+/*等待本进程的线程 tid 退出*/
+int32_t thread_join(pid_t tid, int32_t* status) {
+  return _syscall2(SYS_THREAD_JOIN, tid, status);
+}
+
+/*futex 操作,op 为 FUTEX_WAIT 或 FUTEX_WAKE*/
+int32_t futex(uint32_t* uaddr, uint32_t op, uint32_t val) {
+  return _syscall3(SYS_FUTEX, uaddr, op, val);
+}
+
+/*创建子进程运行 path 处的程序,不复制当前进程的地址空间*/
+pid_t spawn(const char* path, char* argv[]) {
+  return _syscall2(SYS_SPAWN, path, argv);
+}
+
+/*取本进程(RUSAGE_SELF)或已回收子进程(RUSAGE_CHILDREN)的运行统计*/
+int32_t getrusage(uint32_t who, struct rusage* ru) {
+  return _syscall2(SYS_GETRUSAGE, who, ru);
+}
+
+/*把最多 cnt 个任务的运行统计填入 buf,返回填写的项数*/
+uint32_t task_stats(struct task_stat* buf, uint32_t cnt) {
+  return _syscall2(SYS_TASK_STATS, buf, cnt);
+}
+
+/*取最近最多 cnt 秒的平均可运行任务数(乘以 100),返回秒数*/
+uint32_t rq_history(uint32_t* buf, uint32_t cnt) {
+  return _syscall2(SYS_RQ_HISTORY, buf, cnt);
+}
+
+/*开机以来的毫秒数*/
+uint32_t uptime(void) { return _syscall0(SYS_UPTIME); }
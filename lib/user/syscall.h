@@ -4,7 +4,10 @@
 #include <stdint.h>
 
 #include "fs.h"
+#include "futex.h"
 #include "print.h"
+#include "sched.h"
+#include "thread.h"
 
 enum SYSCALL_NR {
   SYS_GETPID,
@@ -36,7 +39,17 @@ enum SYSCALL_NR {
   SYS_WAIT,
   SYS_PIPE,
   SYS_FD_REDIRECT,
-  SYS_HELP
+  SYS_HELP,
+  SYS_SLEEP,
+  SYS_SCHED_SETSCHEDULER,
+  SYS_CLONE,
+  SYS_THREAD_JOIN,
+  SYS_FUTEX,
+  SYS_SPAWN,
+  SYS_GETRUSAGE,
+  SYS_TASK_STATS,
+  SYS_RQ_HISTORY,
+  SYS_UPTIME
 };
 uint32_t getpid(void);
 uint32_t write(int32_t fd, const void* buf, uint32_t count);
@@ -68,4 +81,14 @@ pid_t wait(int32_t* status);
 int32_t pipe(int32_t pipefd[2]);
 void fd_redirect(uint32_t old_local_fd, uint32_t new_local_fd);
 void help(void);
+uint32_t sleep(uint32_t m_seconds);
+int32_t sched_setscheduler(int32_t pid, uint32_t policy, uint32_t rt_priority);
+pid_t clone(void (*entry)(void*), void* arg, void* stack);
+int32_t thread_join(pid_t tid, int32_t* status);
+int32_t futex(uint32_t* uaddr, uint32_t op, uint32_t val);
+pid_t spawn(const char* path, char* argv[]);
+int32_t getrusage(uint32_t who, struct rusage* ru);
+uint32_t task_stats(struct task_stat* buf, uint32_t cnt);
+uint32_t rq_history(uint32_t* buf, uint32_t cnt);
+uint32_t uptime(void);
 #endif /* LIB_USER_SYSCALL */
@@ -0,0 +1,15 @@
+#include "tsc.h"
+
+/*时间戳计数器的低 32 位,用于测量几秒以内的区间*/
+uint32_t rdtsc_low(void) {
+  uint32_t low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+/*时间戳计数器右移 10 位,按千周期计,测较长的区间也不必用 64 位除法*/
+uint32_t rdtsc_k(void) {
+  uint32_t low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return (high << 22) | (low >> 10);
+}
@@ -0,0 +1,7 @@
+#ifndef LIB_USER_TSC
+#define LIB_USER_TSC
+#include "stdint.h"
+
+uint32_t rdtsc_low(void);
+uint32_t rdtsc_k(void);
+#endif /* LIB_USER_TSC */
@@ -13,14 +13,18 @@ bool is_pipe(uint32_t local_fd) {
 
 /* 创建管道,成功返回 0,失败返回−1 */
 int32_t sys_pipe(int32_t pipefd[2]) {
-  int32_t global_fd = get_free_slot_in_global();
-
   /* 申请一页内核内存做环形缓冲区 */
-  file_table[global_fd].fd_inode = get_kernel_pages(1);
-
+  struct ioqueue* ioq = get_kernel_pages(1);
+  if (ioq == NULL) {
+    return -1;
+  }
   /*初始化环形缓冲区*/
-  ioqueue_init((struct ioqueue*)file_table[global_fd].fd_inode);
-  if (file_table[global_fd].fd_inode == NULL) {
+  ioqueue_init(ioq);
+
+  /* 文件表项的 fd_inode 复用为指向环形缓冲区 */
+  int32_t global_fd = get_free_slot_in_global((struct inode*)ioq);
+  if (global_fd == -1) {
+    mfree_page(PF_KERNEL, ioq, 1);
     return -1;
   }
 
@@ -71,7 +75,7 @@ uint32_t pipe_write(int32_t fd, const void* buf, uint32_t count) {
 
 /* 将文件描述符 old_local_fd 重定向为 new_local_fd */
 void sys_fd_redirect(uint32_t old_local_fd, uint32_t new_local_fd) {
-  struct task_struct* cur = running_thread();
+  struct task_struct* cur = running_thread()->group_leader;
   /*针对恢复标准描述符*/
   if (new_local_fd < 3) {
     cur->fd_table[old_local_fd] = new_local_fd;
@@ -137,25 +137,26 @@ static void cmd_exectue(uint32_t argc, char** argv) {
   } else if (!strcmp("help", argv[0])) {
     buildin_help(argc, argv);
   } else {  // 如果是外部命令,需要从磁盘上加载
-    int32_t pid = fork();
-    if (pid) {  // 父进程
-      int32_t status;
-      int32_t child_pid = wait(&status);
-      if (child_pid == -1) {
-        panic("my_shell: no child\n");
-      }
-      printf("\n");
-      printf("child_pid %d, it's status: %d\n", child_pid, status);
+    make_clear_abs_path(argv[0], final_path);
+    /* 先判断下文件是否存在 */
+    struct stat file_stat;
+    argv[0] = final_path;
+    if (stat(argv[0], &file_stat) == -1) {
+      printf("my_shell: cannot access %s,No such file or directory\n",
+             argv[0]);
     } else {
-      make_clear_abs_path(argv[0], final_path);
-      /* 先判断下文件是否存在 */
-      struct stat file_stat;
-      argv[0] = final_path;
-      if (stat(argv[0], &file_stat) == -1) {
-        printf("my_shell: cannot access %s,No such file or directory\n",
-               argv[0]);
+      /* 用 spawn 代替 fork+execv,不必复制 shell 的地址空间 */
+      int32_t pid = spawn(argv[0], argv);
+      if (pid == -1) {
+        printf("my_shell: cannot execute %s\n", argv[0]);
       } else {
-        execv(argv[0], argv);
+        int32_t status;
+        int32_t child_pid = wait(&status);
+        if (child_pid == -1) {
+          panic("my_shell: no child\n");
+        }
+        printf("\n");
+        printf("child_pid %d, it's status: %d\n", child_pid, status);
       }
     }
     int32_t arg_idx = 0;
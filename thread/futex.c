@@ -0,0 +1,113 @@
+#include "futex.h"
+
+#include "debug.h"
+#include "global.h"
+#include "list.h"
+#include "memory.h"
+#include "print.h"
+#include "sync.h"
+#include "thread.h"
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+/* 哈希桶,按物理地址散列,这样共用同一物理页的任务会找到同一个队列 */
+struct futex_bucket {
+  struct spinlock lock;
+  struct list waiters;
+};
+
+/* 等待者放在自己的内核栈上 */
+struct futex_waiter {
+  struct list_elem tag;
+  uint32_t key;  // uaddr 对应的物理地址
+  struct task_struct* task;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASH_SIZE];
+
+void futex_init(void) {
+  put_str("futex_init start\n");
+  uint32_t idx;
+  for (idx = 0; idx < FUTEX_HASH_SIZE; idx++) {
+    spin_lock_init(&futex_table[idx].lock);
+    list_init(&futex_table[idx].waiters);
+  }
+  put_str("futex_init done\n");
+}
+
+static struct futex_bucket* futex_hash(uint32_t key) {
+  return &futex_table[((key >> 2) * 0x9e3779b1) >> (32 - FUTEX_HASH_BITS)];
+}
+
+/* 求用户地址 uaddr 的物理地址作为 key,
+ * uaddr 不对齐、不在用户空间或还没映射时返回 0 */
+static uint32_t futex_key(uint32_t* uaddr) {
+  uint32_t vaddr = (uint32_t)uaddr;
+  if (running_thread()->pgdir == NULL || vaddr % 4 != 0 ||
+      vaddr >= 0xc0000000) {
+    return 0;
+  }
+  if (!(*pde_ptr(vaddr) & PG_P_1) || !(*pte_ptr(vaddr) & PG_P_1)) {
+    return 0;
+  }
+  return addr_v2p(vaddr);
+}
+
+/* *uaddr 等于 val 时睡眠直到被 FUTEX_WAKE 唤醒.
+ * 比较和入队都在桶锁内,与 FUTEX_WAKE 互斥,不会丢失唤醒 */
+static int32_t futex_wait(uint32_t* uaddr, uint32_t key, uint32_t val) {
+  struct futex_bucket* bucket = futex_hash(key);
+  struct futex_waiter waiter;
+  waiter.key = key;
+  waiter.task = running_thread();
+
+  enum intr_status old_status = spin_lock_irqsave(&bucket->lock);
+  if (*uaddr != val) {
+    spin_unlock_irqrestore(&bucket->lock, old_status);
+    return -1;
+  }
+  list_append(&bucket->waiters, &waiter.tag);
+  thread_block_unlock(TASK_BLOCKED, &bucket->lock);
+  intr_set_status(old_status);
+  return 0;
+}
+
+/* 唤醒最多 cnt 个等在 key 上的任务,返回唤醒的个数 */
+static int32_t futex_wake(uint32_t key, uint32_t cnt) {
+  struct futex_bucket* bucket = futex_hash(key);
+  int32_t woken = 0;
+
+  enum intr_status old_status = spin_lock_irqsave(&bucket->lock);
+  struct list_elem* elem = bucket->waiters.head.next;
+  while (elem != &bucket->waiters.tail && (uint32_t)woken < cnt) {
+    struct list_elem* next = elem->next;
+    struct futex_waiter* waiter = elem2entry(struct futex_waiter, tag, elem);
+    if (waiter->key == key) {
+      list_remove(elem);
+      thread_unblock(waiter->task);
+      woken++;
+    }
+    elem = next;
+  }
+  spin_unlock_irqrestore(&bucket->lock, old_status);
+  return woken;
+}
+
+/* 用户态锁的慢速路径,op 为 FUTEX_WAIT 或 FUTEX_WAKE.
+ * WAIT 成功睡眠并被唤醒返回 0,*uaddr 已不等于 val 返回 -1;
+ * WAKE 返回唤醒的任务数;参数错误返回 -1 */
+int32_t sys_futex(uint32_t* uaddr, uint32_t op, uint32_t val) {
+  uint32_t key = futex_key(uaddr);
+  if (key == 0) {
+    return -1;
+  }
+  switch (op) {
+    case FUTEX_WAIT:
+      return futex_wait(uaddr, key, val);
+    case FUTEX_WAKE:
+      return futex_wake(key, val);
+    default:
+      return -1;
+  }
+}
@@ -0,0 +1,11 @@
+#ifndef THREAD_FUTEX
+#define THREAD_FUTEX
+#include "stdint.h"
+
+/* futex 的操作 */
+#define FUTEX_WAIT 0  // *uaddr 仍等于 val 时睡眠
+#define FUTEX_WAKE 1  // 唤醒最多 val 个等在 uaddr 上的任务
+
+void futex_init(void);
+int32_t sys_futex(uint32_t* uaddr, uint32_t op, uint32_t val);
+#endif /* THREAD_FUTEX */
@@ -0,0 +1,136 @@
+#include "rcu.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "print.h"
+#include "smp.h"
+#include "sync.h"
+#include "thread.h"
+#include "workqueue.h"
+
+/* 回调先挂在 rcu_next,开始一个宽限期时整体移到 rcu_wait,
+ * 宽限期结束后移到 rcu_done,由工作线程执行,回调中可以睡眠 */
+static struct spinlock rcu_lock;  // 保护以下各项
+static struct list rcu_next;
+static struct list rcu_wait;
+static struct list rcu_done;
+static bool gp_active;             // 是否有进行中的宽限期
+static uint32_t gp_cpus;           // 宽限期开始时已启动的处理器
+static uint32_t gp_snap[NR_CPUS];  // 宽限期开始时各处理器的 rcu_qs_count
+static struct work rcu_work;
+
+/*把 from 中的回调按顺序全部移到 to 的末尾*/
+static void rcu_move_all(struct list* from, struct list* to) {
+  while (!list_empty(from)) {
+    list_append(to, list_pop(from));
+  }
+}
+
+/*开始一个宽限期,记下各处理器此刻的静止状态计数*/
+static void gp_start(void) {
+  rcu_move_all(&rcu_next, &rcu_wait);
+  gp_cpus = 0;
+  uint8_t idx;
+  for (idx = 0; idx < cpu_cnt; idx++) {
+    if (cpus[idx].started) {
+      gp_cpus |= (1 << idx);
+      gp_snap[idx] = cpus[idx].rcu_qs_count;
+    }
+  }
+  gp_active = true;
+}
+
+/*宽限期开始时在运行的处理器是否都已经过静止状态*/
+static bool gp_passed(void) {
+  uint8_t idx;
+  for (idx = 0; idx < cpu_cnt; idx++) {
+    if ((gp_cpus & (1 << idx)) && cpus[idx].rcu_qs_count == gp_snap[idx]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*工作线程中执行宽限期已结束的回调*/
+static void rcu_do_callbacks(struct work* w UNUSED) {
+  while (1) {
+    enum intr_status old_status = spin_lock_irqsave(&rcu_lock);
+    struct list_elem* elem = list_empty(&rcu_done) ? NULL : list_pop(&rcu_done);
+    spin_unlock_irqrestore(&rcu_lock, old_status);
+    if (elem == NULL) {
+      return;
+    }
+    struct rcu_head* head = elem2entry(struct rcu_head, tag, elem);
+    head->func(head);
+  }
+}
+
+/*读侧临界区开始,期间不能睡眠*/
+void rcu_read_lock(void) { preempt_disable(); }
+
+/*读侧临界区结束*/
+void rcu_read_unlock(void) { preempt_enable(); }
+
+/* 每个处理器的时钟中断中调用:当前任务没在读侧临界区时记一次静止状态,
+ * 顺便推进宽限期 */
+void rcu_tick(void) {
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct cpu* cpu = this_cpu();
+  if (running_thread()->preempt_count == 0) {
+    cpu->rcu_qs_count++;
+  }
+  if (!gp_active && list_empty(&rcu_next)) {
+    return;  // 没有等待的回调,不用拿锁
+  }
+  spin_lock(&rcu_lock);
+  if (gp_active && gp_passed()) {
+    rcu_move_all(&rcu_wait, &rcu_done);
+    gp_active = false;
+    schedule_work(&rcu_work);
+  }
+  if (!gp_active && !list_empty(&rcu_next)) {
+    gp_start();
+  }
+  spin_unlock(&rcu_lock);
+}
+
+/* 等当前所有读者都退出后调用 func(head),立即返回。
+ * 可以在中断处理程序中调用 */
+void call_rcu(struct rcu_head* head, rcu_callback* func) {
+  list_elem_init(&head->tag);
+  head->func = func;
+  enum intr_status old_status = spin_lock_irqsave(&rcu_lock);
+  list_append(&rcu_next, &head->tag);
+  spin_unlock_irqrestore(&rcu_lock, old_status);
+}
+
+/* synchronize_rcu 用来等待宽限期结束 */
+struct rcu_synchronize {
+  struct rcu_head head;
+  struct semaphore done;
+};
+
+static void wakeme_after_rcu(struct rcu_head* rh) {
+  struct rcu_synchronize* rs = elem2entry(struct rcu_synchronize, head, rh);
+  sema_up(&rs->done);
+}
+
+/*阻塞到当前所有读者都退出,不能在读侧临界区中调用*/
+void synchronize_rcu(void) {
+  ASSERT(running_thread()->preempt_count == 0);
+  struct rcu_synchronize rs;
+  sema_init(&rs.done, 0);
+  call_rcu(&rs.head, wakeme_after_rcu);
+  sema_down(&rs.done);
+}
+
+void rcu_init(void) {
+  put_str("rcu_init start\n");
+  spin_lock_init(&rcu_lock);
+  list_init(&rcu_next);
+  list_init(&rcu_wait);
+  list_init(&rcu_done);
+  gp_active = false;
+  work_init(&rcu_work, rcu_do_callbacks);
+  put_str("rcu_init done\n");
+}
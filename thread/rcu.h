@@ -0,0 +1,36 @@
+#ifndef THREAD_RCU
+#define THREAD_RCU
+#include "global.h"
+#include "list.h"
+#include "stdint.h"
+
+/* 读多写少的数据用 RCU 保护:读者只关抢占,不加锁;
+ * 写者发布新版本后,旧版本要等所有处理器都经过一次静止状态
+ * (任务切换,或时钟中断时当前任务没在读侧临界区)才能释放 */
+
+struct rcu_head;
+typedef void rcu_callback(struct rcu_head* head);
+
+/* 嵌在被保护的对象中,宽限期结束后调用 func,一般用来释放对象 */
+struct rcu_head {
+  struct list_elem tag;
+  rcu_callback* func;
+};
+
+/* 写者发布指针前,对象的初始化要先完成 */
+#define rcu_assign_pointer(p, v)          \
+  do {                                    \
+    asm volatile("" : : : "memory");      \
+    (p) = (v);                            \
+  } while (0)
+
+/* 读者取指针,每次都重新从内存读 */
+#define rcu_dereference(p) (*(volatile typeof(p)*)&(p))
+
+void rcu_init(void);
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void rcu_tick(void);
+void call_rcu(struct rcu_head* head, rcu_callback* func);
+void synchronize_rcu(void);
+#endif /* THREAD_RCU */
@@ -0,0 +1,450 @@
+#include "sched.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "smp.h"
+#include "string.h"
+#include "thread.h"
+#include "timer.h"
+
+/* 按优先顺序排列的调度类,排在前面的类有任务就绪时先运行 */
+static const struct sched_class* sched_classes[] = {
+    &rt_sched_class, &fair_sched_class, &rr_sched_class};
+#define NR_SCHED_CLASSES (sizeof(sched_classes) / sizeof(sched_classes[0]))
+
+/* 新任务使用的调度类,make SCHED=rr 时为原来的时间片轮转 */
+#ifdef SCHED_RR
+const struct sched_class* default_sched_class = &rr_sched_class;
+#else
+const struct sched_class* default_sched_class = &fair_sched_class;
+#endif
+
+/*初始化 cpu 上各调度类的就绪队列*/
+void sched_cpu_init(struct cpu* cpu) {
+  uint32_t prio;
+  for (prio = 0; prio < RT_PRIO_CNT; prio++) {
+    list_init(&cpu->rt_queue[prio]);
+  }
+  cpu->rt_bitmap = 0;
+  list_init(&cpu->ready_list);
+  rb_root_init(&cpu->cfs_tree);
+  cpu->min_vruntime = 0;
+  cpu->cfs_load = 0;
+  cpu->nr_cfs = 0;
+  cpu->nr_ready = 0;
+}
+
+/*把 t 自上次记账以来运行的时间累加到 sum_exec_us,返回这段时间(微秒)*/
+uint32_t sched_account(struct task_struct* t) {
+  uint32_t delta = tsc_elapsed_us(&t->exec_start);
+  t->sum_exec_us += delta;
+  return delta;
+}
+
+/*将 t 放入 cpu 的就绪队列,调用者需持有 cpu->rq_lock*/
+void sched_enqueue(struct cpu* cpu, struct task_struct* t, uint32_t flags) {
+  if (t->on_rq) {
+    PANIC("sched_enqueue: thread has been in run queue\n");
+  }
+  t->cpu = cpu;
+  t->status = TASK_READY;
+  if (flags & ENQUEUE_WAKEUP) {
+    t->wakeup_tsc = rdtsc();
+  }
+  if (t->queued_tsc == 0) {  // 换调度类时会出队再入队,不重新计时
+    t->queued_tsc = rdtsc();
+  }
+  t->sched_class->enqueue(cpu, t, flags);
+  t->on_rq = true;
+  cpu->nr_ready++;
+}
+
+/*把就绪的 t 从 cpu 的就绪队列中摘下,调用者需持有 cpu->rq_lock*/
+void sched_dequeue(struct cpu* cpu, struct task_struct* t) {
+  ASSERT(t->on_rq && t->cpu == cpu);
+  t->sched_class->dequeue(cpu, t);
+  t->on_rq = false;
+  cpu->nr_ready--;
+}
+
+/*按调度类的优先顺序取出下一个任务,都没有时返回 NULL*/
+struct task_struct* sched_pick_next(struct cpu* cpu) {
+  uint32_t idx;
+  for (idx = 0; idx < NR_SCHED_CLASSES; idx++) {
+    struct task_struct* t = sched_classes[idx]->pick_next(cpu);
+    if (t != NULL) {
+      t->on_rq = false;
+      cpu->nr_ready--;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+/* 本核没有就绪任务时,从就绪任务最多的核上偷一个已经换下的任务,
+ * 调用者持有本核的 rq_lock,所以对方的锁只 trylock,避免两核互相等待 */
+struct task_struct* sched_steal(struct cpu* self) {
+  struct cpu* busiest = NULL;
+  uint8_t idx;
+  for (idx = 0; idx < cpu_cnt; idx++) {
+    struct cpu* cpu = &cpus[idx];
+    if (cpu == self || !cpu->started || cpu->nr_ready == 0) {
+      continue;
+    }
+    if (busiest == NULL || cpu->nr_ready > busiest->nr_ready) {
+      busiest = cpu;
+    }
+  }
+  if (busiest == NULL || !spin_trylock(&busiest->rq_lock)) {
+    return NULL;
+  }
+
+  struct task_struct* victim = NULL;
+  uint32_t class_idx;
+  for (class_idx = 0; class_idx < NR_SCHED_CLASSES; class_idx++) {
+    victim = sched_classes[class_idx]->pick_steal(busiest);
+    if (victim != NULL) {
+      sched_dequeue(busiest, victim);
+      victim->sched_class->migrate(busiest, self, victim);
+      break;
+    }
+  }
+  spin_unlock(&busiest->rq_lock);
+  return victim;
+}
+
+/*t 将在 cpu 上运行,idle 不属于任何调度类*/
+void sched_set_next(struct cpu* cpu, struct task_struct* t) {
+  if (t == cpu->idle_thread) {
+    return;
+  }
+  if (t->wakeup_tsc != 0) {
+    t->wakeup_latency_us = tsc_elapsed_us(&t->wakeup_tsc);
+    t->wakeup_tsc = 0;
+  }
+  if (t->queued_tsc != 0) {
+    t->run_delay_us += tsc_elapsed_us(&t->queued_tsc);
+    t->queued_tsc = 0;
+  }
+  t->sched_class->set_next(cpu, t);
+}
+
+/*t 刚从 cpu 上换下,在它重新入队之前调用*/
+void sched_put_prev(struct cpu* cpu, struct task_struct* t) {
+  if (t != cpu->idle_thread) {
+    t->sched_class->put_prev(cpu, t);
+  }
+}
+
+/*时钟中断中调用,由当前任务的调度类决定是否该换下它*/
+void sched_tick(void) {
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct task_struct* cur = running_thread();
+  struct cpu* cpu = cur->cpu;
+  if (cur == cpu->idle_thread) {
+    return;  // idle 在每次中断后都会重新调度
+  }
+  spin_lock(&cpu->rq_lock);
+  cur->sched_class->task_tick(cpu, cur);
+  spin_unlock(&cpu->rq_lock);
+}
+
+/*调度类在 sched_classes 中的位置,越小越优先*/
+static uint32_t class_rank(const struct sched_class* class) {
+  uint32_t idx;
+  for (idx = 0; idx < NR_SCHED_CLASSES; idx++) {
+    if (sched_classes[idx] == class) {
+      break;
+    }
+  }
+  return idx;
+}
+
+/* 要求 cpu 上正在运行的任务尽快让出,它在中断或系统调用返回时调度。
+ * 目标是别的核时发 IPI,让它马上进入一次中断返回 */
+static void resched_curr(struct cpu* cpu) {
+  struct task_struct* curr = cpu->cur_thread;
+  if (curr == NULL || curr->need_resched) {
+    return;
+  }
+  curr->need_resched = true;
+  if (cpu != this_cpu()) {
+    smp_send_reschedule(cpu);
+  }
+}
+
+/* t 刚在 cpu 上就绪时调用,调用者持有 cpu->rq_lock。
+ * 高优先级类的任务立即抢占低优先级类的,同类的由调度类决定 */
+void sched_check_preempt(struct cpu* cpu, struct task_struct* t) {
+  struct task_struct* curr = cpu->cur_thread;
+  if (curr == NULL || curr == t) {
+    return;
+  }
+  bool preempt;
+  if (curr == cpu->idle_thread) {
+    preempt = true;
+  } else if (curr->sched_class != t->sched_class) {
+    preempt = class_rank(t->sched_class) < class_rank(curr->sched_class);
+  } else {
+    preempt = t->sched_class->check_preempt(cpu, curr, t);
+  }
+  if (preempt) {
+    resched_curr(cpu);
+  }
+}
+
+/*把 t 换到调度类 class、实时优先级 rt_priority,t 可以在任意状态*/
+static void sched_change(struct task_struct* t, const struct sched_class* class,
+                         uint8_t rt_priority) {
+  /* t 可能正被别的核偷走,锁住后再确认它还在这个核上 */
+  enum intr_status old_status = intr_disable();
+  struct cpu* cpu;
+  while (1) {
+    cpu = t->cpu;
+    spin_lock(&cpu->rq_lock);
+    if (cpu == t->cpu) {
+      break;
+    }
+    spin_unlock(&cpu->rq_lock);
+  }
+
+  bool queued = t->on_rq;
+  bool running = cpu->cur_thread == t;
+  if (queued) {
+    sched_dequeue(cpu, t);
+  }
+  if (running) {
+    sched_put_prev(cpu, t);  // 按原来的类把运行时间记完
+  }
+  if (class == &fair_sched_class && t->sched_class != class) {
+    t->vruntime = cpu->min_vruntime;  // 离开 CFS 期间的 vruntime 已没有意义
+  }
+  t->sched_class = class;
+  t->rt_priority = rt_priority;
+  if (running) {
+    sched_set_next(cpu, t);
+    resched_curr(cpu);  // 降级后可能有更该运行的任务
+  }
+  if (queued) {
+    sched_enqueue(cpu, t, 0);
+    sched_check_preempt(cpu, t);
+  }
+  spin_unlock(&cpu->rq_lock);
+  intr_set_status(old_status);
+}
+
+/* 优先级继承用:把 t 的有效实时优先级设为 rt_priority,
+ * 高于本来的优先级时临时作为实时任务运行,否则恢复本来的调度类 */
+void sched_setprio(struct task_struct* t, uint8_t rt_priority) {
+  if (rt_priority > t->normal_rt_priority) {
+    sched_change(t, &rt_sched_class, rt_priority);
+  } else {
+    sched_change(t, t->normal_class, t->normal_rt_priority);
+  }
+}
+
+/* 修改 pid 的调度策略,pid 为 0 表示自己,成功返回 0,失败返回 -1。
+ * policy 为 SCHED_FIFO 时 rt_priority 取 1~RT_PRIO_CNT-1 */
+int32_t sys_sched_setscheduler(int32_t pid, uint32_t policy,
+                               uint32_t rt_priority) {
+  const struct sched_class* class;
+  if (policy == SCHED_FIFO) {
+    if (rt_priority == 0 || rt_priority >= RT_PRIO_CNT) {
+      return -1;
+    }
+    class = &rt_sched_class;
+  } else if (policy == SCHED_NORMAL) {
+    rt_priority = 0;
+    class = default_sched_class;
+  } else {
+    return -1;
+  }
+  /* t 可能正在退出,在读侧临界区内用完它,pcb 就不会被释放 */
+  rcu_read_lock();
+  struct task_struct* t = pid == 0 ? running_thread() : pid2thread(pid);
+  if (t == NULL || t->status == TASK_DIED) {
+    rcu_read_unlock();
+    return -1;
+  }
+
+  /* 有效优先级还要算上等 t 所持锁的任务,交给 lock_pi_update 决定 */
+  t->normal_class = class;
+  t->normal_rt_priority = rt_priority;
+  lock_pi_update(t);
+  rcu_read_unlock();
+  return 0;
+}
+
+/*fork 出的子进程沿用父进程的调度类,运行统计从零开始*/
+void sched_fork(struct task_struct* child) {
+  child->on_rq = false;
+  child->exec_start = 0;
+  child->sum_exec_us = 0;
+  child->slice_start_us = 0;
+  child->wakeup_tsc = 0;
+  child->wakeup_latency_us = 0;
+  child->queued_tsc = 0;
+  child->run_delay_us = 0;
+  child->iowait_us = 0;
+  child->nvcsw = 0;
+  child->nivcsw = 0;
+  memset(&child->group_usage, 0, sizeof(struct task_usage));
+  memset(&child->child_usage, 0, sizeof(struct task_usage));
+}
+
+/*把 t 自身的运行统计累加到 usage*/
+void sched_usage_add(struct task_usage* usage, struct task_struct* t) {
+  usage->exec_us += t->sum_exec_us;
+  usage->run_delay_us += t->run_delay_us;
+  usage->iowait_us += t->iowait_us;
+  usage->nvcsw += t->nvcsw;
+  usage->nivcsw += t->nivcsw;
+}
+
+/*把 src 累加到 dst*/
+void sched_usage_merge(struct task_usage* dst, const struct task_usage* src) {
+  dst->exec_us += src->exec_us;
+  dst->run_delay_us += src->run_delay_us;
+  dst->iowait_us += src->iowait_us;
+  dst->nvcsw += src->nvcsw;
+  dst->nivcsw += src->nivcsw;
+}
+
+/* 最近 RQ_HISTORY_LEN 秒里每秒的平均可运行任务数(乘以 100),
+ * 只在 BSP 的时钟中断中更新 */
+static uint32_t rq_history[RQ_HISTORY_LEN];
+static uint32_t rq_history_next;  // 下一个要写的位置
+static uint32_t rq_history_cnt;   // 已写入的秒数,最多 RQ_HISTORY_LEN
+static uint32_t rq_sample_sum;    // 本秒内各 tick 可运行任务数之和
+static uint32_t rq_sample_ticks;
+
+/* 每个时钟中断采样一次所有核上的可运行任务数(就绪的加上正在运行的),
+ * 满一秒求平均存入 rq_history。各核的计数不加锁读,统计用足够了 */
+void sched_sample_load(void) {
+  uint32_t runnable = 0;
+  uint8_t idx;
+  for (idx = 0; idx < cpu_cnt; idx++) {
+    struct cpu* cpu = &cpus[idx];
+    if (!cpu->started) {
+      continue;
+    }
+    runnable += cpu->nr_ready;
+    if (cpu->cur_thread != NULL && cpu->cur_thread != cpu->idle_thread) {
+      runnable++;
+    }
+  }
+  rq_sample_sum += runnable;
+  if (++rq_sample_ticks < IRQ0_FREQUENCY) {
+    return;
+  }
+  rq_history[rq_history_next] = rq_sample_sum * 100 / IRQ0_FREQUENCY;
+  rq_history_next = (rq_history_next + 1) % RQ_HISTORY_LEN;
+  if (rq_history_cnt < RQ_HISTORY_LEN) {
+    rq_history_cnt++;
+  }
+  rq_sample_sum = 0;
+  rq_sample_ticks = 0;
+}
+
+/*把微秒计的统计转换成 getrusage 的格式*/
+static void usage_to_rusage(const struct task_usage* usage,
+                            struct rusage* ru) {
+  ru->cpu_ms = us_to_ms(usage->exec_us);
+  ru->run_delay_ms = us_to_ms(usage->run_delay_us);
+  ru->iowait_ms = us_to_ms(usage->iowait_us);
+  ru->nvcsw = usage->nvcsw;
+  ru->nivcsw = usage->nivcsw;
+}
+
+/* sys_getrusage 遍历时的累加结果 */
+struct group_usage_arg {
+  struct task_struct* leader;
+  struct task_usage usage;
+};
+
+/* list_traversal 的回调函数,
+ * 把主线程为 leader 的各任务自身的统计累加到 usage */
+static bool add_group_usage(struct list_elem* pelem, int32_t arg) {
+  struct group_usage_arg* gu = (struct group_usage_arg*)arg;
+  struct task_struct* pthread =
+      elem2entry(struct task_struct, all_list_tag, pelem);
+  if (pthread->group_leader == gu->leader && pthread->status != TASK_DIED) {
+    sched_usage_add(&gu->usage, pthread);
+  }
+  return false;
+}
+
+/* 取本进程(RUSAGE_SELF)或已回收子进程(RUSAGE_CHILDREN)的运行统计,
+ * 成功返回 0,who 不合法时返回 -1。正在运行的任务最多少算一个 tick */
+int32_t sys_getrusage(uint32_t who, struct rusage* ru) {
+  struct task_struct* leader = running_thread()->group_leader;
+  if (who == RUSAGE_CHILDREN) {
+    usage_to_rusage(&leader->child_usage, ru);
+    return 0;
+  }
+  if (who != RUSAGE_SELF) {
+    return -1;
+  }
+  struct group_usage_arg gu;
+  gu.leader = leader;
+  gu.usage = leader->group_usage;  // 已回收的线程
+  rcu_read_lock();
+  list_traversal(&thread_all_list, add_group_usage, (int32_t)&gu);
+  rcu_read_unlock();
+  usage_to_rusage(&gu.usage, ru);
+  return 0;
+}
+
+/* sys_task_stats 遍历时的输出位置 */
+struct task_stats_arg {
+  struct task_stat* buf;
+  uint32_t cnt;     // buf 的容量
+  uint32_t filled;  // 已填写的项数
+};
+
+/*list_traversal 的回调函数,为每个任务填一项,填满后停止*/
+static bool fill_task_stat(struct list_elem* pelem, int32_t arg) {
+  struct task_stats_arg* ts = (struct task_stats_arg*)arg;
+  if (ts->filled == ts->cnt) {
+    return true;
+  }
+  struct task_struct* pthread =
+      elem2entry(struct task_struct, all_list_tag, pelem);
+  struct task_stat* st = &ts->buf[ts->filled++];
+  st->pid = pthread->pid;
+  st->ppid = pthread->parent_pid;
+  st->status = pthread->status;
+  st->rt_priority = pthread->rt_priority;
+  memcpy(st->name, pthread->name, sizeof(st->name));
+  st->name[sizeof(st->name) - 1] = 0;
+  st->cpu_ms = us_to_ms(pthread->sum_exec_us);
+  st->run_delay_ms = us_to_ms(pthread->run_delay_us);
+  st->iowait_ms = us_to_ms(pthread->iowait_us);
+  st->nvcsw = pthread->nvcsw;
+  st->nivcsw = pthread->nivcsw;
+  return false;
+}
+
+/*把最多 cnt 个任务的运行统计填入 buf,返回填写的项数*/
+uint32_t sys_task_stats(struct task_stat* buf, uint32_t cnt) {
+  struct task_stats_arg ts = {buf, cnt, 0};
+  rcu_read_lock();
+  list_traversal(&thread_all_list, fill_task_stat, (int32_t)&ts);
+  rcu_read_unlock();
+  return ts.filled;
+}
+
+/* 把最近最多 cnt 秒的平均可运行任务数(乘以 100)按时间先后填入 buf,
+ * 返回填写的秒数。与 BSP 的采样不加锁,最多读到刚写入的一项 */
+uint32_t sys_rq_history(uint32_t* buf, uint32_t cnt) {
+  if (cnt > rq_history_cnt) {
+    cnt = rq_history_cnt;
+  }
+  uint32_t idx = (rq_history_next + RQ_HISTORY_LEN - cnt) % RQ_HISTORY_LEN;
+  uint32_t filled;
+  for (filled = 0; filled < cnt; filled++) {
+    buf[filled] = rq_history[idx];
+    idx = (idx + 1) % RQ_HISTORY_LEN;
+  }
+  return cnt;
+}
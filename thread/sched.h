@@ -0,0 +1,94 @@
+#ifndef THREAD_SCHED
+#define THREAD_SCHED
+#include "global.h"
+#include "stdint.h"
+
+struct cpu;
+struct task_struct;
+struct task_usage;
+
+/* 入队的原因 */
+#define ENQUEUE_WAKEUP 0x1     // 阻塞后被唤醒
+#define ENQUEUE_NEW 0x2        // 新建的任务第一次入队
+#define ENQUEUE_PREEMPTED 0x4  // 运行中被抢占,而不是主动让出
+
+#define RT_PRIO_CNT 32  // 实时优先级 1~31,数值越大越优先
+
+/* sched_setscheduler 的调度策略 */
+enum sched_policy {
+  SCHED_NORMAL,  // 普通任务,使用默认调度类
+  SCHED_FIFO     // 实时任务,按实时优先级抢占,同级先进先出
+};
+
+/* getrusage 的统计对象 */
+#define RUSAGE_SELF 0      // 本进程的所有线程
+#define RUSAGE_CHILDREN 1  // 已 wait 回收的子进程及其后代
+
+/* getrusage 返回的统计,时间单位毫秒.
+ * 没有缺页统计:页都在加载时分配,缺页异常是致命错误 */
+struct rusage {
+  uint32_t cpu_ms;        // 运行时间
+  uint32_t run_delay_ms;  // 就绪后等待上 cpu 的时间
+  uint32_t iowait_ms;     // 等待磁盘的时间
+  uint32_t nvcsw;         // 主动让出 cpu 的次数
+  uint32_t nivcsw;        // 被抢占的次数
+};
+
+/* task_stats 为每个任务填写的一项 */
+struct task_stat {
+  int16_t pid;
+  int16_t ppid;
+  uint8_t status;       // enum task_status
+  uint8_t rt_priority;  // 实时优先级,非实时任务为 0
+  char name[16];
+  uint32_t cpu_ms;
+  uint32_t run_delay_ms;
+  uint32_t iowait_ms;
+  uint32_t nvcsw;
+  uint32_t nivcsw;
+};
+
+#define RQ_HISTORY_LEN 60  // 保留最近多少秒的就绪队列长度
+
+/* 调度类,各函数调用时都持有 cpu->rq_lock。
+ * 正在运行的任务不在就绪队列中,换下时才重新入队 */
+struct sched_class {
+  char* name;
+  void (*enqueue)(struct cpu* cpu, struct task_struct* t, uint32_t flags);
+  void (*dequeue)(struct cpu* cpu, struct task_struct* t);
+  struct task_struct* (*pick_next)(struct cpu* cpu);  // 取出下一个要运行的任务
+  struct task_struct* (*pick_steal)(struct cpu* cpu);  // 找一个可被别的核偷走的任务,不出队
+  void (*set_next)(struct cpu* cpu, struct task_struct* t);  // t 将要上 cpu
+  void (*put_prev)(struct cpu* cpu, struct task_struct* t);  // t 刚被换下
+  void (*task_tick)(struct cpu* cpu, struct task_struct* t);  // 时钟中断,需要时置 need_resched
+  void (*migrate)(struct cpu* from, struct cpu* to, struct task_struct* t);
+  bool (*check_preempt)(struct cpu* cpu, struct task_struct* curr,
+                        struct task_struct* t);  // 同类的 t 就绪时是否该抢占 curr
+};
+
+extern const struct sched_class rt_sched_class;
+extern const struct sched_class fair_sched_class;
+extern const struct sched_class rr_sched_class;
+extern const struct sched_class* default_sched_class;
+
+void sched_cpu_init(struct cpu* cpu);
+uint32_t sched_account(struct task_struct* t);
+void sched_enqueue(struct cpu* cpu, struct task_struct* t, uint32_t flags);
+void sched_dequeue(struct cpu* cpu, struct task_struct* t);
+struct task_struct* sched_pick_next(struct cpu* cpu);
+struct task_struct* sched_steal(struct cpu* self);
+void sched_set_next(struct cpu* cpu, struct task_struct* t);
+void sched_put_prev(struct cpu* cpu, struct task_struct* t);
+void sched_tick(void);
+void sched_fork(struct task_struct* child);
+void sched_check_preempt(struct cpu* cpu, struct task_struct* t);
+void sched_setprio(struct task_struct* t, uint8_t rt_priority);
+void sched_usage_add(struct task_usage* usage, struct task_struct* t);
+void sched_usage_merge(struct task_usage* dst, const struct task_usage* src);
+void sched_sample_load(void);
+int32_t sys_getrusage(uint32_t who, struct rusage* ru);
+uint32_t sys_task_stats(struct task_stat* buf, uint32_t cnt);
+uint32_t sys_rq_history(uint32_t* buf, uint32_t cnt);
+int32_t sys_sched_setscheduler(int32_t pid, uint32_t policy,
+                               uint32_t rt_priority);
+#endif /* THREAD_SCHED */
@@ -0,0 +1,197 @@
+#include "debug.h"
+#include "process.h"
+#include "sched.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+
+/* 完全公平调度:按权重折算的虚拟运行时间 vruntime 最小的任务先运行。
+ * 权重就是 priority,priority 为 default_prio 的任务 vruntime 与实际时间同速增长 */
+
+/* 目标延迟:所有就绪任务在这段时间内都至少运行一次,可用 make SCHED_LATENCY_MS=n 修改 */
+#ifndef SCHED_LATENCY_MS
+#define SCHED_LATENCY_MS 20
+#endif
+#define SCHED_LATENCY_US (SCHED_LATENCY_MS * 1000)
+#define SCHED_MIN_GRANULARITY_US 4000  // 每个任务一次至少运行的时间
+#define MAX_DELTA_US (1 << 26)  // 一次记账的上限,保证乘法不溢出 32 位
+#define SCHED_WAKEUP_GRANULARITY_US 1000  // 被唤醒的任务至少领先这么多才抢占
+
+static uint32_t task_weight(struct task_struct* t) {
+  return t->priority > 0 ? t->priority : 1;
+}
+
+/*a 是否在 b 之前,用差值比较,不怕回绕*/
+static bool vruntime_before(uint64_t a, uint64_t b) {
+  return (int64_t)(a - b) < 0;
+}
+
+static bool entity_less(struct rb_node* a, struct rb_node* b) {
+  struct task_struct* ta = elem2entry(struct task_struct, run_node, a);
+  struct task_struct* tb = elem2entry(struct task_struct, run_node, b);
+  return vruntime_before(ta->vruntime, tb->vruntime);
+}
+
+/*实际运行 delta 微秒折算成的虚拟时间*/
+static uint32_t calc_delta_fair(uint32_t delta, struct task_struct* t) {
+  if (delta > MAX_DELTA_US) {
+    delta = MAX_DELTA_US;
+  }
+  return delta * default_prio / task_weight(t);
+}
+
+/*调度周期:任务太多时按最小粒度拉长,避免频繁切换*/
+static uint32_t sched_period(uint32_t nr_running) {
+  if (nr_running > SCHED_LATENCY_US / SCHED_MIN_GRANULARITY_US) {
+    return nr_running * SCHED_MIN_GRANULARITY_US;
+  }
+  return SCHED_LATENCY_US;
+}
+
+/* t 在一个调度周期中应得的实际运行时间,按权重分配。
+ * t 正在运行时不在树中,is_queued 为 false,需把它自己算进去 */
+static uint32_t sched_slice(struct cpu* cpu, struct task_struct* t,
+                            bool is_queued) {
+  uint32_t nr = cpu->nr_cfs + (is_queued ? 0 : 1);
+  uint32_t load = cpu->cfs_load + (is_queued ? 0 : task_weight(t));
+  return sched_period(nr) / load * task_weight(t);
+}
+
+static struct task_struct* leftmost_task(struct cpu* cpu) {
+  struct rb_node* left = rb_first(&cpu->cfs_tree);
+  return left == NULL ? NULL : elem2entry(struct task_struct, run_node, left);
+}
+
+/*min_vruntime 只增不减,取正在运行的任务与树中最小者的较小值*/
+static void update_min_vruntime(struct cpu* cpu, struct task_struct* curr) {
+  uint64_t vruntime = cpu->min_vruntime;
+  struct task_struct* left = leftmost_task(cpu);
+  if (curr != NULL) {
+    vruntime = curr->vruntime;
+  }
+  if (left != NULL &&
+      (curr == NULL || vruntime_before(left->vruntime, vruntime))) {
+    vruntime = left->vruntime;
+  }
+  if (vruntime_before(cpu->min_vruntime, vruntime)) {
+    cpu->min_vruntime = vruntime;
+  }
+}
+
+/*给正在运行的 t 记账*/
+static void update_curr(struct cpu* cpu, struct task_struct* t) {
+  uint32_t delta = sched_account(t);
+  t->vruntime += calc_delta_fair(delta, t);
+  update_min_vruntime(cpu, t);
+}
+
+/* 确定 t 入队时的 vruntime:
+ * 新任务排在当前所有任务之后,避免 fork 出大量任务挤占别人;
+ * 睡眠后被唤醒的任务最多补偿半个目标延迟,睡得再久也不会长时间独占 cpu */
+static void place_entity(struct cpu* cpu, struct task_struct* t,
+                         uint32_t flags) {
+  uint64_t vruntime = cpu->min_vruntime;
+  if (flags & ENQUEUE_NEW) {
+    t->vruntime =
+        vruntime + calc_delta_fair(sched_slice(cpu, t, false), t);
+  } else if (flags & ENQUEUE_WAKEUP) {
+    vruntime -= SCHED_LATENCY_US / 2;
+    if (vruntime_before(t->vruntime, vruntime)) {
+      t->vruntime = vruntime;
+    }
+  }
+}
+
+static void fair_enqueue(struct cpu* cpu, struct task_struct* t,
+                         uint32_t flags) {
+  place_entity(cpu, t, flags);
+  rb_insert(&cpu->cfs_tree, &t->run_node, entity_less);
+  cpu->cfs_load += task_weight(t);
+  cpu->nr_cfs++;
+}
+
+static void fair_dequeue(struct cpu* cpu, struct task_struct* t) {
+  rb_erase(&cpu->cfs_tree, &t->run_node);
+  cpu->cfs_load -= task_weight(t);
+  cpu->nr_cfs--;
+}
+
+static struct task_struct* fair_pick_next(struct cpu* cpu) {
+  struct task_struct* t = leftmost_task(cpu);
+  if (t != NULL) {
+    fair_dequeue(cpu, t);
+  }
+  return t;
+}
+
+/*从 vruntime 最大的一端找,它们离上 cpu 最远*/
+static struct task_struct* fair_pick_steal(struct cpu* cpu) {
+  struct rb_node* node = rb_last(&cpu->cfs_tree);
+  while (node != NULL) {
+    struct task_struct* t = elem2entry(struct task_struct, run_node, node);
+    if (!t->on_cpu) {  // 被唤醒但还没换下的任务不能拿走
+      return t;
+    }
+    node = rb_prev(node);
+  }
+  return NULL;
+}
+
+static void fair_set_next(struct cpu* cpu UNUSED, struct task_struct* t) {
+  t->exec_start = rdtsc();
+  t->slice_start_us = t->sum_exec_us;
+}
+
+static void fair_put_prev(struct cpu* cpu, struct task_struct* t) {
+  update_curr(cpu, t);
+}
+
+/* 时钟中断:本轮运行时间超过应得的时间片,
+ * 或 vruntime 领先最左任务超过一个时间片时,换下当前任务 */
+static void fair_task_tick(struct cpu* cpu, struct task_struct* t) {
+  update_curr(cpu, t);
+  if (cpu->nr_cfs == 0) {
+    return;
+  }
+  uint32_t ideal = sched_slice(cpu, t, false);
+  if (ideal < SCHED_MIN_GRANULARITY_US) {
+    ideal = SCHED_MIN_GRANULARITY_US;
+  }
+  uint32_t ran = (uint32_t)(t->sum_exec_us - t->slice_start_us);
+  if (ran >= ideal) {
+    t->need_resched = true;
+    return;
+  }
+  struct task_struct* left = leftmost_task(cpu);
+  if (left != NULL && (int64_t)(t->vruntime - left->vruntime) > ideal) {
+    t->need_resched = true;
+  }
+}
+
+/*vruntime 是相对各核 min_vruntime 的,换核时要平移*/
+static void fair_migrate(struct cpu* from, struct cpu* to,
+                         struct task_struct* t) {
+  t->vruntime = t->vruntime - from->min_vruntime + to->min_vruntime;
+}
+
+/* 被唤醒的 t 的 vruntime 比正在运行的 curr 小出一个唤醒粒度时抢占,
+ * 粒度避免两个任务来回频繁切换 */
+static bool fair_check_preempt(struct cpu* cpu, struct task_struct* curr,
+                               struct task_struct* t) {
+  update_curr(cpu, curr);
+  int64_t lag = (int64_t)(curr->vruntime - t->vruntime);
+  return lag > (int64_t)calc_delta_fair(SCHED_WAKEUP_GRANULARITY_US, t);
+}
+
+const struct sched_class fair_sched_class = {
+    .name = "cfs",
+    .enqueue = fair_enqueue,
+    .dequeue = fair_dequeue,
+    .pick_next = fair_pick_next,
+    .pick_steal = fair_pick_steal,
+    .set_next = fair_set_next,
+    .put_prev = fair_put_prev,
+    .task_tick = fair_task_tick,
+    .migrate = fair_migrate,
+    .check_preempt = fair_check_preempt,
+};
@@ -0,0 +1,82 @@
+#include "debug.h"
+#include "sched.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+
+/* 时间片轮转:priority 即每轮的时间片(嘀嗒数),用完放到队尾 */
+
+static void rr_enqueue(struct cpu* cpu, struct task_struct* t, uint32_t flags) {
+  if (flags & ENQUEUE_WAKEUP) {
+    list_push(&cpu->ready_list, &t->general_tag);  // 被唤醒的任务尽快运行
+  } else {
+    if (!(flags & ENQUEUE_NEW)) {
+      t->ticks = t->priority;  // 时间片用完或主动让出,重新装满
+    }
+    list_append(&cpu->ready_list, &t->general_tag);
+  }
+}
+
+static void rr_dequeue(struct cpu* cpu UNUSED, struct task_struct* t) {
+  list_remove(&t->general_tag);
+}
+
+static struct task_struct* rr_pick_next(struct cpu* cpu) {
+  if (list_empty(&cpu->ready_list)) {
+    return NULL;
+  }
+  return elem2entry(struct task_struct, general_tag,
+                    list_pop(&cpu->ready_list));
+}
+
+/*从队尾找,队尾的任务离上 cpu 最远*/
+static struct task_struct* rr_pick_steal(struct cpu* cpu) {
+  struct list_elem* elem = cpu->ready_list.tail.prev;
+  while (elem != &cpu->ready_list.head) {
+    struct task_struct* t = elem2entry(struct task_struct, general_tag, elem);
+    if (!t->on_cpu) {  // 被唤醒但还没换下的任务不能拿走
+      return t;
+    }
+    elem = elem->prev;
+  }
+  return NULL;
+}
+
+static void rr_set_next(struct cpu* cpu UNUSED, struct task_struct* t) {
+  t->exec_start = rdtsc();
+}
+
+static void rr_put_prev(struct cpu* cpu UNUSED, struct task_struct* t) {
+  sched_account(t);
+}
+
+static void rr_task_tick(struct cpu* cpu UNUSED, struct task_struct* t) {
+  if (t->ticks == 0) {  // 若进程时间片用完,就开始调度新的进程上 cpu
+    t->need_resched = true;
+  } else {
+    t->ticks--;  // 将当前进程的时间片-1
+  }
+}
+
+static void rr_migrate(struct cpu* from UNUSED, struct cpu* to UNUSED,
+                       struct task_struct* t UNUSED) {}
+
+/*同类之间不抢占,被唤醒的任务排在队首,等当前任务的时间片用完*/
+static bool rr_check_preempt(struct cpu* cpu UNUSED,
+                             struct task_struct* curr UNUSED,
+                             struct task_struct* t UNUSED) {
+  return false;
+}
+
+const struct sched_class rr_sched_class = {
+    .name = "rr",
+    .enqueue = rr_enqueue,
+    .dequeue = rr_dequeue,
+    .pick_next = rr_pick_next,
+    .pick_steal = rr_pick_steal,
+    .set_next = rr_set_next,
+    .put_prev = rr_put_prev,
+    .task_tick = rr_task_tick,
+    .migrate = rr_migrate,
+    .check_preempt = rr_check_preempt,
+};
@@ -0,0 +1,100 @@
+#include "debug.h"
+#include "sched.h"
+#include "smp.h"
+#include "thread.h"
+#include "timer.h"
+
+/* 实时调度类:每个实时优先级一个队列,总是运行最高优先级的任务,
+ * 同级先进先出,运行中的实时任务只会被更高优先级的实时任务抢占 */
+
+/*最高的非空优先级,没有时返回 -1*/
+static int32_t rt_highest(struct cpu* cpu) {
+  if (cpu->rt_bitmap == 0) {
+    return -1;
+  }
+  uint32_t prio;
+  asm("bsrl %1, %0" : "=r"(prio) : "rm"(cpu->rt_bitmap));
+  return prio;
+}
+
+static void rt_enqueue(struct cpu* cpu, struct task_struct* t, uint32_t flags) {
+  struct list* queue = &cpu->rt_queue[t->rt_priority];
+  if (flags & ENQUEUE_PREEMPTED) {
+    list_push(queue, &t->general_tag);  // 被抢占的任务还排在同级的最前面
+  } else {
+    list_append(queue, &t->general_tag);
+  }
+  cpu->rt_bitmap |= (1u << t->rt_priority);
+}
+
+static void rt_dequeue(struct cpu* cpu, struct task_struct* t) {
+  list_remove(&t->general_tag);
+  if (list_empty(&cpu->rt_queue[t->rt_priority])) {
+    cpu->rt_bitmap &= ~(1u << t->rt_priority);
+  }
+}
+
+static struct task_struct* rt_pick_next(struct cpu* cpu) {
+  int32_t prio = rt_highest(cpu);
+  if (prio < 0) {
+    return NULL;
+  }
+  struct task_struct* t = elem2entry(struct task_struct, general_tag,
+                                     cpu->rt_queue[prio].head.next);
+  rt_dequeue(cpu, t);
+  return t;
+}
+
+/*从最低优先级找起,各队列从队尾找*/
+static struct task_struct* rt_pick_steal(struct cpu* cpu) {
+  uint32_t prio;
+  for (prio = 1; prio < RT_PRIO_CNT; prio++) {
+    if (!(cpu->rt_bitmap & (1u << prio))) {
+      continue;
+    }
+    struct list* queue = &cpu->rt_queue[prio];
+    struct list_elem* elem = queue->tail.prev;
+    while (elem != &queue->head) {
+      struct task_struct* t = elem2entry(struct task_struct, general_tag, elem);
+      if (!t->on_cpu) {  // 被唤醒但还没换下的任务不能拿走
+        return t;
+      }
+      elem = elem->prev;
+    }
+  }
+  return NULL;
+}
+
+static void rt_set_next(struct cpu* cpu UNUSED, struct task_struct* t) {
+  t->exec_start = rdtsc();
+}
+
+static void rt_put_prev(struct cpu* cpu UNUSED, struct task_struct* t) {
+  sched_account(t);
+}
+
+/*实时任务没有时间片,时钟中断只记账*/
+static void rt_task_tick(struct cpu* cpu UNUSED, struct task_struct* t) {
+  sched_account(t);
+}
+
+static void rt_migrate(struct cpu* from UNUSED, struct cpu* to UNUSED,
+                       struct task_struct* t UNUSED) {}
+
+static bool rt_check_preempt(struct cpu* cpu UNUSED, struct task_struct* curr,
+                             struct task_struct* t) {
+  return t->rt_priority > curr->rt_priority;
+}
+
+const struct sched_class rt_sched_class = {
+    .name = "rt",
+    .enqueue = rt_enqueue,
+    .dequeue = rt_dequeue,
+    .pick_next = rt_pick_next,
+    .pick_steal = rt_pick_steal,
+    .set_next = rt_set_next,
+    .put_prev = rt_put_prev,
+    .task_tick = rt_task_tick,
+    .migrate = rt_migrate,
+    .check_preempt = rt_check_preempt,
+};
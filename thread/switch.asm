@@ -22,4 +22,12 @@ switch_to:
     pop ebx 
     pop edi 
     pop esi 
-    ret    ;会返回到 kernel_thread    
\ No newline at end of file
+    ret    ;会返回到 kernel_thread    
+
+;fork 出的子进程第一次上 cpu 时从这里开始,先完成调度收尾再返回用户态
+extern schedule_tail
+extern intr_exit
+global fork_ret
+fork_ret:
+    call schedule_tail
+    jmp intr_exit
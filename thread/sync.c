@@ -4,12 +4,152 @@
 #include "interrupt.h"
 #include "list.h"
 #include "print.h"
+#include "sched.h"
 #include "thread.h"
+#include "timer.h"
+
+/*初始化自旋锁*/
+void spin_lock_init(struct spinlock* plock) { plock->locked = 0; }
+
+/*原子地将 locked 置 1,返回置位前的值*/
+static inline uint32_t spin_xchg(struct spinlock* plock) {
+  uint32_t old = 1;
+  asm volatile("xchgl %0, %1" : "+r"(old), "+m"(plock->locked) : : "memory");
+  return old;
+}
+
+/*获取自旋锁,调用者需自行保证不会在持锁时被本核中断重入*/
+void spin_lock(struct spinlock* plock) {
+  while (spin_xchg(plock) != 0) {
+    // 先只读等待,避免反复锁总线
+    while (plock->locked) {
+      asm volatile("pause" ::: "memory");
+    }
+  }
+}
+
+/*尝试获取自旋锁,成功返回 true*/
+bool spin_trylock(struct spinlock* plock) { return spin_xchg(plock) == 0; }
+
+/*释放自旋锁*/
+void spin_unlock(struct spinlock* plock) {
+  ASSERT(plock->locked == 1);
+  asm volatile("" ::: "memory");  // x86 写操作不重排,编译器屏障即可
+  plock->locked = 0;
+}
+
+/*关中断后获取自旋锁,返回关中断前的状态*/
+enum intr_status spin_lock_irqsave(struct spinlock* plock) {
+  enum intr_status old_status = intr_disable();
+  spin_lock(plock);
+  return old_status;
+}
+
+/*释放自旋锁并恢复中断状态*/
+void spin_unlock_irqrestore(struct spinlock* plock, enum intr_status status) {
+  spin_unlock(plock);
+  intr_set_status(status);
+}
+
+void wait_queue_init(struct wait_queue* wq) {
+  spin_lock_init(&wq->lock);
+  list_init(&wq->waiters);
+}
+
+/*关中断并获取队列锁,返回关中断前的状态*/
+enum intr_status wait_queue_lock(struct wait_queue* wq) {
+  return spin_lock_irqsave(&wq->lock);
+}
+
+void wait_queue_unlock(struct wait_queue* wq, enum intr_status old_status) {
+  spin_unlock_irqrestore(&wq->lock, old_status);
+}
+
+/*把 entry 移出队列并唤醒其任务,调用者需持有队列锁*/
+static void wake_entry(struct wait_entry* entry) {
+  list_remove(&entry->tag);
+  thread_unblock(entry->task);
+}
+
+/*等待超时,等待者若还在队列中就把它唤醒*/
+static void wait_timeout(uint32_t data) {
+  struct wait_entry* entry = (struct wait_entry*)data;
+  enum intr_status old_status = wait_queue_lock(entry->wq);
+  if (entry->tag.owner != NULL) {
+    entry->timed_out = true;
+    wake_entry(entry);
+  }
+  wait_queue_unlock(entry->wq, old_status);
+}
+
+/* 在 wq 上睡眠,直到被 wake_up 唤醒或超过 timeout_ticks 个 tick(为 0 不限时)。
+ * 调用者需持有队列锁,返回时仍持有;超时返回 false。
+ * 醒来不代表条件已成立,调用者要在循环中重新检查 */
+bool wait_queue_sleep(struct wait_queue* wq, bool exclusive,
+                      uint32_t timeout_ticks) {
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct wait_entry entry;
+  list_elem_init(&entry.tag);
+  entry.task = running_thread();
+  entry.wq = wq;
+  entry.exclusive = exclusive;
+  entry.timed_out = false;
+
+  /* 互斥等待者排在队尾,非互斥的排在队头,唤醒时从头扫描 */
+  if (exclusive) {
+    list_append(&wq->waiters, &entry.tag);
+  } else {
+    list_push(&wq->waiters, &entry.tag);
+  }
+
+  struct timer timer;
+  if (timeout_ticks != 0) {
+    timer_setup(&timer, wait_timeout, (uint32_t)&entry);
+    timer_add(&timer, ticks + timeout_ticks);
+  }
+  thread_block_unlock(TASK_BLOCKED, &wq->lock);
+
+  /* 先取消定时器再拿锁:回调要拿队列锁,持锁等它结束会死锁 */
+  if (timeout_ticks != 0) {
+    timer_del(&timer);
+  }
+  spin_lock(&wq->lock);
+  ASSERT(entry.tag.owner == NULL);
+  return !entry.timed_out;
+}
+
+/* 唤醒所有非互斥等待者和最多 nr_exclusive 个互斥等待者,
+ * 调用者需持有队列锁,返回唤醒的个数 */
+uint32_t wake_up_locked(struct wait_queue* wq, uint32_t nr_exclusive) {
+  uint32_t woken = 0;
+  struct list_elem* elem = wq->waiters.head.next;
+  while (elem != &wq->waiters.tail) {
+    struct list_elem* next = elem->next;
+    struct wait_entry* entry = elem2entry(struct wait_entry, tag, elem);
+    if (entry->exclusive) {
+      if (nr_exclusive == 0) {
+        break;
+      }
+      nr_exclusive--;
+    }
+    wake_entry(entry);
+    woken++;
+    elem = next;
+  }
+  return woken;
+}
+
+uint32_t wake_up(struct wait_queue* wq, uint32_t nr_exclusive) {
+  enum intr_status old_status = wait_queue_lock(wq);
+  uint32_t woken = wake_up_locked(wq, nr_exclusive);
+  wait_queue_unlock(wq, old_status);
+  return woken;
+}
 
 /*初始化信号量*/
-void sema_init(struct semaphore* psema, uint8_t value) {
+void sema_init(struct semaphore* psema, uint32_t value) {
+  wait_queue_init(&psema->wq);
   psema->value = value;
-  list_init(&psema->waiters);
 }
 
 /*初始化锁*/
@@ -17,67 +157,238 @@ void lock_init(struct lock* plock) {
   plock->holder = NULL;
   plock->holder_repeat_nr = 0;
   sema_init(&plock->semaphore, 1);
+  list_init(&plock->pi_waiters);
+  list_elem_init(&plock->holder_tag);
 }
 
-/*信号量down操作*/
-void sema_down(struct semaphore* psema) {
-  /*关中断保证原子操作*/
-  enum intr_status old_status = intr_disable();  // 关闭中断
+/* 信号量 down 操作,最多等 timeout_ticks 个 tick(为 0 不限时),
+ * 成功返回 true,超时返回 false */
+static bool sema_down_ticks(struct semaphore* psema, uint32_t timeout_ticks) {
+  enum intr_status old_status = wait_queue_lock(&psema->wq);
+  uint32_t deadline = ticks + timeout_ticks;
   while (psema->value == 0) {
-    // 此处要使用while,唤醒后再次判断(因为锁可能再次被抢用)
-    // 若 value 为 0,表示已经被别人持有
-    ASSERT(!elem_find(&psema->waiters, &running_thread()->general_tag));
-    if (elem_find(&psema->waiters, &running_thread()->general_tag)) {
-      PANIC("sema_down: thread blocked has been in waiters_list\n");
+    // 醒来后要再次判断,value 可能又被别人抢先拿走
+    uint32_t left = 0;
+    if (timeout_ticks != 0) {
+      left = deadline - ticks;
+      if ((int32_t)left <= 0) {
+        wait_queue_unlock(&psema->wq, old_status);
+        return false;
+      }
     }
-    list_append(&psema->waiters, &running_thread()->general_tag);
-    thread_block(TASK_BLOCKED);
+    wait_queue_sleep(&psema->wq, true, left);
   }
-  /* 若 value 为 1 或被唤醒后成功获得锁,会执行下面的代码,也就是获得了锁*/
   psema->value--;
-  ASSERT(psema->value == 0);
-  // 恢复之前状态
-  intr_set_status(old_status);
+  wait_queue_unlock(&psema->wq, old_status);
+  return true;
 }
 
-/*信号量up操作*/
-void sema_up(struct semaphore* psema) {
-  /*关中断，保证原子操作*/
-  enum intr_status old_status = intr_disable();  // 关闭中断
-  ASSERT(psema->value == 0);
-  if (!list_empty(&psema->waiters)) {
-    // 唤醒一个等待的线程
-    struct task_struct* thread_blocked =
-        elem2entry(struct task_struct, general_tag, list_pop(&psema->waiters));
-    thread_unblock(thread_blocked);
+/*信号量down操作*/
+void sema_down(struct semaphore* psema) { sema_down_ticks(psema, 0); }
+
+/*信号量 down 操作,最多等待 m_seconds 毫秒,超时返回 false*/
+bool sema_down_timeout(struct semaphore* psema, uint32_t m_seconds) {
+  return sema_down_ticks(psema, msecs_to_ticks(m_seconds));
+}
+
+/*value 大于 0 时减 1 并返回 true,否则不等待直接返回 false*/
+bool sema_try_down(struct semaphore* psema) {
+  bool ok = false;
+  enum intr_status old_status = wait_queue_lock(&psema->wq);
+  if (psema->value > 0) {
+    psema->value--;
+    ok = true;
   }
+  wait_queue_unlock(&psema->wq, old_status);
+  return ok;
+}
+
+/*信号量up操作,唤醒一个等待者*/
+void sema_up(struct semaphore* psema) {
+  enum intr_status old_status = wait_queue_lock(&psema->wq);
   psema->value++;
-  ASSERT(psema->value == 1);
-  // 恢复之前的中断状态
-  intr_set_status(old_status);
+  wake_up_locked(&psema->wq, 1);
+  wait_queue_unlock(&psema->wq, old_status);
+}
+
+/* 保护所有 struct lock 的 holder、pi_waiters 和任务的 held_locks、blocked_on.
+ * 持有 pi_lock 时只会再取 rq_lock(改优先级),从不取等待队列锁;
+ * 反过来 cond_wait 会在持有条件变量的队列锁时取 pi_lock(经 lock_release) */
+static struct spinlock pi_lock;
+
+#define PI_MAX_DEPTH 8  // 沿等锁链传递优先级的最大层数,防止锁成环时死循环
+
+/*t 应有的实时优先级:本来的与所持各锁上等待者中最高的取大*/
+static uint8_t pi_top_prio(struct task_struct* t) {
+  uint8_t prio = t->normal_rt_priority;
+  struct list_elem* lock_elem = t->held_locks.head.next;
+  while (lock_elem != &t->held_locks.tail) {
+    struct lock* plock = elem2entry(struct lock, holder_tag, lock_elem);
+    struct list_elem* waiter_elem = plock->pi_waiters.head.next;
+    while (waiter_elem != &plock->pi_waiters.tail) {
+      struct task_struct* waiter =
+          elem2entry(struct task_struct, pi_tag, waiter_elem);
+      if (waiter->rt_priority > prio) {
+        prio = waiter->rt_priority;
+      }
+      waiter_elem = waiter_elem->next;
+    }
+    lock_elem = lock_elem->next;
+  }
+  return prio;
+}
+
+/* 重新计算 t 的有效优先级,若有变化且 t 也在等锁,
+ * 再沿 blocked_on 传给那把锁的持有者。调用者持有 pi_lock */
+static void pi_propagate(struct task_struct* t) {
+  uint32_t depth = 0;
+  while (t != NULL && depth++ < PI_MAX_DEPTH) {
+    uint8_t prio = pi_top_prio(t);
+    if (prio == t->rt_priority) {
+      return;
+    }
+    sched_setprio(t, prio);
+    if (t->blocked_on == NULL) {
+      return;
+    }
+    t = t->blocked_on->holder;
+  }
+}
+
+/*sched_setscheduler 改了 t 本来的优先级后调用,重新计算有效优先级*/
+void lock_pi_update(struct task_struct* t) {
+  enum intr_status old_status = spin_lock_irqsave(&pi_lock);
+  pi_propagate(t);
+  spin_unlock_irqrestore(&pi_lock, old_status);
+}
+
+/*拿到锁之后登记为持有者,继承仍在等这把锁的任务的优先级*/
+static void lock_set_holder(struct lock* plock, struct task_struct* cur) {
+  enum intr_status old_status = spin_lock_irqsave(&pi_lock);
+  if (cur->blocked_on != NULL) {
+    list_remove(&cur->pi_tag);
+    cur->blocked_on = NULL;
+  }
+  plock->holder = cur;
+  list_append(&cur->held_locks, &plock->holder_tag);
+  pi_propagate(cur);
+  spin_unlock_irqrestore(&pi_lock, old_status);
 }
 
 /*获取锁plock*/
 void lock_acquire(struct lock* plock) {
-  if (plock->holder != running_thread()) {
-    sema_down(&plock->semaphore);  // 对信号量 P 操作,原子操作
-    plock->holder = running_thread();
-    ASSERT(plock->holder_repeat_nr == 0);
-    plock->holder_repeat_nr = 1;
-  } else {  // 已经加锁，未释放再次加锁
+  struct task_struct* cur = running_thread();
+  if (plock->holder == cur) {  // 已经加锁，未释放再次加锁
     plock->holder_repeat_nr++;
+    return;
+  }
+  if (!sema_try_down(&plock->semaphore)) {
+    /* 先登记为等待者并提升持有者,再去睡眠。
+     * 持有者可能刚拿到信号量还没登记,它登记时会看到这里的等待者 */
+    enum intr_status old_status = spin_lock_irqsave(&pi_lock);
+    cur->blocked_on = plock;
+    list_append(&plock->pi_waiters, &cur->pi_tag);
+    pi_propagate(plock->holder);
+    spin_unlock_irqrestore(&pi_lock, old_status);
+
+    sema_down(&plock->semaphore);  // 对信号量 P 操作,原子操作
   }
+  lock_set_holder(plock, cur);
+  ASSERT(plock->holder_repeat_nr == 0);
+  plock->holder_repeat_nr = 1;
 }
 
 /*释放锁plock*/
 void lock_release(struct lock* plock) {
-  ASSERT(plock->holder == running_thread());  // 取保自己是锁的持有者
+  struct task_struct* cur = running_thread();
+  ASSERT(plock->holder == cur);  // 取保自己是锁的持有者
   if (plock->holder_repeat_nr > 1) {
     plock->holder_repeat_nr--;
     return;
   }
   ASSERT(plock->holder_repeat_nr == 1);
-  plock->holder = NULL;
   plock->holder_repeat_nr = 0;
+
+  /* 先撤掉这把锁带来的提升再唤醒等待者,降级后若该让出会在返回前调度 */
+  enum intr_status old_status = spin_lock_irqsave(&pi_lock);
+  plock->holder = NULL;
+  list_remove(&plock->holder_tag);
+  pi_propagate(cur);
+  spin_unlock_irqrestore(&pi_lock, old_status);
+
   sema_up(&plock->semaphore);  // 信号量的 V 操作,也是原子操作
-}
\ No newline at end of file
+}
+
+/*初始化读写锁*/
+void rwlock_init(struct rwlock* rw) {
+  wait_queue_init(&rw->wq);
+  rw->readers = 0;
+  rw->writer = false;
+  rw->waiting_writers = 0;
+}
+
+/*获取读锁,读者非互斥等待,写锁释放时一起被唤醒*/
+void read_lock(struct rwlock* rw) {
+  enum intr_status old_status = wait_queue_lock(&rw->wq);
+  while (rw->writer || rw->waiting_writers > 0) {
+    wait_queue_sleep(&rw->wq, false, 0);
+  }
+  rw->readers++;
+  wait_queue_unlock(&rw->wq, old_status);
+}
+
+/*释放读锁,最后一个读者离开时唤醒一个写者*/
+void read_unlock(struct rwlock* rw) {
+  enum intr_status old_status = wait_queue_lock(&rw->wq);
+  ASSERT(rw->readers > 0 && !rw->writer);
+  if (--rw->readers == 0 && rw->waiting_writers > 0) {
+    wake_up_locked(&rw->wq, 1);
+  }
+  wait_queue_unlock(&rw->wq, old_status);
+}
+
+/*获取写锁,写者互斥等待,每次只唤醒一个*/
+void write_lock(struct rwlock* rw) {
+  enum intr_status old_status = wait_queue_lock(&rw->wq);
+  while (rw->writer || rw->readers > 0) {
+    rw->waiting_writers++;
+    wait_queue_sleep(&rw->wq, true, 0);
+    rw->waiting_writers--;
+  }
+  rw->writer = true;
+  wait_queue_unlock(&rw->wq, old_status);
+}
+
+/* 释放写锁,唤醒所有读者和一个写者。
+ * 还有写者在等时读者醒来会再次睡眠,锁优先交给写者 */
+void write_unlock(struct rwlock* rw) {
+  enum intr_status old_status = wait_queue_lock(&rw->wq);
+  ASSERT(rw->writer && rw->readers == 0);
+  rw->writer = false;
+  wake_up_locked(&rw->wq, 1);
+  wait_queue_unlock(&rw->wq, old_status);
+}
+
+/*初始化条件变量*/
+void cond_init(struct condition* cond) { wait_queue_init(&cond->wq); }
+
+/* 释放 plock 并睡眠,被 signal 唤醒后重新获取 plock.
+ * 入队和释放 plock 都在队列锁内完成,不会错过两者之间的 signal;
+ * 可能被虚假唤醒,调用者要在循环中检查条件 */
+void cond_wait(struct condition* cond, struct lock* plock) {
+  ASSERT(plock->holder == running_thread());
+  uint32_t repeat_nr = plock->holder_repeat_nr;  // 递归持有的层数要一并释放
+  enum intr_status old_status = wait_queue_lock(&cond->wq);
+  plock->holder_repeat_nr = 1;
+  lock_release(plock);
+  wait_queue_sleep(&cond->wq, true, 0);
+  wait_queue_unlock(&cond->wq, old_status);
+  lock_acquire(plock);
+  plock->holder_repeat_nr = repeat_nr;
+}
+
+/*唤醒一个等待者,调用者应持有与之配合的锁*/
+void cond_signal(struct condition* cond) { wake_up(&cond->wq, 1); }
+
+/*唤醒所有等待者*/
+void cond_broadcast(struct condition* cond) { wake_up(&cond->wq, WAKE_ALL); }
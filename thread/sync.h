@@ -1,28 +1,94 @@
-#ifndef THREAD_SYNC
-#define THREAD_SYNC
-#include "list.h"
-#include "stdint.h"
-#include "thread.h"
-
-/*信号量结构*/
-struct semaphore {
-  uint8_t value;
-  struct list waiters;
-};
-
-/*锁结构*/
-struct lock {
-  struct task_struct* holder;  // 锁的持有者
-  struct semaphore semaphore;  // 用二元信号实现锁
-  uint32_t holder_repeat_nr;   // 锁的持有者重复申请锁的使用次数
-};
-
-void sema_init(struct semaphore* psema, uint8_t value);
-void lock_init(struct lock* plock);
-void sema_down(struct semaphore* psema);
-void sema_up(struct semaphore* psema);
-void lock_acquire(struct lock* plock);
-void lock_release(struct lock* plock);
-void thread_yield(void);
-
-#endif /* THREAD_SYNC */
+#ifndef THREAD_SYNC
+#define THREAD_SYNC
+#include "interrupt.h"
+#include "list.h"
+#include "stdint.h"
+
+struct task_struct;
+
+/*自旋锁,多核间短临界区互斥用,持有期间不能睡眠*/
+struct spinlock {
+  volatile uint32_t locked;  // 0 表示空闲,1 表示已被持有
+};
+
+#define WAKE_ALL 0xffffffff  // wake_up 的 nr_exclusive 取此值时唤醒全部
+
+/* 等待队列。lock 同时用来保护等待的条件:
+ * 等待者持锁检查条件后睡眠,唤醒者改变条件后持锁唤醒,不会丢失唤醒 */
+struct wait_queue {
+  struct spinlock lock;
+  struct list waiters;
+};
+
+/* 队列中的一个等待者,放在等待任务自己的栈上 */
+struct wait_entry {
+  struct list_elem tag;
+  struct task_struct* task;
+  struct wait_queue* wq;
+  bool exclusive;  // 互斥等待,每次 wake_up 只唤醒指定个数
+  bool timed_out;  // 是因超时被唤醒的
+};
+
+/*计数信号量,等待者在 wq 上互斥等待,每次 up 只唤醒一个*/
+struct semaphore {
+  struct wait_queue wq;  // 队列锁同时保护 value
+  uint32_t value;
+};
+
+/*锁结构,带优先级继承:持有者的有效优先级不低于等锁任务中最高的*/
+struct lock {
+  struct task_struct* holder;  // 锁的持有者
+  struct semaphore semaphore;  // 用二元信号实现锁
+  uint32_t holder_repeat_nr;   // 锁的持有者重复申请锁的使用次数
+  struct list pi_waiters;      // 等待此锁的任务,由 pi_lock 保护
+  struct list_elem holder_tag;  // 在持有者 held_locks 中的结点
+};
+
+/* 读写锁,可睡眠,读者之间不互斥,写者独占。
+ * 有写者在等时新来的读者也要等,避免写者饿死,因此读锁不能递归获取 */
+struct rwlock {
+  struct wait_queue wq;        // 队列锁同时保护以下各项
+  uint32_t readers;            // 持有读锁的任务数
+  bool writer;                 // 是否有写者持有
+  uint32_t waiting_writers;    // 正在等待的写者数
+};
+
+/*条件变量,与 struct lock 配合使用,等待前后都持有该锁*/
+struct condition {
+  struct wait_queue wq;
+};
+
+void spin_lock_init(struct spinlock* plock);
+void spin_lock(struct spinlock* plock);
+bool spin_trylock(struct spinlock* plock);
+void spin_unlock(struct spinlock* plock);
+enum intr_status spin_lock_irqsave(struct spinlock* plock);
+void spin_unlock_irqrestore(struct spinlock* plock, enum intr_status status);
+void wait_queue_init(struct wait_queue* wq);
+enum intr_status wait_queue_lock(struct wait_queue* wq);
+void wait_queue_unlock(struct wait_queue* wq, enum intr_status old_status);
+bool wait_queue_sleep(struct wait_queue* wq, bool exclusive,
+                      uint32_t timeout_ticks);
+uint32_t wake_up_locked(struct wait_queue* wq, uint32_t nr_exclusive);
+uint32_t wake_up(struct wait_queue* wq, uint32_t nr_exclusive);
+void sema_init(struct semaphore* psema, uint32_t value);
+void lock_init(struct lock* plock);
+void sema_down(struct semaphore* psema);
+bool sema_down_timeout(struct semaphore* psema, uint32_t m_seconds);
+bool sema_try_down(struct semaphore* psema);
+void sema_up(struct semaphore* psema);
+void lock_acquire(struct lock* plock);
+void lock_release(struct lock* plock);
+void lock_pi_update(struct task_struct* t);
+void rwlock_init(struct rwlock* rw);
+void read_lock(struct rwlock* rw);
+void read_unlock(struct rwlock* rw);
+void write_lock(struct rwlock* rw);
+void write_unlock(struct rwlock* rw);
+void cond_init(struct condition* cond);
+void cond_wait(struct condition* cond, struct lock* plock);
+void cond_signal(struct condition* cond);
+void cond_broadcast(struct condition* cond);
+void thread_yield(void);
+
+#endif /* THREAD_SYNC */
@@ -5,6 +5,7 @@
 #include "bitmap.h"
 #include "debug.h"
 #include "file.h"
+#include "fpu.h"
 #include "fs.h"
 #include "global.h"
 #include "interrupt.h"
@@ -12,15 +13,16 @@
 #include "memory.h"
 #include "print.h"
 #include "process.h"
+#include "rcu.h"
+#include "sched.h"
+#include "smp.h"
 #include "stdint.h"
 #include "string.h"
 #include "sync.h"
+#include "timer.h"
 
-struct task_struct* main_thread;      // 主线程PCB
-struct task_struct* idle_thread;      // ide线程
-struct list thread_ready_list;        // 就绪队列
-struct list thread_all_list;          // 所有任务队列
-static struct list_elem* thread_tag;  // 用于保存队列中的线程结点
+struct task_struct* main_thread;  // 主线程PCB
+struct list thread_all_list;      // 所有任务队列,写者由大内核锁互斥,读者可用 RCU
 
 struct lock pid_lock;  // 分配pid锁
 /* pid 的位图,最大支持 1024 个 pid */
@@ -61,31 +63,50 @@ void release_pid(pid_t pid) {
   lock_release(&pid_pool.pid_lock);
 }
 
+/*宽限期结束后释放已退出任务的 pcb*/
+static void free_task_rcu(struct rcu_head* head) {
+  struct task_struct* t = elem2entry(struct task_struct, rcu, head);
+  mfree_page(PF_KERNEL, t, 1);
+}
+
 /* 回收 结束线程 的 pcb 和页表,并将其从调度队列中去除 */
 void thread_exit(struct task_struct* thread_over, bool need_schedule) {
   /* 要保证 schedule 在关中断情况下调用 */
   intr_disable();
+  if (thread_over != running_thread()) {
+    // 它可能还在别的核上执行换下的过程,等它彻底离开后才能回收 pcb
+    while (thread_over->on_cpu) {
+      asm volatile("pause" ::: "memory");
+    }
+  }
   thread_over->status = TASK_DIED;
 
   /* 如果 thread_over 不是当前线程,
  就有可能还在就绪队列中,将其从中删除 */
-  if (elem_find(&thread_ready_list, &thread_over->general_tag)) {
-    list_remove(&thread_over->general_tag);
+  struct cpu* cpu = thread_over->cpu;
+  if (cpu != NULL) {
+    spin_lock(&cpu->rq_lock);
+    if (thread_over->on_rq) {
+      sched_dequeue(cpu, thread_over);
+    }
+    spin_unlock(&cpu->rq_lock);
   }
-  if (thread_over->pgdir) {
+  fpu_release(thread_over);
+  if (thread_over->pgdir && thread_over->group_leader == thread_over) {  // 页表由主线程回收
     mfree_page(PF_KERNEL, thread_over->pgdir, 1);
   }
   /* 从 all_thread_list 中去掉此任务 */
   list_remove(&thread_over->all_list_tag);
 
-  /* 回收 pcb 所在的页,主线程的 pcb 不在堆中,跨过 */
-  if (thread_over != main_thread) {
-    mfree_page(PF_KERNEL, thread_over, 1);
-  }
-
   /*归来pid*/
   release_pid(thread_over->pid);
 
+  /* 回收 pcb 所在的页,主线程的 pcb 不在堆中,跨过。
+   * pid2thread 的读者可能还在访问它,等宽限期过后再释放 */
+  if (thread_over != main_thread) {
+    call_rcu(&thread_over->rcu, free_task_rcu);
+  }
+
   /* 如果需要下一轮调度则主动调用 schedule */
   if (need_schedule) {
     schedule();
@@ -104,8 +125,12 @@ static bool pid_check(struct list_elem* pelem, int32_t pid) {
   return false;
 }
 
-/* 根据 pid 找 pcb,若找到则返回该 pcb,否则返回 NULL */
+/* 根据 pid 找 pcb,若找到则返回该 pcb,否则返回 NULL.
+ * 调用者要在 rcu_read_lock 之内查找,并在退出读侧临界区前用完返回的 pcb,
+ * 之后它可能已被 thread_exit 释放 */
 struct task_struct* pid2thread(int32_t pid) {
+  ASSERT(running_thread()->preempt_count > 0);
+  /* 删除结点时不改它的 next,插入时先填好结点再发布,读者向后遍历不用加锁 */
   struct list_elem* pelem = list_traversal(&thread_all_list, pid_check, pid);
   if (pelem == NULL) {
     return NULL;
@@ -116,8 +141,20 @@ struct task_struct* pid2thread(int32_t pid) {
   return thread;
 }
 
-/*系统空闲时运行的线程*/
-static void idle(void* arg UNUSED) {
+/*判断 pthread 所在的进程中是否没有别的线程*/
+static bool other_thread_check(struct list_elem* pelem, int32_t pthread) {
+  struct task_struct* t = elem2entry(struct task_struct, all_list_tag, pelem);
+  struct task_struct* self = (struct task_struct*)pthread;
+  return t != self && t->group_leader == self->group_leader;
+}
+
+bool thread_group_alone(struct task_struct* pthread) {
+  return list_traversal(&thread_all_list, other_thread_check,
+                        (int32_t)pthread) == NULL;
+}
+
+/*处理器空闲时的循环,每次被中断唤醒后都重新调度一次*/
+void cpu_idle(void) {
   while (1) {
     thread_block(TASK_BLOCKED);
     // 执行 hlt 时必须要保证目前处在开中断的情况下
@@ -126,6 +163,9 @@ static void idle(void* arg UNUSED) {
   }
 }
 
+/*系统空闲时运行的线程*/
+static void idle(void* arg UNUSED) { cpu_idle(); }
+
 /*获取当前pcb指针*/
 struct task_struct* running_thread() {
   uint32_t esp;
@@ -137,7 +177,8 @@ struct task_struct* running_thread() {
 
 /* 由 kernel_thread 去执行 function(func_arg) */
 static void kernel_thread(thread_func* function, void* func_arg) {
-  intr_enable();  // 打开中断
+  schedule_tail();  // 第一次上 cpu,先完成 schedule 没做完的收尾
+  intr_enable();    // 打开中断
   function(func_arg);
 }
 
@@ -175,6 +216,9 @@ void init_thread(struct task_struct* pthread, char* name, int prio) {
   pthread->priority = prio;
   pthread->ticks = prio;
   pthread->elapsed_ticks = 0;
+  pthread->sched_class = default_sched_class;
+  pthread->normal_class = default_sched_class;
+  list_init(&pthread->held_locks);
   pthread->pgdir = NULL;
   /*预留标准输入输出*/
   pthread->fd_table[0] = 0;
@@ -188,6 +232,8 @@ void init_thread(struct task_struct* pthread, char* name, int prio) {
   }
   pthread->cwd_inode_nr = 0;  // 以根目录作为默认工作路径
   pthread->parent_pid = -1;
+  pthread->group_leader = pthread;
+  wait_queue_init(&pthread->child_exit_wq);
   pthread->stack_magic = STACK_MAGIC;  // 魔数
 }
 
@@ -197,49 +243,114 @@ struct task_struct* thread_start(char* name, int prio, thread_func fuction,
   struct task_struct* thread = get_kernel_pages(1);
   init_thread(thread, name, prio);
   thread_create(thread, fuction, func_arg);
-  /*确保之前不再队列里面*/
-  ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-  /*加入就绪线程队列*/
-  list_append(&thread_ready_list, &thread->general_tag);
+  thread_admit(thread);
+  return thread;
+}
 
-  /* 确保之前不在队列中 */
-  ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
-  /*加入全部线程线程队列*/
-  list_append(&thread_all_list, &thread->all_list_tag);
+/* 将新建的任务加入全部任务队列,并放入当前处理器的就绪队列 */
+void thread_admit(struct task_struct* pthread) {
+  kernel_lock_acquire();
+  ASSERT(!elem_find(&thread_all_list, &pthread->all_list_tag));
+  list_append_rcu(&thread_all_list, &pthread->all_list_tag);
+  kernel_lock_release();
+
+  struct cpu* cpu = this_cpu();
+  enum intr_status old_status = spin_lock_irqsave(&cpu->rq_lock);
+  sched_enqueue(cpu, pthread, ENQUEUE_NEW);
+  spin_unlock_irqrestore(&cpu->rq_lock, old_status);
+}
 
-  return thread;
+/* 为 cpu 创建 idle 线程。idle 不进就绪队列,本核无任务可运行时才被选中 */
+struct task_struct* idle_thread_create(struct cpu* cpu) {
+  struct task_struct* idle_thread = get_kernel_pages(1);
+  char name[16] = {0};
+  sprintf(name, "idle%d", cpu->id);
+  init_thread(idle_thread, name, 10);
+  thread_create(idle_thread, idle, NULL);
+  idle_thread->status = TASK_BLOCKED;
+  idle_thread->cpu = cpu;
+  cpu->idle_thread = idle_thread;
+
+  kernel_lock_acquire();
+  ASSERT(!elem_find(&thread_all_list, &idle_thread->all_list_tag));
+  list_append_rcu(&thread_all_list, &idle_thread->all_list_tag);
+  kernel_lock_release();
+  return idle_thread;
 }
 
-/*实现任务调度*/
+/* 实现任务调度。本核的 rq_lock 在 switch_to 期间一直持有,
+ * 由换上来的任务在 schedule_tail 中释放 */
 void schedule() {
   // 此时中断应该处于关闭状态
   ASSERT(intr_get_status() == INTR_OFF);
   struct task_struct* cur = running_thread();
+  struct cpu* cpu = cur->cpu;
+  ASSERT(cur->preempt_count == 0);  // 不可抢占的区域中不能睡眠
+  bool preempted = cur->need_resched;
+  bool voluntary = cur->status != TASK_RUNNING;  // 阻塞而换下,否则是被抢占或让出
+  cur->need_resched = false;
+  cpu->rcu_qs_count++;  // 任务切换是 RCU 的静止状态
+
+  if (cur->kernel_lock_depth > 0) {
+    spin_unlock(&kernel_lock);  // 换下期间让出大内核锁
+  }
+  spin_lock(&cpu->rq_lock);
+  sched_put_prev(cpu, cur);
   if (cur->status == TASK_RUNNING) {
-    // 该线程时间片已经使用完，将其加入队尾
-    ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-    list_append(&thread_ready_list, &cur->general_tag);
-    cur->ticks = cur->priority;
-    cur->status = TASK_READY;
+    if (cur == cpu->idle_thread) {
+      cur->status = TASK_BLOCKED;  // idle 不进就绪队列
+    } else {
+      // 被抢占或主动让出,重新入队
+      sched_enqueue(cpu, cur, preempted ? ENQUEUE_PREEMPTED : 0);
+    }
   } else {
     /* 若此线程需要某事件发生后才能继续上 cpu 运行,
-      不需要将其加入队列,因为当前线程不在就绪队列中 */
+      不需要将其加入队列,因为当前线程不在就绪队列中;
+      若状态已是 READY,说明换下前就被其他核唤醒,已经在队列里了 */
   }
 
-  // 没有任务时就唤醒ide线程
-  if (list_empty(&thread_ready_list)) {
-    thread_unblock(idle_thread);
+  struct task_struct* next = sched_pick_next(cpu);  // 弹出一个线程上cpu
+  if (next == NULL) {
+    next = sched_steal(cpu);
+  }
+  if (next == NULL) {  // 没有任务时就运行 idle 线程
+    next = cpu->idle_thread;
   }
-
-  thread_tag = NULL;
-  thread_tag = list_pop(&thread_ready_list);  // 弹出一个线程上cpu
-
-  struct task_struct* next =
-      elem2entry(struct task_struct, general_tag, thread_tag);
   next->status = TASK_RUNNING;
-  /* 激活任务页表等 */
-  process_activate(next);
-  switch_to(cur, next);
+  next->cpu = cpu;
+  sched_set_next(cpu, next);
+
+  if (next != cur) {
+    if (cur != cpu->idle_thread) {
+      if (voluntary) {
+        cur->nvcsw++;
+      } else {
+        cur->nivcsw++;
+      }
+    }
+    next->on_cpu = true;
+    cpu->cur_thread = next;
+    cpu->prev_thread = cur;
+    /* 激活任务页表等 */
+    process_activate(next);
+    fpu_switch(cur, next);
+    switch_to(cur, next);
+  }
+  /* 重新被调度上 cpu 后从这里继续 */
+  schedule_tail();
+  if (cur->kernel_lock_depth > 0) {
+    spin_lock(&kernel_lock);
+  }
+}
+
+/* 任务刚被换上 cpu 时调用:标记上一个任务已彻底换下,释放本核的 rq_lock */
+void schedule_tail(void) {
+  struct cpu* cpu = this_cpu();
+  if (cpu->prev_thread != NULL) {
+    cpu->prev_thread->on_cpu = false;
+    cpu->prev_thread = NULL;
+  }
+  spin_unlock(&cpu->rq_lock);
 }
 
 /*将kernel中的main函数完善为主线程*/
@@ -250,16 +361,20 @@ static void make_main_thread(void) {
    * 不需要通过 get_kernel_page 另分配一页*/
   main_thread = running_thread();
   init_thread(main_thread, "main", 31);
+  main_thread->cpu = &cpus[0];
+  main_thread->on_cpu = true;
+  main_thread->exec_start = rdtsc();
+  cpus[0].cur_thread = main_thread;
 
   // main线程正在运行，所以不需要添加在就绪队列当中
   ASSERT(!elem_find(&thread_all_list, &main_thread->all_list_tag));
-  list_append(&thread_all_list, &main_thread->all_list_tag);
+  list_append_rcu(&thread_all_list, &main_thread->all_list_tag);
 }
 
 /*设置线程的阻塞状态*/
 void thread_block(enum task_status stat) {
   ASSERT(((stat == TASK_BLOCKED) || (stat == TASK_WAITING) ||
-          (stat == TASK_HANGING)))
+          (stat == TASK_HANGING)));
   enum intr_status old_status = intr_disable();  // 关闭中断
   struct task_struct* cur_thread = running_thread();
   cur_thread->status = stat;
@@ -268,7 +383,18 @@ void thread_block(enum task_status stat) {
   intr_set_status(old_status);
 }
 
-/*解除pthread的阻塞状态*/
+/* 在持有 lock 的情况下设置阻塞状态再释放 lock 并调度。
+ * 唤醒方也要持有 lock,这样它看到的一定是已经阻塞的线程,唤醒不会丢失 */
+void thread_block_unlock(enum task_status stat, struct spinlock* lock) {
+  ASSERT(((stat == TASK_BLOCKED) || (stat == TASK_WAITING) ||
+          (stat == TASK_HANGING)));
+  ASSERT(intr_get_status() == INTR_OFF);  // 持有自旋锁时中断应该是关闭的
+  running_thread()->status = stat;
+  spin_unlock(lock);
+  schedule();
+}
+
+/*解除pthread的阻塞状态,放回它上次运行的处理器的就绪队列*/
 void thread_unblock(struct task_struct* pthread) {
   enum intr_status old_status = intr_disable();  // 关闭中断
 
@@ -276,30 +402,54 @@ void thread_unblock(struct task_struct* pthread) {
           (pthread->status == TASK_WAITING) ||
           (pthread->status == TASK_HANGING)));
   if (pthread->status != TASK_READY) {
-    ASSERT(!elem_find(&thread_ready_list, &pthread->general_tag));
-    if (elem_find(&thread_ready_list, &pthread->general_tag)) {
-      PANIC("thread_unblock: blocked thread in ready_list\n");
-    }
-    list_push(&thread_ready_list, &pthread->general_tag);
-    pthread->status = TASK_READY;
+    struct cpu* cpu = pthread->cpu;
+    spin_lock(&cpu->rq_lock);
+    sched_enqueue(cpu, pthread, ENQUEUE_WAKEUP);
+    sched_check_preempt(cpu, pthread);  // 需要时让该核立即调度
+    spin_unlock(&cpu->rq_lock);
   }
   intr_set_status(old_status);
 }
 
+/* 中断和系统调用返回前调用,调用时中断是关闭的。
+ * 当前任务被要求让出时在这里调度,被唤醒的任务不必等到时间片用完 */
+void check_resched(void) {
+  ASSERT(intr_get_status() == INTR_OFF);
+  struct task_struct* cur = running_thread();
+  if (cur->need_resched && cur->preempt_count == 0) {
+    schedule();
+  }
+}
+
+/*禁止抢占当前任务,可以嵌套*/
+void preempt_disable(void) {
+  running_thread()->preempt_count++;
+  asm volatile("" : : : "memory");
+}
+
+/* 恢复抢占。禁止期间被要求让出的,在开着中断时立即调度,
+ * 否则留给下一次中断或系统调用返回 */
+void preempt_enable(void) {
+  struct task_struct* cur = running_thread();
+  ASSERT(cur->preempt_count > 0);
+  asm volatile("" : : : "memory");
+  if (--cur->preempt_count == 0 && cur->need_resched &&
+      intr_get_status() == INTR_ON) {
+    intr_disable();
+    schedule();
+    intr_enable();
+  }
+}
+
 /*主动让出CPU(重新入队等待下一轮调度)*/
 void thread_yield(void) {
-  put_str("thread_init start\n");
-  struct task_struct* cur = running_thread();
   enum intr_status old_status = intr_disable();
-  ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-  list_append(&thread_ready_list, &cur->general_tag);
-  cur->status = TASK_READY;
-  schedule();
+  schedule();  // 状态仍是 RUNNING,schedule 会把它重新放回就绪队列
   intr_set_status(old_status);
 }
 
 int32_t pcb_fd_install(uint32_t fd_idx) {
-  struct task_struct* cur_thread = running_thread();
+  struct task_struct* cur_thread = running_thread()->group_leader;
   uint32_t idx = 3;
   while (idx < MAX_FILES_OPEN_PER_PROC) {
     if (cur_thread->fd_table[idx] == -1) {
@@ -387,15 +537,24 @@ void sys_ps(void) {
 /* 初始化线程环境 */
 void thread_init(void) {
   put_str("thread_init start\n");
-  list_init(&thread_ready_list);
   list_init(&thread_all_list);
   lock_init(&pid_lock);
   pid_pool_init();
+  cpu_init(&cpus[0], 0);
+  cpus[0].started = true;
+  /* process_execute 要把 init 放入当前处理器的就绪队列,
+   * 先让 main 的 pcb 归属 BSP,make_main_thread 中会再完整初始化 */
+  running_thread()->cpu = &cpus[0];
+  running_thread()->kernel_lock_depth = 0;
+  list_init(&running_thread()->held_locks);  // 创建 init 时就要加锁
+  running_thread()->blocked_on = NULL;
   /* 先创建第一个用户进程:init */
   process_execute(init, "init");
   /* 将当前 main 函数创建为线程 */
   make_main_thread();
-  /* 创建 idle 线程 */
-  idle_thread = thread_start("idle", 10, idle, NULL);
-  put_str("thread_init done\n");
+  /* 创建 BSP 的 idle 线程 */
+  idle_thread_create(&cpus[0]);
+  put_str("   scheduler: ");
+  put_str(default_sched_class->name);
+  put_str("\nthread_init done\n");
 }
@@ -3,13 +3,20 @@
 
 #include "list.h"
 #include "memory.h"
+#include "rbtree.h"
+#include "rcu.h"
 #include "stdint.h"
+#include "sync.h"
 
 #define MAX_FILES_OPEN_PER_PROC 8  // 每个进程允许打开文件的最大数量
 typedef void thread_func(void*);
 typedef int16_t pid_t;
 
 #define STACK_MAGIC 0x19870916  // 自定义魔术
+
+struct cpu;
+struct spinlock;
+struct sched_class;
 /*进程状态*/
 enum task_status {
   TASK_RUNNING,  // 运行
@@ -20,6 +27,15 @@ enum task_status {
   TASK_DIED,     // 死亡
 };
 
+/* 已被回收的任务留下的运行统计,单位微秒 */
+struct task_usage {
+  uint64_t exec_us;       // 运行时间
+  uint64_t run_delay_us;  // 就绪后等待上 cpu 的时间
+  uint64_t iowait_us;     // 等待磁盘的时间
+  uint32_t nvcsw;         // 主动让出 cpu 的次数
+  uint32_t nivcsw;        // 被抢占的次数
+};
+
 // 中断产生时一系列压栈操作是压入了此结构中
 struct intr_stack {
   uint32_t vec_no;  // 中断号
@@ -70,21 +86,57 @@ struct task_struct {
   uint8_t ticks;           // 每次在处理器上执行的时间嘀嗒数
   uint32_t elapsed_ticks;  // 运行时间嘀嗒总数（总运行时间）
 
+  struct cpu* cpu;             // 所在(或最近一次运行)的处理器
+  volatile bool on_cpu;        // 是否还在某个处理器上执行(含正在被换下)
+  bool need_resched;           // 时间片已用完,中断返回前需要调度
+  uint32_t preempt_count;      // 大于 0 时不可抢占,也不能睡眠(如 RCU 读侧)
+
+  /* 调度相关,由所在核的 rq_lock 保护 */
+  const struct sched_class* sched_class;  // 所属的调度类
+  bool on_rq;                // 是否在就绪队列中
+  struct rb_node run_node;   // 在 CFS 就绪树中的结点
+  uint64_t vruntime;         // 按权重折算的虚拟运行时间(微秒)
+  uint64_t exec_start;       // 本次上 cpu 后尚未记账的起点(TSC)
+  uint64_t sum_exec_us;      // 累计运行时间(微秒)
+  uint64_t slice_start_us;   // 本轮上 cpu 时的 sum_exec_us
+  uint8_t rt_priority;       // 实时优先级,非实时任务为 0
+  /* 优先级继承:以上两项是有效值,持锁期间可能被等锁的任务临时提升,
+   * 以下两项是 sched_setscheduler 设定的本来值。由 sync.c 的 pi_lock 保护 */
+  const struct sched_class* normal_class;
+  uint8_t normal_rt_priority;
+  struct list held_locks;    // 持有的 struct lock
+  struct lock* blocked_on;   // 正在等待的 struct lock
+  struct list_elem pi_tag;   // 在所等锁的 pi_waiters 中的结点
+  uint64_t wakeup_tsc;       // 被唤醒的时刻(TSC),上 cpu 后清零
+  uint32_t wakeup_latency_us;  // 最近一次从被唤醒到上 cpu 的时间
+  uint64_t queued_tsc;         // 进入就绪队列的时刻(TSC),上 cpu 后清零
+  uint64_t run_delay_us;       // 累计在就绪队列中等待的时间
+  uint64_t iowait_us;          // 累计等待磁盘的时间
+  uint32_t nvcsw;              // 阻塞而让出 cpu 的次数
+  uint32_t nivcsw;             // 仍可运行却被换下的次数
+  struct task_usage group_usage;  // 主线程用:已回收的本进程其他线程
+  struct task_usage child_usage;  // 主线程用:已 wait 回收的子进程
+  uint32_t kernel_lock_depth;  // 大内核锁的持有层数,被换下时暂时释放
+  void* fpu_state;             // fxsave 保存区,第一次使用浮点时才分配
+  struct cpu* fpu_last_cpu;    // 最近一次装入浮点状态的处理器
+
   int32_t fd_table[MAX_FILES_OPEN_PER_PROC];  // 文件描述符数组
 
   struct list_elem general_tag;  // 用于线程在一般的队列(就绪/等待队列)中的结点
-  struct list_elem all_list_tag;  // 总队列(所有线程)中的节点
+  struct list_elem all_list_tag;  // 总队列(所有线程)中的节点,按 pid 查找时只在 RCU 读侧遍历
+  struct rcu_head rcu;            // 退出后延迟释放 pcb 用
 
   uint32_t* pgdir;                     // 进程自己页表的虚拟地址
   struct virtual_addr userprog_vaddr;  // 放进程页目录表的虚拟地址
   struct mem_block_desc u_block_desc[DESC_CNT];  // 用户进程内存块描述符
   uint32_t cwd_inode_nr;  // 进程所在的工作目录的inode编号
-  int16_t parent_pid;     // 父进程的pid
+  int16_t parent_pid;     // 父进程的pid,线程为所在进程主线程的 pid
+  struct task_struct* group_leader;  // 所在进程的主线程,线程共用它的文件描述符表和内存块描述符
+  struct wait_queue child_exit_wq;  // 在此等待子进程或本进程中的线程退出
   int8_t exit_status;     // 进程结束时自己调用exit传入的返回值
   uint32_t stack_magic;   // 栈的边界标记,用于检测栈的溢出
 };
 
-extern struct list thread_ready_list;
 extern struct list thread_all_list;
 
 struct task_struct* thread_start(char* name, int prio, thread_func fuction,
@@ -102,13 +154,23 @@ void thread_init(void);
 /*设置线程的阻塞状态*/
 void thread_block(enum task_status stat);
 
+/*设置阻塞状态后释放 lock 再调度,lock 保护的是唤醒条件*/
+void thread_block_unlock(enum task_status stat, struct spinlock* lock);
+
 /*解除pthread的阻塞状态*/
 void thread_unblock(struct task_struct* pthread);
+void check_resched(void);
+void preempt_disable(void);
+void preempt_enable(void);
 
 void init_thread(struct task_struct* pthread, char* name, int prio);
 void thread_create(struct task_struct* pthread, thread_func function,
                    void* func_arg);
 void thread_yield(void);
+void thread_admit(struct task_struct* pthread);
+void schedule_tail(void);
+void cpu_idle(void);
+struct task_struct* idle_thread_create(struct cpu* cpu);
 int32_t pcb_fd_install(uint32_t fd_idx);
 
 pid_t fork_pid(void);
@@ -116,4 +178,5 @@ void sys_ps(void);
 void release_pid(pid_t pid);
 void thread_exit(struct task_struct* thread_over, bool need_schedule);
 struct task_struct* pid2thread(int32_t pid);
+bool thread_group_alone(struct task_struct* pthread);
 #endif /* THREAD_THREAD */
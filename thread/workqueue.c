@@ -0,0 +1,72 @@
+#include "workqueue.h"
+
+#include "debug.h"
+#include "interrupt.h"
+#include "print.h"
+#include "string.h"
+#include "thread.h"
+
+static struct workqueue system_wq;  // 各模块共用的工作队列
+
+/*初始化工作 w*/
+void work_init(struct work* w, work_func* func) {
+  list_elem_init(&w->tag);
+  w->func = func;
+  w->pending = false;
+}
+
+/* 工作线程:取出工作逐个执行,队列空时阻塞。
+ * 执行工作时不持有大内核锁,要访问文件系统等的工作需自己获取 */
+static void worker_thread(void* arg) {
+  struct workqueue* wq = arg;
+  while (1) {
+    enum intr_status old_status = spin_lock_irqsave(&wq->lock);
+    if (list_empty(&wq->works)) {
+      wq->sleeping = true;
+      thread_block_unlock(TASK_BLOCKED, &wq->lock);
+      intr_set_status(old_status);
+      continue;
+    }
+    struct work* w = elem2entry(struct work, tag, list_pop(&wq->works));
+    w->pending = false;  // 执行期间可以被再次加入队列
+    spin_unlock_irqrestore(&wq->lock, old_status);
+    w->func(w);
+  }
+}
+
+/*创建工作队列 wq 并启动名为 name 的工作线程*/
+void workqueue_create(struct workqueue* wq, char* name, int prio) {
+  strcpy(wq->name, name);
+  spin_lock_init(&wq->lock);
+  list_init(&wq->works);
+  wq->sleeping = false;
+  wq->worker = thread_start(name, prio, worker_thread, wq);
+}
+
+/* 把 w 加入 wq,可以在中断处理程序中调用。
+ * w 已在队列中时不重复加入,返回 false */
+bool queue_work(struct workqueue* wq, struct work* w) {
+  bool queued = false;
+  enum intr_status old_status = spin_lock_irqsave(&wq->lock);
+  if (!w->pending) {
+    w->pending = true;
+    list_append(&wq->works, &w->tag);
+    queued = true;
+    if (wq->sleeping) {
+      wq->sleeping = false;
+      thread_unblock(wq->worker);
+    }
+  }
+  spin_unlock_irqrestore(&wq->lock, old_status);
+  return queued;
+}
+
+/*把 w 加入系统工作队列*/
+bool schedule_work(struct work* w) { return queue_work(&system_wq, w); }
+
+/*创建系统工作队列*/
+void workqueue_init(void) {
+  put_str("workqueue_init start\n");
+  workqueue_create(&system_wq, "kworker", 31);
+  put_str("workqueue_init done\n");
+}
@@ -0,0 +1,32 @@
+#ifndef THREAD_WORKQUEUE
+#define THREAD_WORKQUEUE
+#include "global.h"
+#include "list.h"
+#include "stdint.h"
+#include "sync.h"
+
+struct work;
+typedef void work_func(struct work* w);
+
+/* 交给内核工作线程执行的一项工作,可以睡眠 */
+struct work {
+  struct list_elem tag;  // 挂在工作队列中
+  work_func* func;
+  bool pending;  // 已在队列中等待执行
+};
+
+/* 工作队列,由一个专门的内核线程依次执行其中的工作 */
+struct workqueue {
+  char name[16];
+  struct spinlock lock;  // 保护 works 与 sleeping
+  struct list works;
+  struct task_struct* worker;  // 执行工作的内核线程
+  bool sleeping;               // worker 是否因队列为空而阻塞
+};
+
+void work_init(struct work* w, work_func* func);
+void workqueue_create(struct workqueue* wq, char* name, int prio);
+bool queue_work(struct workqueue* wq, struct work* w);
+bool schedule_work(struct work* w);
+void workqueue_init(void);
+#endif /* THREAD_WORKQUEUE */
@@ -2,10 +2,15 @@
 
 #include "elf.h"
 #include "file.h"
+#include "fpu.h"
 #include "fs.h"
 #include "memory.h"
 #include "pipe.h"
+#include "process.h"
+#include "smp.h"
 #include "string.h"
+#include "thread.h"
+#include "wait_exit.h"
 extern void intr_exit(void);
 #define TASK_NAME_LEN 16
 typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
@@ -131,7 +136,7 @@ static void proc_clean() {
         uint32_t global_fd = fd_local2global(fd_idx);
         if (--file_table[global_fd].fd_pos == 0) {
           mfree_page(PF_KERNEL, file_table[global_fd].fd_inode, 1);
-          file_table[global_fd].fd_inode = NULL;
+          file_slot_release(global_fd);
         }
       } else {
         sys_close(fd_idx);
@@ -148,12 +153,18 @@ int32_t sys_execv(const char* path, const char* argv[]) {
     argc++;
   }
   struct task_struct* cur = running_thread();
+  /* 还有别的线程时不能替换共用的地址空间 */
+  if (!thread_group_alone(cur)) {
+    return -1;
+  }
   proc_clean();
   int32_t entry_point = load(path);
   if (entry_point == -1) {  // 若加载失败则返回-1
     return -1;
   }
 
+  fpu_release(cur);  // 新程序从初始的浮点状态开始
+
   /* 修改进程名 */
   memcpy(cur->name, path, TASK_NAME_LEN);
   cur->name[TASK_NAME_LEN - 1] = 0;
@@ -167,10 +178,83 @@ int32_t sys_execv(const char* path, const char* argv[]) {
   /* 使新用户进程的栈地址为最高用户空间地址 */
   intr_0_stack->esp = (void*)0xc0000000;
 
-  /* exec不同于fork,为使新进程更快被执行,直接从中断返回 */
+  /* exec不同于fork,为使新进程更快被执行,直接从中断返回,
+   * 不再经过 syscall_handler,所以要在这里释放大内核锁 */
+  kernel_lock_release();
   asm volatile("movl %0, %%esp; jmp intr_exit"
                :
                : "g"(intr_0_stack)
                : "memory");
   return 0;
 }
+
+/* 把 path 和 argv 拷贝到一页内核内存中,参数太多或太长时返回 NULL */
+struct spawn_args* spawn_args_build(const char* path, const char* argv[]) {
+  struct spawn_args* args = get_kernel_pages(1);
+  if (args == NULL) {
+    return NULL;
+  }
+  strcpy(args->path, path);
+  args->argc = 0;
+  args->str_len = 0;
+  uint32_t room = PG_SIZE - sizeof(struct spawn_args);
+  while (argv[args->argc]) {
+    uint32_t len = strlen(argv[args->argc]) + 1;
+    if (args->argc == SPAWN_MAX_ARGS || args->str_len + len > room) {
+      mfree_page(PF_KERNEL, args, 1);
+      return NULL;
+    }
+    memcpy(args->strs + args->str_len, argv[args->argc], len);
+    args->str_len += len;
+    args->argc++;
+  }
+  return args;
+}
+
+/* sys_spawn 创建的子进程第一次上 cpu 时在内核中执行:
+ * 在自己全新的地址空间中加载程序,把参数放到用户栈上,然后进入用户态 */
+void start_spawned_process(void* args_) {
+  struct spawn_args* args = args_;
+  struct task_struct* cur = running_thread();
+  kernel_lock_acquire();  // 要访问文件系统,和系统调用一样持有大内核锁
+
+  int32_t entry_point = load(args->path);
+  void* stack_page = get_a_page(PF_USER, USER_STACK3_VADDR);
+  if (entry_point == -1 || stack_page == NULL) {
+    mfree_page(PF_KERNEL, args, 1);
+    sys_exit(-1);
+  }
+  memcpy(cur->name, args->path, TASK_NAME_LEN);
+  cur->name[TASK_NAME_LEN - 1] = 0;
+
+  /* 用户栈顶依次放参数字符串和 argv 数组,字符串总长不超过一页减去 path,
+   * 所以都在这一页内 */
+  char* strs = (char*)(0xc0000000 - args->str_len);
+  memcpy(strs, args->strs, args->str_len);
+  char** uargv = (char**)((uint32_t)strs & 0xfffffffc) - (args->argc + 1);
+  uint32_t arg_idx;
+  for (arg_idx = 0; arg_idx < args->argc; arg_idx++) {
+    uargv[arg_idx] = strs;
+    strs += strlen(strs) + 1;
+  }
+  uargv[args->argc] = NULL;
+
+  struct intr_stack* intr_0_stack =
+      (struct intr_stack*)((uint32_t)cur + PG_SIZE - sizeof(struct intr_stack));
+  memset(intr_0_stack, 0, sizeof(struct intr_stack));
+  intr_0_stack->fs = intr_0_stack->ds = intr_0_stack->es = SELECTOR_U_DATA;
+  intr_0_stack->ebx = (int32_t)uargv;
+  intr_0_stack->ecx = args->argc;
+  intr_0_stack->eip = (void*)entry_point;
+  intr_0_stack->cs = SELECTOR_U_CODE;
+  intr_0_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
+  intr_0_stack->esp = uargv;
+  intr_0_stack->ss = SELECTOR_U_DATA;
+  mfree_page(PF_KERNEL, args, 1);
+
+  kernel_lock_release();
+  asm volatile("movl %0, %%esp; jmp intr_exit"
+               :
+               : "g"(intr_0_stack)
+               : "memory");
+}
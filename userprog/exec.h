@@ -1,6 +1,20 @@
 #ifndef USERPROG_EXEC
 #define USERPROG_EXEC
+#include "fs.h"
 #include "global.h"
 #include "stdint.h"
+
+#define SPAWN_MAX_ARGS 32  // spawn 的参数个数上限
+
+/* sys_spawn 交给子进程的程序路径和参数,占一页内核内存,由子进程释放 */
+struct spawn_args {
+  char path[MAX_PATH_LEN];
+  uint32_t argc;
+  uint32_t str_len;  // strs 中已用的字节数
+  char strs[];       // argv 的各字符串首尾相接存放
+};
+
 int32_t sys_execv(const char *path, const char *argv[]);
+struct spawn_args *spawn_args_build(const char *path, const char *argv[]);
+void start_spawned_process(void *args_);
 #endif /* USERPROG_EXEC */
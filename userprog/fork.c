@@ -2,33 +2,57 @@
 
 #include "bitmap.h"
 #include "debug.h"
+#include "exec.h"
 #include "file.h"
+#include "fpu.h"
+#include "fs.h"
 #include "inode.h"
 #include "interrupt.h"
 #include "memory.h"
 #include "pipe.h"
 #include "process.h"
+#include "sched.h"
 #include "string.h"
 
-extern void intr_exit(void);
+extern void fork_ret(void);
 
-/*将父进程的pcb拷贝给子进程*/
-
-static int32_t copy_pcb_vaddrbitmap_stack0(struct task_struct* child_thread,
-                                           struct task_struct* parent_thread) {
-  /* a 复制 pcb 所在的整个页,里面包含进程 pcb 信息及特级 0 极的栈,
-  里面包含了返回地址 */
+/* 复制 pcb 所在的整个页,里面包含进程 pcb 信息及特级 0 极的栈,
+ * 里面包含了返回地址,再单独修改不能沿用的字段 */
+static void copy_pcb(struct task_struct* child_thread,
+                     struct task_struct* parent_thread) {
   memcpy(child_thread, parent_thread, PG_SIZE);
 
-  /*单独进行修改*/
   child_thread->pid = fork_pid();
   child_thread->elapsed_ticks = 0;
   child_thread->status = TASK_READY;
   child_thread->ticks = child_thread->priority;
   child_thread->parent_pid = parent_thread->pid;
-  child_thread->general_tag.prev = child_thread->general_tag.next = NULL;
-  child_thread->all_list_tag.prev = child_thread->all_list_tag.next = NULL;
+  child_thread->on_cpu = false;
+  child_thread->kernel_lock_depth = 0;  // 子任务从 fork_ret 直接返回用户态,不持有大内核锁
+  sched_fork(child_thread);
+  list_elem_init(&child_thread->general_tag);
+  list_elem_init(&child_thread->all_list_tag);
+  wait_queue_init(&child_thread->child_exit_wq);
+  /* 子任务不持有任何锁,也就没有被提升的优先级 */
+  child_thread->sched_class = parent_thread->normal_class;
+  child_thread->rt_priority = parent_thread->normal_rt_priority;
+  list_init(&child_thread->held_locks);
+  child_thread->blocked_on = NULL;
+  list_elem_init(&child_thread->pi_tag);
+}
+
+/*将父进程的pcb拷贝给子进程*/
+static int32_t copy_pcb_vaddrbitmap_stack0(struct task_struct* child_thread,
+                                           struct task_struct* parent_thread) {
+  copy_pcb(child_thread, parent_thread);
+  /* 由线程 fork 时,文件描述符表要取自主线程 */
+  child_thread->group_leader = child_thread;
+  memcpy(child_thread->fd_table, parent_thread->group_leader->fd_table,
+         sizeof(child_thread->fd_table));
   block_desc_init(child_thread->u_block_desc);  // 重置内存块描述符
+  if (fpu_fork(child_thread, parent_thread) == -1) {
+    return -1;
+  }
   /* b 复制父进程的虚拟地址池的位图 */
   uint32_t bitmap_pg_cnt =
       DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8, PG_SIZE);
@@ -103,7 +127,8 @@ static int32_t build_child_stack(struct task_struct* child_thread) {
   uint32_t* ebx_ptr_in_thread_stack = (uint32_t*)intr_0_stack - 4;
   uint32_t* ebp_ptr_in_thread_stack = (uint32_t*)intr_0_stack - 5;
 
-  *ret_addr_in_thread_stack = (uint32_t)intr_exit;  // 返回地址更新为intr_exit
+  // 返回地址更新为fork_ret,完成调度收尾后经intr_exit返回
+  *ret_addr_in_thread_stack = (uint32_t)fork_ret;
   *ebp_ptr_in_thread_stack = *ebx_ptr_in_thread_stack = 0;
   *edi_ptr_in_thread_stack = *esi_ptr_in_thread_stack = 0;
 
@@ -121,7 +146,7 @@ static void update_inode_open_cnts(struct task_struct* thread) {
       if (is_pipe(local_fd)) {
         file_table[global_fd].fd_pos++;
       } else {
-        file_table[global_fd].fd_inode->i_open_cnts++;
+        inode_dup(file_table[global_fd].fd_inode);
       }
     }
     local_fd++;
@@ -175,10 +200,102 @@ pid_t sys_fork(void) {
     return -1;
   }
 
-  ASSERT(!elem_find(&thread_ready_list, &child_thread->general_tag));
-  list_append(&thread_ready_list, &child_thread->general_tag);
-  ASSERT(!elem_find(&thread_all_list, &child_thread->all_list_tag));
-  list_append(&thread_all_list, &child_thread->all_list_tag);
+  thread_admit(child_thread);
 
   return child_thread->pid;
-}
\ No newline at end of file
+}
+
+/* 创建与当前进程共用页表、虚拟地址池和文件描述符表的线程,
+ * 新线程在用户栈 stack 上从 entry(arg) 开始执行,entry 不能返回.
+ * 成功返回线程的 pid,失败返回 -1 */
+pid_t sys_clone(void (*entry)(void*), void* arg, void* stack) {
+  struct task_struct* cur = running_thread();
+  uint32_t* ustack = stack;
+  if (cur->pgdir == NULL || (uint32_t)ustack < USER_VADDR_START + 8 ||
+      (uint32_t)ustack > 0xc0000000) {
+    return -1;
+  }
+  struct task_struct* thread = get_kernel_pages(1);
+  if (thread == NULL) {
+    return -1;
+  }
+
+  /* 虚拟地址池的位图随 pcb 一起拷贝,两者指向同一份 */
+  copy_pcb(thread, cur);
+  thread->group_leader = cur->group_leader;
+  thread->parent_pid = cur->group_leader->pid;
+  thread->fpu_state = NULL;  // 新线程从初始的浮点状态开始
+  thread->fpu_last_cpu = NULL;
+
+  /* 在新线程的用户栈上按 cdecl 放好参数和一个空的返回地址 */
+  *--ustack = (uint32_t)arg;
+  *--ustack = 0;
+  struct intr_stack* intr_0_stack =
+      (struct intr_stack*)((uint32_t)thread + PG_SIZE -
+                           sizeof(struct intr_stack));
+  intr_0_stack->eip = (void (*)(void))entry;
+  intr_0_stack->esp = ustack;
+  build_child_stack(thread);
+
+  thread_admit(thread);
+  return thread->pid;
+}
+
+/* 创建子进程直接运行 path 处的程序,参数为 argv,继承当前的文件描述符.
+ * 不复制父进程的地址空间,程序由子进程自己加载,
+ * 所以耗时与父进程大小无关,用来代替 fork 后紧接着 execv.
+ * 成功返回子进程的 pid,失败返回 -1 */
+pid_t sys_spawn(const char* path, const char* argv[]) {
+  struct task_struct* cur = running_thread();
+  struct stat file_stat;
+  if (strlen(path) >= MAX_PATH_LEN || sys_stat(path, &file_stat) == -1 ||
+      file_stat.st_filetype != FT_REGULAR) {
+    return -1;
+  }
+  struct spawn_args* args = spawn_args_build(path, argv);
+  if (args == NULL) {
+    return -1;
+  }
+  struct task_struct* child = get_kernel_pages(1);
+  if (child == NULL) {
+    mfree_page(PF_KERNEL, args, 1);
+    return -1;
+  }
+
+  copy_pcb(child, cur);
+  child->group_leader = child;
+  memcpy(child->fd_table, cur->group_leader->fd_table,
+         sizeof(child->fd_table));
+  block_desc_init(child->u_block_desc);
+  child->fpu_state = NULL;  // 新程序从初始的浮点状态开始
+  child->fpu_last_cpu = NULL;
+  memcpy(child->name, path, sizeof(child->name));
+  child->name[sizeof(child->name) - 1] = 0;
+
+  /* 全新的页表和虚拟地址池,此时只有内核空间 */
+  create_user_vaddr_bitmap(child);
+  child->pgdir = create_page_dir();
+  struct bitmap* btmp = &child->userprog_vaddr.vaddr_bitmap;
+  if (btmp->bits == NULL || child->pgdir == NULL) {
+    /* 子进程还没入队,把已经拿到的 pid 和内存都还回去 */
+    if (btmp->bits != NULL) {
+      mfree_page(PF_KERNEL, btmp->bits,
+                 DIV_ROUND_UP(btmp->btmp_bytes_len, PG_SIZE));
+    }
+    if (child->pgdir != NULL) {
+      mfree_page(PF_KERNEL, child->pgdir, 1);
+    }
+    release_pid(child->pid);
+    mfree_page(PF_KERNEL, child, 1);
+    mfree_page(PF_KERNEL, args, 1);
+    return -1;
+  }
+
+  /* 子进程像内核线程一样从 start_spawned_process 开始执行 */
+  child->self_kstack = (uint32_t*)((uint32_t)child + PG_SIZE);
+  thread_create(child, start_spawned_process, args);
+
+  update_inode_open_cnts(child);
+  thread_admit(child);
+  return child->pid;
+}
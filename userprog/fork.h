@@ -2,4 +2,6 @@
 #define USERPROG_FORK
 #include "thread.h"
 pid_t sys_fork(void);
+pid_t sys_clone(void (*entry)(void*), void* arg, void* stack);
+pid_t sys_spawn(const char* path, const char* argv[]);
 #endif /* USERPROG_FORK */
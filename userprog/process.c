@@ -84,7 +84,7 @@ uint32_t* create_page_dir(void) {
   return page_dir_vaddr;
 }
 
-/* 创建用户进程虚拟地址位图 */
+/* 创建用户进程虚拟地址位图,分配失败时 bits 为 NULL */
 void create_user_vaddr_bitmap(struct task_struct* user_prog) {
   user_prog->userprog_vaddr.vaddr_start = USER_VADDR_START;
   // 位图要占用的页数量
@@ -93,7 +93,9 @@ void create_user_vaddr_bitmap(struct task_struct* user_prog) {
   user_prog->userprog_vaddr.vaddr_bitmap.bits = get_kernel_pages(bitmap_pg_cnt);
   user_prog->userprog_vaddr.vaddr_bitmap.btmp_bytes_len =
       (0xc0000000 - USER_VADDR_START) / PG_SIZE / 8;
-  bitmap_init(&user_prog->userprog_vaddr.vaddr_bitmap);
+  if (user_prog->userprog_vaddr.vaddr_bitmap.bits != NULL) {
+    bitmap_init(&user_prog->userprog_vaddr.vaddr_bitmap);
+  }
 }
 
 /*创建用户进程*/
@@ -107,11 +109,5 @@ void process_execute(void* filename, char* name) {
   thread->pgdir = create_page_dir();
 
   block_desc_init(thread->u_block_desc);  // 初始化用户进程内存块
-  // 关闭中断
-  enum intr_status old_status = intr_disable();
-  ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-  list_append(&thread_ready_list, &thread->general_tag);
-  ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
-  list_append(&thread_all_list, &thread->all_list_tag);
-  intr_set_status(old_status);
+  thread_admit(thread);
 }
\ No newline at end of file
@@ -4,16 +4,19 @@
 #include "exec.h"
 #include "fork.h"
 #include "fs.h"
+#include "futex.h"
 #include "memory.h"
 #include "pipe.h"
 #include "print.h"
+#include "sched.h"
 #include "stdint.h"
 #include "stdio_kernel.h"
 #include "string.h"
 #include "syscall.h"
 #include "thread.h"
+#include "timer.h"
 #include "wait_exit.h"
-#define syscall_nr 32
+#define syscall_nr 64
 typedef void* syscall;
 syscall syscall_table[syscall_nr];
 
@@ -71,5 +74,15 @@ void syscall_init(void) {
   syscall_table[SYS_PIPE] = sys_pipe;
   syscall_table[SYS_FD_REDIRECT] = sys_fd_redirect;
   syscall_table[SYS_HELP] = sys_help;
+  syscall_table[SYS_SLEEP] = sys_sleep;
+  syscall_table[SYS_SCHED_SETSCHEDULER] = sys_sched_setscheduler;
+  syscall_table[SYS_CLONE] = sys_clone;
+  syscall_table[SYS_THREAD_JOIN] = sys_thread_join;
+  syscall_table[SYS_FUTEX] = sys_futex;
+  syscall_table[SYS_SPAWN] = sys_spawn;
+  syscall_table[SYS_GETRUSAGE] = sys_getrusage;
+  syscall_table[SYS_TASK_STATS] = sys_task_stats;
+  syscall_table[SYS_RQ_HISTORY] = sys_rq_history;
+  syscall_table[SYS_UPTIME] = sys_uptime;
   put_str("syscall_init done\n");
 }
\ No newline at end of file
@@ -3,9 +3,15 @@
 #include "print.h"
 #include "global.h"
 #include "memory.h"
+#include "smp.h"
 #include "string.h"
 #include "stdint.h"
 
+#define GDT_BASE 0xc0000900  // gdt 的虚拟地址(物理地址 0x900)
+/* 前 7 项由 loader 和 tss_init 填写,AP 的 tss 描述符依次放在后面 */
+#define GDT_DESC_CNT (7 + NR_CPUS - 1)
+#define AP_TSS_DESC_IDX(cpu_id) (7 + (cpu_id) - 1)
+
 /* 任务状态段 tss 结构 */
 struct tss {
   uint32_t backlink;  // 指向上一个任务的tss的指针
@@ -36,11 +42,11 @@ struct tss {
   uint32_t trace;    // 追踪调试标志(不用)
   uint32_t io_base;  // io位图基址
 };
-static struct tss tss;
+static struct tss tss[NR_CPUS];  // 每个处理器一个 tss
 
-/*更新tss中esp0字段的值为pthread的0级栈*/
+/*更新当前处理器 tss 中esp0字段的值为pthread的0级栈*/
 void update_tss_esp(struct task_struct* pthread) {
-  tss.esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);
+  tss[this_cpu()->id].esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);
 }
 
 /*创建gdt描述符*/
@@ -59,18 +65,29 @@ static struct gdt_desc make_gdt_desc(uint32_t* desc_addr, uint32_t limit,
   return desc;
 }
 
+/*初始化 cpu_id 号处理器的 tss,并返回其描述符*/
+static struct gdt_desc tss_desc_init(uint8_t cpu_id) {
+  uint32_t tss_size = sizeof(struct tss);
+  memset(&tss[cpu_id], 0, tss_size);
+  tss[cpu_id].ss0 = SELECTOR_K_STACK;
+  tss[cpu_id].io_base = tss_size;  // io位图挨着tss后
+  return make_gdt_desc((uint32_t*)&tss[cpu_id], tss_size - 1, TSS_ATTR_LOW,
+                       TSS_ATTR_HIGH);
+}
+
+/*加载 gdtr,界限包含所有处理器的 tss 描述符*/
+static void gdt_load(void) {
+  uint64_t gdt_operand =
+      ((GDT_DESC_CNT * 8 - 1) | ((uint64_t)(uint32_t)GDT_BASE << 16));
+  asm volatile("lgdt %0" ::"m"(gdt_operand));
+}
+
 /* 在 gdt 中创建 tss 并重新加载 gdt */
 void tss_init() {
   put_str("tss_init start\n");
-  uint32_t tss_size = sizeof(tss);
-  memset(&tss, 0, tss_size);
-  tss.ss0 = SELECTOR_K_STACK;
-  tss.io_base = tss_size;  // io位图挨着tss后
-
   /* gdt 段基址为 0x900,把 tss 放到第 4 个位置,也就是 0x900+0x20 的位置 */
   /* 在 gdt 中添加 dpl 为 0 的 TSS 描述符 */
-  *((struct gdt_desc*)0xc0000920) =
-      make_gdt_desc((uint32_t*)&tss, tss_size - 1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
+  *((struct gdt_desc*)0xc0000920) = tss_desc_init(0);
 
   /* 在 gdt 中添加 dpl 为 3 的数据段和代码段描述符 */
   *((struct gdt_desc*)0xc0000928) = make_gdt_desc(
@@ -80,11 +97,17 @@ void tss_init() {
       (uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
 
   // 加载gdtr
-  uint64_t gdt_operand = ((7 * 8 - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16));
-
-  asm volatile("lgdt %0" ::"m"(gdt_operand));
+  gdt_load();
   asm volatile("ltr %w0" ::"r"(SELECTOR_TSS));
 
   put_str("tss_init and ltr done\n");
   return;
 }
+
+/* 为 AP 创建 tss,AP 启动时用的是临时 gdt,在这里换成内核的 gdt */
+void tss_init_ap(uint8_t cpu_id) {
+  uint8_t desc_idx = AP_TSS_DESC_IDX(cpu_id);
+  ((struct gdt_desc*)GDT_BASE)[desc_idx] = tss_desc_init(cpu_id);
+  gdt_load();
+  asm volatile("ltr %w0" ::"r"((uint16_t)((desc_idx << 3) + (TI_GDT << 2) + RPL0)));
+}
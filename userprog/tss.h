@@ -2,5 +2,6 @@
 #define USERPROG_TSS
 #include "thread.h"
 void tss_init();
+void tss_init_ap(uint8_t cpu_id);
 void update_tss_esp(struct task_struct* pthread);
 #endif /* USERPROG_TSS */
@@ -5,54 +5,77 @@
 #include "fs.h"
 #include "list.h"
 #include "pipe.h"
+#include "sched.h"
+#define FREE_BATCH 64  // 攒够这么多物理页再一起归还
+
+/* 攒一批要归还的物理页 */
+struct page_batch {
+  uint32_t cnt;
+  uint32_t pages[FREE_BATCH];
+};
+
+static void batch_add(struct page_batch* batch, uint32_t pg_phy_addr) {
+  batch->pages[batch->cnt++] = pg_phy_addr;
+  if (batch->cnt == FREE_BATCH) {
+    free_phy_pages(batch->pages, batch->cnt);
+    batch->cnt = 0;
+  }
+}
+
 /* 释放用户进程资源:
  * 1 页表中对应的物理页
  * 2 虚拟内存池占物理页框
  * 3 关闭打开的文件 */
 static void realease_prog_resource(struct task_struct* release_thread) {
   uint32_t* pgdir_vaddr = release_thread->pgdir;
+  struct bitmap* btmp = &release_thread->userprog_vaddr.vaddr_bitmap;
+  uint32_t vaddr_start = release_thread->userprog_vaddr.vaddr_start;
+  uint32_t* btmp_words = (uint32_t*)btmp->bits;
+  uint32_t btmp_words_len = btmp->btmp_bytes_len / 4;  // 末尾不足一个字的逐位查
+  uint32_t btmp_bits_len = btmp->btmp_bytes_len * 8;
+  struct page_batch batch;
+  batch.cnt = 0;
 
-  uint16_t user_pde_nr = 768, pde_idx = 0;
-  uint32_t pde = 0;
-  uint32_t* v_pde_ptr = NULL;
-
-  uint16_t user_pte_nr = 1024, pte_idx = 0;
-  uint32_t pte = 0;
-  uint32_t* v_pte_ptr = NULL;
-
-  uint32_t* first_pte_vaddr_in_pde = NULL;
-
-  uint32_t pg_phy_addr = 0;
-
-  /* 回收页表中用户空间的页框 */
-  while (pde_idx < user_pde_nr) {
-    v_pde_ptr = pgdir_vaddr + pde_idx;
-    pde = *v_pde_ptr;
-    if (pde & 0x00000001) {
-      first_pte_vaddr_in_pde = pte_ptr(pde_idx * 0x400000);
-      pte_idx = 0;
-      while (pte_idx < user_pte_nr) {
-        v_pte_ptr = first_pte_vaddr_in_pde + pte_idx;
-        pte = *v_pte_ptr;
-        if (pte & 0x00000001) {
-          // 在位图中清零
-          pg_phy_addr = pte & 0xfffff000;
-          free_a_phy_page(pg_phy_addr);
+  /* 回收用户空间的页框:只看有页表的 4MB 区域,
+   * 再由虚拟地址位图找出其中分配过的页,按 32 页一组跳过空闲的 */
+  uint32_t pde_idx = vaddr_start >> 22;
+  for (; pde_idx < 768; pde_idx++) {
+    uint32_t pde = pgdir_vaddr[pde_idx];
+    if (!(pde & PG_P_1)) {
+      continue;
+    }
+    uint32_t region = pde_idx << 22;
+    uint32_t vaddr = region < vaddr_start ? vaddr_start : region;
+    uint32_t region_end = region + 0x400000;
+    while (vaddr < region_end) {
+      uint32_t bit_idx = (vaddr - vaddr_start) / PG_SIZE;
+      if (bit_idx >= btmp_bits_len) {
+        break;
+      }
+      uint32_t word_idx = bit_idx / 32;
+      if (word_idx < btmp_words_len &&
+          (btmp_words[word_idx] >> (bit_idx % 32)) == 0) {
+        vaddr += (32 - bit_idx % 32) * PG_SIZE;  // 这一组剩下的页都没有分配
+        continue;
+      }
+      if (bitmap_scan_test(btmp, bit_idx)) {
+        uint32_t pte = *pte_ptr(vaddr);
+        if (pte & PG_P_1) {
+          batch_add(&batch, pte & 0xfffff000);
         }
-        pte_idx++;
       }
-
-      pg_phy_addr = pde & 0xfffff000;
-      free_a_phy_page(pg_phy_addr);
+      vaddr += PG_SIZE;
     }
-    pde_idx++;
+    /* 页表所在的页框 */
+    batch_add(&batch, pde & 0xfffff000);
+  }
+  if (batch.cnt > 0) {
+    free_phy_pages(batch.pages, batch.cnt);
   }
-  /* 回收用户虚拟地址池所占的物理内存*/
-  uint32_t bitmap_pg_cnt =
-      (release_thread->userprog_vaddr.vaddr_bitmap.btmp_bytes_len) / PG_SIZE;
-  uint8_t* user_vaddr_pool_bitmap =
-      release_thread->userprog_vaddr.vaddr_bitmap.bits;
-  mfree_page(PF_KERNEL, user_vaddr_pool_bitmap, bitmap_pg_cnt);
+
+  /* 回收用户虚拟地址池所占的物理内存,分配时按页向上取整 */
+  uint32_t bitmap_pg_cnt = DIV_ROUND_UP(btmp->btmp_bytes_len, PG_SIZE);
+  mfree_page(PF_KERNEL, btmp->bits, bitmap_pg_cnt);
 
   /* 关闭进程打开的文件 */
   uint8_t fd_idx = 3;
@@ -62,7 +85,7 @@ static void realease_prog_resource(struct task_struct* release_thread) {
         uint32_t global_fd = fd_local2global(fd_idx);
         if (--file_table[global_fd].fd_pos == 0) {
           mfree_page(PF_KERNEL, file_table[global_fd].fd_inode, 1);
-          file_table[global_fd].fd_inode = NULL;
+          file_slot_release(global_fd);
         }
       } else {
         sys_close(fd_idx);
@@ -73,11 +96,12 @@ static void realease_prog_resource(struct task_struct* release_thread) {
 }
 
 /* list_traversal 的回调函数,
- * 查找 pelem 的 parent_pid 是否是 ppid,成功返回 true,失败则返回 false */
+ * 查找 pelem 的 parent_pid 是否是 ppid,成功返回 true,失败则返回 false.
+ * 线程的 parent_pid 是主线程,但它不算子进程 */
 static bool find_child(struct list_elem* pelem, int32_t ppid) {
   struct task_struct* pthread =
       elem2entry(struct task_struct, all_list_tag, pelem);
-  if (pthread->parent_pid == ppid) {
+  if (pthread->parent_pid == ppid && pthread->group_leader == pthread) {
     return true;
   }
   return false;
@@ -88,7 +112,8 @@ static bool find_child(struct list_elem* pelem, int32_t ppid) {
 static bool find_hanging_child(struct list_elem* pelem, int32_t ppid) {
   struct task_struct* pthread =
       elem2entry(struct task_struct, all_list_tag, pelem);
-  if (pthread->parent_pid == ppid && pthread->status == TASK_HANGING) {
+  if (pthread->parent_pid == ppid && pthread->group_leader == pthread &&
+      pthread->status == TASK_HANGING) {
     return true;
   }
   return false;
@@ -99,17 +124,70 @@ static bool find_hanging_child(struct list_elem* pelem, int32_t ppid) {
 static bool init_adopt_a_child(struct list_elem* pelem, int32_t pid) {
   struct task_struct* pthread =
       elem2entry(struct task_struct, all_list_tag, pelem);
-  if (pthread->parent_pid == pid) {
+  if (pthread->parent_pid == pid && pthread->group_leader == pthread) {
     pthread->parent_pid = 1;
     return true;
   }
   return false;
 }
 
+/* find_group_thread 的查找条件 */
+struct group_match {
+  struct task_struct* leader;
+  bool hanging;  // 为 true 时只找已退出的线程
+};
+
+/* list_traversal 的回调函数,
+ * 查找主线程为 leader 的其他线程 */
+static bool find_group_thread(struct list_elem* pelem, int32_t arg) {
+  struct group_match* match = (struct group_match*)arg;
+  struct task_struct* pthread =
+      elem2entry(struct task_struct, all_list_tag, pelem);
+  return pthread != match->leader && pthread->group_leader == match->leader &&
+         (!match->hanging || pthread->status == TASK_HANGING);
+}
+
+/* 唤醒 wq 上的等待者后把自己挂起,调用前已持有 wq 的锁.
+ * 持队列锁置为挂起状态,等待者醒来检查时一定能看到 */
+static void exit_notify(struct wait_queue* wq) {
+  wake_up_locked(wq, WAKE_ALL);
+  thread_block_unlock(TASK_HANGING, &wq->lock);
+}
+
+/* 主线程退出前先等其余线程都结束,回收它们的 pcb,
+ * 之后才能释放共用的地址空间 */
+static void reap_group_threads(struct task_struct* leader) {
+  struct group_match match = {leader, true};
+  enum intr_status old_status = wait_queue_lock(&leader->child_exit_wq);
+  while (1) {
+    match.hanging = true;
+    struct list_elem* elem =
+        list_traversal(&thread_all_list, find_group_thread, (int32_t)&match);
+    if (elem != NULL) {
+      struct task_struct* pthread =
+          elem2entry(struct task_struct, all_list_tag, elem);
+      wait_queue_unlock(&leader->child_exit_wq, old_status);
+      sched_usage_add(&leader->group_usage, pthread);
+      thread_exit(pthread, false);
+      old_status = wait_queue_lock(&leader->child_exit_wq);
+      continue;
+    }
+    match.hanging = false;
+    if (list_traversal(&thread_all_list, find_group_thread,
+                       (int32_t)&match) == NULL) {
+      wait_queue_unlock(&leader->child_exit_wq, old_status);
+      return;
+    }
+    wait_queue_sleep(&leader->child_exit_wq, false, 0);
+  }
+}
+
 /* 等待子进程调用 exit,将子进程的退出状态保存到 status 指向的变量.
  * 成功则返回子进程的 pid,失败则返回−1 */
 pid_t sys_wait(int32_t* status) {
   struct task_struct* parent_thread = running_thread();
+  /* 子进程持同一把锁置为挂起状态后才唤醒,检查和睡眠之间不会漏掉 */
+  enum intr_status old_status = wait_queue_lock(&parent_thread->child_exit_wq);
   while (1) {
     /* 优先处理已经是挂起状态的任务 */
     struct list_elem* child_elem = list_traversal(
@@ -122,6 +200,13 @@ pid_t sys_wait(int32_t* status) {
 
       /* thread_exit 之后,pcb 会被回收,因此提前获取 pid */
       uint16_t child_pid = child_thread->pid;
+      wait_queue_unlock(&parent_thread->child_exit_wq, old_status);
+
+      /* 子进程的统计连同它回收的线程和子进程一起算到父进程名下 */
+      struct task_usage* usage = &parent_thread->group_leader->child_usage;
+      sched_usage_add(usage, child_thread);
+      sched_usage_merge(usage, &child_thread->group_usage);
+      sched_usage_merge(usage, &child_thread->child_usage);
 
       /*从就绪队列和全部队列中删除进程表项*/
       thread_exit(child_thread, false);
@@ -132,14 +217,49 @@ pid_t sys_wait(int32_t* status) {
     child_elem =
         list_traversal(&thread_all_list, find_child, parent_thread->pid);
     if (child_elem == NULL) {
+      wait_queue_unlock(&parent_thread->child_exit_wq, old_status);
       return -1;
     } else {
-      thread_block(TASK_WAITING);
+      wait_queue_sleep(&parent_thread->child_exit_wq, false, 0);
     }
   }
 }
 
-/*子进程用来结束自己时调用*/
+/* 等待同一进程中的线程 tid 退出,将其退出状态保存到 status 指向的变量.
+ * 成功返回 0,tid 不是本进程的其他线程则返回 -1 */
+int32_t sys_thread_join(pid_t tid, int32_t* status) {
+  struct task_struct* cur = running_thread();
+  struct wait_queue* wq = &cur->group_leader->child_exit_wq;
+  enum intr_status old_status = wait_queue_lock(wq);
+  while (1) {
+    /* 每次被唤醒都重新按 pid 查找,它可能已被别的线程 join 回收 */
+    rcu_read_lock();
+    struct task_struct* pthread = pid2thread(tid);
+    if (pthread == NULL || pthread == cur ||
+        pthread == pthread->group_leader ||
+        pthread->group_leader != cur->group_leader) {
+      rcu_read_unlock();
+      wait_queue_unlock(wq, old_status);
+      return -1;
+    }
+    if (pthread->status == TASK_HANGING) {
+      if (status != NULL) {
+        *status = pthread->exit_status;
+      }
+      /* 挂起的线程只由 join 它的线程回收,出了读侧临界区 pcb 也还在 */
+      rcu_read_unlock();
+      wait_queue_unlock(wq, old_status);
+      sched_usage_add(&cur->group_leader->group_usage, pthread);
+      thread_exit(pthread, false);
+      return 0;
+    }
+    rcu_read_unlock();
+    wait_queue_sleep(wq, false, 0);
+  }
+}
+
+/* 子进程用来结束自己时调用.
+ * 线程调用时只结束自己,主线程调用时等其余线程结束后再结束整个进程 */
 void sys_exit(int32_t status) {
   struct task_struct* child_thread = running_thread();
   child_thread->exit_status = status;
@@ -149,14 +269,22 @@ void sys_exit(int32_t status) {
   /* 将进程 child_thread 的所有子进程都过继给 init */
   list_traversal(&thread_all_list, init_adopt_a_child, child_thread->pid);
 
+  if (child_thread->group_leader != child_thread) {
+    /* 线程的 pcb 由 join 它的线程或退出时的主线程回收 */
+    wait_queue_lock(&child_thread->group_leader->child_exit_wq);
+    exit_notify(&child_thread->group_leader->child_exit_wq);
+    return;
+  }
+  reap_group_threads(child_thread);
+
   /* 回收进程 child_thread 的资源 */
   realease_prog_resource(child_thread);
-  /* 如果父进程正在等待子进程退出,将父进程唤醒 */
+  /* 唤醒等待子进程退出的父进程,将自己挂起,等父进程获取其status并回收其pcb */
+  rcu_read_lock();
   struct task_struct* parent_thread = pid2thread(child_thread->parent_pid);
-  if (parent_thread->status == TASK_WAITING) {
-    thread_unblock(parent_thread);
-  }
-
-  // 将自己挂起,等待父进程获取其status,并回收其pcb
-  thread_block(TASK_HANGING);
+  wait_queue_lock(&parent_thread->child_exit_wq);
+  /* 持队列锁时关着中断,本核直到挂起换下才经过静止状态,
+   * 在此之前父进程的 pcb 不会被释放 */
+  rcu_read_unlock();
+  exit_notify(&parent_thread->child_exit_wq);
 }
\ No newline at end of file
@@ -4,4 +4,5 @@
 #include "thread.h"
 void sys_exit(int32_t status);
 pid_t sys_wait(int32_t* status);
+int32_t sys_thread_join(pid_t tid, int32_t* status);
 #endif /* USERPROG_WAIT_EXIT */